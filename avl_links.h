@@ -0,0 +1,557 @@
+#ifndef AVL_LINKS_H
+#define AVL_LINKS_H
+
+#include "key_compare.h"
+
+/**
+* The AVL algorithms of trees whose nodes refer to each other by some
+* integer Link rather than by pointer: CompactAVLTree's vector indices
+* and MappedAVLTree's file offsets. Everything here goes through the
+* storage, Tree, which keeps each node's left, right and parent links
+* and balance factor (height of the right subtree minus the left: -1, 0
+* or +1) and provides
+*
+*   static const Link NIL;
+*   Link left(Link), right(Link), parent(Link);      and const
+*   void setLeft(Link, Link), setRight(Link, Link), setParent(Link, Link);
+*   int balance(Link);  void setBalance(Link, int);
+*   Link root();  void setRoot(Link);
+*   const Key& keyOf(Link);
+*   Compare comp_;
+*
+* Nodes are created and freed by the tree; attach() and unlink() only
+* link them in and out. Nothing holds a reference to a node across a
+* call into the tree, so storage that moves (a remapped file) is fine.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+class AVLLinks
+{
+public:
+    static Link descend(const Tree& tree, const Key& key, Link& parent, bool& isLeft);
+    static void attach(Tree& tree, Link node, Link parent, bool isLeft);
+    static void unlink(Tree& tree, Link node);
+
+    static Link findNode(const Tree& tree, const Key& key);
+    static Link lowerBound(const Tree& tree, const Key& key);
+    static Link upperBound(const Tree& tree, const Key& key);
+    static Link first(const Tree& tree);
+    static Link last(const Tree& tree);
+    static Link successor(const Tree& tree, Link node);
+    static Link predecessor(const Tree& tree, Link node);
+    static bool isBalanced(const Tree& tree);
+
+private:
+    static void replaceChild(Tree& tree, Link parent, Link oldChild, Link newChild);
+    static Link rotateLeft(Tree& tree, Link node);
+    static Link rotateRight(Tree& tree, Link node);
+    static Link rotateRightLeft(Tree& tree, Link node);
+    static Link rotateLeftRight(Tree& tree, Link node);
+    static void retraceInsert(Tree& tree, Link node);
+    static void retraceRemove(Tree& tree, Link node, bool leftShrank);
+    static int checkBalance(const Tree& tree, Link node, bool& balanced);
+};
+
+/*
+  ------------------------------------------
+  Begin implementations for the AVLLinks class.
+  ------------------------------------------
+*/
+
+/**
+* Looks key up with one three-way comparison per level. Returns the node
+* holding it, or NIL with parent and isLeft set to where it would go.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::descend(const Tree& tree, const Key& key,
+    Link& parent, bool& isLeft)
+{
+    Link current = tree.root();
+    parent = Tree::NIL;
+    isLeft = false;
+    while (current != Tree::NIL) {
+        int order = KeyOrder<Compare>::compare(tree.comp_, key, tree.keyOf(current));
+        if (order == 0) {
+            return current;
+        }
+        parent = current;
+        isLeft = order < 0;
+        current = isLeft ? tree.left(current) : tree.right(current);
+    }
+    return Tree::NIL;
+}
+
+/**
+* Links the new leaf node in where descend() said, and rebalances.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+void AVLLinks<Tree, Link, Key, Compare>::attach(Tree& tree, Link node, Link parent, bool isLeft)
+{
+    tree.setParent(node, parent);
+    if (parent == Tree::NIL) {
+        tree.setRoot(node);
+        return;
+    }
+    if (isLeft) {
+        tree.setLeft(parent, node);
+    }
+    else {
+        tree.setRight(parent, node);
+    }
+    retraceInsert(tree, node);
+}
+
+/**
+* Makes newChild take oldChild's place under parent, or at the root if
+* parent is NIL.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+void AVLLinks<Tree, Link, Key, Compare>::replaceChild(Tree& tree, Link parent, Link oldChild,
+    Link newChild)
+{
+    if (parent == Tree::NIL) {
+        tree.setRoot(newChild);
+    }
+    else if (tree.left(parent) == oldChild) {
+        tree.setLeft(parent, newChild);
+    }
+    else {
+        tree.setRight(parent, newChild);
+    }
+    if (newChild != Tree::NIL) {
+        tree.setParent(newChild, parent);
+    }
+}
+
+/**
+* Lifts node's right child into its place and returns it. Balance
+* factors are fixed for both uses: after an insertion the child leans
+* right; after a removal it may also be balanced, in which case the
+* subtree keeps its height and both nodes end up leaning.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::rotateLeft(Tree& tree, Link node)
+{
+    Link child = tree.right(node);
+    Link inner = tree.left(child);
+    tree.setRight(node, inner);
+    if (inner != Tree::NIL) {
+        tree.setParent(inner, node);
+    }
+    replaceChild(tree, tree.parent(node), node, child);
+    tree.setLeft(child, node);
+    tree.setParent(node, child);
+
+    if (tree.balance(child) == 0) {
+        tree.setBalance(node, 1);
+        tree.setBalance(child, -1);
+    }
+    else {
+        tree.setBalance(node, 0);
+        tree.setBalance(child, 0);
+    }
+    return child;
+}
+
+/**
+* Mirror image of rotateLeft.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::rotateRight(Tree& tree, Link node)
+{
+    Link child = tree.left(node);
+    Link inner = tree.right(child);
+    tree.setLeft(node, inner);
+    if (inner != Tree::NIL) {
+        tree.setParent(inner, node);
+    }
+    replaceChild(tree, tree.parent(node), node, child);
+    tree.setRight(child, node);
+    tree.setParent(node, child);
+
+    if (tree.balance(child) == 0) {
+        tree.setBalance(node, -1);
+        tree.setBalance(child, 1);
+    }
+    else {
+        tree.setBalance(node, 0);
+        tree.setBalance(child, 0);
+    }
+    return child;
+}
+
+/**
+* Double rotation for a node whose right child leans left: the right
+* child's left child becomes the subtree root, and returns it.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::rotateRightLeft(Tree& tree, Link node)
+{
+    Link child = tree.right(node);
+    Link pivot = tree.left(child);
+    Link pivotLeft = tree.left(pivot);
+    Link pivotRight = tree.right(pivot);
+
+    tree.setLeft(child, pivotRight);
+    if (pivotRight != Tree::NIL) {
+        tree.setParent(pivotRight, child);
+    }
+    tree.setRight(node, pivotLeft);
+    if (pivotLeft != Tree::NIL) {
+        tree.setParent(pivotLeft, node);
+    }
+    replaceChild(tree, tree.parent(node), node, pivot);
+    tree.setLeft(pivot, node);
+    tree.setRight(pivot, child);
+    tree.setParent(node, pivot);
+    tree.setParent(child, pivot);
+
+    int pivotBalance = tree.balance(pivot);
+    tree.setBalance(node, (pivotBalance > 0) ? -1 : 0);
+    tree.setBalance(child, (pivotBalance < 0) ? 1 : 0);
+    tree.setBalance(pivot, 0);
+    return pivot;
+}
+
+/**
+* Mirror image of rotateRightLeft.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::rotateLeftRight(Tree& tree, Link node)
+{
+    Link child = tree.left(node);
+    Link pivot = tree.right(child);
+    Link pivotLeft = tree.left(pivot);
+    Link pivotRight = tree.right(pivot);
+
+    tree.setRight(child, pivotLeft);
+    if (pivotLeft != Tree::NIL) {
+        tree.setParent(pivotLeft, child);
+    }
+    tree.setLeft(node, pivotRight);
+    if (pivotRight != Tree::NIL) {
+        tree.setParent(pivotRight, node);
+    }
+    replaceChild(tree, tree.parent(node), node, pivot);
+    tree.setLeft(pivot, child);
+    tree.setRight(pivot, node);
+    tree.setParent(node, pivot);
+    tree.setParent(child, pivot);
+
+    int pivotBalance = tree.balance(pivot);
+    tree.setBalance(node, (pivotBalance < 0) ? 1 : 0);
+    tree.setBalance(child, (pivotBalance > 0) ? -1 : 0);
+    tree.setBalance(pivot, 0);
+    return pivot;
+}
+
+/**
+* Walks up from a new leaf while subtrees grow. A node that was leaning
+* the other way absorbs the growth; one already leaning this way is
+* rotated, which restores the subtree's old height. Either ends it.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+void AVLLinks<Tree, Link, Key, Compare>::retraceInsert(Tree& tree, Link node)
+{
+    for (Link up = tree.parent(node); up != Tree::NIL; node = up, up = tree.parent(node)) {
+        int lean = tree.balance(up);
+        if (tree.right(up) == node) {
+            if (lean > 0) {
+                if (tree.balance(node) < 0) {
+                    rotateRightLeft(tree, up);
+                }
+                else {
+                    rotateLeft(tree, up);
+                }
+                return;
+            }
+            tree.setBalance(up, lean + 1);
+        }
+        else {
+            if (lean < 0) {
+                if (tree.balance(node) > 0) {
+                    rotateLeftRight(tree, up);
+                }
+                else {
+                    rotateRight(tree, up);
+                }
+                return;
+            }
+            tree.setBalance(up, lean - 1);
+        }
+        if (lean != 0) {
+            return;
+        }
+    }
+}
+
+/**
+* Walks up from node, one of whose subtrees has just lost a level, while
+* subtrees shrink. A balanced node absorbs the loss; a rotation may or
+* may not shrink the subtree, depending on the sibling's balance.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+void AVLLinks<Tree, Link, Key, Compare>::retraceRemove(Tree& tree, Link node, bool leftShrank)
+{
+    while (node != Tree::NIL) {
+        Link up = tree.parent(node);
+        bool nodeIsLeft = (up != Tree::NIL && tree.left(up) == node);
+        int lean = tree.balance(node);
+        if (leftShrank) {
+            if (lean > 0) {
+                int siblingLean = tree.balance(tree.right(node));
+                if (siblingLean < 0) {
+                    rotateRightLeft(tree, node);
+                }
+                else {
+                    rotateLeft(tree, node);
+                }
+                if (siblingLean == 0) {
+                    return;
+                }
+            }
+            else {
+                tree.setBalance(node, lean + 1);
+                if (lean == 0) {
+                    return;
+                }
+            }
+        }
+        else {
+            if (lean < 0) {
+                int siblingLean = tree.balance(tree.left(node));
+                if (siblingLean > 0) {
+                    rotateLeftRight(tree, node);
+                }
+                else {
+                    rotateRight(tree, node);
+                }
+                if (siblingLean == 0) {
+                    return;
+                }
+            }
+            else {
+                tree.setBalance(node, lean - 1);
+                if (lean == 0) {
+                    return;
+                }
+            }
+        }
+        node = up;
+        leftShrank = nodeIsLeft;
+    }
+}
+
+/**
+* Takes node out of the tree and rebalances; the tree then frees it. A
+* node with two children is replaced in the tree by its successor, so
+* no item is ever copied and no other node changes its Link.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+void AVLLinks<Tree, Link, Key, Compare>::unlink(Tree& tree, Link node)
+{
+    Link up = tree.parent(node);
+    Link left = tree.left(node);
+    Link right = tree.right(node);
+
+    if (left == Tree::NIL || right == Tree::NIL) {
+        bool wasLeft = (up != Tree::NIL && tree.left(up) == node);
+        replaceChild(tree, up, node, (left != Tree::NIL) ? left : right);
+        retraceRemove(tree, up, wasLeft);
+        return;
+    }
+    Link next = right;
+    while (tree.left(next) != Tree::NIL) {
+        next = tree.left(next);
+    }
+    Link retraceFrom;
+    bool leftShrank;
+    if (next == right) {
+        retraceFrom = next;
+        leftShrank = false;
+    }
+    else {
+        // Detach next from the bottom of the right subtree first
+        Link nextParent = tree.parent(next);
+        Link nextRight = tree.right(next);
+        tree.setLeft(nextParent, nextRight);
+        if (nextRight != Tree::NIL) {
+            tree.setParent(nextRight, nextParent);
+        }
+        tree.setRight(next, right);
+        tree.setParent(right, next);
+        retraceFrom = nextParent;
+        leftShrank = true;
+    }
+    tree.setLeft(next, left);
+    tree.setParent(left, next);
+    replaceChild(tree, up, node, next);
+    tree.setBalance(next, tree.balance(node));
+    retraceRemove(tree, retraceFrom, leftShrank);
+}
+
+/**
+* One comparator call per level, as in BinarySearchTree::internalFind:
+* a three-way comparator stops at a match, scalar keys test == on the
+* way down, and anything else takes the lower bound and checks it once.
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::findNode(const Tree& tree, const Key& key)
+{
+    Link current = tree.root();
+    if (IsThreeWayCompare<Compare, Key, Key>::value) {
+        while (current != Tree::NIL) {
+            int order = KeyOrder<Compare>::compare(tree.comp_, key, tree.keyOf(current));
+            if (order == 0) {
+                return current;
+            }
+            current = (order < 0) ? tree.left(current) : tree.right(current);
+        }
+        return Tree::NIL;
+    }
+    if (HasNativeEquality<Compare, Key, Key>::value) {
+        while (current != Tree::NIL) {
+            const Key& here = tree.keyOf(current);
+            if (KeyOrder<Compare>::equivalent(tree.comp_, key, here)) {
+                return current;
+            }
+            current = KeyOrder<Compare>::less(tree.comp_, key, here) ? tree.left(current)
+                                                                      : tree.right(current);
+        }
+        return Tree::NIL;
+    }
+    Link bound = lowerBound(tree, key);
+    if (bound != Tree::NIL && !KeyOrder<Compare>::less(tree.comp_, key, tree.keyOf(bound))) {
+        return bound;
+    }
+    return Tree::NIL;
+}
+
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::lowerBound(const Tree& tree, const Key& key)
+{
+    Link current = tree.root();
+    Link bound = Tree::NIL;
+    while (current != Tree::NIL) {
+        if (KeyOrder<Compare>::less(tree.comp_, tree.keyOf(current), key)) {
+            current = tree.right(current);
+        }
+        else {
+            bound = current;
+            current = tree.left(current);
+        }
+    }
+    return bound;
+}
+
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::upperBound(const Tree& tree, const Key& key)
+{
+    Link current = tree.root();
+    Link bound = Tree::NIL;
+    while (current != Tree::NIL) {
+        if (KeyOrder<Compare>::less(tree.comp_, key, tree.keyOf(current))) {
+            bound = current;
+            current = tree.left(current);
+        }
+        else {
+            current = tree.right(current);
+        }
+    }
+    return bound;
+}
+
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::first(const Tree& tree)
+{
+    Link current = tree.root();
+    if (current == Tree::NIL) {
+        return Tree::NIL;
+    }
+    while (tree.left(current) != Tree::NIL) {
+        current = tree.left(current);
+    }
+    return current;
+}
+
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::last(const Tree& tree)
+{
+    Link current = tree.root();
+    if (current == Tree::NIL) {
+        return Tree::NIL;
+    }
+    while (tree.right(current) != Tree::NIL) {
+        current = tree.right(current);
+    }
+    return current;
+}
+
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::successor(const Tree& tree, Link node)
+{
+    if (tree.right(node) != Tree::NIL) {
+        node = tree.right(node);
+        while (tree.left(node) != Tree::NIL) {
+            node = tree.left(node);
+        }
+        return node;
+    }
+    Link up = tree.parent(node);
+    while (up != Tree::NIL && tree.right(up) == node) {
+        node = up;
+        up = tree.parent(node);
+    }
+    return up;
+}
+
+template <typename Tree, typename Link, typename Key, typename Compare>
+Link AVLLinks<Tree, Link, Key, Compare>::predecessor(const Tree& tree, Link node)
+{
+    if (tree.left(node) != Tree::NIL) {
+        node = tree.left(node);
+        while (tree.right(node) != Tree::NIL) {
+            node = tree.right(node);
+        }
+        return node;
+    }
+    Link up = tree.parent(node);
+    while (up != Tree::NIL && tree.left(up) == node) {
+        node = up;
+        up = tree.parent(node);
+    }
+    return up;
+}
+
+/**
+* Checks the AVL property from the subtree heights, recomputed from
+* scratch (the stored balance factors are not trusted). O(n).
+*/
+template <typename Tree, typename Link, typename Key, typename Compare>
+bool AVLLinks<Tree, Link, Key, Compare>::isBalanced(const Tree& tree)
+{
+    bool balanced = true;
+    checkBalance(tree, tree.root(), balanced);
+    return balanced;
+}
+
+template <typename Tree, typename Link, typename Key, typename Compare>
+int AVLLinks<Tree, Link, Key, Compare>::checkBalance(const Tree& tree, Link node, bool& balanced)
+{
+    if (node == Tree::NIL || !balanced) {
+        return 0;
+    }
+    int left = checkBalance(tree, tree.left(node), balanced);
+    int right = checkBalance(tree, tree.right(node), balanced);
+    if (left - right > 1 || right - left > 1) {
+        balanced = false;
+    }
+    return 1 + ((left > right) ? left : right);
+}
+
+/*
+  ----------------------------------------
+  End implementations for the AVLLinks class.
+  ----------------------------------------
+*/
+
+#endif
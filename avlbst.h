@@ -6,12 +6,24 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <stdexcept>
+#include <vector>
 #include "bst.h"
+#include "fork_join.h"
 
 using namespace std;
 
 struct KeyError { };
 
+// Define as 1 before including to have each AVLNode also count the
+// nodes in its subtree, which gives AVLTree O(log n) rank/select/
+// count_range. Off by default: the counts change all the way up, so
+// every retrace after an update would walk on to the root to fix them
+// instead of stopping as soon as heights settle. size() is O(1) either way.
+#ifndef AVL_SUBTREE_SIZES
+#define AVL_SUBTREE_SIZES 0
+#endif
+
 /**
 * A special kind of node for an AVL tree, which adds the balance as a data member, plus
 * other additional helper functions. You do NOT need to implement any functionality or
@@ -23,22 +35,33 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(Key&& key, Value&& value, AVLNode<Key, Value>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
+#if AVL_SUBTREE_SIZES
+    // Getter/setter for the number of nodes in this node's subtree.
+    uint32_t getSize() const;
+    void setSize(uint32_t size);
+#endif
+
     // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    // return pointers to AVLNodes - not plain Nodes. They hide (rather than
+    // override) the Node getters, so the choice is made at compile time from
+    // the static type. See the Node class in bst.h for more information.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
+#if AVL_SUBTREE_SIZES
+    uint32_t size_;     // fits beside balance_ in what would be padding
+#endif
 };
 
 /*
@@ -53,6 +76,22 @@ protected:
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
     Node<Key, Value>(key, value, parent), balance_(0)
+#if AVL_SUBTREE_SIZES
+    , size_(1)
+#endif
+{
+
+}
+
+/**
+* A constructor that moves the key and value into the base class.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(Key&& key, Value&& value, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), balance_(0)
+#if AVL_SUBTREE_SIZES
+    , size_(1)
+#endif
 {
 
 }
@@ -93,8 +132,28 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
     balance_ += diff;
 }
 
+#if AVL_SUBTREE_SIZES
+/**
+* A getter for the size of the subtree rooted at this AVLNode.
+*/
+template<class Key, class Value>
+uint32_t AVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
+* A setter for the size of the subtree rooted at this AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setSize(uint32_t size)
+{
+    size_ = size;
+}
+#endif
+
+/**
+* A redefined function for getting the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
 */
 template<class Key, class Value>
@@ -104,7 +163,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Redefined for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
@@ -113,7 +172,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Redefined for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
@@ -129,12 +188,54 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
+    AVLTree();
+    explicit AVLTree(std::size_t slabNodes, const Compare& comp = Compare());
+    template<typename InputIt, typename = typename std::enable_if<
+        !std::is_integral<InputIt>::value>::type>
+    AVLTree(InputIt first, InputIt last, const Compare& comp = Compare());
+    virtual ~AVLTree();
+    using BinarySearchTree<Key, Value, Compare>::insert;
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+
+    // Apply a whole batch of updates at once; each returns how many keys
+    // were newly inserted / actually erased.
+    template<typename InputIt>
+    std::size_t insert_batch(InputIt first, InputIt last);
+    template<typename InputIt>
+    std::size_t erase_batch(InputIt first, InputIt last);
+
+#if AVL_SUBTREE_SIZES
+    // Order statistics, O(log n). rank is the number of keys less than key,
+    // select(i) the i-th smallest (0-based) or end(), and count_range the
+    // number of keys in [lo, hi).
+    std::size_t rank(const Key& key) const;
+    typename BinarySearchTree<Key, Value, Compare>::iterator select(std::size_t i) const;
+    std::size_t count_range(const Key& lo, const Key& hi) const;
+#endif
+
+    // Concatenation and splitting by key, neither copying a node: join
+    // takes right's nodes and storage over, and split hands the upper
+    // part to right, which shares this tree's storage from then on.
+    void join(const std::pair<const Key, Value>& item, AVLTree& right);
+    void join(AVLTree& right);
+    void split(const Key& key, AVLTree& right);
+
+    // Set operations with a tree ordered the same way, in
+    // O(m log(n/m + 1)) for sizes m <= n. union_with first copies all of
+    // other into this tree's storage, adding O(other.size()): trees do
+    // not share nodes. On union, keys in both trees take other's value.
+    void union_with(const AVLTree& other);
+    void intersect_with(const AVLTree& other);
+    void difference(const AVLTree& other);
+
+    // O(1), from the root's stored height. shape() still checks every node.
+    bool isBalanced() const override;
+    int height() const override;
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
@@ -142,6 +243,15 @@ protected:
 
     Node<Key, Value>* createNode(const Key& key, const Value& value, 
         Node<Key, Value>* parent) override;
+    Node<Key, Value>* createNode(Key&& key, Value&& value,
+        Node<Key, Value>* parent) override;
+    Node<Key, Value>* linkNode(Node<Key, Value>* parent, bool isLeft,
+        typename BinarySearchTree<Key, Value, Compare>::ItemFactory& item) override;
+    void destroyNode(Node<Key, Value>* node) override;
+    Node<Key, Value>* createNodeAt(void* block, Key&& key, Value&& value,
+        Node<Key, Value>* parent) override;
+    void destructNode(Node<Key, Value>* node) override;
+    void refreshNode(Node<Key, Value>* node) override;
 
     // Same as Base Class insert, just with AVLNode
     void insertBase (const std::pair<const Key, Value> &new_item);
@@ -152,112 +262,354 @@ protected:
     void doubleWithLeftChild(AVLNode<Key, Value>* grandparent);
     void doubleWithRightChild(AVLNode<Key, Value>* grandparent);
 
+    static int8_t height(const AVLNode<Key, Value>* node);
+    static void updateNode(AVLNode<Key, Value>* node);
+#if AVL_SUBTREE_SIZES
+    static uint32_t subtreeSize(const AVLNode<Key, Value>* node);
+#endif
+    AVLNode<Key, Value>* rebalance(AVLNode<Key, Value>* node);
+    void retrace(AVLNode<Key, Value>* node);
+
 
     void removeNoChild(AVLNode<Key, Value>* nodeToRemove);
     void removeOneChild(AVLNode<Key, Value>* nodeToRemove);
+    void removeNode(AVLNode<Key, Value>* nodeToRemove);
+
+    void checkCapacity() const;
+
+    // Join-based primitives on detached subtrees: roots whose parent is
+    // null but which are not root_.
+    static AVLNode<Key, Value>* detach(AVLNode<Key, Value>* node);
+    AVLNode<Key, Value>* joinNodes(AVLNode<Key, Value>* left, AVLNode<Key, Value>* pivot,
+        AVLNode<Key, Value>* right);
+    AVLNode<Key, Value>* joinNodes(AVLNode<Key, Value>* left, AVLNode<Key, Value>* right);
+    AVLNode<Key, Value>* splitLast(AVLNode<Key, Value>* tree, AVLNode<Key, Value>*& last);
+    void splitNodes(AVLNode<Key, Value>* tree, const Key& key, AVLNode<Key, Value>*& less,
+        AVLNode<Key, Value>*& match, AVLNode<Key, Value>*& greater);
+    static void collectSubtree(AVLNode<Key, Value>* tree, std::vector<Node<Key, Value>*>& nodes);
+    static std::size_t countUpper(AVLNode<Key, Value>* less, AVLNode<Key, Value>* greater,
+        std::size_t total);
+
+    // The recursions of insert_batch and erase_batch over a sorted batch.
+    void insertBatchNodes(AVLNode<Key, Value>*& tree, std::pair<Key, Value>* batch,
+        std::size_t count, std::size_t& inserted);
+    AVLNode<Key, Value>* eraseBatchNodes(AVLNode<Key, Value>* tree, const Key* keys,
+        std::size_t count, std::size_t& erased);
+
+    AVLNode<Key, Value>* unionNodes(AVLNode<Key, Value>* a, AVLNode<Key, Value>* b,
+        std::vector<Node<Key, Value>*>& garbage, int forks);
+    AVLNode<Key, Value>* intersectNodes(AVLNode<Key, Value>* a, const AVLNode<Key, Value>* b,
+        std::vector<Node<Key, Value>*>& garbage, int forks);
+    AVLNode<Key, Value>* differenceNodes(AVLNode<Key, Value>* a, const AVLNode<Key, Value>* b,
+        std::vector<Node<Key, Value>*>& garbage, int forks);
+    static bool worthForking(const AVLNode<Key, Value>* a, int forks);
+    void destroyAll(std::vector<Node<Key, Value>*>& nodes);
 
 
 
 };
 
+/**
+* Default constructor; the base pool is sized for AVLNodes.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), NodePool::DEFAULT_SLAB_NODES,
+        Compare())
+{
+
+}
+
+/**
+* Constructor that picks the node allocation policy (see BinarySearchTree).
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(std::size_t slabNodes, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), slabNodes, comp)
+{
+
+}
+
+/**
+* Range constructor; see BinarySearchTree::bulk_load. The load runs here
+* rather than in the base constructor so that it creates AVLNodes.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIt, typename>
+AVLTree<Key, Value, Compare>::AVLTree(InputIt first, InputIt last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), NodePool::DEFAULT_SLAB_NODES, comp)
+{
+    this->bulk_load(first, last);
+}
+
+/**
+* Clears here so that nodes are torn down through the AVL destroyNode.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::~AVLTree()
+{
+    this->clear();
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &new_item)
 {
-    //Uses derived createNode function
-    BinarySearchTree<Key, Value>::insert(new_item);
+    BinarySearchTree<Key, Value, Compare>::insert(new_item);
+}
 
+/**
+* Every insertion (a descent through the base insertUnique, a hinted
+* insert or an append) links its node here, which uses the derived
+* createNode, then retraces only as far up as heights actually change.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::linkNode(Node<Key, Value>* parent, bool isLeft,
+    typename BinarySearchTree<Key, Value, Compare>::ItemFactory& item)
+{
+    Node<Key, Value>* newNode = BinarySearchTree<Key, Value, Compare>::linkNode(parent, isLeft, item);
+    retrace(static_cast<AVLNode<Key, Value>*>(newNode)->getParent());
+    return newNode;
+}
 
-    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(
-        this->internalFind(new_item.first));
+/**
+* Height of a possibly-null subtree; an empty subtree has height -1.
+*/
+template<class Key, class Value, class Compare>
+int8_t AVLTree<Key, Value, Compare>::height(const AVLNode<Key, Value>* node)
+{
+    return (node == nullptr) ? -1 : node->getBalance();
+}
 
-    //Balance + Rotations
-    while (node != nullptr) {
-        if (node->getLeft()->getBalance() - node->getRight()->getBalance() > 1) {
-            if (node->getLeft()->getLeft()->getBalance() >= node->getLeft()->getRight()->getBalance()) {
-                rotateWithLeftChild(node);
-            }
-            else {
-                doubleWithLeftChild(node);
-                
-            }
+/**
+* Recomputes a node's height (and subtree size) from its children's.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::updateNode(AVLNode<Key, Value>* node)
+{
+    node->setBalance(std::max(height(node->getLeft()), height(node->getRight())) + 1);
+#if AVL_SUBTREE_SIZES
+    node->setSize(subtreeSize(node->getLeft()) + subtreeSize(node->getRight()) + 1);
+#endif
+}
+
+#if AVL_SUBTREE_SIZES
+/**
+* Size of a possibly-null subtree.
+*/
+template<class Key, class Value, class Compare>
+uint32_t AVLTree<Key, Value, Compare>::subtreeSize(const AVLNode<Key, Value>* node)
+{
+    return (node == nullptr) ? 0 : node->getSize();
+}
+#endif
+
+/**
+* Rotates node if its children's heights differ by more than one,
+* otherwise just refreshes its height. Returns the root of the subtree
+* that node used to root.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::rebalance(AVLNode<Key, Value>* node)
+{
+    AVLNode<Key, Value>* left = node->getLeft();
+    AVLNode<Key, Value>* right = node->getRight();
+
+    if (height(left) - height(right) > 1) {
+        if (height(left->getLeft()) >= height(left->getRight())) {
+            rotateWithLeftChild(node);
+            this->counters_.rotated(false);
         }
-        else if (node->getRight()->getBalance() - node->getLeft()->getBalance() > 1) {
-            if (node->getRight()->getRight()->getBalance() >= node->getRight()->getLeft()->getBalance()) {
-                rotateWithRightChild(node);
-            }
-            else {
-                doubleWithRightChild(node);
-            }
+        else {
+            doubleWithLeftChild(node);
+            this->counters_.rotated(true);
+        }
+        return node->getParent();
+    }
+    if (height(right) - height(left) > 1) {
+        if (height(right->getRight()) >= height(right->getLeft())) {
+            rotateWithRightChild(node);
+            this->counters_.rotated(false);
+        }
+        else {
+            doubleWithRightChild(node);
+            this->counters_.rotated(true);
         }
+        return node->getParent();
+    }
+    updateNode(node);
+    return node;
+}
 
-        node->setBalance(max(node->getLeft()->getBalance(), node->getRight()->getBalance()) + 1);
-        node = node->getParent();
+/**
+* Walks from node towards the root, fixing heights and rotating where
+* needed. Stops as soon as a subtree comes out the same height it had
+* before, since nothing above it can have changed. After an insertion
+* that is at most one rotation plus, amortized, O(1) height updates.
+* Subtree sizes, when kept, change all the way up, so those are then
+* refreshed along the rest of the path.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::retrace(AVLNode<Key, Value>* node)
+{
+    uint64_t steps = 0;
+    while (node != nullptr) {
+        ++steps;
+        int8_t oldHeight = node->getBalance();
+        AVLNode<Key, Value>* parent = node->getParent();
+        AVLNode<Key, Value>* subtree = rebalance(node);
+        if (subtree->getBalance() == oldHeight) {
+#if AVL_SUBTREE_SIZES
+            for (node = parent; node != nullptr; node = node->getParent()) {
+                node->setSize(subtreeSize(node->getLeft()) + subtreeSize(node->getRight()) + 1);
+            }
+#endif
+            break;
+        }
+        node = parent;
     }
+    this->counters_.retraced(steps);
+}
 
 
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    checkCapacity();
+    return this->template constructNode<AVLNode<Key, Value> >(key, value, 
+        static_cast<AVLNode<Key, Value>*>(parent)); // Creates AVLNode
 }
 
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::createNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    checkCapacity();
+    return this->template constructNode<AVLNode<Key, Value> >(std::move(key), std::move(value),
+        static_cast<AVLNode<Key, Value>*>(parent));
+}
 
+/**
+* Subtree sizes are 32-bit, so refuse to grow past what they can count.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::checkCapacity() const
+{
+#if AVL_SUBTREE_SIZES
+    if (this->size() >= UINT32_MAX) {
+        throw std::length_error("AVLTree is full");
+    }
+#endif
+}
 
-template<class Key, class Value>
-Node<Key, Value>* AVLTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+/**
+* Gives bulk-built nodes their height; children are already final.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::refreshNode(Node<Key, Value>* node)
 {
-    return new AVLNode<Key, Value>(key, value, 
-        static_cast<AVLNode<Key, Value>*>(parent)); // Creates AVLNode
+    updateNode(static_cast<AVLNode<Key, Value>*>(node));
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateWithLeftChild(AVLNode<Key, Value>* n_3) {
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<AVLNode<Key, Value>*>(node)->~AVLNode<Key, Value>();
+    this->pool_.deallocate(node);
+}
 
-    AVLNode<Key, Value>* n_2 = n_3->getLeft();
-    AVLNode<Key, Value>* n_1 = n_2->getLeft();
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::createNodeAt(void* block, Key&& key, Value&& value,
+    Node<Key, Value>* parent)
+{
+    return new (block) AVLNode<Key, Value>(std::move(key), std::move(value),
+        static_cast<AVLNode<Key, Value>*>(parent));
+}
 
-    nodeSwap(n_2, n_3);
-    n_2->setLeft(n_1);
-    n_2->setRight(n_3);
-    if (n_1 != nullptr) {n_1->setParent(n_2);}
-    n_3->setParent(n_2);
-    n_3->setLeft(nullptr);
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::destructNode(Node<Key, Value>* node)
+{
+    static_cast<AVLNode<Key, Value>*>(node)->~AVLNode<Key, Value>();
+}
+
+/**
+* Single rotation that lifts n_3's left child n_2 into n_3's place.
+* n_2's right subtree becomes n_3's left subtree.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateWithLeftChild(AVLNode<Key, Value>* n_3) {
 
-    n_3->setBalance(max(n_3->getLeft()->getBalance(),
-        n_3->getRight()->getBalance()) +1);
-    n_2->setBalance(max(n_2->getLeft()->getBalance(),
-        n_3->getBalance()) + 1);
+    AVLNode<Key, Value>* n_2 = n_3->getLeft();
+    AVLNode<Key, Value>* parent = n_3->getParent();
+    AVLNode<Key, Value>* inner = n_2->getRight();
 
+    n_3->setLeft(inner);
+    if (inner != nullptr) {inner->setParent(n_3);}
 
+    n_2->setParent(parent);
+    if (parent == nullptr) {
+        // A detached subtree (see joinNodes) has no parent either
+        if (this->root_ == n_3) {
+            this->root_ = n_2;
+        }
+    }
+    else if (parent->getLeft() == n_3) {
+        parent->setLeft(n_2);
+    }
+    else {
+        parent->setRight(n_2);
+    }
 
+    n_2->setRight(n_3);
+    n_3->setParent(n_2);
 
+    updateNode(n_3);
+    updateNode(n_2);
 }
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateWithRightChild(AVLNode<Key, Value>* n_3) {
+
+/**
+* Mirror image of rotateWithLeftChild.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateWithRightChild(AVLNode<Key, Value>* n_3) {
 
     AVLNode<Key, Value>* n_2 = n_3->getRight();
-    AVLNode<Key, Value>* n_1 = n_2->getRight();
+    AVLNode<Key, Value>* parent = n_3->getParent();
+    AVLNode<Key, Value>* inner = n_2->getLeft();
+
+    n_3->setRight(inner);
+    if (inner != nullptr) {inner->setParent(n_3);}
+
+    n_2->setParent(parent);
+    if (parent == nullptr) {
+        // A detached subtree (see joinNodes) has no parent either
+        if (this->root_ == n_3) {
+            this->root_ = n_2;
+        }
+    }
+    else if (parent->getLeft() == n_3) {
+        parent->setLeft(n_2);
+    }
+    else {
+        parent->setRight(n_2);
+    }
 
-    nodeSwap(n_2, n_3);
-    n_2->setRight(n_1);
     n_2->setLeft(n_3);
-    if (n_1 != nullptr) {n_1->setParent(n_2);}
     n_3->setParent(n_2);
-    n_3->setRight(nullptr);
 
-    n_3->setBalance(max(n_3->getLeft()->getBalance(),
-        n_3->getRight()->getBalance()) +1);
-    n_2->setBalance(max(n_2->getRight()->getBalance(),
-        n_3->getBalance()) + 1);
+    updateNode(n_3);
+    updateNode(n_2);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::doubleWithLeftChild(AVLNode<Key, Value>* n_3) {
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::doubleWithLeftChild(AVLNode<Key, Value>* n_3) {
     rotateWithRightChild(n_3->getLeft());
     rotateWithLeftChild(n_3);
 }
-template<class Key, class Value>
-void AVLTree<Key, Value>::doubleWithRightChild(AVLNode<Key, Value>* n_3) {
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::doubleWithRightChild(AVLNode<Key, Value>* n_3) {
     rotateWithLeftChild(n_3->getRight());
     rotateWithRightChild(n_3);
 }
@@ -267,8 +619,8 @@ void AVLTree<Key, Value>::doubleWithRightChild(AVLNode<Key, Value>* n_3) {
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>:: remove(const Key& key)
 {
     //reimplementing remove
     AVLNode<Key, Value>* nodeToRemove = static_cast<AVLNode<Key, Value>*>(
@@ -277,7 +629,12 @@ void AVLTree<Key, Value>:: remove(const Key& key)
     if (nodeToRemove == nullptr) {
         return;
     }
+    removeNode(nodeToRemove);
+}
 
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeNode(AVLNode<Key, Value>* nodeToRemove)
+{
 
     // Case 1: Node has no children
     if (nodeToRemove->getLeft() == nullptr && nodeToRemove->getRight() == nullptr) {
@@ -306,78 +663,757 @@ void AVLTree<Key, Value>:: remove(const Key& key)
 
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeNoChild(AVLNode<Key, Value>* nodeToRemove) 
+/**
+* Inserts every (key, value) pair in [first, last), overwriting the
+* values of keys already present; for repeated keys in the batch the
+* last value wins. The batch is sorted, then merged in by splitting the
+* tree at its middle key, merging each half of the batch into the
+* matching side, and joining the sides back, which is O(k log(n/k + 1))
+* for k keys. Compare must not throw; if copying an item does, the keys
+* merged in so far stay.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIt>
+std::size_t AVLTree<Key, Value, Compare>::insert_batch(InputIt first, InputIt last)
+{
+    std::vector<std::pair<Key, Value> > batch;
+    for (; first != last; ++first) {
+        batch.push_back(std::pair<Key, Value>((*first).first, (*first).second));
+    }
+    this->sortUnique(batch);
+
+    std::size_t inserted = 0;
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+    this->root_ = nullptr;
+    try {
+        insertBatchNodes(root, batch.data(), batch.size(), inserted);
+    }
+    catch (...) {
+        this->root_ = root;
+        throw;
+    }
+    this->root_ = root;
+    return inserted;
+}
+
+/**
+* Removes every key in [first, last) that is present, the same way
+* insert_batch merges: split at the middle key, recurse, join. A half
+* of the batch that meets an empty subtree stops there, so the cost is
+* O(k log(n/k + 1)). Compare must not throw.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIt>
+std::size_t AVLTree<Key, Value, Compare>::erase_batch(InputIt first, InputIt last)
+{
+    std::vector<Key> keys(first, last);
+    std::sort(keys.begin(), keys.end(),
+        [this](const Key& a, const Key& b) { return this->keyLess(a, b); });
+    keys.erase(std::unique(keys.begin(), keys.end(),
+        [this](const Key& a, const Key& b) { return !this->keyLess(a, b); }), keys.end());
+
+    std::size_t erased = 0;
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+    this->root_ = nullptr;
+    this->root_ = eraseBatchNodes(root, keys.data(), keys.size(), erased);
+    return erased;
+}
+
+/**
+* Makes node the root of a detached subtree and returns it.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::detach(AVLNode<Key, Value>* node)
+{
+    if (node != nullptr) {
+        node->setParent(nullptr);
+    }
+    return node;
+}
+
+/**
+* Joins detached subtrees left and right, with every key of left less
+* than pivot's and every key of right greater, under the lone node pivot.
+* If their heights differ by more than one, pivot is hung on the taller
+* tree's inner spine where the heights meet; the subtree there grows by
+* one, just as after an insertion, so the usual retrace rebalances it.
+* O(|height(left) - height(right)| + 1). Returns the new root.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinNodes(AVLNode<Key, Value>* left,
+    AVLNode<Key, Value>* pivot, AVLNode<Key, Value>* right)
+{
+    int leftHeight = height(left);
+    int rightHeight = height(right);
+    AVLNode<Key, Value>* parent = nullptr;
+
+    if (leftHeight > rightHeight + 1) {
+        while (height(left) > rightHeight + 1) {
+            parent = left;
+            left = left->getRight();
+        }
+    }
+    else if (rightHeight > leftHeight + 1) {
+        while (height(right) > leftHeight + 1) {
+            parent = right;
+            right = right->getLeft();
+        }
+    }
+
+    pivot->setLeft(left);
+    if (left != nullptr) {left->setParent(pivot);}
+    pivot->setRight(right);
+    if (right != nullptr) {right->setParent(pivot);}
+    pivot->setParent(parent);
+    updateNode(pivot);
+    if (parent == nullptr) {
+        return pivot;
+    }
+
+    if (leftHeight > rightHeight) {
+        parent->setRight(pivot);
+    }
+    else {
+        parent->setLeft(pivot);
+    }
+    retrace(parent);
+    AVLNode<Key, Value>* root = pivot;
+    while (root->getParent() != nullptr) {
+        root = root->getParent();
+    }
+    return root;
+}
+
+/**
+* Joins detached subtrees with no pivot, borrowing left's last node.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinNodes(AVLNode<Key, Value>* left,
+    AVLNode<Key, Value>* right)
+{
+    if (left == nullptr) {
+        return right;
+    }
+    if (right == nullptr) {
+        return left;
+    }
+    AVLNode<Key, Value>* last = nullptr;
+    AVLNode<Key, Value>* rest = splitLast(left, last);
+    return joinNodes(rest, last, right);
+}
+
+/**
+* Unlinks the last node of a detached subtree into last and returns the
+* root of what remains.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::splitLast(AVLNode<Key, Value>* tree,
+    AVLNode<Key, Value>*& last)
+{
+    AVLNode<Key, Value>* left = detach(tree->getLeft());
+    if (tree->getRight() == nullptr) {
+        last = tree;
+        return left;
+    }
+    AVLNode<Key, Value>* rest = splitLast(detach(tree->getRight()), last);
+    return joinNodes(left, tree, rest);
+}
+
+/**
+* Splits a detached subtree into detached subtrees of the keys less
+* than key and greater than key, and the node holding key (or nullptr).
+* Each level joins the node it passes onto one side, and the joins
+* telescope, so a split is O(log n) in all.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::splitNodes(AVLNode<Key, Value>* tree, const Key& key,
+    AVLNode<Key, Value>*& less, AVLNode<Key, Value>*& match, AVLNode<Key, Value>*& greater)
+{
+    if (tree == nullptr) {
+        less = match = greater = nullptr;
+        return;
+    }
+    AVLNode<Key, Value>* left = detach(tree->getLeft());
+    AVLNode<Key, Value>* right = detach(tree->getRight());
+    int order = this->keyCompare(key, tree->getKey());
+    if (order < 0) {
+        AVLNode<Key, Value>* middle = nullptr;
+        splitNodes(left, key, less, match, middle);
+        greater = joinNodes(middle, tree, right);
+    }
+    else if (order > 0) {
+        AVLNode<Key, Value>* middle = nullptr;
+        splitNodes(right, key, middle, match, greater);
+        less = joinNodes(left, tree, middle);
+    }
+    else {
+        tree->setLeft(nullptr);
+        tree->setRight(nullptr);
+        updateNode(tree);
+        less = left;
+        match = tree;
+        greater = right;
+    }
+}
+
+/**
+* Appends the nodes of a detached subtree to nodes in key order.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::collectSubtree(AVLNode<Key, Value>* tree,
+    std::vector<Node<Key, Value>*>& nodes)
+{
+    std::vector<AVLNode<Key, Value>*> path;
+    while (tree != nullptr || !path.empty()) {
+        while (tree != nullptr) {
+            path.push_back(tree);
+            tree = tree->getLeft();
+        }
+        tree = path.back();
+        path.pop_back();
+        nodes.push_back(tree);
+        tree = tree->getRight();
+    }
+}
+
+/**
+* Merges the sorted, duplicate-free batch[0, count) into the detached
+* subtree tree. tree is updated in place and is a whole subtree again
+* even if creating a node throws.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertBatchNodes(AVLNode<Key, Value>*& tree,
+    std::pair<Key, Value>* batch, std::size_t count, std::size_t& inserted)
+{
+    if (count == 0) {
+        return;
+    }
+    std::size_t middle = count / 2;
+    AVLNode<Key, Value>* less = nullptr;
+    AVLNode<Key, Value>* match = nullptr;
+    AVLNode<Key, Value>* greater = nullptr;
+    splitNodes(tree, batch[middle].first, less, match, greater);
+    if (match != nullptr) {
+        match->setValue(std::move(batch[middle].second));
+    }
+    else {
+        try {
+            match = static_cast<AVLNode<Key, Value>*>(createNode(
+                std::move(batch[middle].first), std::move(batch[middle].second), nullptr));
+        }
+        catch (...) {
+            tree = joinNodes(less, greater);
+            throw;
+        }
+        ++inserted;
+    }
+    try {
+        insertBatchNodes(less, batch, middle, inserted);
+        insertBatchNodes(greater, batch + middle + 1, count - middle - 1, inserted);
+    }
+    catch (...) {
+        tree = joinNodes(less, match, greater);
+        throw;
+    }
+    tree = joinNodes(less, match, greater);
+}
+
+/**
+* Removes the keys of the sorted, duplicate-free keys[0, count) from the
+* detached subtree tree and returns what is left.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::eraseBatchNodes(AVLNode<Key, Value>* tree,
+    const Key* keys, std::size_t count, std::size_t& erased)
+{
+    if (count == 0 || tree == nullptr) {
+        return tree;
+    }
+    std::size_t middle = count / 2;
+    AVLNode<Key, Value>* less = nullptr;
+    AVLNode<Key, Value>* match = nullptr;
+    AVLNode<Key, Value>* greater = nullptr;
+    splitNodes(tree, keys[middle], less, match, greater);
+    if (match != nullptr) {
+        destroyNode(match);
+        ++erased;
+    }
+    less = eraseBatchNodes(less, keys, middle, erased);
+    greater = eraseBatchNodes(greater, keys + middle + 1, count - middle - 1, erased);
+    return joinNodes(less, greater);
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::destroyAll(std::vector<Node<Key, Value>*>& nodes)
 {
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        destroyNode(nodes[i]);
+    }
+    nodes.clear();
+}
+
+/**
+* Appends item and then every item of right, whose keys must all be
+* greater than item's, which must be greater than every key here.
+* right is left empty; its nodes and their storage move here as they
+* are. Throws std::invalid_argument, changing nothing, if the keys are
+* out of order or the trees allocate nodes differently.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::join(const std::pair<const Key, Value>& item, AVLTree& right)
+{
+    if (&right == this || !this->pool_.compatible(right.pool_)) {
+        throw std::invalid_argument("AVLTree::join: trees cannot share nodes");
+    }
+    Node<Key, Value>* last = this->root_;
+    while (last != nullptr && last->getRight() != nullptr) {
+        last = last->getRight();
+    }
+    Node<Key, Value>* first = right.getSmallestNode();
+    if ((last != nullptr && !this->keyLess(last->getKey(), item.first))
+        || (first != nullptr && !this->keyLess(item.first, first->getKey()))) {
+        throw std::invalid_argument("AVLTree::join: keys out of order");
+    }
+
+    AVLNode<Key, Value>* pivot = static_cast<AVLNode<Key, Value>*>(
+        createNode(item.first, item.second, nullptr));
+    try {
+        this->pool_.adopt(right.pool_);
+    }
+    catch (...) {
+        destroyNode(pivot);
+        throw;
+    }
+    AVLNode<Key, Value>* left = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* rest = static_cast<AVLNode<Key, Value>*>(right.root_);
+    this->root_ = nullptr;
+    right.root_ = nullptr;
+    this->root_ = joinNodes(left, pivot, rest);
+}
+
+/**
+* As above with no item in between: right's keys must all be greater
+* than every key here.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::join(AVLTree& right)
+{
+    if (&right == this || !this->pool_.compatible(right.pool_)) {
+        throw std::invalid_argument("AVLTree::join: trees cannot share nodes");
+    }
+    Node<Key, Value>* last = this->root_;
+    while (last != nullptr && last->getRight() != nullptr) {
+        last = last->getRight();
+    }
+    Node<Key, Value>* first = right.getSmallestNode();
+    if (last != nullptr && first != nullptr && !this->keyLess(last->getKey(), first->getKey())) {
+        throw std::invalid_argument("AVLTree::join: keys out of order");
+    }
+
+    this->pool_.adopt(right.pool_);
+    AVLNode<Key, Value>* left = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* rest = static_cast<AVLNode<Key, Value>*>(right.root_);
+    this->root_ = nullptr;
+    right.root_ = nullptr;
+    this->root_ = joinNodes(left, rest);
+}
+
+/**
+* Moves every item whose key is not less than key into right, which
+* must be empty. The nodes move as they are: the split is O(log n), and
+* right then holds this tree's node storage too (see NodePool::share),
+* which is freed once both trees have let go of it. Counting the k
+* moved nodes adds O(min(k, n - k)) steps, or nothing with
+* AVL_SUBTREE_SIZES. Throws std::invalid_argument, changing nothing, if
+* right is not empty or the trees allocate nodes differently.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::split(const Key& key, AVLTree& right)
+{
+    if (&right == this || !right.empty()) {
+        throw std::invalid_argument("AVLTree::split: right must be another, empty tree");
+    }
+    if (!this->pool_.compatible(right.pool_)) {
+        throw std::invalid_argument("AVLTree::split: trees cannot share nodes");
+    }
+    std::size_t total = this->size();
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+    this->root_ = nullptr;
+    AVLNode<Key, Value>* less = nullptr;
+    AVLNode<Key, Value>* match = nullptr;
+    AVLNode<Key, Value>* greater = nullptr;
+    splitNodes(root, key, less, match, greater);
+    if (match != nullptr) {
+        greater = joinNodes(nullptr, match, greater);
+    }
+
+    try {
+        right.pool_.share(this->pool_, countUpper(less, greater, total));
+    }
+    catch (...) {
+        this->root_ = joinNodes(less, greater);
+        throw;
+    }
+    this->root_ = less;
+    right.root_ = greater;
+}
+
+/**
+* The number of nodes under greater, when less and greater hold total
+* between them. Without stored subtree sizes both are walked in order,
+* in step, until the smaller one runs out.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::countUpper(AVLNode<Key, Value>* less,
+    AVLNode<Key, Value>* greater, std::size_t total)
+{
+#if AVL_SUBTREE_SIZES
+    (void)less;
+    (void)total;
+    return subtreeSize(greater);
+#else
+    Node<Key, Value>* lower = less;
+    Node<Key, Value>* upper = greater;
+    while (lower != nullptr && lower->getLeft() != nullptr) {
+        lower = lower->getLeft();
+    }
+    while (upper != nullptr && upper->getLeft() != nullptr) {
+        upper = upper->getLeft();
+    }
+    std::size_t counted = 0;
+    while (lower != nullptr && upper != nullptr) {
+        lower = BinarySearchTree<Key, Value, Compare>::successor(lower);
+        upper = BinarySearchTree<Key, Value, Compare>::successor(upper);
+        ++counted;
+    }
+    return (upper == nullptr) ? counted : total - counted;
+#endif
+}
+
+/**
+* Forks only near the top of the recursion, while the subtree is big
+* enough to pay for a thread.
+*/
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::worthForking(const AVLNode<Key, Value>* a, int forks)
+{
+    return forks > 0 && height(a) >= 12;
+}
+
+/**
+* Union of detached subtrees a and b (both of this tree): split a by
+* b's root key, unite the halves with b's subtrees, and join the two
+* results under b's root. a's node for that key, if any, is dropped
+* into garbage. The two halves are independent, so they run in
+* parallel near the top.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::unionNodes(AVLNode<Key, Value>* a,
+    AVLNode<Key, Value>* b, std::vector<Node<Key, Value>*>& garbage, int forks)
+{
+    if (a == nullptr) {
+        return b;
+    }
+    if (b == nullptr) {
+        return a;
+    }
+    AVLNode<Key, Value>* bLeft = detach(b->getLeft());
+    AVLNode<Key, Value>* bRight = detach(b->getRight());
+    AVLNode<Key, Value>* less = nullptr;
+    AVLNode<Key, Value>* match = nullptr;
+    AVLNode<Key, Value>* greater = nullptr;
+    splitNodes(a, b->getKey(), less, match, greater);
+    if (match != nullptr) {
+        garbage.push_back(match);
+    }
+
+    AVLNode<Key, Value>* left = nullptr;
+    AVLNode<Key, Value>* right = nullptr;
+    std::vector<Node<Key, Value>*> rightGarbage;
+    forkJoin(worthForking(a, forks) ? &WorkStealingPool::instance() : nullptr,
+        [&]() { left = unionNodes(less, bLeft, garbage, forks - 1); },
+        [&]() { right = unionNodes(greater, bRight, rightGarbage, forks - 1); });
+    garbage.insert(garbage.end(), rightGarbage.begin(), rightGarbage.end());
+    return joinNodes(left, b, right);
+}
+
+/**
+* Intersection of detached subtree a with b, a subtree of another tree
+* that is only read. Nodes of a whose key is not in b go to garbage.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::intersectNodes(AVLNode<Key, Value>* a,
+    const AVLNode<Key, Value>* b, std::vector<Node<Key, Value>*>& garbage, int forks)
+{
+    if (a == nullptr) {
+        return nullptr;
+    }
+    if (b == nullptr) {
+        collectSubtree(a, garbage);
+        return nullptr;
+    }
+    AVLNode<Key, Value>* less = nullptr;
+    AVLNode<Key, Value>* match = nullptr;
+    AVLNode<Key, Value>* greater = nullptr;
+    splitNodes(a, b->getKey(), less, match, greater);
+
+    AVLNode<Key, Value>* left = nullptr;
+    AVLNode<Key, Value>* right = nullptr;
+    std::vector<Node<Key, Value>*> rightGarbage;
+    forkJoin(worthForking(a, forks) ? &WorkStealingPool::instance() : nullptr,
+        [&]() { left = intersectNodes(less, b->getLeft(), garbage, forks - 1); },
+        [&]() { right = intersectNodes(greater, b->getRight(), rightGarbage, forks - 1); });
+    garbage.insert(garbage.end(), rightGarbage.begin(), rightGarbage.end());
+    return (match != nullptr) ? joinNodes(left, match, right) : joinNodes(left, right);
+}
+
+/**
+* Detached subtree a less the keys of b, another tree's subtree.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::differenceNodes(AVLNode<Key, Value>* a,
+    const AVLNode<Key, Value>* b, std::vector<Node<Key, Value>*>& garbage, int forks)
+{
+    if (a == nullptr || b == nullptr) {
+        return a;
+    }
+    AVLNode<Key, Value>* less = nullptr;
+    AVLNode<Key, Value>* match = nullptr;
+    AVLNode<Key, Value>* greater = nullptr;
+    splitNodes(a, b->getKey(), less, match, greater);
+    if (match != nullptr) {
+        garbage.push_back(match);
+    }
+
+    AVLNode<Key, Value>* left = nullptr;
+    AVLNode<Key, Value>* right = nullptr;
+    std::vector<Node<Key, Value>*> rightGarbage;
+    forkJoin(worthForking(a, forks) ? &WorkStealingPool::instance() : nullptr,
+        [&]() { left = differenceNodes(less, b->getLeft(), garbage, forks - 1); },
+        [&]() { right = differenceNodes(greater, b->getRight(), rightGarbage, forks - 1); });
+    garbage.insert(garbage.end(), rightGarbage.begin(), rightGarbage.end());
+    return joinNodes(left, right);
+}
+
+/**
+* Adds every item of other, overwriting the values of keys present in
+* both. other's items are first copied into this tree's storage as a
+* balanced subtree, O(other.size()); the union then only relinks nodes,
+* O(m log(n/m + 1)) for m the smaller size. The copy dominates when
+* other is the larger tree, but then most of it is new to this tree and
+* needs a node here anyway. Compare must not throw.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::union_with(const AVLTree& other)
+{
+    if (&other == this || other.empty()) {
+        return;
+    }
+    std::vector<Node<Key, Value>*> items;
+    other.collectInOrder(items);
+    std::vector<Node<Key, Value>*> copies;
+    copies.reserve(items.size());
+    try {
+        for (std::size_t i = 0; i < items.size(); ++i) {
+            copies.push_back(createNode(items[i]->getKey(), items[i]->getValue(), nullptr));
+        }
+    }
+    catch (...) {
+        destroyAll(copies);
+        throw;
+    }
+    AVLNode<Key, Value>* b = static_cast<AVLNode<Key, Value>*>(
+        this->linkBalanced(copies.data(), copies.size(), nullptr));
+
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this->root_);
+    this->root_ = nullptr;
+    std::vector<Node<Key, Value>*> garbage;
+    AVLNode<Key, Value>* root = unionNodes(a, b, garbage, forkDepth(WorkStealingPool::instance()));
+    this->root_ = root;
+    destroyAll(garbage);
+}
+
+/**
+* Keeps only the keys that other also holds. Compare must not throw.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::intersect_with(const AVLTree& other)
+{
+    if (&other == this) {
+        return;
+    }
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this->root_);
+    this->root_ = nullptr;
+    std::vector<Node<Key, Value>*> garbage;
+    AVLNode<Key, Value>* root = intersectNodes(a,
+        static_cast<const AVLNode<Key, Value>*>(other.root_), garbage,
+        forkDepth(WorkStealingPool::instance()));
+    this->root_ = root;
+    destroyAll(garbage);
+}
+
+/**
+* Removes every key that other holds. Compare must not throw.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::difference(const AVLTree& other)
+{
+    if (&other == this) {
+        this->clear();
+        return;
+    }
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this->root_);
+    this->root_ = nullptr;
+    std::vector<Node<Key, Value>*> garbage;
+    AVLNode<Key, Value>* root = differenceNodes(a,
+        static_cast<const AVLNode<Key, Value>*>(other.root_), garbage,
+        forkDepth(WorkStealingPool::instance()));
+    this->root_ = root;
+    destroyAll(garbage);
+}
+
+/**
+* Trusts the heights every update maintains, checking only that they
+* are consistent at the root and that the root's is one an AVL tree of
+* this size can have.
+*/
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::isBalanced() const
+{
+    const AVLNode<Key, Value>* root = static_cast<const AVLNode<Key, Value>*>(this->root_);
+    if (root == nullptr) {
+        return true;
+    }
+    int leftHeight = height(root->getLeft());
+    int rightHeight = height(root->getRight());
+    return std::abs(leftHeight - rightHeight) <= 1
+        && height(root) == std::max(leftHeight, rightHeight) + 1
+        && height(root) <= this->maxBalancedHeight(this->size());
+}
+
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::height() const
+{
+    return height(static_cast<const AVLNode<Key, Value>*>(this->root_));
+}
+
+#if AVL_SUBTREE_SIZES
+/**
+* Counts the keys less than key in one descent, adding up the left
+* subtrees passed over on the way.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::rank(const Key& key) const
+{
+    std::size_t less = 0;
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while (current != nullptr) {
+        if (this->keyLess(current->getKey(), key)) {
+            less += subtreeSize(current->getLeft()) + 1;
+            current = current->getRight();
+        }
+        else {
+            current = current->getLeft();
+        }
+    }
+    return less;
+}
+
+/**
+* Returns an iterator to the i-th smallest key (counting from 0), or
+* end() if the tree has no more than i keys.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator AVLTree<Key, Value, Compare>::select(std::size_t i) const
+{
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while (current != nullptr) {
+        std::size_t leftSize = subtreeSize(current->getLeft());
+        if (i < leftSize) {
+            current = current->getLeft();
+        }
+        else if (i == leftSize) {
+            break;
+        }
+        else {
+            i -= leftSize + 1;
+            current = current->getRight();
+        }
+    }
+    return this->makeIterator(current);
+}
+
+/**
+* Number of keys k with lo <= k < hi.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::count_range(const Key& lo, const Key& hi) const
+{
+    if (!this->keyLess(lo, hi)) {
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
+#endif
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeNoChild(AVLNode<Key, Value>* nodeToRemove) 
+{
+    AVLNode<Key, Value>* parent = nodeToRemove->getParent();
     if (nodeToRemove == this->root_){
         this->root_ = nullptr;
     } 
     else {
         // Remove Left Child
-        if (nodeToRemove->getParent()->getLeft() == nodeToRemove) {
-            nodeToRemove->getParent()->setLeft(nullptr);
+        if (parent->getLeft() == nodeToRemove) {
+            parent->setLeft(nullptr);
         } 
         // Or Removes Right Child
         else {
-            nodeToRemove->getParent()->setRight(nullptr);
+            parent->setRight(nullptr);
         }
     }
-    delete nodeToRemove;
+    destroyNode(nodeToRemove);
+    retrace(parent);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeOneChild(AVLNode<Key, Value>* nodeToRemove) 
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeOneChild(AVLNode<Key, Value>* nodeToRemove) 
 {
     AVLNode<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? 
                                     nodeToRemove->getLeft() : nodeToRemove->getRight();
+    AVLNode<Key, Value>* parent = nodeToRemove->getParent();
     if (nodeToRemove == this->root_) {
         this->root_ = child;
         child->setParent(nullptr);
     } 
     else {
         // Remove Left Child
-        if (nodeToRemove->getParent()->getLeft() == nodeToRemove) {
-            nodeToRemove->getParent()->setLeft(child);
+        if (parent->getLeft() == nodeToRemove) {
+            parent->setLeft(child);
         } 
         // Or Removes Right
         else {
-            nodeToRemove->getParent()->setRight(child);
-        }
-        child->setParent(nodeToRemove->getParent());
-    }
-    delete nodeToRemove;
-
-    while (child != nullptr) {
-        if (child->getLeft()->getBalance() - child->getRight()->getBalance() > 1) {
-            if (child->getLeft()->getLeft()->getBalance() >= child->getLeft()->getRight()->getBalance()) {
-                rotateWithLeftChild(child);
-            }
-            else {
-                doubleWithLeftChild(child);
-                
-            }
+            parent->setRight(child);
         }
-        else if (child->getRight()->getBalance() - child->getLeft()->getBalance() > 1) {
-            if (child->getRight()->getRight()->getBalance() >= child->getRight()->getLeft()->getBalance()) {
-                rotateWithRightChild(child);
-            }
-            else {
-                doubleWithRightChild(child);
-            }
-        }
-
-        child->setBalance(max(child->getLeft()->getBalance(), child->getRight()->getBalance()) + 1);
-        child = child->getParent();
+        child->setParent(parent);
     }
+    destroyNode(nodeToRemove);
+    retrace(parent);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+#if AVL_SUBTREE_SIZES
+    uint32_t tempS = n1->getSize();
+    n1->setSize(n2->getSize());
+    n2->setSize(tempS);
+#endif
 }
 
 
@@ -0,0 +1,204 @@
+#include <list>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+template <typename Key, typename Value>
+bool matches(const AVLTree<Key, Value>& tree, const map<Key, Value>& expected)
+{
+    TreeShape shape = tree.shape();
+    return tree.size() == expected.size() && shape.nodes == expected.size() &&
+           shape.balanced && shape.height == tree.height() &&
+           sameItems(tree.begin(), tree.end(), expected);
+}
+
+/**
+* Applies batch to expected the way insert_batch does, last value
+* winning, and returns how many keys were new.
+*/
+size_t insertExpected(map<int, int>& expected, const vector<pair<int, int> >& batch)
+{
+    size_t inserted = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        inserted += expected.count(batch[i].first) == 0;
+        expected[batch[i].first] = batch[i].second;
+    }
+    return inserted;
+}
+
+size_t eraseExpected(map<int, int>& expected, const vector<int>& keys)
+{
+    size_t erased = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        erased += expected.erase(keys[i]);
+    }
+    return erased;
+}
+
+/**
+* Empty batches change nothing, on an empty tree and on a full one, and
+* a key repeated inside a batch counts once and keeps its last value.
+*/
+void testEdgeBatches()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    vector<pair<int, int> > none;
+    vector<int> noKeys;
+    CHECK(tree.insert_batch(none.begin(), none.end()) == 0);
+    CHECK(tree.erase_batch(noKeys.begin(), noKeys.end()) == 0);
+    CHECK(matches(tree, expected));
+
+    vector<pair<int, int> > repeated;
+    for (int i = 0; i < 10; ++i) {
+        repeated.push_back(make_pair(5, i));
+        repeated.push_back(make_pair(i * 2, i));
+    }
+    size_t inserted = insertExpected(expected, repeated);
+    CHECK(tree.insert_batch(repeated.begin(), repeated.end()) == inserted && inserted == 11);
+    CHECK(matches(tree, expected) && tree.find(5)->second == 9);
+
+    CHECK(tree.insert_batch(none.begin(), none.end()) == 0);
+    CHECK(tree.erase_batch(noKeys.begin(), noKeys.end()) == 0);
+    CHECK(matches(tree, expected));
+
+    // Repeated and absent keys in an erase batch
+    vector<int> keys;
+    keys.push_back(4);
+    keys.push_back(4);
+    keys.push_back(5);
+    keys.push_back(-1);
+    keys.push_back(4);
+    keys.push_back(100);
+    size_t erased = eraseExpected(expected, keys);
+    CHECK(tree.erase_batch(keys.begin(), keys.end()) == erased && erased == 2);
+    CHECK(matches(tree, expected));
+
+    // Batches from input that is not random access
+    list<pair<int, int> > linked(repeated.rbegin(), repeated.rend());
+    insertExpected(expected, vector<pair<int, int> >(linked.begin(), linked.end()));
+    tree.insert_batch(linked.begin(), linked.end());
+    CHECK(matches(tree, expected) && tree.find(5)->second == 0);
+    list<int> linkedKeys(keys.begin(), keys.end());
+    eraseExpected(expected, keys);
+    tree.erase_batch(linkedKeys.begin(), linkedKeys.end());
+    CHECK(matches(tree, expected));
+}
+
+/**
+* Batches that reach below the smallest key, above the largest and into
+* every gap between, and an erase batch covering the whole range, which
+* leaves the tree empty and ready for reuse.
+*/
+void testWholeRange()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    vector<pair<int, int> > middle;
+    for (int i = 0; i < 1000; ++i) {
+        middle.push_back(make_pair(10 * i, i));
+    }
+    insertExpected(expected, middle);
+    tree.insert_batch(middle.begin(), middle.end());
+    CHECK(matches(tree, expected));
+
+    vector<pair<int, int> > spanning;
+    for (int key = -5000; key < 15000; key += 7) {
+        spanning.push_back(make_pair(key, -key));
+    }
+    size_t inserted = insertExpected(expected, spanning);
+    CHECK(tree.insert_batch(spanning.begin(), spanning.end()) == inserted);
+    CHECK(matches(tree, expected));
+
+    vector<int> everything;
+    for (int key = -6000; key < 16000; ++key) {
+        everything.push_back(key);
+    }
+    CHECK(tree.erase_batch(everything.begin(), everything.end()) == expected.size());
+    expected.clear();
+    CHECK(matches(tree, expected) && tree.begin() == tree.end());
+
+    CHECK(tree.insert_batch(middle.begin(), middle.end()) == middle.size());
+    insertExpected(expected, middle);
+    CHECK(matches(tree, expected));
+}
+
+/**
+* Random batches of every size from one key to many times the tree,
+* each followed by single inserts and removes, against std::map.
+*/
+void testRandomBatches()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    mt19937 rng(6);
+    const size_t batchSizes[] = { 1, 2, 3, 17, 100, 1000, 20000 };
+    bool allMatch = true;
+    for (int round = 0; round < 40; ++round) {
+        size_t size = batchSizes[rng() % (sizeof(batchSizes) / sizeof(batchSizes[0]))];
+        int range = static_cast<int>(rng() % 50000) + 10;
+        if (rng() % 3 != 0) {
+            vector<pair<int, int> > batch;
+            for (size_t i = 0; i < size; ++i) {
+                batch.push_back(make_pair(static_cast<int>(rng() % range), round));
+            }
+            size_t inserted = insertExpected(expected, batch);
+            allMatch = allMatch && tree.insert_batch(batch.begin(), batch.end()) == inserted;
+        }
+        else {
+            vector<int> keys;
+            for (size_t i = 0; i < size; ++i) {
+                keys.push_back(static_cast<int>(rng() % range));
+            }
+            size_t erased = eraseExpected(expected, keys);
+            allMatch = allMatch && tree.erase_batch(keys.begin(), keys.end()) == erased;
+        }
+        for (int i = 0; i < 20; ++i) {
+            int key = static_cast<int>(rng() % range);
+            tree.insert(make_pair(key, -round));
+            expected[key] = -round;
+            key = static_cast<int>(rng() % range);
+            tree.remove(key);
+            expected.erase(key);
+        }
+        allMatch = allMatch && matches(tree, expected);
+    }
+    CHECK(allMatch);
+}
+
+// Items that own memory go through the same merge
+void testStrings()
+{
+    AVLTree<string, string> tree;
+    map<string, string> expected;
+    vector<pair<string, string> > batch;
+    for (int i = 0; i < 3000; ++i) {
+        string key = to_string(i * 7 % 2000);
+        batch.push_back(make_pair(key, string(i % 40, 'v')));
+        expected[key] = string(i % 40, 'v');
+    }
+    CHECK(tree.insert_batch(batch.begin(), batch.end()) == expected.size());
+    CHECK(matches(tree, expected));
+
+    vector<string> keys;
+    for (int i = 0; i < 2000; i += 2) {
+        keys.push_back(to_string(i));
+        expected.erase(to_string(i));
+    }
+    CHECK(tree.erase_batch(keys.begin(), keys.end()) == 1000);
+    CHECK(matches(tree, expected));
+}
+
+int main()
+{
+    testEdgeBatches();
+    testWholeRange();
+    testRandomBatches();
+    testStrings();
+    return checkResult("batch-test");
+}
@@ -0,0 +1,1375 @@
+#include <algorithm>
+#include <atomic>
+#include <malloc.h>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "btree.h"
+#include "compact_avl.h"
+#include "mapped_avl.h"
+#include "concurrent_avl.h"
+#include "durable_avl.h"
+#include "rcu_avl.h"
+
+using namespace std;
+
+/*
+ * Throughput benchmarks for the search trees.
+ * Usage: ./bst-bench [suite] [max n]   (default: all suites)
+ * Output is CSV on stdout, one header line per suite. max n sets the
+ * largest size of the compare suite (default 1e6, e.g. 1e8).
+ */
+
+typedef chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// n distinct keys 0, stride, 2*stride, ... + offset in random order
+static vector<int> shuffledKeys(size_t n, int stride, int offset, unsigned seed)
+{
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = static_cast<int>(i) * stride + offset;
+    }
+    mt19937 rng(seed);
+    shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+static void buildEvenTree(AVLTree<int, int>& tree, size_t n)
+{
+    vector<pair<int, int> > items(n);
+    for (size_t i = 0; i < n; ++i) {
+        items[i] = make_pair(static_cast<int>(i) * 2, static_cast<int>(i));
+    }
+    tree.bulk_load(items.begin(), items.end());
+}
+
+/*
+ * Raw NodePool allocation, n blocks the size of an AVLTree<int, int>
+ * node. The cost per block should not grow with n; if the largest size
+ * costs several times the smallest per block, slab growth has turned
+ * superlinear and this says so on stderr.
+ */
+static void benchPool()
+{
+    printf("suite,n,slabs,ms,ns_per_node\n");
+    const size_t sizes[] = {1000000, 4000000, 16000000};
+    const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+    double perNode[count];
+    for (size_t s = 0; s < count; ++s) {
+        size_t n = sizes[s];
+        NodePool pool(sizeof(AVLNode<int, int>), NodePool::DEFAULT_SLAB_NODES);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            pool.allocate();
+        }
+        double ms = msSince(start);
+        perNode[s] = ms * 1e6 / n;
+        printf("pool,%zu,%zu,%.3f,%.1f\n", n, pool.slabCount(), ms, perNode[s]);
+    }
+    if (perNode[count - 1] > 4 * perNode[0]) {
+        fprintf(stderr, "pool: %.1f ns per node at %zu but %.1f at %zu\n",
+                perNode[count - 1], sizes[count - 1], perNode[0], sizes[0]);
+    }
+}
+
+/*
+ * insert_batch/erase_batch against the same keys applied one at a time,
+ * for batches of k new (odd) keys into a tree of n even keys.
+ */
+static void benchBatch()
+{
+    printf("suite,n,batch,op,ms,ns_per_key\n");
+    const size_t sizes[] = {100000, 1000000};
+    const size_t batches[] = {1000, 10000, 100000, 1000000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); ++b) {
+            size_t n = sizes[s];
+            size_t k = batches[b];
+            vector<int> keys = shuffledKeys(k, 2, 1, 7);
+            vector<pair<int, int> > batch(k);
+            for (size_t i = 0; i < k; ++i) {
+                batch[i] = make_pair(keys[i], keys[i]);
+            }
+
+            AVLTree<int, int> batched;
+            AVLTree<int, int> single;
+            buildEvenTree(batched, n);
+            buildEvenTree(single, n);
+
+            Clock::time_point start = Clock::now();
+            batched.insert_batch(batch.begin(), batch.end());
+            double ms = msSince(start);
+            printf("batch,%zu,%zu,insert_batch,%.3f,%.1f\n", n, k, ms, ms * 1e6 / k);
+
+            start = Clock::now();
+            for (size_t i = 0; i < k; ++i) {
+                single.insert(batch[i]);
+            }
+            ms = msSince(start);
+            printf("batch,%zu,%zu,insert_each,%.3f,%.1f\n", n, k, ms, ms * 1e6 / k);
+
+            start = Clock::now();
+            batched.erase_batch(keys.begin(), keys.end());
+            ms = msSince(start);
+            printf("batch,%zu,%zu,erase_batch,%.3f,%.1f\n", n, k, ms, ms * 1e6 / k);
+
+            start = Clock::now();
+            for (size_t i = 0; i < k; ++i) {
+                single.remove(keys[i]);
+            }
+            ms = msSince(start);
+            printf("batch,%zu,%zu,erase_each,%.3f,%.1f\n", n, k, ms, ms * 1e6 / k);
+        }
+    }
+}
+
+/*
+ * The same workload against each map engine. Swapping the engine behind
+ * an alias is all a caller needs to do, e.g.
+ *   template <typename K, typename V> using OrderedMap = BTree<K, V>;
+ */
+typedef AVLTree<int, int> AvlEngine;
+typedef BTree<int, int> BTreeEngine;
+typedef CompactAVLTree<int, int> CompactEngine;
+
+template <typename Tree>
+static void benchEngine(const char* name, size_t n)
+{
+    vector<int> keys = shuffledKeys(n, 1, 0, 11);
+    vector<int> probes = shuffledKeys(n, 1, 0, 13);
+    Tree tree;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    double ms = msSince(start);
+    printf("engine,%s,%zu,insert,%.3f,%.1f\n", name, n, ms, ms * 1e6 / n);
+
+    long long sum = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        sum += tree.find(probes[i])->second;
+    }
+    ms = msSince(start);
+    printf("engine,%s,%zu,find,%.3f,%.1f\n", name, n, ms, ms * 1e6 / n);
+
+    start = Clock::now();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        sum += it->second;
+    }
+    ms = msSince(start);
+    printf("engine,%s,%zu,iterate,%.3f,%.1f\n", name, n, ms, ms * 1e6 / n);
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        tree.remove(probes[i]);
+    }
+    ms = msSince(start);
+    printf("engine,%s,%zu,remove,%.3f,%.1f\n", name, n, ms, ms * 1e6 / n);
+
+    if (sum == 42) {
+        fprintf(stderr, "unlikely\n");   // keeps the loops from being elided
+    }
+}
+
+/*
+ * AVLTree against the B+ tree and compact AVL engines on random int keys.
+ */
+static void benchEngines()
+{
+    printf("suite,engine,n,op,ms,ns_per_key\n");
+    const size_t sizes[] = {10000, 100000, 1000000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        benchEngine<AvlEngine>("avl", sizes[s]);
+        benchEngine<BTreeEngine>("btree", sizes[s]);
+        benchEngine<CompactEngine>("compact", sizes[s]);
+    }
+}
+
+// Bytes currently allocated from the heap, including mmapped blocks
+static size_t heapInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+template <typename Tree>
+static void reserveNodes(Tree& tree, size_t n)
+{
+    (void)tree;
+    (void)n;
+}
+
+static void reserveNodes(CompactEngine& tree, size_t n)
+{
+    tree.reserve(n);
+}
+
+template <typename Tree>
+static void benchMemoryOf(const char* name, size_t n, bool reserve)
+{
+    vector<int> keys = shuffledKeys(n, 1, 0, 29);
+    size_t before = heapInUse();
+    {
+        Tree tree;
+        if (reserve) {
+            reserveNodes(tree, n);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        size_t bytes = heapInUse() - before;
+        printf("memory,%s,%zu,%.1f\n", name, n, static_cast<double>(bytes) / n);
+    }
+}
+
+/*
+ * Heap bytes per item for int -> int maps built from random inserts,
+ * allocator overhead and spare capacity included. compact_reserved
+ * sizes the node vector up front; compact shows it grown by doubling.
+ */
+static void benchMemory()
+{
+    printf("suite,structure,n,bytes_per_node\n");
+    const size_t sizes[] = {100000, 1000000, 10000000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t n = sizes[s];
+        benchMemoryOf<BinarySearchTree<int, int> >("bst", n, false);
+        benchMemoryOf<AvlEngine>("avl", n, false);
+        benchMemoryOf<CompactEngine>("compact", n, false);
+        benchMemoryOf<CompactEngine>("compact_reserved", n, true);
+        benchMemoryOf<BTreeEngine>("btree", n, false);
+        benchMemoryOf<map<int, int> >("std_map", n, false);
+    }
+}
+
+/*
+ * Point lookups on a tree against its frozen snapshot.
+ */
+static void benchFrozen()
+{
+    printf("suite,n,structure,op,ms,ns_per_key\n");
+    const size_t sizes[] = {10000, 100000, 1000000, 4000000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t n = sizes[s];
+        AVLTree<int, int> tree;
+        buildEvenTree(tree, n);
+        Clock::time_point start = Clock::now();
+        FrozenMap<int, int> frozen = tree.freeze();
+        double ms = msSince(start);
+        printf("frozen,%zu,frozen,freeze,%.3f,%.1f\n", n, ms, ms * 1e6 / n);
+
+        vector<int> probes = shuffledKeys(n, 2, 0, 17);
+        long long sum = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            sum += tree.find(probes[i])->second;
+        }
+        ms = msSince(start);
+        printf("frozen,%zu,avl,find,%.3f,%.1f\n", n, ms, ms * 1e6 / n);
+
+        start = Clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            sum += frozen.find(probes[i])->second;
+        }
+        ms = msSince(start);
+        printf("frozen,%zu,frozen,find,%.3f,%.1f\n", n, ms, ms * 1e6 / n);
+
+        start = Clock::now();
+        for (FrozenMap<int, int>::iterator it = frozen.begin(); it != frozen.end(); ++it) {
+            sum += it->second;
+        }
+        ms = msSince(start);
+        printf("frozen,%zu,frozen,iterate,%.3f,%.1f\n", n, ms, ms * 1e6 / n);
+
+        if (sum == 42) {
+            fprintf(stderr, "unlikely\n");
+        }
+    }
+}
+
+/*
+ * ConcurrentAVLMap throughput from 1 to 64 threads: a fixed total of
+ * operations (90% find, 5% insert, 5% remove on random keys) is split
+ * evenly across the threads. One shard is a single-lock baseline.
+ */
+static void concurrentWorker(ConcurrentAVLMap<int, int>* map, size_t ops, unsigned seed,
+                             int keyRange, long long* found)
+{
+    mt19937 rng(seed);
+    uniform_int_distribution<int> key(0, keyRange - 1);
+    uniform_int_distribution<int> op(0, 99);
+    long long hits = 0;
+    int value;
+    for (size_t i = 0; i < ops; ++i) {
+        int k = key(rng);
+        int o = op(rng);
+        if (o < 90) {
+            hits += map->find(k, value);
+        }
+        else if (o < 95) {
+            map->insert(make_pair(k, k));
+        }
+        else {
+            map->remove(k);
+        }
+    }
+    *found = hits;
+}
+
+static void benchConcurrent()
+{
+    printf("suite,shards,threads,op,ms,ns_per_op\n");
+    const size_t n = 100000;
+    const size_t totalOps = 2000000;
+    const size_t shardCounts[] = {1, 64};
+    const size_t threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+    for (size_t s = 0; s < sizeof(shardCounts) / sizeof(shardCounts[0]); ++s) {
+        for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+            size_t threads = threadCounts[t];
+            ConcurrentAVLMap<int, int> map(shardCounts[s]);
+            vector<int> keys = shuffledKeys(n, 2, 0, 23);
+            for (size_t i = 0; i < n; ++i) {
+                map.insert(make_pair(keys[i], keys[i]));
+            }
+
+            vector<thread> workers;
+            vector<long long> found(threads);
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < threads; ++i) {
+                workers.push_back(thread(concurrentWorker, &map, totalOps / threads,
+                                         static_cast<unsigned>(i + 1), static_cast<int>(2 * n),
+                                         &found[i]));
+            }
+            for (size_t i = 0; i < threads; ++i) {
+                workers[i].join();
+            }
+            double ms = msSince(start);
+            printf("concurrent,%zu,%zu,mixed,%.3f,%.1f\n", shardCounts[s], threads, ms,
+                   ms * 1e6 / totalOps);
+
+            long long sum = 0;
+            for (size_t i = 0; i < threads; ++i) {
+                sum += found[i];
+            }
+            if (sum == 42) {
+                fprintf(stderr, "unlikely\n");
+            }
+        }
+    }
+}
+
+/*
+ * Read latency with and without a concurrent writer, for the
+ * reader/writer-locked map (one shard) and the RCU map. Each reader
+ * times every find; the writer inserts and removes odd keys until the
+ * readers are done.
+ */
+template <typename Map>
+static void rcuReader(const Map* map, size_t ops, unsigned seed, int keyRange,
+                      vector<double>* latencies)
+{
+    mt19937 rng(seed);
+    uniform_int_distribution<int> key(0, keyRange - 1);
+    latencies->resize(ops);
+    int value;
+    long long hits = 0;
+    for (size_t i = 0; i < ops; ++i) {
+        int k = key(rng);
+        Clock::time_point start = Clock::now();
+        hits += map->find(k, value);
+        (*latencies)[i] = chrono::duration<double, nano>(Clock::now() - start).count();
+    }
+    if (hits == 42) {
+        fprintf(stderr, "unlikely\n");
+    }
+}
+
+template <typename Map>
+static void rcuWriter(Map* map, int keyRange, const atomic<bool>* stop)
+{
+    mt19937 rng(99);
+    uniform_int_distribution<int> key(0, keyRange / 2 - 1);
+    for (size_t i = 0; !stop->load(); ++i) {
+        int k = 2 * key(rng) + 1;
+        if (i % 2) {
+            map->insert(make_pair(k, k));
+        }
+        else {
+            map->remove(k);
+        }
+    }
+}
+
+template <typename Map>
+static void benchReadLatency(const char* name, Map& map, size_t readers, bool writing)
+{
+    const size_t n = 1000000;
+    const size_t ops = 200000;
+    atomic<bool> stop(false);
+    thread writer;
+    if (writing) {
+        writer = thread(rcuWriter<Map>, &map, static_cast<int>(2 * n), &stop);
+    }
+    vector<thread> threads;
+    vector<vector<double> > latencies(readers);
+    for (size_t i = 0; i < readers; ++i) {
+        threads.push_back(thread(rcuReader<Map>, &map, ops, static_cast<unsigned>(i + 1),
+                                 static_cast<int>(2 * n), &latencies[i]));
+    }
+    for (size_t i = 0; i < readers; ++i) {
+        threads[i].join();
+    }
+    stop.store(true);
+    if (writing) {
+        writer.join();
+    }
+
+    vector<double> all;
+    for (size_t i = 0; i < readers; ++i) {
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    }
+    sort(all.begin(), all.end());
+    double total = 0;
+    for (size_t i = 0; i < all.size(); ++i) {
+        total += all[i];
+    }
+    printf("rcu,%s,%zu,%d,%.1f,%.1f,%.1f\n", name, readers, writing ? 1 : 0,
+           total / all.size(), all[all.size() / 2], all[all.size() * 99 / 100]);
+}
+
+static void benchRcu()
+{
+    printf("suite,map,readers,writer,mean_ns,p50_ns,p99_ns\n");
+    const size_t n = 1000000;
+    vector<int> keys = shuffledKeys(n, 2, 0, 29);
+    ConcurrentAVLMap<int, int> locked(1);
+    RcuAVLMap<int, int> rcu;
+    for (size_t i = 0; i < n; ++i) {
+        locked.insert(make_pair(keys[i], keys[i]));
+        rcu.insert(make_pair(keys[i], keys[i]));
+    }
+    const size_t readerCounts[] = {1, 2, 4};
+    for (size_t r = 0; r < sizeof(readerCounts) / sizeof(readerCounts[0]); ++r) {
+        for (int writing = 0; writing < 2; ++writing) {
+            benchReadLatency("rwlock", locked, readerCounts[r], writing != 0);
+            benchReadLatency("rcu", rcu, readerCounts[r], writing != 0);
+        }
+    }
+}
+
+/*
+ * Join-based set operations on a tree of n even keys against one of m
+ * keys drawn from [0, 2n), so that about half of them are shared;
+ * union_with next to insert_batch of the same items.
+ */
+static void benchSetOps()
+{
+    printf("suite,n,m,op,ms,ns_per_key\n");
+    const size_t n = 1000000;
+    const size_t counts[] = {1000, 100000, 1000000};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        size_t m = counts[c];
+        vector<int> keys = shuffledKeys(2 * n, 1, 0, 31);
+        keys.resize(m);
+        sort(keys.begin(), keys.end());
+        vector<pair<int, int> > items(m);
+        for (size_t i = 0; i < m; ++i) {
+            items[i] = make_pair(keys[i], keys[i]);
+        }
+        AVLTree<int, int> other(items.begin(), items.end());
+
+        const char* ops[] = {"union_with", "insert_batch", "intersect_with", "difference"};
+        for (size_t op = 0; op < sizeof(ops) / sizeof(ops[0]); ++op) {
+            AVLTree<int, int> tree;
+            buildEvenTree(tree, n);
+            Clock::time_point start = Clock::now();
+            switch (op) {
+            case 0: tree.union_with(other); break;
+            case 1: tree.insert_batch(items.begin(), items.end()); break;
+            case 2: tree.intersect_with(other); break;
+            default: tree.difference(other); break;
+            }
+            double ms = msSince(start);
+            printf("setops,%zu,%zu,%s,%.3f,%.1f\n", n, m, ops[op], ms, ms * 1e6 / m);
+        }
+    }
+}
+
+/*
+ * parallel_bulk_load, parallel_for_each and parallel_clear on pools of
+ * 1 to 8 threads, against their serial counterparts. The tree is
+ * unpooled (one allocation per node), as a tree with non-trivial
+ * items would need a walk to tear down.
+ */
+static void benchParallel()
+{
+    printf("suite,n,threads,op,ms,ns_per_key\n");
+    const size_t n = 2000000;
+    vector<pair<int, int> > items(n);
+    for (size_t i = 0; i < n; ++i) {
+        items[i] = make_pair(static_cast<int>(i), static_cast<int>(i));
+    }
+
+    {
+        AVLTree<int, int> tree(0);
+        Clock::time_point start = Clock::now();
+        tree.bulk_load(items.begin(), items.end());
+        double ms = msSince(start);
+        printf("parallel,%zu,serial,bulk_load,%.3f,%.1f\n", n, ms, ms * 1e6 / n);
+
+        start = Clock::now();
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            it->second += 1;
+        }
+        ms = msSince(start);
+        printf("parallel,%zu,serial,for_each,%.3f,%.1f\n", n, ms, ms * 1e6 / n);
+
+        start = Clock::now();
+        tree.clear();
+        ms = msSince(start);
+        printf("parallel,%zu,serial,clear,%.3f,%.1f\n", n, ms, ms * 1e6 / n);
+    }
+
+    const unsigned threadCounts[] = {1, 2, 4, 8};
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+        unsigned threads = threadCounts[t];
+        WorkStealingPool pool(threads - 1);
+        AVLTree<int, int> tree(0);
+        Clock::time_point start = Clock::now();
+        tree.parallel_bulk_load(items.begin(), items.end(), pool);
+        double ms = msSince(start);
+        printf("parallel,%zu,%u,bulk_load,%.3f,%.1f\n", n, threads, ms, ms * 1e6 / n);
+
+        start = Clock::now();
+        tree.parallel_for_each([](pair<const int, int>& item) { item.second += 1; }, pool);
+        ms = msSince(start);
+        printf("parallel,%zu,%u,for_each,%.3f,%.1f\n", n, threads, ms, ms * 1e6 / n);
+
+        start = Clock::now();
+        tree.parallel_clear(pool);
+        ms = msSince(start);
+        printf("parallel,%zu,%u,clear,%.3f,%.1f\n", n, threads, ms, ms * 1e6 / n);
+    }
+}
+
+/*
+ * Full in-order scans with iterator (successor() climbs parent
+ * pointers), reverse_iterator, and scan() (explicit stack with
+ * prefetch). Keys are inserted in random order, so neighbours in key
+ * order are scattered in memory, as in a tree built up over time.
+ */
+static void benchScan()
+{
+    printf("suite,n,walk,ms,mnodes_per_s\n");
+    const size_t sizes[] = {1000000, 10000000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t n = sizes[s];
+        AVLTree<int, int> tree;
+        vector<int> keys = shuffledKeys(n, 1, 0, 17);
+        for (size_t i = 0; i < n; ++i) {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        keys = vector<int>();
+
+        for (int round = 0; round < 2; ++round) {
+            long sum = 0;
+            Clock::time_point start = Clock::now();
+            for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+                sum += it->second;
+            }
+            double ms = msSince(start);
+            printf("scan,%zu,iterator,%.3f,%.1f\n", n, ms, n / ms / 1e3);
+
+            start = Clock::now();
+            for (AVLTree<int, int>::reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it) {
+                sum -= it->second;
+            }
+            ms = msSince(start);
+            printf("scan,%zu,reverse_iterator,%.3f,%.1f\n", n, ms, n / ms / 1e3);
+
+            start = Clock::now();
+            for (const pair<const int, int>& item : tree.scan()) {
+                sum += item.second;
+            }
+            ms = msSince(start);
+            printf("scan,%zu,scan,%.3f,%.1f\n", n, ms, n / ms / 1e3);
+            if (sum != static_cast<long>(n) * static_cast<long>(n - 1) / 2) {
+                fprintf(stderr, "scan: bad checksum\n");
+            }
+        }
+    }
+}
+
+template <typename Key>
+static void benchIngestOrder(const char* keyType, const char* order,
+    const vector<pair<Key, int> >& items)
+{
+    const char* methods[] = {"insert", "insert_end_hint", "insert_last_hint", "append_sorted"};
+    size_t n = items.size();
+    for (int method = 0; method < 4; ++method) {
+        AVLTree<Key, int> tree;
+        Clock::time_point start = Clock::now();
+        if (method == 0) {
+            for (size_t i = 0; i < n; ++i) {
+                tree.insert(items[i]);
+            }
+        }
+        else if (method == 1) {
+            for (size_t i = 0; i < n; ++i) {
+                tree.insert(tree.end(), items[i]);
+            }
+        }
+        else if (method == 2) {
+            typename AVLTree<Key, int>::iterator hint = tree.end();
+            for (size_t i = 0; i < n; ++i) {
+                hint = tree.insert(hint, items[i]);
+            }
+        }
+        else {
+            tree.append_sorted(items.begin(), items.end());
+        }
+        double ms = msSince(start);
+        printf("ingest,%zu,%s,%s,%s,%.3f,%.1f\n", n, keyType, order, methods[method],
+               ms, ms * 1e6 / n);
+    }
+}
+
+/*
+ * Ingesting keys in ascending order: plain insert, insert with end() as
+ * the hint, insert hinted with the iterator the previous call returned,
+ * and append_sorted. "nearly" shuffles the keys within windows of 8.
+ * String keys share a long prefix, so each comparison a hint saves is
+ * worth more than with ints.
+ */
+static void benchIngest()
+{
+    printf("suite,n,key,order,method,ms,ns_per_key\n");
+    const size_t n = 2000000;
+    vector<pair<int, int> > ints(n);
+    vector<pair<string, int> > strings(n);
+    for (size_t i = 0; i < n; ++i) {
+        char key[32];
+        snprintf(key, sizeof(key), "customer-%012zu", i);
+        ints[i] = make_pair(static_cast<int>(i), static_cast<int>(i));
+        strings[i] = make_pair(string(key), static_cast<int>(i));
+    }
+    benchIngestOrder("int", "sorted", ints);
+    benchIngestOrder("string", "sorted", strings);
+
+    mt19937 rng(23);
+    for (size_t i = 0; i + 8 <= n; i += 8) {
+        shuffle(ints.begin() + i, ints.begin() + i + 8, rng);
+        shuffle(strings.begin() + i, strings.begin() + i + 8, rng);
+    }
+    benchIngestOrder("int", "nearly", ints);
+    benchIngestOrder("string", "nearly", strings);
+
+    // Hinted ascending ingestion should cost the same per key at any size
+    const size_t sizes[] = {65536, 1000000, 8000000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        vector<pair<int, int> > ascending(sizes[s]);
+        for (size_t i = 0; i < sizes[s]; ++i) {
+            ascending[i] = make_pair(static_cast<int>(i), static_cast<int>(i));
+        }
+        benchIngestOrder("int", "sorted", ascending);
+    }
+}
+
+/*
+ * save and load of an int -> int AVLTree against rebuilding it with
+ * one insert per item, and against just reading the file's bytes (the
+ * I/O floor for load; the file is usually in the page cache here).
+ */
+static void benchSnapshot()
+{
+    printf("suite,n,op,ms,ns_per_key,mb_per_s\n");
+    const char* path = "bst-bench.snap";
+    const size_t n = 10000000;
+    AVLTree<int, int> tree;
+    buildEvenTree(tree, n);
+    double mb = static_cast<double>(n) * (sizeof(int) + sizeof(int)) / 1e6;
+
+    Clock::time_point start = Clock::now();
+    tree.save(path);
+    double ms = msSince(start);
+    printf("snapshot,%zu,save,%.3f,%.1f,%.0f\n", n, ms, ms * 1e6 / n, mb / ms * 1e3);
+
+    vector<char> bytes(static_cast<size_t>(mb * 1e6) + sizeof(SnapshotHeader));
+    start = Clock::now();
+    FILE* file = fopen(path, "rb");
+    size_t got = fread(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+    ms = msSince(start);
+    printf("snapshot,%zu,read_file,%.3f,%.1f,%.0f\n", n, ms, ms * 1e6 / n, mb / ms * 1e3);
+    if (got != bytes.size()) {
+        fprintf(stderr, "snapshot: short read\n");
+    }
+
+    {
+        AVLTree<int, int> loaded;
+        start = Clock::now();
+        loaded.load(path);
+        ms = msSince(start);
+        printf("snapshot,%zu,load,%.3f,%.1f,%.0f\n", n, ms, ms * 1e6 / n, mb / ms * 1e3);
+    }
+
+    {
+        AVLTree<int, int> rebuilt;
+        start = Clock::now();
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            rebuilt.insert(*it);
+        }
+        ms = msSince(start);
+        printf("snapshot,%zu,reinsert,%.3f,%.1f,%.0f\n", n, ms, ms * 1e6 / n, mb / ms * 1e3);
+    }
+    remove(path);
+}
+
+/*
+ * A file-backed MappedAVLTree against an in-memory AVLTree restored from
+ * a snapshot: time until the first lookup can be served, then lookups,
+ * inserts and sync on the reopened file. The file is in the page cache,
+ * so open-to-first-find shows the cost of the load step, not of disk.
+ */
+static void benchMapped()
+{
+    printf("suite,n,structure,op,ms,ns_per_op\n");
+    const char* mappedPath = "bst-bench.tree";
+    const char* snapshotPath = "bst-bench.snap";
+    const size_t n = 10000000;
+    const size_t ops = 1000000;
+    remove(mappedPath);
+    AVLTree<int, int> source;
+    buildEvenTree(source, n);
+    source.save(snapshotPath);
+    {
+        MappedAVLTree<int, int> built(mappedPath);
+        built.reserve(n + ops);
+        for (AVLTree<int, int>::iterator it = source.begin(); it != source.end(); ++it) {
+            built.insert(*it);
+        }
+    }
+    source.clear();
+
+    Clock::time_point start = Clock::now();
+    AVLTree<int, int> loaded;
+    loaded.load(snapshotPath);
+    long long sum = loaded.find(2)->second;
+    double ms = msSince(start);
+    printf("mapped,%zu,avl,load_to_first_find,%.3f,%.1f\n", n, ms, ms * 1e6);
+
+    start = Clock::now();
+    MappedAVLTree<int, int> mapped(mappedPath);
+    sum += mapped.find(2)->second;
+    ms = msSince(start);
+    printf("mapped,%zu,mapped,open_to_first_find,%.3f,%.1f\n", n, ms, ms * 1e6);
+
+    vector<int> probes = shuffledKeys(ops, 2 * static_cast<int>(n / ops), 0, 23);
+    start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        sum += loaded.find(probes[i])->second;
+    }
+    ms = msSince(start);
+    printf("mapped,%zu,avl,find,%.3f,%.1f\n", n, ms, ms * 1e6 / ops);
+
+    start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        sum += mapped.find(probes[i])->second;
+    }
+    ms = msSince(start);
+    printf("mapped,%zu,mapped,find,%.3f,%.1f\n", n, ms, ms * 1e6 / ops);
+
+    vector<int> fresh = shuffledKeys(ops, 2 * static_cast<int>(n / ops), 1, 29);
+    start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        loaded.insert(make_pair(fresh[i], 0));
+    }
+    ms = msSince(start);
+    printf("mapped,%zu,avl,insert,%.3f,%.1f\n", n, ms, ms * 1e6 / ops);
+
+    start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        mapped.insert(make_pair(fresh[i], 0));
+    }
+    ms = msSince(start);
+    printf("mapped,%zu,mapped,insert,%.3f,%.1f\n", n, ms, ms * 1e6 / ops);
+
+    start = Clock::now();
+    mapped.sync();
+    ms = msSince(start);
+    printf("mapped,%zu,mapped,sync,%.3f,%.1f\n", n, ms, ms * 1e6 / ops);
+
+    if (sum == 42) {
+        fprintf(stderr, "unlikely\n");
+    }
+    mapped.close();
+    remove(mappedPath);
+    remove(snapshotPath);
+}
+
+/*
+ * Logged inserts into a DurableAVLTree at several group-commit sizes,
+ * against plain AVLTree inserts, and against making a tree of the same
+ * size durable by saving a full snapshot. us_per_commit is what one
+ * write + fdatasync costs, the floor for the latency of a durable write.
+ */
+static void benchWal()
+{
+    printf("suite,group_records,ops,ms,ops_per_s,commits,us_per_commit\n");
+    const char* snapshotPath = "bst-bench.snap";
+    const char* logPath = "bst-bench.log";
+    const size_t maxOps = 200000;
+    vector<int> keys = shuffledKeys(maxOps, 1, 0, 31);
+
+    AVLTree<int, int> plain;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < maxOps; ++i) {
+        plain.insert(make_pair(keys[i], 0));
+    }
+    double ms = msSince(start);
+    printf("wal,none,%zu,%.3f,%.0f,0,0\n", maxOps, ms, maxOps / ms * 1e3);
+
+    const size_t groups[] = {1, 8, 64, 512, 4096};
+    for (size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); ++g) {
+        // Small groups are slow: enough ops for a few hundred commits
+        size_t ops = min(maxOps, groups[g] * 500);
+        remove(snapshotPath);
+        remove(logPath);
+        DurableAVLTree<int, int> tree(snapshotPath, logPath, groups[g], chrono::seconds(3600));
+        start = Clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            tree.insert(make_pair(keys[i], 0));
+        }
+        tree.commit();
+        ms = msSince(start);
+        printf("wal,%zu,%zu,%.3f,%.0f,%llu,%.1f\n", groups[g], ops, ms, ops / ms * 1e3,
+               static_cast<unsigned long long>(tree.commits()), ms * 1e3 / tree.commits());
+    }
+
+    {
+        start = Clock::now();
+        DurableAVLTree<int, int> tree(snapshotPath, logPath);
+        ms = msSince(start);
+        printf("wal,replay,%llu,%.3f,%.0f,0,0\n",
+               static_cast<unsigned long long>(tree.replayedRecords()), ms,
+               tree.replayedRecords() / ms * 1e3);
+    }
+
+    AVLTree<int, int> big;
+    buildEvenTree(big, 1000000);
+    start = Clock::now();
+    big.save(snapshotPath);
+    ms = msSince(start);
+    printf("wal,full_snapshot,%zu,%.3f,%.0f,1,%.1f\n", big.size(), ms, 1e3 / ms, ms * 1e3);
+    remove(snapshotPath);
+    remove(logPath);
+}
+
+/*
+ * The compare suite: BinarySearchTree, AVLTree and std::map doing the
+ * same operations on the same keys, over key orders, key/value types and
+ * sizes, one CSV row per (structure, types, order, n, op).
+ *
+ * Keys are made from ranks 0..n-1, in an order that is one of
+ *   uniform      each rank once, shuffled
+ *   sorted       ascending
+ *   reverse      descending
+ *   zipfian      n draws, theta 0.99, hot ranks scattered over the range
+ *   adversarial  zig-zag from both ends (0, n-1, 1, n-2, ...), a path in
+ *                a plain BST; an AVL rotates on every insert, about 5 in 8
+ *                of them double (BST_STATS: 0.62 double, 0.37 single)
+ * Each cell inserts the sequence, finds it again (a fresh draw for
+ * uniform and zipfian), iterates, removes the first half of it and
+ * clears the rest. p50/p99 come from timing every k-th operation alone,
+ * at most COMPARE_SAMPLES per cell, clock overhead included; iterate is
+ * sampled per step and clear, one operation, has none.
+ * Each tree's cell must also end with the counts std_map's does (see
+ * CompareCounts); a mismatch is reported on stderr and fails the suite.
+ *
+ * A plain BST is quadratic on the sorted, reverse and adversarial
+ * orders, so those cells are left out above BST_DEGENERATE_MAX.
+ */
+static const size_t COMPARE_SAMPLES = 100000;
+static const size_t BST_DEGENERATE_MAX = 20000;
+
+enum CompareOrder { UNIFORM, SORTED, REVERSE, ZIPFIAN, ADVERSARIAL };
+static const char* const compareOrderNames[] = {"uniform", "sorted", "reverse", "zipfian",
+                                                "adversarial"};
+
+/*
+ * Zipfian ranks over [0, n) after Gray et al., "Quickly generating
+ * billion-record synthetic databases": O(n) setup, O(1) per draw and
+ * no table, so it scales to 1e8.
+ */
+class ZipfianRanks
+{
+public:
+    ZipfianRanks(size_t n, double theta) : n_(n), theta_(theta)
+    {
+        double zeta2 = 1.0 + pow(0.5, theta);
+        zetan_ = 0;
+        for (size_t i = 1; i <= n; ++i) {
+            zetan_ += 1.0 / pow(static_cast<double>(i), theta);
+        }
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+    }
+
+    size_t operator()(mt19937_64& rng) const
+    {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, theta_)) {
+            return 1;
+        }
+        size_t rank = static_cast<size_t>(n_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+        return (rank < n_) ? rank : n_ - 1;
+    }
+
+private:
+    size_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+static vector<uint32_t> compareRanks(CompareOrder order, size_t n, unsigned seed)
+{
+    vector<uint32_t> ranks(n);
+    for (size_t i = 0; i < n; ++i) {
+        ranks[i] = static_cast<uint32_t>(i);
+    }
+    if (order == UNIFORM) {
+        mt19937 rng(seed);
+        shuffle(ranks.begin(), ranks.end(), rng);
+    }
+    else if (order == REVERSE) {
+        reverse(ranks.begin(), ranks.end());
+    }
+    else if (order == ADVERSARIAL) {
+        for (size_t i = 0; i < n; ++i) {
+            ranks[i] = static_cast<uint32_t>((i % 2 == 0) ? i / 2 : n - 1 - i / 2);
+        }
+    }
+    else if (order == ZIPFIAN) {
+        ZipfianRanks zipf(n, 0.99);
+        mt19937_64 rng(seed);
+        for (size_t i = 0; i < n; ++i) {
+            // An odd multiplier is a bijection mod 10^k, scattering the hot ranks
+            ranks[i] = static_cast<uint32_t>(zipf(rng) * 2654435761ull % n);
+        }
+    }
+    return ranks;
+}
+
+// Keys and values made from a rank, increasing with it
+template <typename T> struct CompareItem;
+
+template <> struct CompareItem<int>
+{
+    static const char* name() { return "int"; }
+    static int make(uint32_t rank) { return static_cast<int>(rank); }
+};
+
+template <> struct CompareItem<uint64_t>
+{
+    static const char* name() { return "u64"; }
+    static uint64_t make(uint32_t rank) { return (static_cast<uint64_t>(rank) << 24) | 0xABCDEF; }
+};
+
+// Past the short-string buffer, sharing a long prefix as real keys do
+template <> struct CompareItem<string>
+{
+    static const char* name() { return "string"; }
+    static string make(uint32_t rank)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "user:%016u", rank);
+        return string(text);
+    }
+};
+
+// The trees' remove under std::map's name, and vice versa
+template <typename Map, typename Key>
+static void compareRemove(Map& map, const Key& key)
+{
+    map.remove(key);
+}
+
+template <typename Key, typename Value>
+static void compareRemove(map<Key, Value>& map, const Key& key)
+{
+    map.erase(key);
+}
+
+template <typename Key, typename Value>
+static void compareInsert(map<Key, Value>& map, const pair<const Key, Value>& item)
+{
+    pair<typename std::map<Key, Value>::iterator, bool> result = map.insert(item);
+    if (!result.second) {
+        result.first->second = item.second;
+    }
+}
+
+template <typename Map, typename Key, typename Value>
+static void compareInsert(Map& map, const pair<const Key, Value>& item)
+{
+    map.insert(item);
+}
+
+struct CompareTiming
+{
+    double ms;
+    double p50;
+    double p99;
+};
+
+/*
+ * Runs op(i) for i in [0, ops), timing the whole loop and every stride-th
+ * call on its own.
+ */
+template <typename Op>
+static CompareTiming compareRun(size_t ops, Op op)
+{
+    size_t stride = max<size_t>(1, ops / COMPARE_SAMPLES);
+    vector<double> samples;
+    samples.reserve(ops / stride + 1);
+    size_t untilSample = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        if (untilSample == 0) {
+            Clock::time_point before = Clock::now();
+            op(i);
+            samples.push_back(chrono::duration<double, nano>(Clock::now() - before).count());
+            untilSample = stride;
+        }
+        else {
+            op(i);
+        }
+        --untilSample;
+    }
+    CompareTiming timing;
+    timing.ms = msSince(start);
+    timing.p50 = timing.p99 = 0;
+    if (!samples.empty()) {
+        size_t mid = samples.size() / 2;
+        nth_element(samples.begin(), samples.begin() + mid, samples.end());
+        timing.p50 = samples[mid];
+        size_t tail = samples.size() * 99 / 100;
+        nth_element(samples.begin(), samples.begin() + tail, samples.end());
+        timing.p99 = samples[tail];
+    }
+    return timing;
+}
+
+static void compareRow(const char* structure, const char* types, CompareOrder order, size_t n,
+    const char* op, size_t ops, const CompareTiming& timing, bool latency)
+{
+    printf("compare,%s,%s,%s,%zu,%s,%zu,%.3f,%.0f,", structure, types,
+           compareOrderNames[order], n, op, ops, timing.ms,
+           (timing.ms > 0) ? ops / timing.ms * 1e3 : 0.0);
+    if (latency) {
+        printf("%.0f,%.0f\n", timing.p50, timing.p99);
+    }
+    else {
+        printf(",\n");
+    }
+}
+
+/*
+ * What a cell saw, which every structure must agree on for the same
+ * order and types: the size after inserting, the keys found, the steps
+ * iteration took to reach end(), and the size after removing.
+ */
+struct CompareCounts
+{
+    size_t inserted;
+    size_t found;
+    size_t iterated;
+    size_t remaining;
+
+    bool operator==(const CompareCounts& other) const
+    {
+        return inserted == other.inserted && found == other.found &&
+               iterated == other.iterated && remaining == other.remaining;
+    }
+};
+
+template <typename Map, typename Key, typename Value>
+static CompareCounts compareCell(const char* structure, CompareOrder order, size_t n)
+{
+    char types[32];
+    snprintf(types, sizeof(types), "%s_%s", CompareItem<Key>::name(), CompareItem<Value>::name());
+    vector<uint32_t> ranks = compareRanks(order, n, 41);
+    vector<pair<Key, Value> > items(n);
+    for (size_t i = 0; i < n; ++i) {
+        items[i] = make_pair(CompareItem<Key>::make(ranks[i]), CompareItem<Value>::make(ranks[i]));
+    }
+
+    Map map;
+    CompareTiming timing = compareRun(n, [&](size_t i) {
+        compareInsert(map, pair<const Key, Value>(items[i].first, items[i].second));
+    });
+    compareRow(structure, types, order, n, "insert", n, timing, true);
+    CompareCounts counts;
+    counts.inserted = map.size();
+
+    if (order == UNIFORM || order == ZIPFIAN) {
+        vector<uint32_t> probeRanks = compareRanks(order, n, 43);
+        for (size_t i = 0; i < n; ++i) {
+            items[i].first = CompareItem<Key>::make(probeRanks[i]);
+        }
+    }
+    size_t found = 0;
+    timing = compareRun(n, [&](size_t i) {
+        found += (map.find(items[i].first) != map.end());
+    });
+    compareRow(structure, types, order, n, "find", n, timing, true);
+    counts.found = found;
+
+    typename Map::iterator it = map.begin();
+    size_t visited = map.size();
+    size_t defaults = 0;
+    timing = compareRun(visited, [&](size_t) {
+        defaults += (it->second == Value());
+        ++it;
+    });
+    compareRow(structure, types, order, n, "iterate", visited, timing, true);
+    counts.iterated = (it == map.end()) ? visited : 0;
+
+    timing = compareRun(n / 2, [&](size_t i) {
+        compareRemove(map, items[i].first);
+    });
+    compareRow(structure, types, order, n, "remove", n / 2, timing, true);
+    counts.remaining = map.size();
+
+    size_t left = map.size();
+    Clock::time_point start = Clock::now();
+    map.clear();
+    timing.ms = msSince(start);
+    compareRow(structure, types, order, n, "clear", left, timing, false);
+
+    if (defaults == 42) {
+        fprintf(stderr, "unlikely\n");
+    }
+    return counts;
+}
+
+static bool compareAgrees(const char* structure, const char* types, CompareOrder order,
+    size_t n, const CompareCounts& counts, const CompareCounts& expected)
+{
+    if (counts == expected) {
+        return true;
+    }
+    fprintf(stderr, "compare: %s %s %s n=%zu disagrees with std_map: "
+            "inserted %zu/%zu found %zu/%zu iterated %zu/%zu remaining %zu/%zu\n",
+            structure, types, compareOrderNames[order], n, counts.inserted, expected.inserted,
+            counts.found, expected.found, counts.iterated, expected.iterated,
+            counts.remaining, expected.remaining);
+    return false;
+}
+
+/*
+ * Every order for one pair of types, the trees checked against std_map;
+ * false if either disagrees.
+ */
+template <typename Key, typename Value>
+static bool compareTypes(size_t n)
+{
+    char types[32];
+    snprintf(types, sizeof(types), "%s_%s", CompareItem<Key>::name(), CompareItem<Value>::name());
+    bool agree = true;
+    for (int order = UNIFORM; order <= ADVERSARIAL; ++order) {
+        CompareOrder o = static_cast<CompareOrder>(order);
+        bool withBst = n <= BST_DEGENERATE_MAX || o == UNIFORM || o == ZIPFIAN;
+        CompareCounts bst = {0, 0, 0, 0};
+        if (withBst) {
+            bst = compareCell<BinarySearchTree<Key, Value>, Key, Value>("bst", o, n);
+        }
+        CompareCounts avl = compareCell<AVLTree<Key, Value>, Key, Value>("avl", o, n);
+        CompareCounts expected = compareCell<map<Key, Value>, Key, Value>("std_map", o, n);
+        if (withBst) {
+            agree = compareAgrees("bst", types, o, n, bst, expected) && agree;
+        }
+        agree = compareAgrees("avl", types, o, n, avl, expected) && agree;
+    }
+    return agree;
+}
+
+static bool benchCompare(size_t maxN)
+{
+    printf("suite,structure,types,order,n,op,ops,ms,ops_per_s,p50_ns,p99_ns\n");
+    bool agree = true;
+    for (size_t n = 1000; n <= maxN; n *= 10) {
+        agree = compareTypes<int, int>(n) && agree;
+        agree = compareTypes<uint64_t, uint64_t>(n) && agree;
+        agree = compareTypes<string, int>(n) && agree;
+    }
+    return agree;
+}
+
+/*
+ * Operation counts per key for the compare suite's orders, from the
+ * trees' own counters; all zero unless built with -DBST_STATS=1.
+ */
+template <typename Tree>
+static void statsOf(const char* structure, CompareOrder order, size_t n)
+{
+    vector<uint32_t> ranks = compareRanks(order, n, 41);
+    Tree tree;
+    for (size_t i = 0; i < n; ++i) {
+        tree.insert(make_pair(static_cast<int>(ranks[i]), 0));
+    }
+    TreeStats built = tree.stats();
+    tree.resetStats();
+    size_t found = 0;
+    for (size_t i = 0; i < n; ++i) {
+        found += (tree.find(static_cast<int>(ranks[i])) != tree.end());
+    }
+    TreeStats probed = tree.stats();
+    printf("stats,%s,%s,%zu,%.2f,%.2f,%.3f,%.3f,%.2f,%llu,%.2f,%.2f\n", structure,
+           compareOrderNames[order], n,
+           static_cast<double>(built.comparisons) / n,
+           static_cast<double>(built.nodesVisited) / n,
+           static_cast<double>(built.singleRotations) / n,
+           static_cast<double>(built.doubleRotations) / n,
+           built.retraces ? static_cast<double>(built.retraceSteps) / built.retraces : 0.0,
+           static_cast<unsigned long long>(built.longestRetrace),
+           static_cast<double>(probed.comparisons) / n, probed.averageLookupDepth());
+    if (found == 42) {
+        fprintf(stderr, "unlikely\n");
+    }
+}
+
+static void benchStats()
+{
+    if (!BST_STATS) {
+        fprintf(stderr, "stats: built without BST_STATS, counts are zero\n");
+    }
+    printf("suite,structure,order,n,insert_compares,insert_visits,single_rotations,"
+           "double_rotations,avg_retrace,longest_retrace,find_compares,avg_find_depth\n");
+    const size_t n = 100000;
+    for (int order = UNIFORM; order <= ADVERSARIAL; ++order) {
+        CompareOrder o = static_cast<CompareOrder>(order);
+        if (o == UNIFORM || o == ZIPFIAN) {
+            statsOf<BinarySearchTree<int, int> >("bst", o, n);
+        }
+        statsOf<AVLTree<int, int> >("avl", o, n);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char* suite = (argc > 1) ? argv[1] : "all";
+    bool all = strcmp(suite, "all") == 0;
+    bool ran = false;
+
+    if (all || strcmp(suite, "pool") == 0) {
+        benchPool();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "batch") == 0) {
+        benchBatch();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "engine") == 0) {
+        benchEngines();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "frozen") == 0) {
+        benchFrozen();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "concurrent") == 0) {
+        benchConcurrent();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "rcu") == 0) {
+        benchRcu();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "setops") == 0) {
+        benchSetOps();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "parallel") == 0) {
+        benchParallel();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "scan") == 0) {
+        benchScan();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "ingest") == 0) {
+        benchIngest();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "memory") == 0) {
+        benchMemory();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "snapshot") == 0) {
+        benchSnapshot();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "mapped") == 0) {
+        benchMapped();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "wal") == 0) {
+        benchWal();
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "compare") == 0) {
+        if (!benchCompare((argc > 2) ? static_cast<size_t>(strtod(argv[2], nullptr)) : 1000000)) {
+            return 1;
+        }
+        ran = true;
+    }
+
+    if (all || strcmp(suite, "stats") == 0) {
+        benchStats();
+        ran = true;
+    }
+
+    if (!ran) {
+        fprintf(stderr, "unknown suite: %s\n", suite);
+        return 1;
+    }
+    return 0;
+}
@@ -6,20 +6,35 @@
 #include <cstdlib>
 #include <stack>
 #include <utility>
+#include <type_traits>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include "node_pool.h"
+#include "fork_join.h"
+#include "frozen_map.h"
+#include "key_compare.h"
+#include "tree_snapshot.h"
+#include "tree_stats.h"
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing in a node is virtual, so nodes carry no vtable
+ * pointer and every link access can be inlined. Node types
+ * for other kinds of search trees, such as Red Black trees,
+ * Splay trees, and AVL trees, redeclare the getters to return
+ * their own type; trees create and destroy nodes through
+ * their createNode/destroyNode hooks, never through a Node*.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(Key&& key, Value&& value, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -27,14 +42,15 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
     std::pair<const Key, Value> item_;
@@ -62,6 +78,19 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* Constructor that moves the key and value into the node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Key&& key, Value&& value, Node<Key, Value>* parent) :
+    item_(std::move(key), std::move(value)),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
@@ -119,7 +148,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -128,7 +157,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -137,7 +166,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -181,6 +210,15 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* A setter that moves a new value into the node.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value)
+{
+    item_.second = std::move(value);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
@@ -189,29 +227,73 @@ void Node<Key, Value>::setValue(const Value& value)
 
 /**
 * A templated unbalanced binary search tree.
+* Keys are ordered by Compare, which may be a less-than predicate or a
+* three-way comparator (see key_compare.h).
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    explicit BinarySearchTree(std::size_t slabNodes, const Compare& comp = Compare());
+    template<typename InputIt, typename = typename std::enable_if<
+        !std::is_integral<InputIt>::value>::type>
+    BinarySearchTree(InputIt first, InputIt last, const Compare& comp = Compare());
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    template<typename P>
+    void insert(P&& keyValuePair);
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
-    bool isBalanced() const; //TODO
+    template<typename InputIt>
+    void bulk_load(InputIt first, InputIt last);
+
+    // clear, bulk_load and a visit of every item, with the work split
+    // at subtree boundaries across the threads of a pool.
+    void parallel_clear(WorkStealingPool& pool = WorkStealingPool::instance());
+    template<typename InputIt>
+    void parallel_bulk_load(InputIt first, InputIt last,
+        WorkStealingPool& pool = WorkStealingPool::instance());
+    template<typename Fn>
+    void parallel_for_each(Fn fn, WorkStealingPool& pool = WorkStealingPool::instance()) const;
+
+    // A checksummed binary copy of the items (see tree_snapshot.h).
+    // load replaces the contents, rebuilding a balanced tree in linear
+    // time; on any error it throws and leaves the tree as it was.
+    void save(const std::string& path) const;
+    void load(const std::string& path);
+    // isBalanced and height walk the whole tree, without recursion;
+    // AVLTree answers both from its stored heights. shape() is the full
+    // walk, gathering everything in one pass.
+    virtual bool isBalanced() const; //TODO
+    virtual int height() const;
+    TreeShape shape() const;
     void print() const;
     bool empty() const;
+    std::size_t size() const;
+    Compare key_comp() const;
+    // Operation counts (see tree_stats.h); all zero unless built with BST_STATS
+    TreeStats stats() const;
+    void resetStats();
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
 public:
+    class const_iterator;
+
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * Bidirectional: decrementing end() gives the largest item.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -221,24 +303,223 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare>;
+        friend class const_iterator;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree* tree = nullptr);
+        Node<Key, Value> *current_;
+        const BinarySearchTree* tree_;  // to step back from end()
+    };
+
+    /**
+    * As iterator, but giving read-only access to the values.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        const_iterator();
+        const_iterator(const iterator& other);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare>;
+        const_iterator(Node<Key,Value>* ptr, const BinarySearchTree* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree* tree_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * A forward iterator for full scans. It keeps the path of pending
+    * ancestors on an explicit stack instead of climbing parent pointers,
+    * and prefetches each pending node's right child as it is pushed, so
+    * that the child is in cache by the time the scan gets to it. Copying
+    * one copies the stack; prefer iterator for anything but a scan.
+    */
+    class scan_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        scan_iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const scan_iterator& rhs) const;
+        bool operator!=(const scan_iterator& rhs) const;
+
+        scan_iterator& operator++();
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare>;
+        explicit scan_iterator(Node<Key,Value>* root);
+        void pushLeft(Node<Key,Value>* node);
+        std::vector<Node<Key, Value>*> path_;
+    };
+
+    /**
+    * The whole tree in key order through scan_iterator, as returned by
+    * scan(). Usable directly in a range-based for loop.
+    */
+    class scan_view
+    {
+    public:
+        explicit scan_view(Node<Key,Value>* root);
+
+        scan_iterator begin() const;
+        scan_iterator end() const;
+
+    private:
+        Node<Key, Value>* root_;
+    };
+
+    /**
+    * The items with keys in [lo, hi), as returned by range(lo, hi).
+    * Usable directly in a range-based for loop.
+    */
+    class range_view
+    {
+    public:
+        range_view(iterator first, iterator last);
+
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    private:
+        iterator first_;
+        iterator last_;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
+    scan_view scan() const;
     iterator find(const Key& key) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
+    // Ordered lookups: one descent each, then plain iteration.
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    range_view range(const Key& lo, const Key& hi) const;
+
+    // Heterogeneous lookups, available when Compare::is_transparent
+    // exists: the probe is compared against keys without converting it.
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+
+    // An immutable, read-optimized copy of the current contents
+    FrozenMap<Key, Value, Compare> freeze() const;
+
+    // Move-aware insertion. Neither overwrites an existing key; the
+    // bool is true if a new node was created.
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+
+    // Insertion next to a known position, for keys that arrive in (or
+    // nearly in) order. Both overwrite an existing key's value.
+    iterator insert(iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    template<typename InputIt>
+    void append_sorted(InputIt first, InputIt last);
+
 protected:
+    // For derived trees whose nodes are larger than Node
+    BinarySearchTree(std::size_t nodeSize, std::size_t slabNodes, const Compare& comp);
+
+    /**
+    * Supplies the key and value of a node being inserted. The virtual
+    * insertion hook takes one of these rather than a finished pair so
+    * that arguments of any type reach the derived trees, and nothing
+    * is built until the descent shows the key is needed.
+    */
+    class ItemFactory
+    {
+    public:
+        virtual Key key() = 0;
+        virtual Value value() = 0;
+    protected:
+        ~ItemFactory() {}
+    };
+
+    template<typename KeyFn, typename ValueFn>
+    class LambdaItemFactory : public ItemFactory
+    {
+    public:
+        LambdaItemFactory(KeyFn keyFn, ValueFn valueFn) : keyFn_(keyFn), valueFn_(valueFn) {}
+        virtual Key key() { return keyFn_(); }
+        virtual Value value() { return valueFn_(); }
+    private:
+        KeyFn keyFn_;
+        ValueFn valueFn_;
+    };
+
+    template<typename KeyFn, typename ValueFn>
+    static LambdaItemFactory<KeyFn, ValueFn> makeItemFactory(KeyFn keyFn, ValueFn valueFn);
+
+    // Lets derived trees hand out iterators to their nodes
+    iterator makeIterator(Node<Key, Value>* node) const;
+
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalFind(const K& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalLowerBound(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* internalUpperBound(const K& key) const;
+    // One comparator call each, whichever kind Compare is
+    template<typename A, typename B>
+    bool keyLess(const A& a, const B& b) const;
+    template<typename A, typename B>
+    int keyCompare(const A& a, const B& b) const;
+    template<typename A, typename B>
+    bool keyEquivalent(const A& a, const B& b) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value>* getLargestNode() const;
+    Node<Key, Value>* cachedLargestNode();
+    void cacheLargestNode(Node<Key, Value>* node);
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
@@ -256,13 +537,77 @@ protected:
     virtual Node<Key, Value>* createNode(const Key& key, const Value& value, 
         Node<Key, Value>* parent
     );
-    int isBalancedHelper(Node<Key, Value>* node, bool& balanced) const;
+    virtual Node<Key, Value>* createNode(Key&& key, Value&& value,
+        Node<Key, Value>* parent
+    );
+    virtual void destroyNode(Node<Key, Value>* node);
+    template<typename NodeType, typename... Args>
+    NodeType* constructNode(Args&&... args);
+    // Construct and destroy in place, leaving the memory to the caller
+    virtual Node<Key, Value>* createNodeAt(void* block, Key&& key, Value&& value,
+        Node<Key, Value>* parent);
+    virtual void destructNode(Node<Key, Value>* node);
+
+    // Linear-time construction of a perfectly balanced tree
+    template<typename InputIt>
+    void bulkLoad(InputIt first, InputIt last, std::input_iterator_tag);
+    template<typename RandomIt>
+    void bulkLoad(RandomIt first, RandomIt last, std::random_access_iterator_tag);
+    template<typename RandomIt>
+    Node<Key, Value>* buildBalanced(RandomIt first, std::size_t count, Node<Key, Value>* parent);
+    template<typename ForwardIt>
+    bool isStrictlySorted(ForwardIt first, ForwardIt last) const;
+    void sortUnique(std::vector<std::pair<Key, Value> >& items) const;
+    virtual void refreshNode(Node<Key, Value>* node);
+    Node<Key, Value>* linkBalanced(Node<Key, Value>** nodes, std::size_t count,
+        Node<Key, Value>* parent);
+    void collectInOrder(std::vector<Node<Key, Value>*>& nodes) const;
+    void loadSnapshot(SnapshotReader& reader, std::true_type rawColumns);
+    void loadSnapshot(SnapshotReader& reader, std::false_type rawColumns);
+
+    // The parallel operations' recursions; forks counts the levels left
+    // to split across the pool.
+    template<typename InputIt>
+    void parallelLoad(InputIt first, InputIt last, WorkStealingPool& pool,
+        std::input_iterator_tag);
+    template<typename RandomIt>
+    void parallelLoad(RandomIt first, RandomIt last, WorkStealingPool& pool,
+        std::random_access_iterator_tag);
+    template<typename RandomIt>
+    void parallelBuild(RandomIt first, std::size_t count, WorkStealingPool& pool);
+    template<typename RandomIt>
+    Node<Key, Value>* buildParallel(RandomIt first, void** blocks, std::size_t count,
+        Node<Key, Value>* parent, int forks, WorkStealingPool& pool);
+    void destroySubtree(Node<Key, Value>* node, int forks, WorkStealingPool& pool);
+    template<typename Fn>
+    void visitSubtree(Node<Key, Value>* node, Fn& fn, int forks, WorkStealingPool& pool) const;
+
+    // Every insertion path ends here. Returns the node holding key and
+    // whether it was newly created; an existing value is replaced only
+    // if assign is true.
+    virtual std::pair<Node<Key, Value>*, bool> insertUnique(const Key& key,
+        ItemFactory& item, bool assign);
+    std::pair<Node<Key, Value>*, bool> insertNear(Node<Key, Value>* hint, const Key& key,
+        ItemFactory& item, bool assign);
+    // Creates a node from item as the given child of parent (or as the
+    // root if parent is null); derived trees rebalance from there.
+    virtual Node<Key, Value>* linkNode(Node<Key, Value>* parent, bool isLeft, ItemFactory& item);
+    template<typename... Args>
+    std::pair<Node<Key, Value>*, bool> emplaceItem(bool assign, Args&&... args);
+    static int maxBalancedHeight(std::size_t nodes);
     static Node<Key, Value>* successor(Node<Key, Value>* current);
 
 
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+    NodePool pool_;
+    Compare comp_;
+    mutable TreeCounters counters_;
+    // getLargestNode() as of pool_.generation() largestAt_, for hinted
+    // inserts at the end; see cachedLargestNode.
+    Node<Key, Value>* largest_;
+    std::uint64_t largestAt_;
 };
 
 /*
@@ -273,9 +618,13 @@ Begin implementations for the BinarySearchTree::iterator class.
 
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
+* tree is only needed to decrement the iterator from end().
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr) : current_(ptr) 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr,
+    const BinarySearchTree* tree) :
+    current_(ptr),
+    tree_(tree)
 {
 
 }
@@ -283,8 +632,10 @@ BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr) : current
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() : current_(nullptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator() :
+    current_(nullptr),
+    tree_(nullptr)
 {
 
 }
@@ -292,9 +643,9 @@ BinarySearchTree<Key, Value>::iterator::iterator() : current_(nullptr)
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -302,9 +653,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -313,10 +664,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     return current_ == rhs.current_;
 
@@ -326,10 +677,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     return !(*this == rhs);
 
@@ -339,15 +690,49 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
-    current_ = BinarySearchTree<Key, Value>::successor(current_);
+    current_ = BinarySearchTree<Key, Value, Compare>::successor(current_);
     return *this;
 
 }
 
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator previous(*this);
+    ++(*this);
+    return previous;
+}
+
+/**
+* Moves the iterator back one item; from end() that is the largest item.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator--()
+{
+    if (current_ == nullptr) {
+        current_ = tree_->getLargestNode();
+    }
+    else {
+        current_ = BinarySearchTree<Key, Value, Compare>::predecessor(current_);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator previous(*this);
+    --(*this);
+    return previous;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -356,202 +741,1017 @@ End implementations for the BinarySearchTree::iterator class.
 */
 
 /*
------------------------------------------------------
-Begin implementations for the BinarySearchTree class.
------------------------------------------------------
+-------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+-------------------------------------------------------------------
 */
 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator(Node<Key,Value> *ptr,
+    const BinarySearchTree* tree) :
+    current_(ptr),
+    tree_(tree)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator() :
+    current_(nullptr),
+    tree_(nullptr)
+{
+
+}
+
 /**
-* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* Any iterator converts to a const_iterator at the same item.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() : root_(nullptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator(const iterator& other) :
+    current_(other.current_),
+    tree_(other.tree_)
 {
 
+}
 
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator*() const
+{
+    return current_->getItem();
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator->() const
 {
-    clear();
+    return &(current_->getItem());
+}
 
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return current_ == rhs.current_;
 }
 
-/**
- * Returns true if tree is empty
-*/
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
 {
-    return root_ == NULL;
+    return !(*this == rhs);
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++()
 {
-    printRoot(root_);
-    std::cout << "\n";
+    current_ = BinarySearchTree<Key, Value, Compare>::successor(current_);
+    return *this;
 }
 
-/**
-* Returns an iterator to the "smallest" item in the tree
-*/
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++(int)
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
+    const_iterator previous(*this);
+    ++(*this);
+    return previous;
 }
 
-/**
-* Returns an iterator whose value means INVALID
-*/
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--()
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
-    return end;
+    if (current_ == nullptr) {
+        current_ = tree_->getLargestNode();
+    }
+    else {
+        current_ = BinarySearchTree<Key, Value, Compare>::predecessor(current_);
+    }
+    return *this;
 }
 
-/**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
-*/
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--(int)
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    const_iterator previous(*this);
+    --(*this);
+    return previous;
 }
 
-/**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+/*
+-----------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+-----------------------------------------------------------------
+*/
+
+/*
+------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::scan_iterator class.
+------------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::scan_iterator::scan_iterator()
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+
+/**
+* Starts at the smallest item under root. The stack never holds more
+* than the tree height, so it is sized for that once, here.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::scan_iterator::scan_iterator(Node<Key,Value>* root)
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    path_.reserve(64);
+    pushLeft(root);
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* Pushes node and its chain of left children. A pushed node's right
+* subtree is visited only after everything on its left, so its root is
+* prefetched now, while there is work left to overlap the miss with.
 */
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair) {
-    // If tree is empty, create new root node
-    if (root_ == nullptr) {
-        root_ = createNode(keyValuePair.first, keyValuePair.second, nullptr);  // Uses overridden method    
-        return;
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::scan_iterator::pushLeft(Node<Key,Value>* node)
+{
+    while (node != nullptr) {
+        Node<Key, Value>* right = node->getRight();
+        if (right != nullptr) {
+            __builtin_prefetch(right);
+        }
+        path_.push_back(node);
+        node = node->getLeft();
     }
+}
 
-    Node<Key, Value>* current = root_;
-    Node<Key, Value>* parent = nullptr;
+template<class Key, class Value, class Compare>
+std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare>::scan_iterator::operator*() const
+{
+    return path_.back()->getItem();
+}
 
-    // Search for the key in the tree
-    while (current != nullptr) {
-        parent = current;
-        if (keyValuePair.first < current->getKey()) {
-            current = current->getLeft();
-        } 
-        else if (keyValuePair.first > current->getKey()) {
-            current = current->getRight();
-        }
-        else {
-            // Key already exists - update the value
-            current->setValue(keyValuePair.second);
-            return;
-        }
-    }
+template<class Key, class Value, class Compare>
+std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare>::scan_iterator::operator->() const
+{
+    return &(path_.back()->getItem());
+}
 
-    // Reached insertion point
-    Node<Key, Value>* newNode = createNode(keyValuePair.first, keyValuePair.second, parent);
-    if (keyValuePair.first < parent->getKey()) {
-        parent->setLeft(newNode);
-    } 
-    else {
-        parent->setRight(newNode);
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::scan_iterator::operator==(const scan_iterator& rhs) const
+{
+    if (path_.empty() || rhs.path_.empty()) {
+        return path_.empty() && rhs.path_.empty();
     }
+    return path_.back() == rhs.path_.back();
 }
 
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::scan_iterator::operator!=(const scan_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
 
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* Pops the current node and descends into its right subtree, which was
+* prefetched when the node was pushed. Amortized O(1), and no parent
+* pointer is ever read.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::scan_iterator&
+BinarySearchTree<Key, Value, Compare>::scan_iterator::operator++()
 {
-    Node<Key, Value>* nodeToRemove = internalFind(key);
-    if (nodeToRemove == nullptr) {
-        return;
-    }
+    Node<Key, Value>* node = path_.back();
+    path_.pop_back();
+    pushLeft(node->getRight());
+    return *this;
+}
 
-    // Case 1: Node has no children
-    if (nodeToRemove->getLeft() == nullptr && nodeToRemove->getRight() == nullptr) {
-        removeNoChild(nodeToRemove);
-    }
-    // Case 2: Node has one child
-    else if (nodeToRemove->getLeft() == nullptr || nodeToRemove->getRight() == nullptr) {
-        removeOneChild(nodeToRemove);
-    }
-    // Case 3: Node has two children, swap with predecessor
-    else {
-        Node<Key, Value>* pred = predecessor(nodeToRemove);
-        nodeSwap(nodeToRemove, pred);
-        
-        //Node has no children
-        if (nodeToRemove->getLeft() == nullptr && nodeToRemove->getRight() == nullptr) {
-            removeNoChild(nodeToRemove);
-        }
+/*
+----------------------------------------------------------------
+End implementations for the BinarySearchTree::scan_iterator class.
+----------------------------------------------------------------
+*/
+
+/*
+--------------------------------------------------------------
+Begin implementations for the BinarySearchTree::scan_view class.
+--------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::scan_view::scan_view(Node<Key,Value>* root) :
+    root_(root)
+{
 
-        //Node has one child
-        else if (nodeToRemove->getLeft() == nullptr || nodeToRemove->getRight() == nullptr) {
-            removeOneChild(nodeToRemove);
-        }
-    }
 }
 
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::createNode(const Key& key, const Value& value, 
-    Node<Key, Value>* parent) 
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::scan_iterator
+BinarySearchTree<Key, Value, Compare>::scan_view::begin() const
 {
-    return new Node<Key, Value>(key, value, parent); 
+    return scan_iterator(root_);
 }
 
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::scan_iterator
+BinarySearchTree<Key, Value, Compare>::scan_view::end() const
 {
-    if (current == nullptr) {
-        return nullptr;
-    }
+    return scan_iterator();
+}
 
-    // Case 1: Left child exists, predecessor is rightmost in left subtree
-    if (current->getLeft() != nullptr) {
-        Node<Key, Value>* pred= current->getLeft();
-        while (pred->getRight() != nullptr) {
-            pred = pred->getRight();
-        }
-        return pred;
-    }
+/*
+------------------------------------------------------------
+End implementations for the BinarySearchTree::scan_view class.
+------------------------------------------------------------
+*/
+
+/*
+---------------------------------------------------------------
+Begin implementations for the BinarySearchTree::range_view class.
+---------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::range_view::range_view(iterator first, iterator last) :
+    first_(first),
+    last_(last)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::range_view::begin() const
+{
+    return first_;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::range_view::end() const
+{
+    return last_;
+}
+
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::range_view::empty() const
+{
+    return first_ == last_;
+}
+
+/*
+-------------------------------------------------------------
+End implementations for the BinarySearchTree::range_view class.
+-------------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------------
+Begin implementations for the BinarySearchTree class.
+-----------------------------------------------------
+*/
+
+/**
+* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* Nodes are allocated from slabs of NodePool::DEFAULT_SLAB_NODES.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree() :
+    root_(nullptr),
+    pool_(sizeof(Node<Key, Value>), NodePool::DEFAULT_SLAB_NODES),
+    comp_(),
+    largest_(nullptr),
+    largestAt_(0)
+{
+
+
+}
+
+/**
+* Constructor that picks the node allocation policy: nodes are carved
+* from slabs of slabNodes nodes, or individually heap allocated if
+* slabNodes is 0.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(std::size_t slabNodes,
+    const Compare& comp) :
+    root_(nullptr),
+    pool_(sizeof(Node<Key, Value>), slabNodes),
+    comp_(comp),
+    largest_(nullptr),
+    largestAt_(0)
+{
+
+}
+
+/**
+* Range constructor; see bulk_load.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIt, typename>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(InputIt first, InputIt last,
+    const Compare& comp) :
+    root_(nullptr),
+    pool_(sizeof(Node<Key, Value>), NodePool::DEFAULT_SLAB_NODES),
+    comp_(comp),
+    largest_(nullptr),
+    largestAt_(0)
+{
+    bulk_load(first, last);
+}
+
+/**
+* Constructor for derived trees, which size the pool for their own nodes.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(std::size_t nodeSize,
+    std::size_t slabNodes, const Compare& comp) :
+    root_(nullptr),
+    pool_(nodeSize, slabNodes),
+    comp_(comp),
+    largest_(nullptr),
+    largestAt_(0)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
+{
+    clear();
+
+}
+
+/**
+ * Returns true if tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
+{
+    return root_ == NULL;
+}
+
+/**
+* Returns the number of items in the tree in O(1); every node is one
+* live block in the pool.
+*/
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::size() const
+{
+    return pool_.liveCount();
+}
+
+/**
+* Returns a copy of the comparator that orders the keys.
+*/
+template<class Key, class Value, class Compare>
+Compare BinarySearchTree<Key, Value, Compare>::key_comp() const
+{
+    return comp_;
+}
+
+template<typename Key, typename Value, typename Compare>
+TreeStats BinarySearchTree<Key, Value, Compare>::stats() const
+{
+    return counters_.stats();
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::resetStats()
+{
+    counters_.reset();
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
+{
+    printRoot(root_);
+    std::cout << "\n";
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator begin(getSmallestNode(), this);
+    return begin;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::makeIterator(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator end(NULL, this);
+    return end;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cbegin() const
+{
+    return const_iterator(getSmallestNode(), this);
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cend() const
+{
+    return const_iterator(nullptr, this);
+}
+
+/**
+* Returns a reverse iterator to the largest item in the tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns a view for a fast full scan in key order; see scan_iterator.
+* The view is invalidated by any change to the tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::scan_view
+BinarySearchTree<Key, Value, Compare>::scan() const
+{
+    return scan_view(root_);
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
+{
+    Node<Key, Value> *curr = internalFind(k);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr, this);
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(internalUpperBound(key), this);
+}
+
+/**
+* Returns the (possibly empty) range of items whose key equals key.
+* Keys are unique, so this takes the lower bound and, if it matches,
+* steps once past it.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator,
+          typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const Key& key) const
+{
+    iterator first(internalLowerBound(key), this);
+    iterator last(first);
+    if (first != end() && !keyLess(key, first->first)) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Returns a view of the items with lo <= key < hi, found in O(log n)
+* and iterated in O(k).
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::range_view
+BinarySearchTree<Key, Value, Compare>::range(const Key& lo, const Key& hi) const
+{
+    if (!keyLess(lo, hi)) {
+        return range_view(end(), end());
+    }
+    return range_view(iterator(internalLowerBound(lo), this),
+                      iterator(internalLowerBound(hi), this));
+}
+
+/**
+* Heterogeneous find: key may be any type Compare accepts alongside Key.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K& key) const
+{
+    return iterator(internalFind(key), this);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const K& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const K& key) const
+{
+    return iterator(internalUpperBound(key), this);
+}
+
+/**
+* Returns a FrozenMap holding a copy of every item. The snapshot is
+* independent of this tree: later changes here do not affect it, and
+* it stays valid after the tree is destroyed.
+*/
+template<class Key, class Value, class Compare>
+FrozenMap<Key, Value, Compare> BinarySearchTree<Key, Value, Compare>::freeze() const
+{
+    return FrozenMap<Key, Value, Compare>(begin(), end(), comp_);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair) {
+    auto item = makeItemFactory(
+        [&]() { return keyValuePair.first; },
+        [&]() { return keyValuePair.second; });
+    insertUnique(keyValuePair.first, item, true);  // Uses overridden method
+}
+
+/**
+* Inserts any pair-like argument (e.g. a std::pair<Key, Value> from
+* std::make_pair), moving from it when it is an rvalue. Like the
+* other insert, an existing key has its value overwritten.
+*/
+template<typename Key, typename Value, typename Compare>
+template <typename P>
+void BinarySearchTree<Key, Value, Compare>::insert(P&& keyValuePair) {
+    emplaceItem(true, std::forward<P>(keyValuePair));
+}
+
+/**
+* Builds a (key, value) pair from args and moves it into the tree if
+* the key is not already present.
+*/
+template<typename Key, typename Value, typename Compare>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::emplace(Args&&... args) {
+    std::pair<Node<Key, Value>*, bool> result = emplaceItem(false, std::forward<Args>(args)...);
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+/**
+* Inserts key with a value constructed from args, unless the key is
+* already present, in which case neither key nor args are touched.
+*/
+template<typename Key, typename Value, typename Compare>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(const Key& key, Args&&... args) {
+    auto item = makeItemFactory(
+        [&]() { return key; },
+        [&]() { return Value(std::forward<Args>(args)...); });
+    std::pair<Node<Key, Value>*, bool> result = insertUnique(key, item, false);
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+template<typename Key, typename Value, typename Compare>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(Key&& key, Args&&... args) {
+    auto item = makeItemFactory(
+        [&]() { return std::move(key); },
+        [&]() { return Value(std::forward<Args>(args)...); });
+    std::pair<Node<Key, Value>*, bool> result = insertUnique(key, item, false);
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+/**
+* Inserts keyValuePair as close as possible to hint, and returns an
+* iterator to it. If the key goes just before or just after hint, the
+* root-to-leaf descent is skipped, so feeding each call the iterator
+* the last one returned ingests ascending or descending keys in O(1)
+* comparisons each. Ascending keys hinted with end() or with the last
+* node also skip the walk to the largest node, and cost amortized O(1)
+* plus the rebalancing. A wrong hint costs a normal insert.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(iterator hint,
+    const std::pair<const Key, Value>& keyValuePair) {
+    auto item = makeItemFactory(
+        [&]() { return keyValuePair.first; },
+        [&]() { return keyValuePair.second; });
+    return iterator(insertNear(hint.current_, keyValuePair.first, item, true).first, this);
+}
+
+/**
+* Inserts [first, last), which should be in increasing key order. Each
+* item greater than every key so far is linked straight in as the right
+* child of the current largest node (which never has one), so an
+* ascending stream costs one comparison per item plus the rebalancing.
+* Items out of order are still inserted, through the normal path.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare>::append_sorted(InputIt first, InputIt last) {
+    Node<Key, Value>* largest = cachedLargestNode();
+    for (; first != last; ++first) {
+        const auto& keyValuePair = *first;
+        auto item = makeItemFactory(
+            [&]() { return keyValuePair.first; },
+            [&]() { return keyValuePair.second; });
+        if (largest == nullptr || keyLess(largest->getKey(), keyValuePair.first)) {
+            largest = linkNode(largest, false, item);
+        }
+        else {
+            insertUnique(keyValuePair.first, item, true);
+        }
+    }
+    cacheLargestNode(largest);
+}
+
+/**
+* Shared body of insert(P&&) and emplace: the pair is built once on the
+* stack, then its key and value are moved into the node.
+*/
+template<typename Key, typename Value, typename Compare>
+template <typename... Args>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::emplaceItem(bool assign, Args&&... args) {
+    std::pair<Key, Value> keyValuePair(std::forward<Args>(args)...);
+    auto item = makeItemFactory(
+        [&]() { return std::move(keyValuePair.first); },
+        [&]() { return std::move(keyValuePair.second); });
+    return insertUnique(keyValuePair.first, item, assign);
+}
+
+template<typename Key, typename Value, typename Compare>
+template <typename KeyFn, typename ValueFn>
+typename BinarySearchTree<Key, Value, Compare>::template LambdaItemFactory<KeyFn, ValueFn>
+BinarySearchTree<Key, Value, Compare>::makeItemFactory(KeyFn keyFn, ValueFn valueFn) {
+    return LambdaItemFactory<KeyFn, ValueFn>(keyFn, valueFn);
+}
+
+/**
+* Finds key, or the leaf position where it belongs and creates a node
+* there from item. The side of the parent is decided during the descent,
+* so the key is not read again once item has been consumed.
+*
+* Each level costs one comparator call. A three-way comparator stops at
+* an equal key; with a less-than predicate the descent always runs to a
+* leaf, remembering the last node it passed on the left (the largest
+* key not greater than key), and one more call at the end tells whether
+* that node holds key. Scalar keys keep the plain two-test descent: a
+* compare is cheaper than the cold extra levels down to a leaf.
+*/
+template<typename Key, typename Value, typename Compare>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::insertUnique(const Key& key, ItemFactory& item, bool assign) {
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* parent = nullptr;
+    Node<Key, Value>* match = nullptr;
+    bool isLeft = false;
+    TreeCounters::Descent descent(counters_, TreeCounters::INSERT);
+
+    // Search for the key in the tree
+    if (IsThreeWayCompare<Compare, Key, Key>::value) {
+        while (current != nullptr) {
+            descent.visit();
+            parent = current;
+            int order = keyCompare(key, current->getKey());
+            if (order == 0) {
+                match = current;
+                break;
+            }
+            isLeft = order < 0;
+            current = isLeft ? current->getLeft() : current->getRight();
+        }
+    }
+    else if (std::is_scalar<Key>::value) {
+        while (current != nullptr) {
+            descent.visit();
+            parent = current;
+            if (keyLess(key, current->getKey())) {
+                isLeft = true;
+                current = current->getLeft();
+            }
+            else if (keyLess(current->getKey(), key)) {
+                isLeft = false;
+                current = current->getRight();
+            }
+            else {
+                match = current;
+                break;
+            }
+        }
+    }
+    else {
+        while (current != nullptr) {
+            descent.visit();
+            parent = current;
+            isLeft = keyLess(key, current->getKey());
+            if (isLeft) {
+                current = current->getLeft();
+            }
+            else {
+                match = current;
+                current = current->getRight();
+            }
+        }
+        if (match != nullptr && keyLess(match->getKey(), key)) {
+            match = nullptr;
+        }
+    }
+
+    if (match != nullptr) {
+        // Key already exists - update the value
+        if (assign) {
+            match->setValue(item.value());
+        }
+        return std::make_pair(match, false);
+    }
+
+    // Reached insertion point (or the tree was empty)
+    return std::make_pair(linkNode(parent, isLeft, item), true);
+}
+
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::linkNode(Node<Key, Value>* parent, bool isLeft, ItemFactory& item) {
+    Node<Key, Value>* newNode = createNode(item.key(), item.value(), parent);
+    if (parent == nullptr) {
+        root_ = newNode;
+    }
+    else if (isLeft) {
+        parent->setLeft(newNode);
+    }
+    else {
+        parent->setRight(newNode);
+    }
+    return newNode;
+}
+
+/**
+* Inserts key right next to hint (or after the largest key if hint is
+* null) when it belongs there, which takes one or two comparisons and a
+* short walk to hint's neighbour instead of a descent from the root.
+* Anywhere else it falls back to insertUnique. Appending after the
+* largest node, hinted with null or with that node, uses the cached
+* largest node (see cachedLargestNode), so it walks neither down to it
+* nor up from it looking for a successor.
+*
+* A new key between hint and a neighbour always has a free slot: the
+* left of hint or the right of its predecessor when it goes before,
+* the right of hint or the left of its successor when it goes after.
+*/
+template<typename Key, typename Value, typename Compare>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::insertNear(Node<Key, Value>* hint, const Key& key,
+    ItemFactory& item, bool assign) {
+    if (root_ == nullptr) {
+        return std::make_pair(linkNode(nullptr, false, item), true);
+    }
+    if (hint == nullptr) {
+        Node<Key, Value>* last = cachedLargestNode();
+        if (keyLess(last->getKey(), key)) {
+            Node<Key, Value>* newNode = linkNode(last, false, item);
+            cacheLargestNode(newNode);
+            return std::make_pair(newNode, true);
+        }
+    }
+    else if (keyLess(key, hint->getKey())) {
+        Node<Key, Value>* before = predecessor(hint);
+        if (before == nullptr || keyLess(before->getKey(), key)) {
+            if (hint->getLeft() == nullptr) {
+                return std::make_pair(linkNode(hint, true, item), true);
+            }
+            return std::make_pair(linkNode(before, false, item), true);
+        }
+    }
+    else if (keyLess(hint->getKey(), key)) {
+        bool largest = hint == largest_ && largestAt_ == pool_.generation();
+        Node<Key, Value>* after = largest ? nullptr : successor(hint);
+        if (after == nullptr || keyLess(key, after->getKey())) {
+            if (hint->getRight() == nullptr) {
+                Node<Key, Value>* newNode = linkNode(hint, false, item);
+                if (after == nullptr) {
+                    cacheLargestNode(newNode);
+                }
+                return std::make_pair(newNode, true);
+            }
+            return std::make_pair(linkNode(after, true, item), true);
+        }
+    }
+    else {
+        if (assign) {
+            hint->setValue(item.value());
+        }
+        return std::make_pair(hint, false);
+    }
+    return insertUnique(key, item, assign);
+}
+
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key)
+{
+    Node<Key, Value>* nodeToRemove = internalFind(key);
+    if (nodeToRemove == nullptr) {
+        return;
+    }
+
+    // Case 1: Node has no children
+    if (nodeToRemove->getLeft() == nullptr && nodeToRemove->getRight() == nullptr) {
+        removeNoChild(nodeToRemove);
+    }
+    // Case 2: Node has one child
+    else if (nodeToRemove->getLeft() == nullptr || nodeToRemove->getRight() == nullptr) {
+        removeOneChild(nodeToRemove);
+    }
+    // Case 3: Node has two children, swap with predecessor
+    else {
+        Node<Key, Value>* pred = predecessor(nodeToRemove);
+        nodeSwap(nodeToRemove, pred);
+        
+        //Node has no children
+        if (nodeToRemove->getLeft() == nullptr && nodeToRemove->getRight() == nullptr) {
+            removeNoChild(nodeToRemove);
+        }
+
+        //Node has one child
+        else if (nodeToRemove->getLeft() == nullptr || nodeToRemove->getRight() == nullptr) {
+            removeOneChild(nodeToRemove);
+        }
+    }
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::createNode(const Key& key, const Value& value, 
+    Node<Key, Value>* parent) 
+{
+    return constructNode<Node<Key, Value> >(key, value, parent);
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::createNode(Key&& key, Value&& value,
+    Node<Key, Value>* parent)
+{
+    return constructNode<Node<Key, Value> >(std::move(key), std::move(value), parent);
+}
+
+/**
+* Constructs a node of the given type in a block from the pool.
+*/
+template<class Key, class Value, class Compare>
+template<typename NodeType, typename... Args>
+NodeType* BinarySearchTree<Key, Value, Compare>::constructNode(Args&&... args)
+{
+    static_assert(!std::is_polymorphic<NodeType>::value, "nodes must not carry a vtable");
+    void* block = pool_.allocate();
+    counters_.allocated(1);
+    try {
+        return new (block) NodeType(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        pool_.deallocate(block);
+        throw;
+    }
+}
+
+/**
+* Constructs a node in a block the caller got from the pool.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::createNodeAt(void* block, Key&& key,
+    Value&& value, Node<Key, Value>* parent)
+{
+    return new (block) Node<Key, Value>(std::move(key), std::move(value), parent);
+}
+
+/**
+* Destroys a node but keeps its memory, for the caller to recycle.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::destructNode(Node<Key, Value>* node)
+{
+    node->~Node<Key, Value>();
+}
+
+/**
+* Destroys a node made by createNode and hands its memory back to the pool.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    node->~Node<Key, Value>();
+    pool_.deallocate(node);
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
+{
+    if (current == nullptr) {
+        return nullptr;
+    }
+
+    // Case 1: Left child exists, predecessor is rightmost in left subtree
+    if (current->getLeft() != nullptr) {
+        Node<Key, Value>* pred= current->getLeft();
+        while (pred->getRight() != nullptr) {
+            pred = pred->getRight();
+        }
+        return pred;
+    }
     // Case 2: No left child
     else {
         Node<Key, Value>* parent = current->getParent();
@@ -565,8 +1765,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* cu
     }
 }
 
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* node) {
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::successor(Node<Key, Value>* node) {
     if (node->getRight() != nullptr) {
         // Case 1: Right child exists
         Node<Key, Value>* current = node->getRight();
@@ -586,8 +1786,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* node
     }
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::removeNoChild(Node<Key, Value>* nodeToRemove) {
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::removeNoChild(Node<Key, Value>* nodeToRemove) {
     if (nodeToRemove == root_){
         root_ = nullptr;
     } 
@@ -601,11 +1801,11 @@ void BinarySearchTree<Key, Value>::removeNoChild(Node<Key, Value>* nodeToRemove)
             nodeToRemove->getParent()->setRight(nullptr);
         }
     }
-    delete nodeToRemove;
+    destroyNode(nodeToRemove);
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::removeOneChild(Node<Key, Value>* nodeToRemove){
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::removeOneChild(Node<Key, Value>* nodeToRemove){
     Node<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? 
                                     nodeToRemove->getLeft() : nodeToRemove->getRight();
     if (nodeToRemove == root_) {
@@ -623,15 +1823,24 @@ void BinarySearchTree<Key, Value>::removeOneChild(Node<Key, Value>* nodeToRemove
         }
         child->setParent(nodeToRemove->getParent());
     }
-    delete nodeToRemove;
+    destroyNode(nodeToRemove);
 }
 
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
+* Pooled nodes with trivially destructible keys and values are
+* released a whole slab at a time without walking the tree.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear() {
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear() {
+    if (pool_.pooled() && std::is_trivially_destructible<Key>::value
+        && std::is_trivially_destructible<Value>::value) {
+        pool_.release();
+        root_ = nullptr;
+        return;
+    }
+
     std::stack<Node<Key, Value>*> nodes;
     if (root_ != nullptr) {
         nodes.push(root_);
@@ -650,17 +1859,441 @@ void BinarySearchTree<Key, Value>::clear() {
             nodes.push(current->getRight());
         }
 
-        delete current;
+        destroyNode(current);
+    }
+    pool_.release();
+    root_ = nullptr;
+}
+
+
+/**
+* clear() with the nodes destroyed in parallel, one subtree per task.
+* No task returns memory to the (single-threaded) node pool: blocks are
+* discarded and the pool is released in one go at the end.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::parallel_clear(WorkStealingPool& pool)
+{
+    if (!pool_.pooled() || !std::is_trivially_destructible<Key>::value
+        || !std::is_trivially_destructible<Value>::value) {
+        destroySubtree(root_, forkDepth(pool), pool);
     }
+    pool_.release();
     root_ = nullptr;
 }
 
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroySubtree(Node<Key, Value>* node, int forks,
+    WorkStealingPool& pool)
+{
+    if (node != nullptr && forks > 0) {
+        Node<Key, Value>* left = node->getLeft();
+        Node<Key, Value>* right = node->getRight();
+        forkJoin(&pool,
+            [&]() { destroySubtree(left, forks - 1, pool); },
+            [&]() { destroySubtree(right, forks - 1, pool); });
+        destructNode(node);
+        pool_.discard(node);
+        return;
+    }
+
+    std::vector<Node<Key, Value>*> nodes;
+    if (node != nullptr) {
+        nodes.push_back(node);
+    }
+    while (!nodes.empty()) {
+        Node<Key, Value>* current = nodes.back();
+        nodes.pop_back();
+        if (current->getLeft() != nullptr) {
+            nodes.push_back(current->getLeft());
+        }
+        if (current->getRight() != nullptr) {
+            nodes.push_back(current->getRight());
+        }
+        destructNode(current);
+        pool_.discard(current);
+    }
+}
+
+/**
+* bulk_load with the nodes built and linked in parallel, one subtree
+* per task. Blocks for every node are taken from the pool first, so the
+* tasks never touch the allocator. Items whose conversion to Key or
+* Value might throw are loaded serially, as bulk_load does.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare>::parallel_bulk_load(InputIt first, InputIt last,
+    WorkStealingPool& pool)
+{
+    parallel_clear(pool);
+    parallelLoad(first, last, pool, typename std::iterator_traits<InputIt>::iterator_category());
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename RandomIt>
+void BinarySearchTree<Key, Value, Compare>::parallelLoad(RandomIt first, RandomIt last,
+    WorkStealingPool& pool, std::random_access_iterator_tag)
+{
+    if (isStrictlySorted(first, last)) {
+        parallelBuild(first, static_cast<std::size_t>(last - first), pool);
+    }
+    else {
+        parallelLoad(first, last, pool, std::input_iterator_tag());
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare>::parallelLoad(InputIt first, InputIt last,
+    WorkStealingPool& pool, std::input_iterator_tag)
+{
+    std::vector<std::pair<Key, Value> > items;
+    for (; first != last; ++first) {
+        items.push_back(std::pair<Key, Value>((*first).first, (*first).second));
+    }
+
+    sortUnique(items);
+    parallelBuild(std::make_move_iterator(items.begin()), items.size(), pool);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename RandomIt>
+void BinarySearchTree<Key, Value, Compare>::parallelBuild(RandomIt first, std::size_t count,
+    WorkStealingPool& pool)
+{
+    typedef typename std::iterator_traits<RandomIt>::reference Item;
+    if (!noexcept(Key(std::declval<Item>().first)) || !noexcept(Value(std::declval<Item>().second))) {
+        root_ = buildBalanced(first, count, nullptr);
+        return;
+    }
+
+    std::vector<void*> blocks;
+    blocks.reserve(count);
+    try {
+        for (std::size_t i = 0; i < count; ++i) {
+            blocks.push_back(pool_.allocate());
+        }
+    }
+    catch (...) {
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            pool_.deallocate(blocks[i]);
+        }
+        throw;
+    }
+    counters_.allocated(count);
+    root_ = buildParallel(first, blocks.data(), count, nullptr, forkDepth(pool), pool);
+}
+
+/**
+* As buildBalanced, but the node for item i goes in blocks[i] and the
+* two halves are built in parallel near the top.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename RandomIt>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::buildParallel(RandomIt first,
+    void** blocks, std::size_t count, Node<Key, Value>* parent, int forks, WorkStealingPool& pool)
+{
+    if (count == 0) {
+        return nullptr;
+    }
+    std::size_t mid = count / 2;
+    RandomIt middle = first + mid;
+    Node<Key, Value>* node = createNodeAt(blocks[mid], Key((*middle).first),
+        Value((*middle).second), parent);
+    Node<Key, Value>* left = nullptr;
+    Node<Key, Value>* right = nullptr;
+    forkJoin((forks > 0 && count >= 4096) ? &pool : nullptr,
+        [&]() { left = buildParallel(first, blocks, mid, node, forks - 1, pool); },
+        [&]() {
+            right = buildParallel(middle + 1, blocks + mid + 1, count - mid - 1, node,
+                forks - 1, pool);
+        });
+    node->setLeft(left);
+    node->setRight(right);
+    refreshNode(node);
+    return node;
+}
+
+/**
+* Calls fn(item) once for every item. Subtrees near the top are handed
+* to different threads, so fn may run concurrently with itself and sees
+* the items in key order only within each subtree. The tree must not
+* change meanwhile.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename Fn>
+void BinarySearchTree<Key, Value, Compare>::parallel_for_each(Fn fn, WorkStealingPool& pool) const
+{
+    visitSubtree(root_, fn, forkDepth(pool), pool);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename Fn>
+void BinarySearchTree<Key, Value, Compare>::visitSubtree(Node<Key, Value>* node, Fn& fn, int forks,
+    WorkStealingPool& pool) const
+{
+    if (node != nullptr && forks > 0) {
+        forkJoin(&pool,
+            [&]() { visitSubtree(node->getLeft(), fn, forks - 1, pool); },
+            [&]() {
+                fn(node->getItem());
+                visitSubtree(node->getRight(), fn, forks - 1, pool);
+            });
+        return;
+    }
+
+    std::vector<Node<Key, Value>*> path;
+    while (node != nullptr || !path.empty()) {
+        while (node != nullptr) {
+            path.push_back(node);
+            node = node->getLeft();
+        }
+        node = path.back();
+        path.pop_back();
+        fn(node->getItem());
+        node = node->getRight();
+    }
+}
+
+/**
+* Replaces the contents of the tree with the (key, value) pairs in
+* [first, last), building a perfectly balanced tree in O(n) when the
+* keys are already in strictly increasing order. Unsorted input is
+* sorted first, and for repeated keys the last value wins, as it would
+* with repeated inserts. Sorted random-access input is read in place;
+* anything else is first gathered into a temporary vector.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare>::bulk_load(InputIt first, InputIt last)
+{
+    clear();
+    bulkLoad(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename RandomIt>
+void BinarySearchTree<Key, Value, Compare>::bulkLoad(RandomIt first, RandomIt last,
+    std::random_access_iterator_tag)
+{
+    if (isStrictlySorted(first, last)) {
+        root_ = buildBalanced(first, static_cast<std::size_t>(last - first), nullptr);
+    }
+    else {
+        bulkLoad(first, last, std::input_iterator_tag());
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare>::bulkLoad(InputIt first, InputIt last,
+    std::input_iterator_tag)
+{
+    std::vector<std::pair<Key, Value> > items;
+    for (; first != last; ++first) {
+        items.push_back(std::pair<Key, Value>((*first).first, (*first).second));
+    }
+
+    sortUnique(items);
+    root_ = buildBalanced(std::make_move_iterator(items.begin()), items.size(), nullptr);
+}
+
+/**
+* Builds a subtree from count sorted items, rooting it at the middle
+* item so that the two halves differ in size by at most one. Nodes are
+* created in preorder, so a subtree's nodes sit close together in the
+* pool. Recursion depth is log2(count).
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename RandomIt>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::buildBalanced(RandomIt first,
+    std::size_t count, Node<Key, Value>* parent)
+{
+    if (count == 0) {
+        return nullptr;
+    }
+    std::size_t mid = count / 2;
+    RandomIt middle = first + mid;
+    Node<Key, Value>* node = createNode(Key((*middle).first), Value((*middle).second), parent);
+    node->setLeft(buildBalanced(first, mid, node));
+    node->setRight(buildBalanced(middle + 1, count - mid - 1, node));
+    refreshNode(node);
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename ForwardIt>
+bool BinarySearchTree<Key, Value, Compare>::isStrictlySorted(ForwardIt first, ForwardIt last) const
+{
+    if (first == last) {
+        return true;
+    }
+    ForwardIt next = first;
+    for (++next; next != last; ++first, ++next) {
+        if (!keyLess((*first).first, (*next).first)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Sorts items by key and collapses runs of equal keys onto their last
+* value, as repeated inserts would. Already-sorted input costs one pass.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::sortUnique(std::vector<std::pair<Key, Value> >& items) const
+{
+    if (isStrictlySorted(items.begin(), items.end())) {
+        return;
+    }
+    std::stable_sort(items.begin(), items.end(),
+        [this](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) {
+            return keyLess(a.first, b.first);
+        });
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        if (kept > 0 && !keyLess(items[kept - 1].first, items[i].first)) {
+            items[kept - 1].second = std::move(items[i].second);
+        }
+        else {
+            if (kept != i) {
+                items[kept] = std::move(items[i]);
+            }
+            ++kept;
+        }
+    }
+    items.resize(kept);
+}
+
+/**
+* Writes every key in order, then every value in order.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::save(const std::string& path) const
+{
+    SnapshotWriter writer(path);
+    scan_view items = scan();
+    for (scan_iterator it = items.begin(); it != items.end(); ++it) {
+        SnapshotCodec<Key>::write(writer, it->first);
+    }
+    for (scan_iterator it = items.begin(); it != items.end(); ++it) {
+        SnapshotCodec<Value>::write(writer, it->second);
+    }
+    writer.commit(SnapshotHeader::describe(size(), SnapshotCodec<Key>::RAW, sizeof(Key),
+        SnapshotCodec<Value>::RAW, sizeof(Value)));
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::load(const std::string& path)
+{
+    SnapshotReader reader(path);
+    reader.expect(SnapshotCodec<Key>::RAW, sizeof(Key), SnapshotCodec<Value>::RAW, sizeof(Value),
+        SnapshotCodec<Key>::MIN_BYTES + SnapshotCodec<Value>::MIN_BYTES);
+    loadSnapshot(reader, std::integral_constant<bool,
+        SnapshotCodec<Key>::RAW && SnapshotCodec<Value>::RAW>());
+}
+
+/**
+* Raw columns are read with one call each into uninitialized arrays and
+* the tree is built straight from them: the file's bytes are copied
+* once, into the nodes.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::loadSnapshot(SnapshotReader& reader, std::true_type)
+{
+    typedef typename std::aligned_storage<sizeof(Key), alignof(Key)>::type KeySlot;
+    typedef typename std::aligned_storage<sizeof(Value), alignof(Value)>::type ValueSlot;
+
+    std::size_t count = static_cast<std::size_t>(reader.header().count);
+    std::unique_ptr<KeySlot[]> keys(new KeySlot[count]);
+    std::unique_ptr<ValueSlot[]> values(new ValueSlot[count]);
+    reader.read(keys.get(), count * sizeof(Key));
+    reader.read(values.get(), count * sizeof(Value));
+    reader.finish();
+
+    SnapshotColumns<Key, Value> first(reinterpret_cast<const Key*>(keys.get()),
+                                      reinterpret_cast<const Value*>(values.get()));
+    if (!isStrictlySorted(first, first + count)) {
+        throw std::runtime_error("snapshot: keys are out of order for this comparator");
+    }
+    clear();
+    root_ = buildBalanced(first, count, nullptr);
+}
+
+/**
+* Items with encoded keys or values are decoded into a vector and moved
+* from there into the nodes.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::loadSnapshot(SnapshotReader& reader, std::false_type)
+{
+    std::vector<std::pair<Key, Value> > items(static_cast<std::size_t>(reader.header().count));
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        SnapshotCodec<Key>::read(reader, items[i].first);
+    }
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        SnapshotCodec<Value>::read(reader, items[i].second);
+    }
+    reader.finish();
+
+    if (!isStrictlySorted(items.begin(), items.end())) {
+        throw std::runtime_error("snapshot: keys are out of order for this comparator");
+    }
+    clear();
+    root_ = buildBalanced(std::make_move_iterator(items.begin()), items.size(), nullptr);
+}
+
+/**
+* Relinks count existing nodes, given in key order, into a perfectly
+* balanced subtree under parent and returns its root. No node is
+* allocated or freed.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::linkBalanced(Node<Key, Value>** nodes,
+    std::size_t count, Node<Key, Value>* parent)
+{
+    if (count == 0) {
+        return nullptr;
+    }
+    std::size_t mid = count / 2;
+    Node<Key, Value>* node = nodes[mid];
+    node->setParent(parent);
+    node->setLeft(linkBalanced(nodes, mid, node));
+    node->setRight(linkBalanced(nodes + mid + 1, count - mid - 1, node));
+    refreshNode(node);
+    return node;
+}
+
+/**
+* Appends every node of the tree to nodes in key order.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::collectInOrder(std::vector<Node<Key, Value>*>& nodes) const
+{
+    for (Node<Key, Value>* current = getSmallestNode(); current != nullptr;
+         current = successor(current)) {
+        nodes.push_back(current);
+    }
+}
+
+/**
+* Called bottom-up on each node a bulk build or relink places, once its
+* children are linked. Plain BST nodes store nothing derived from their children.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::refreshNode(Node<Key, Value>* node)
+{
+    (void)node;
+}
 
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::getSmallestNode() const {
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::getSmallestNode() const {
     if (root_ == nullptr) {
         return nullptr;  // Empty tree case
     }
@@ -672,67 +2305,291 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::getSmallestNode() const {
     return current;
 }
 
+/**
+* The node with the largest key, or NULL if the tree is empty.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::getLargestNode() const {
+    Node<Key, Value>* current = root_;
+    if (current == nullptr) {
+        return nullptr;
+    }
+    while (current->getRight() != nullptr) {
+        current = current->getRight();
+    }
+    return current;
+}
+
+/**
+* getLargestNode() in O(1) while the cached answer holds. Only the set
+* of nodes can change which node is largest (rotations keep it), and
+* every change to that set allocates, frees or adopts through pool_,
+* so the cache holds as long as the pool's generation is unchanged.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::cachedLargestNode() {
+    if (largest_ == nullptr || largestAt_ != pool_.generation()) {
+        cacheLargestNode(getLargestNode());
+    }
+    return largest_;
+}
+
+/**
+* Records node, which must be the largest node now, for cachedLargestNode.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::cacheLargestNode(Node<Key, Value>* node) {
+    largest_ = node;
+    largestAt_ = pool_.generation();
+}
+
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
-* exists
+* exists. Like insertUnique, it makes one comparator call per level:
+* a three-way comparator returns on a match, and a less-than predicate
+* takes the lower bound and checks it once for equality. Scalar keys,
+* whose compares are cheap, test for a match on the way down instead
+* (with ==, when Compare is std::less or std::greater).
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const {
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const K& key) const {
+    Node<Key, Value>* current = root_;
+    if (IsThreeWayCompare<Compare, K, Key>::value) {
+        TreeCounters::Descent descent(counters_, TreeCounters::LOOKUP);
+        while (current != nullptr) {
+            descent.visit();
+            int order = keyCompare(key, current->getKey());
+            if (order == 0) {
+                return current;
+            }
+            current = (order < 0) ? current->getLeft() : current->getRight();
+        }
+        return nullptr;  // Key not found
+    }
+    if (HasNativeEquality<Compare, K, Key>::value) {
+        TreeCounters::Descent descent(counters_, TreeCounters::LOOKUP);
+        while (current != nullptr) {
+            descent.visit();
+            if (keyEquivalent(key, current->getKey())) {
+                return current;
+            }
+            else if (keyLess(key, current->getKey())) {
+                current = current->getLeft();
+            }
+            else {
+                current = current->getRight();
+            }
+        }
+        return nullptr;  // Key not found
+    }
+    if (std::is_scalar<K>::value && std::is_scalar<Key>::value) {
+        TreeCounters::Descent descent(counters_, TreeCounters::LOOKUP);
+        while (current != nullptr) {
+            descent.visit();
+            if (keyLess(key, current->getKey())) {
+                current = current->getLeft();
+            }
+            else if (keyLess(current->getKey(), key)) {
+                current = current->getRight();
+            }
+            else {
+                return current;
+            }
+        }
+        return nullptr;  // Key not found
+    }
+
+    // The lower-bound descent counts as the lookup
+    Node<Key, Value>* candidate = internalLowerBound(key);
+    if (candidate != nullptr && !keyLess(key, candidate->getKey())) {
+        return candidate;
+    }
+    return nullptr;  // Key not found
+}
+
+/**
+* Finds the node with the smallest key not less than key: every node
+* whose key qualifies becomes the candidate before the descent moves
+* left to look for a smaller one.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalLowerBound(const K& key) const {
     Node<Key, Value>* current = root_;
-    
+    Node<Key, Value>* candidate = nullptr;
+    TreeCounters::Descent descent(counters_, TreeCounters::LOOKUP);
+
     while (current != nullptr) {
-        if (key == current->getKey()) {
-            return current; 
+        descent.visit();
+        if (keyLess(current->getKey(), key)) {
+            current = current->getRight();
+        }
+        else {
+            candidate = current;
+            current = current->getLeft();
         }
-        else if (key < current->getKey()) {
-            current = current->getLeft(); 
+    }
+    return candidate;
+}
+
+/**
+* Finds the node with the smallest key greater than key.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalUpperBound(const K& key) const {
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* candidate = nullptr;
+    TreeCounters::Descent descent(counters_, TreeCounters::LOOKUP);
+
+    while (current != nullptr) {
+        descent.visit();
+        if (keyLess(key, current->getKey())) {
+            candidate = current;
+            current = current->getLeft();
         }
         else {
             current = current->getRight();
         }
     }
-    
-    return nullptr;  // Key not found
+    return candidate;
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename A, typename B>
+bool BinarySearchTree<Key, Value, Compare>::keyLess(const A& a, const B& b) const {
+    counters_.compared();
+    return KeyOrder<Compare>::less(comp_, a, b);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename A, typename B>
+int BinarySearchTree<Key, Value, Compare>::keyCompare(const A& a, const B& b) const {
+    counters_.compared();
+    return KeyOrder<Compare>::compare(comp_, a, b);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename A, typename B>
+bool BinarySearchTree<Key, Value, Compare>::keyEquivalent(const A& a, const B& b) const {
+    counters_.compared();
+    return KeyOrder<Compare>::equivalent(comp_, a, b);
 }
 
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const {
-    bool balanced = true;
-    isBalancedHelper(root_, balanced);
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const {
+    return shape().balanced;
+}
 
-    //Balanced, pass by reference, is the return for function
-    return balanced;
+/**
+ * Number of edges on the longest root-to-leaf path; -1 when empty.
+ */
+template<typename Key, typename Value, typename Compare>
+int BinarySearchTree<Key, Value, Compare>::height() const {
+    return shape().height;
 }
 
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::isBalancedHelper(Node<Key, Value>* node, bool& balanced) const {
-    // Base case: empty tree has height -1
-    if (node == nullptr) return -1;
-    
-    // Early termination if we already found imbalance
-    if (!balanced) return 0;
-    
-    // Get heights of subtrees
-    int leftHeight = isBalancedHelper(node->getLeft(), balanced);
-    int rightHeight = isBalancedHelper(node->getRight(), balanced);
-    
-    // Check current node's balance
-    if (abs(leftHeight - rightHeight) > 1) {
-        balanced = false;
+/**
+ * Walks every node once, in post-order, following parent pointers, so
+ * a degenerate tree millions of nodes deep costs no stack. The only
+ * other state is the left subtree height of each node on the current
+ * path, needed for the balance check; it is a fixed array, since a tree
+ * that outgrows it is too deep to be balanced anyway.
+ */
+template<typename Key, typename Value, typename Compare>
+TreeShape BinarySearchTree<Key, Value, Compare>::shape() const {
+    // A balanced tree of height h has at least Fib(h + 3) - 1 nodes, so
+    // none that fits in memory reaches this depth.
+    const int BALANCED_DEPTH_LIMIT = 96;
+    int leftHeights[BALANCED_DEPTH_LIMIT];
+
+    enum Step { DOWN, UP_FROM_LEFT, UP_FROM_RIGHT };
+    TreeShape shape;
+    uint64_t depthSum = 0;
+    int depth = 0;
+    int childHeight = -1;   // height of the subtree just finished
+    Step step = DOWN;
+    Node<Key, Value>* node = root_;
+    while (node != nullptr) {
+        if (step == DOWN) {
+            ++shape.nodes;
+            depthSum += depth;
+            shape.height = std::max(shape.height, depth);
+            if (node->getLeft() == nullptr && node->getRight() == nullptr) {
+                ++shape.leaves;
+            }
+            if (node->getLeft() != nullptr) {
+                node = node->getLeft();
+                ++depth;
+                continue;
+            }
+            childHeight = -1;
+            step = UP_FROM_LEFT;
+        }
+        if (step == UP_FROM_LEFT) {
+            if (depth < BALANCED_DEPTH_LIMIT) {
+                leftHeights[depth] = childHeight;
+            }
+            else {
+                shape.balanced = false;
+            }
+            if (node->getRight() != nullptr) {
+                node = node->getRight();
+                ++depth;
+                step = DOWN;
+                continue;
+            }
+            childHeight = -1;
+        }
+        // Both subtrees are done. Once the tree is known to be
+        // unbalanced, subtree heights no longer matter.
+        if (shape.balanced) {
+            int leftHeight = leftHeights[depth];
+            if (abs(leftHeight - childHeight) > 1) {
+                shape.balanced = false;
+            }
+            childHeight = 1 + std::max(leftHeight, childHeight);
+        }
+        Node<Key, Value>* parent = node->getParent();
+        step = (parent != nullptr && parent->getLeft() == node) ? UP_FROM_LEFT : UP_FROM_RIGHT;
+        node = parent;
+        --depth;
     }
-    
-    // Return height of current subtree
-    return 1 + std::max(leftHeight, rightHeight);
+    if (shape.nodes > 0) {
+        shape.averageDepth = static_cast<double>(depthSum) / shape.nodes;
+    }
+    return shape;
 }
 
+/**
+ * The greatest height a balanced tree of the given size can have: the
+ * largest h whose sparsest balanced tree, of N(h) = N(h - 1) + N(h - 2) + 1
+ * nodes, still fits. Under 1.45 log2(nodes + 2); -1 for no nodes.
+ */
+template<typename Key, typename Value, typename Compare>
+int BinarySearchTree<Key, Value, Compare>::maxBalancedHeight(std::size_t nodes) {
+    if (nodes == 0) {
+        return -1;
+    }
+    uint64_t shorter = 1;   // N(h)
+    uint64_t taller = 2;    // N(h + 1)
+    int height = 0;
+    while (taller <= nodes) {
+        uint64_t next = shorter + taller + 1;
+        shorter = taller;
+        taller = next;
+        ++height;
+    }
+    return height;
+}
 
-
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
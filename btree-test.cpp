@@ -0,0 +1,175 @@
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "btree.h"
+#include "test_check.h"
+
+using namespace std;
+
+/**
+* The tree holds expected's items in order, and find, lower_bound and
+* operator[] agree with it for every probe.
+*/
+template <typename Tree, typename Key, typename Value, typename Compare>
+bool matches(const Tree& tree, const map<Key, Value, Compare>& expected, const vector<Key>& probes)
+{
+    if (tree.size() != expected.size() || tree.empty() != expected.empty() ||
+        !sameItems(tree.begin(), tree.end(), expected)) {
+        return false;
+    }
+    for (size_t i = 0; i < probes.size(); ++i) {
+        const Key& key = probes[i];
+        typename map<Key, Value, Compare>::const_iterator it = expected.find(key);
+        typename map<Key, Value, Compare>::const_iterator lower = expected.lower_bound(key);
+        typename Tree::iterator found = tree.find(key);
+        typename Tree::iterator treeLower = tree.lower_bound(key);
+        if ((found == tree.end()) != (it == expected.end()) ||
+            (treeLower == tree.end()) != (lower == expected.end()) ||
+            (lower != expected.end() && !(treeLower->first == lower->first))) {
+            return false;
+        }
+        if (it != expected.end() && !(found->second == it->second && tree[key] == it->second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Random inserts, overwrites and removes against std::map. Every few
+* thousand steps the tree is checked in full; removing nearly all keys
+* at the end merges the nodes back down to an empty tree.
+*/
+template <typename Tree, typename Key, typename Value, typename Compare, typename MakeKey>
+bool randomUpdates(Tree& tree, map<Key, Value, Compare>& expected, MakeKey makeKey,
+                   int range, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<Key> probes;
+    for (int i = -1; i <= range; ++i) {
+        probes.push_back(makeKey(i));
+    }
+    bool allMatch = true;
+    for (int i = 0; i < 20 * range; ++i) {
+        Key key = makeKey(static_cast<int>(rng() % range));
+        if (rng() % 3 != 0) {
+            Value value = static_cast<Value>(i);
+            tree.insert(make_pair(key, value));
+            expected[key] = value;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        if (i % 3000 == 0) {
+            allMatch = allMatch && matches(tree, expected, probes);
+        }
+    }
+    allMatch = allMatch && matches(tree, expected, probes);
+    for (int i = 0; i < range - 3; ++i) {
+        tree.remove(makeKey(i));
+        expected.erase(makeKey(i));
+    }
+    allMatch = allMatch && matches(tree, expected, probes);
+    for (int i = range - 3; i < range; ++i) {
+        tree.remove(makeKey(i));
+        expected.erase(makeKey(i));
+    }
+    return allMatch && tree.empty() && tree.begin() == tree.end() &&
+           matches(tree, expected, probes);
+}
+
+int intKey(int i)
+{
+    return i;
+}
+
+string stringKey(int i)
+{
+    return "key-" + to_string(i * 7919 % 100003);
+}
+
+// Node sizes from the smallest fanout the tree allows to the default
+template <size_t NodeBytes>
+void testNodeSize()
+{
+    BTree<int, int, less<int>, NodeBytes> ints;
+    map<int, int> expectedInts;
+    CHECK(randomUpdates(ints, expectedInts, intKey, 2000, NodeBytes));
+
+    BTree<string, long, less<string>, NodeBytes> strings;
+    map<string, long> expectedStrings;
+    CHECK(randomUpdates(strings, expectedStrings, stringKey, 1500, NodeBytes + 1));
+
+    // Ascending and descending runs split only one side of each node
+    BTree<int, int, less<int>, NodeBytes> ordered;
+    map<int, int> expected;
+    for (int i = 0; i < 5000; ++i) {
+        ordered.insert(make_pair(i, i));
+        ordered.insert(make_pair(-i - 1, i));
+        expected[i] = i;
+        expected[-i - 1] = i;
+    }
+    vector<int> probes;
+    for (int i = -5001; i <= 5000; i += 13) {
+        probes.push_back(i);
+    }
+    CHECK(matches(ordered, expected, probes));
+    for (int i = 0; i < 5000; i += 2) {
+        ordered.remove(i);
+        expected.erase(i);
+    }
+    CHECK(matches(ordered, expected, probes));
+}
+
+void testComparators()
+{
+    BTree<int, int, greater<int>, 64> reversed;
+    map<int, int, greater<int> > expected;
+    CHECK(randomUpdates(reversed, expected, intKey, 2000, 5));
+
+    BTree<string, long, StringCompare, 64> threeWay;
+    map<string, long> expectedStrings;
+    CHECK(randomUpdates(threeWay, expectedStrings, stringKey, 1500, 6));
+}
+
+void testAccessAndClear()
+{
+    BTree<string, string, less<string>, 64> tree;
+    for (int i = 0; i < 1000; ++i) {
+        pair<string, string> item(stringKey(i), string(40, 'a' + i % 26));
+        tree.insert(std::move(item));
+    }
+    tree[stringKey(3)] = "changed";
+    CHECK(tree.find(stringKey(3))->second == "changed");
+    (*tree.begin()).second = "first";
+    CHECK(tree.begin()->second == "first");
+
+    const BTree<string, string, less<string>, 64>& constTree = tree;
+    bool threw = false;
+    try {
+        constTree["absent"];
+    }
+    catch (const out_of_range&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(tree.lower_bound("zzz") == tree.end());
+
+    tree.clear();
+    CHECK(tree.empty() && tree.size() == 0 && tree.begin() == tree.end());
+    tree.insert(make_pair(string("again"), string("1")));
+    CHECK(tree.size() == 1 && tree.find("again") != tree.end());
+}
+
+int main()
+{
+    testNodeSize<16>();
+    testNodeSize<64>();
+    testNodeSize<256>();
+    testComparators();
+    testAccessAndClear();
+    return checkResult("btree-test");
+}
@@ -0,0 +1,682 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include "key_compare.h"
+
+/**
+* A templated B+ tree map with the same insert/remove/find/operator[]
+* and iterator interface as BinarySearchTree, so that the two can be
+* swapped with a type alias.
+*
+* Items live only in the leaves, which are chained left to right for
+* iteration; inner nodes hold separator keys. Keys and values are kept
+* in separate contiguous arrays so a node search touches only keys.
+* The fanout is chosen so that a node's key and value (or child
+* pointer) arrays take about NodeBytes bytes, which keeps each level of
+* a lookup to a few cache lines instead of one miss per binary level.
+*
+* Keys are ordered by Compare, a less-than predicate or a three-way
+* comparator as for the other trees (see key_compare.h).
+*
+* Key and Value must be default constructible and move assignable:
+* node arrays are allocated full and items are shifted with moves.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+    std::size_t NodeBytes = 256>
+class BTree
+{
+public:
+    static const std::size_t LEAF_SLOTS =
+        (NodeBytes / (sizeof(Key) + sizeof(Value)) < 4) ? 4 :
+        NodeBytes / (sizeof(Key) + sizeof(Value));
+    static const std::size_t INNER_SLOTS =
+        (NodeBytes / (sizeof(Key) + sizeof(void*)) < 4) ? 4 :
+        NodeBytes / (sizeof(Key) + sizeof(void*));
+
+private:
+    struct NodeBase
+    {
+        bool isLeaf;
+        std::size_t count;      // number of keys in use
+    };
+
+    // One spare slot lets a node overflow by one before it is split.
+    struct Leaf : NodeBase
+    {
+        Key keys[LEAF_SLOTS + 1];
+        Value values[LEAF_SLOTS + 1];
+        Leaf* prev;
+        Leaf* next;
+    };
+
+    // children[i] holds the keys k with keys[i-1] <= k < keys[i].
+    struct Inner : NodeBase
+    {
+        Key keys[INNER_SLOTS + 1];
+        NodeBase* children[INNER_SLOTS + 2];
+    };
+
+public:
+    /**
+    * A proxy for one item: (*it).first / it->second work as they do for
+    * BinarySearchTree, but refer into the leaf's key and value arrays.
+    */
+    typedef std::pair<const Key&, Value&> reference;
+
+    class iterator
+    {
+    public:
+        struct pointer
+        {
+            reference item;
+            reference* operator->() { return &item; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BTree<Key, Value, Compare, NodeBytes>;
+        iterator(Leaf* leaf, std::size_t index);
+        Leaf* leaf_;
+        std::size_t index_;
+    };
+
+    explicit BTree(const Compare& comp = Compare());
+    ~BTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    template<typename P>
+    void insert(P&& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    // Not copyable, like BinarySearchTree
+    BTree(const BTree& other);
+    BTree& operator=(const BTree& other);
+
+    // Compare as a less-than predicate, for the std:: searches
+    struct KeyLess
+    {
+        const Compare* comp;
+        bool operator()(const Key& a, const Key& b) const
+        {
+            return KeyOrder<Compare>::less(*comp, a, b);
+        }
+    };
+
+    struct Split
+    {
+        NodeBase* right;    // nullptr if the child did not split
+        Key separator;
+    };
+
+    bool insertInto(NodeBase* node, Key& key, Value& value, Split& split);
+    bool removeFrom(NodeBase* node, const Key& key);
+    void fixUnderflow(Inner* parent, std::size_t i);
+    void mergeChildren(Inner* parent, std::size_t i);
+    Leaf* findLeaf(const Key& key) const;
+    std::size_t childIndex(const Inner* node, const Key& key) const;
+    KeyLess keyLess() const;
+    static void destroy(NodeBase* node);
+
+    NodeBase* root_;
+    Leaf* first_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+const std::size_t BTree<Key, Value, Compare, NodeBytes>::LEAF_SLOTS;
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+const std::size_t BTree<Key, Value, Compare, NodeBytes>::INNER_SLOTS;
+
+/*
+---------------------------------------------------
+Begin implementations for the BTree::iterator class.
+---------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+BTree<Key, Value, Compare, NodeBytes>::iterator::iterator() : leaf_(nullptr), index_(0)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+BTree<Key, Value, Compare, NodeBytes>::iterator::iterator(Leaf* leaf, std::size_t index) :
+    leaf_(leaf),
+    index_(index)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::reference
+BTree<Key, Value, Compare, NodeBytes>::iterator::operator*() const
+{
+    return reference(leaf_->keys[index_], leaf_->values[index_]);
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::iterator::pointer
+BTree<Key, Value, Compare, NodeBytes>::iterator::operator->() const
+{
+    pointer p = { **this };
+    return p;
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+bool BTree<Key, Value, Compare, NodeBytes>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+bool BTree<Key, Value, Compare, NodeBytes>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Steps within the leaf, then along the leaf chain; O(1) per step.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::iterator&
+BTree<Key, Value, Compare, NodeBytes>::iterator::operator++()
+{
+    if (++index_ == leaf_->count) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/*
+-------------------------------------------------
+End implementations for the BTree::iterator class.
+-------------------------------------------------
+*/
+
+/*
+-----------------------------------------
+Begin implementations for the BTree class.
+-----------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+BTree<Key, Value, Compare, NodeBytes>::BTree(const Compare& comp) :
+    root_(nullptr),
+    first_(nullptr),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+BTree<Key, Value, Compare, NodeBytes>::~BTree()
+{
+    clear();
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+bool BTree<Key, Value, Compare, NodeBytes>::empty() const
+{
+    return size_ == 0;
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+std::size_t BTree<Key, Value, Compare, NodeBytes>::size() const
+{
+    return size_;
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::iterator
+BTree<Key, Value, Compare, NodeBytes>::begin() const
+{
+    return iterator(first_, 0);
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::iterator
+BTree<Key, Value, Compare, NodeBytes>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::iterator
+BTree<Key, Value, Compare, NodeBytes>::find(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr) {
+        return end();
+    }
+    const Key* pos = std::lower_bound(leaf->keys, leaf->keys + leaf->count, key, keyLess());
+    if (pos == leaf->keys + leaf->count || keyLess()(key, *pos)) {
+        return end();
+    }
+    return iterator(leaf, pos - leaf->keys);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key.
+* Every key in the leaves left of the one reached is less than key, so
+* if this leaf has no answer the next leaf's first item is it.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::iterator
+BTree<Key, Value, Compare, NodeBytes>::lower_bound(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr) {
+        return end();
+    }
+    std::size_t index =
+        std::lower_bound(leaf->keys, leaf->keys + leaf->count, key, keyLess()) - leaf->keys;
+    if (index == leaf->count) {
+        return iterator(leaf->next, 0);
+    }
+    return iterator(leaf, index);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+Value& BTree<Key, Value, Compare, NodeBytes>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+Value const & BTree<Key, Value, Compare, NodeBytes>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+void BTree<Key, Value, Compare, NodeBytes>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    insert(std::pair<Key, Value>(keyValuePair.first, keyValuePair.second));
+}
+
+/**
+* Inserts any pair-like argument, moving from it when it is an rvalue.
+* A full root splits into two and a new root is placed above them, so
+* the tree only ever grows at the top and all leaves stay level.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+template <typename P>
+void BTree<Key, Value, Compare, NodeBytes>::insert(P&& keyValuePair)
+{
+    std::pair<Key, Value> item(std::forward<P>(keyValuePair));
+    if (root_ == nullptr) {
+        Leaf* leaf = new Leaf();
+        leaf->isLeaf = true;
+        leaf->count = 0;
+        leaf->prev = nullptr;
+        leaf->next = nullptr;
+        root_ = first_ = leaf;
+    }
+
+    Split split;
+    split.right = nullptr;
+    if (insertInto(root_, item.first, item.second, split)) {
+        ++size_;
+    }
+    if (split.right != nullptr) {
+        Inner* root = new Inner();
+        root->isLeaf = false;
+        root->count = 1;
+        root->keys[0] = std::move(split.separator);
+        root->children[0] = root_;
+        root->children[1] = split.right;
+        root_ = root;
+    }
+}
+
+/**
+* Recursive insert. Returns true if a new item was added. If node had
+* to split, its new right sibling and their separator are returned in
+* split for the caller to link in.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+bool BTree<Key, Value, Compare, NodeBytes>::insertInto(NodeBase* node, Key& key, Value& value, Split& split)
+{
+    if (node->isLeaf) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        std::size_t pos =
+            std::lower_bound(leaf->keys, leaf->keys + leaf->count, key, keyLess()) - leaf->keys;
+        if (pos < leaf->count && !keyLess()(key, leaf->keys[pos])) {
+            leaf->values[pos] = std::move(value);
+            return false;
+        }
+        std::move_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        std::move_backward(leaf->values + pos, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        leaf->keys[pos] = std::move(key);
+        leaf->values[pos] = std::move(value);
+        ++leaf->count;
+
+        if (leaf->count > LEAF_SLOTS) {
+            Leaf* right = new Leaf();
+            right->isLeaf = true;
+            std::size_t mid = leaf->count / 2;
+            right->count = leaf->count - mid;
+            std::move(leaf->keys + mid, leaf->keys + leaf->count, right->keys);
+            std::move(leaf->values + mid, leaf->values + leaf->count, right->values);
+            leaf->count = mid;
+
+            right->prev = leaf;
+            right->next = leaf->next;
+            if (leaf->next != nullptr) {
+                leaf->next->prev = right;
+            }
+            leaf->next = right;
+
+            split.right = right;
+            split.separator = right->keys[0];
+        }
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    std::size_t i = childIndex(inner, key);
+    Split childSplit;
+    childSplit.right = nullptr;
+    bool inserted = insertInto(inner->children[i], key, value, childSplit);
+    if (childSplit.right == nullptr) {
+        return inserted;
+    }
+
+    std::move_backward(inner->keys + i, inner->keys + inner->count, inner->keys + inner->count + 1);
+    std::copy_backward(inner->children + i + 1, inner->children + inner->count + 1,
+        inner->children + inner->count + 2);
+    inner->keys[i] = std::move(childSplit.separator);
+    inner->children[i + 1] = childSplit.right;
+    ++inner->count;
+
+    if (inner->count > INNER_SLOTS) {
+        // The middle key moves up; it does not stay in either half
+        Inner* right = new Inner();
+        right->isLeaf = false;
+        std::size_t mid = inner->count / 2;
+        right->count = inner->count - mid - 1;
+        std::move(inner->keys + mid + 1, inner->keys + inner->count, right->keys);
+        std::copy(inner->children + mid + 1, inner->children + inner->count + 1, right->children);
+        split.separator = std::move(inner->keys[mid]);
+        split.right = right;
+        inner->count = mid;
+    }
+    return inserted;
+}
+
+/**
+* Removes the item with the given key, if present. Underfull nodes
+* borrow from or merge with a sibling on the way back up, and a root
+* left with a single child is replaced by that child.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+void BTree<Key, Value, Compare, NodeBytes>::remove(const Key& key)
+{
+    if (root_ == nullptr || !removeFrom(root_, key)) {
+        return;
+    }
+    --size_;
+
+    if (root_->isLeaf) {
+        if (root_->count == 0) {
+            delete static_cast<Leaf*>(root_);
+            root_ = nullptr;
+            first_ = nullptr;
+        }
+    }
+    else if (root_->count == 0) {
+        Inner* old = static_cast<Inner*>(root_);
+        root_ = old->children[0];
+        delete old;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+bool BTree<Key, Value, Compare, NodeBytes>::removeFrom(NodeBase* node, const Key& key)
+{
+    if (node->isLeaf) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        std::size_t pos =
+            std::lower_bound(leaf->keys, leaf->keys + leaf->count, key, keyLess()) - leaf->keys;
+        if (pos == leaf->count || keyLess()(key, leaf->keys[pos])) {
+            return false;
+        }
+        std::move(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+        std::move(leaf->values + pos + 1, leaf->values + leaf->count, leaf->values + pos);
+        --leaf->count;
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    std::size_t i = childIndex(inner, key);
+    if (!removeFrom(inner->children[i], key)) {
+        return false;
+    }
+    NodeBase* child = inner->children[i];
+    std::size_t minimum = child->isLeaf ? LEAF_SLOTS / 2 : INNER_SLOTS / 2;
+    if (child->count < minimum) {
+        fixUnderflow(inner, i);
+    }
+    return true;
+}
+
+/**
+* Refills parent's child i from a sibling with items to spare, or else
+* merges it with a sibling.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+void BTree<Key, Value, Compare, NodeBytes>::fixUnderflow(Inner* parent, std::size_t i)
+{
+    NodeBase* child = parent->children[i];
+    std::size_t minimum = child->isLeaf ? LEAF_SLOTS / 2 : INNER_SLOTS / 2;
+    NodeBase* left = (i > 0) ? parent->children[i - 1] : nullptr;
+    NodeBase* right = (i < parent->count) ? parent->children[i + 1] : nullptr;
+
+    if (left != nullptr && left->count > minimum) {
+        if (child->isLeaf) {
+            Leaf* c = static_cast<Leaf*>(child);
+            Leaf* l = static_cast<Leaf*>(left);
+            std::move_backward(c->keys, c->keys + c->count, c->keys + c->count + 1);
+            std::move_backward(c->values, c->values + c->count, c->values + c->count + 1);
+            c->keys[0] = std::move(l->keys[l->count - 1]);
+            c->values[0] = std::move(l->values[l->count - 1]);
+            --l->count;
+            ++c->count;
+            parent->keys[i - 1] = c->keys[0];
+        }
+        else {
+            Inner* c = static_cast<Inner*>(child);
+            Inner* l = static_cast<Inner*>(left);
+            std::move_backward(c->keys, c->keys + c->count, c->keys + c->count + 1);
+            std::copy_backward(c->children, c->children + c->count + 1, c->children + c->count + 2);
+            c->keys[0] = std::move(parent->keys[i - 1]);
+            c->children[0] = l->children[l->count];
+            parent->keys[i - 1] = std::move(l->keys[l->count - 1]);
+            --l->count;
+            ++c->count;
+        }
+    }
+    else if (right != nullptr && right->count > minimum) {
+        if (child->isLeaf) {
+            Leaf* c = static_cast<Leaf*>(child);
+            Leaf* r = static_cast<Leaf*>(right);
+            c->keys[c->count] = std::move(r->keys[0]);
+            c->values[c->count] = std::move(r->values[0]);
+            ++c->count;
+            std::move(r->keys + 1, r->keys + r->count, r->keys);
+            std::move(r->values + 1, r->values + r->count, r->values);
+            --r->count;
+            parent->keys[i] = r->keys[0];
+        }
+        else {
+            Inner* c = static_cast<Inner*>(child);
+            Inner* r = static_cast<Inner*>(right);
+            c->keys[c->count] = std::move(parent->keys[i]);
+            c->children[c->count + 1] = r->children[0];
+            ++c->count;
+            parent->keys[i] = std::move(r->keys[0]);
+            std::move(r->keys + 1, r->keys + r->count, r->keys);
+            std::copy(r->children + 1, r->children + r->count + 1, r->children);
+            --r->count;
+        }
+    }
+    else if (left != nullptr) {
+        mergeChildren(parent, i - 1);
+    }
+    else {
+        mergeChildren(parent, i);
+    }
+}
+
+/**
+* Folds parent's child i + 1 into child i and drops their separator.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+void BTree<Key, Value, Compare, NodeBytes>::mergeChildren(Inner* parent, std::size_t i)
+{
+    NodeBase* leftBase = parent->children[i];
+    NodeBase* rightBase = parent->children[i + 1];
+
+    if (leftBase->isLeaf) {
+        Leaf* l = static_cast<Leaf*>(leftBase);
+        Leaf* r = static_cast<Leaf*>(rightBase);
+        std::move(r->keys, r->keys + r->count, l->keys + l->count);
+        std::move(r->values, r->values + r->count, l->values + l->count);
+        l->count += r->count;
+        l->next = r->next;
+        if (r->next != nullptr) {
+            r->next->prev = l;
+        }
+        delete r;
+    }
+    else {
+        Inner* l = static_cast<Inner*>(leftBase);
+        Inner* r = static_cast<Inner*>(rightBase);
+        l->keys[l->count] = std::move(parent->keys[i]);
+        std::move(r->keys, r->keys + r->count, l->keys + l->count + 1);
+        std::copy(r->children, r->children + r->count + 1, l->children + l->count + 1);
+        l->count += r->count + 1;
+        delete r;
+    }
+
+    std::move(parent->keys + i + 1, parent->keys + parent->count, parent->keys + i);
+    std::copy(parent->children + i + 2, parent->children + parent->count + 1, parent->children + i + 1);
+    --parent->count;
+}
+
+/**
+* Index of the child of node whose range contains key.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+std::size_t BTree<Key, Value, Compare, NodeBytes>::childIndex(const Inner* node, const Key& key) const
+{
+    return std::upper_bound(node->keys, node->keys + node->count, key, keyLess()) - node->keys;
+}
+
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::KeyLess
+BTree<Key, Value, Compare, NodeBytes>::keyLess() const
+{
+    KeyLess less = { &comp_ };
+    return less;
+}
+
+/**
+* Descends to the leaf whose range contains key.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+typename BTree<Key, Value, Compare, NodeBytes>::Leaf*
+BTree<Key, Value, Compare, NodeBytes>::findLeaf(const Key& key) const
+{
+    NodeBase* node = root_;
+    if (node == nullptr) {
+        return nullptr;
+    }
+    while (!node->isLeaf) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children[childIndex(inner, key)];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+void BTree<Key, Value, Compare, NodeBytes>::clear()
+{
+    if (root_ != nullptr) {
+        destroy(root_);
+    }
+    root_ = nullptr;
+    first_ = nullptr;
+    size_ = 0;
+}
+
+/**
+* Frees a subtree; recursion depth is the tree's height.
+*/
+template <typename Key, typename Value, typename Compare, std::size_t NodeBytes>
+void BTree<Key, Value, Compare, NodeBytes>::destroy(NodeBase* node)
+{
+    if (node->isLeaf) {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for (std::size_t i = 0; i <= inner->count; ++i) {
+        destroy(inner->children[i]);
+    }
+    delete inner;
+}
+
+/*
+---------------------------------------
+End implementations for the BTree class.
+---------------------------------------
+*/
+
+#endif
@@ -0,0 +1,215 @@
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "compact_avl.h"
+#include "test_check.h"
+
+using namespace std;
+
+/**
+* Lookups, bounds, operator[] and iteration both ways agree with
+* expected, and the tree is balanced.
+*/
+template <typename Tree, typename Key, typename Value, typename Compare>
+bool matches(const Tree& tree, const map<Key, Value, Compare>& expected)
+{
+    if (tree.size() != expected.size() || tree.empty() != expected.empty() ||
+        !tree.isBalanced() || !sameItems(tree.begin(), tree.end(), expected)) {
+        return false;
+    }
+    typename Tree::iterator back = tree.end();
+    for (typename map<Key, Value, Compare>::const_reverse_iterator it = expected.rbegin();
+         it != expected.rend(); ++it) {
+        --back;
+        if (!(back->first == it->first)) {
+            return false;
+        }
+    }
+    return back == tree.begin();
+}
+
+void testAgainstMap()
+{
+    CompactAVLTree<int, int> tree;
+    map<int, int> expected;
+    mt19937 rng(11);
+    bool allMatch = true;
+    for (int i = 0; i < 30000; ++i) {
+        int key = static_cast<int>(rng() % 3000);
+        if (rng() % 3 != 0) {
+            tree.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        if (i % 5000 == 0) {
+            allMatch = allMatch && matches(tree, expected);
+        }
+    }
+    CHECK(allMatch);
+    CHECK(matches(tree, expected));
+
+    bool lookupsAgree = true;
+    const CompactAVLTree<int, int>& constTree = tree;
+    for (int key = -1; key <= 3000; ++key) {
+        map<int, int>::iterator it = expected.find(key);
+        CompactAVLTree<int, int>::iterator found = tree.find(key);
+        if ((found != tree.end()) != (it != expected.end()) ||
+            (it != expected.end() && (found->second != it->second ||
+                                      tree[key] != it->second ||
+                                      constTree[key] != it->second))) {
+            lookupsAgree = false;
+        }
+        map<int, int>::iterator lower = expected.lower_bound(key);
+        map<int, int>::iterator upper = expected.upper_bound(key);
+        CompactAVLTree<int, int>::iterator treeLower = tree.lower_bound(key);
+        CompactAVLTree<int, int>::iterator treeUpper = tree.upper_bound(key);
+        if ((treeLower == tree.end()) != (lower == expected.end()) ||
+            (lower != expected.end() && treeLower->first != lower->first) ||
+            (treeUpper == tree.end()) != (upper == expected.end()) ||
+            (upper != expected.end() && treeUpper->first != upper->first)) {
+            lookupsAgree = false;
+        }
+    }
+    CHECK(lookupsAgree);
+
+    bool threw = false;
+    try {
+        tree[-5];
+    }
+    catch (const out_of_range&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // Values written through operator[] and iterators stick
+    if (!expected.empty()) {
+        int key = expected.begin()->first;
+        tree[key] = -1;
+        tree.begin()->second -= 1;
+        expected[key] = -2;
+    }
+    CHECK(matches(tree, expected));
+
+    tree.clear();
+    CHECK(tree.empty() && tree.size() == 0 && tree.begin() == tree.end());
+    tree.insert(make_pair(1, 1));
+    CHECK(tree.size() == 1 && tree.find(1) != tree.end());
+}
+
+/**
+* remove() moves the last node into the freed slot; with string keys
+* and values that move must carry the whole item and relink it.
+*/
+void testStringsAndMoves()
+{
+    CompactAVLTree<string, string> tree;
+    tree.reserve(1000);
+    map<string, string> expected;
+    mt19937 rng(2);
+    for (int i = 0; i < 5000; ++i) {
+        string key = "key" + to_string(rng() % 700);
+        if (rng() % 2 != 0) {
+            string value(20 + i % 50, 'a' + i % 26);
+            if (i % 4 == 0) {
+                tree.insert(make_pair(key, value));
+            }
+            else {
+                pair<string, string> item(key, value);
+                tree.insert(std::move(item));
+            }
+            expected[key] = value;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+    }
+    CHECK(matches(tree, expected));
+}
+
+// A key whose copies can be made to throw; its moves never do
+struct FragileKey
+{
+    static bool copiesFail;
+
+    explicit FragileKey(int i) : name("key" + to_string(i)) {}
+    FragileKey(const FragileKey& other) : name(other.name)
+    {
+        if (copiesFail) {
+            throw runtime_error("copy failed");
+        }
+    }
+    FragileKey(FragileKey&& other) noexcept : name(std::move(other.name)) {}
+    bool operator<(const FragileKey& other) const { return name < other.name; }
+    bool operator==(const FragileKey& other) const { return name == other.name; }
+
+    string name;
+};
+
+bool FragileKey::copiesFail = false;
+
+/**
+* A remove() whose key copy throws leaves the tree exactly as it was,
+* and the tree goes on to remove everything once copies work again.
+*/
+void testThrowingKeyCopy()
+{
+    CompactAVLTree<FragileKey, string> tree;
+    map<FragileKey, string> expected;
+    for (int i = 0; i < 300; ++i) {
+        tree.insert(make_pair(FragileKey(i * 7 % 300), string(30, 'a' + i % 26)));
+        expected.insert(make_pair(FragileKey(i * 7 % 300), string(30, 'a' + i % 26)));
+    }
+
+    FragileKey::copiesFail = true;
+    bool allUnchanged = true;
+    size_t threw = 0;
+    for (int i = 0; i < 300; i += 2) {
+        try {
+            tree.remove(FragileKey(i));
+            expected.erase(FragileKey(i));
+        }
+        catch (const runtime_error&) {
+            ++threw;
+        }
+        allUnchanged = allUnchanged && tree.size() == expected.size() && tree.isBalanced() &&
+                       sameItems(tree.begin(), tree.end(), expected);
+    }
+    FragileKey::copiesFail = false;
+    CHECK(allUnchanged && threw > 100);
+
+    for (int i = 0; i < 300; ++i) {
+        tree.remove(FragileKey(i));
+        expected.erase(FragileKey(i));
+    }
+    CHECK(tree.empty() && matches(tree, expected));
+}
+
+void testComparator()
+{
+    CompactAVLTree<int, int, greater<int> > tree;
+    map<int, int, greater<int> > expected;
+    for (int i = 0; i < 500; ++i) {
+        tree.insert(make_pair(i * 7 % 501, i));
+        expected[i * 7 % 501] = i;
+    }
+    for (int i = 0; i < 500; i += 3) {
+        tree.remove(i);
+        expected.erase(i);
+    }
+    CHECK(matches(tree, expected));
+}
+
+int main()
+{
+    testAgainstMap();
+    testStringsAndMoves();
+    testThrowingKeyCopy();
+    testComparator();
+    return checkResult("compact-test");
+}
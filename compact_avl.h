@@ -0,0 +1,534 @@
+#ifndef COMPACT_AVL_H
+#define COMPACT_AVL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "avl_links.h"
+#include "key_compare.h"
+
+/**
+* An AVL tree map with the same insert/remove/find/operator[] and
+* iterator interface as AVLTree, so that the two can be swapped with a
+* type alias, but a much smaller node.
+*
+* Nodes live in one contiguous vector and link to each other by 32-bit
+* index rather than by pointer. The parent index shares its word with
+* the node's balance factor (-1, 0 or +1) in the top two bits, so the
+* links and balance take 12 bytes, against 29 for an AVLNode's
+* pointers, height and subtree size, and nodes need no per-allocation
+* rounding. With int keys and values a node is 20 bytes instead of 48.
+*
+* remove() keeps the vector dense by moving the last node into the
+* freed slot, so it invalidates iterators (as erasing from a vector
+* does); insert() leaves existing iterators valid. Keys and values
+* must move without throwing; if copying the moved key throws, remove()
+* leaves the tree as it was. The balancing itself
+* is AVLLinks, shared with MappedAVLTree; this class is its storage.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class CompactAVLTree
+{
+    static_assert(std::is_nothrow_move_constructible<Key>::value &&
+                  std::is_nothrow_move_constructible<Value>::value,
+                  "remove() moves a node's key and value into a freed slot and must not fail there");
+
+public:
+    // Indices need two bits of the parent word for the balance factor
+    static const std::size_t MAX_NODES = (std::size_t(1) << 30) - 1;
+
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class CompactAVLTree<Key, Value, Compare>;
+        iterator(CompactAVLTree* tree, uint32_t index);
+        CompactAVLTree* tree_;
+        uint32_t index_;
+    };
+
+    explicit CompactAVLTree(const Compare& comp = Compare());
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    template<typename P>
+    void insert(P&& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reserve(std::size_t nodes);
+    bool empty() const;
+    std::size_t size() const;
+    bool isBalanced() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    static const uint32_t NIL = 0xFFFFFFFFu;
+    static const uint32_t PARENT_MASK = 0x3FFFFFFFu;   // NIL parent is all ones here
+
+    struct CompactNode
+    {
+        CompactNode(const Key& key, const Value& value, uint32_t parent) :
+            item(key, value), left(NIL), right(NIL),
+            parentAndBalance((parent & PARENT_MASK) | BALANCED)
+        {
+        }
+        CompactNode(Key&& key, Value&& value, uint32_t parent) :
+            item(std::move(key), std::move(value)), left(NIL), right(NIL),
+            parentAndBalance((parent & PARENT_MASK) | BALANCED)
+        {
+        }
+        // Takes over other's links and value, with key a copy of its key
+        CompactNode(Key&& key, CompactNode& other) noexcept :
+            item(std::move(key), std::move(other.item.second)), left(other.left),
+            right(other.right), parentAndBalance(other.parentAndBalance)
+        {
+        }
+
+        static const uint32_t BALANCED = 1u << 30;  // balance factor + 1, in bits 30-31
+
+        std::pair<const Key, Value> item;
+        uint32_t left;
+        uint32_t right;
+        uint32_t parentAndBalance;
+    };
+
+    typedef AVLLinks<CompactAVLTree, uint32_t, Key, Compare> Links;
+    friend class AVLLinks<CompactAVLTree, uint32_t, Key, Compare>;
+
+    uint32_t left(uint32_t node) const;
+    uint32_t right(uint32_t node) const;
+    void setLeft(uint32_t node, uint32_t child);
+    void setRight(uint32_t node, uint32_t child);
+    uint32_t parent(uint32_t node) const;
+    void setParent(uint32_t node, uint32_t parent);
+    int balance(uint32_t node) const;
+    void setBalance(uint32_t node, int balance);
+    uint32_t root() const;
+    void setRoot(uint32_t node);
+    const Key& keyOf(uint32_t node) const;
+
+    template<typename K, typename V>
+    void insertItem(K&& key, V&& value);
+    void releaseSlot(uint32_t node, Key&& lastKey);
+
+    std::vector<CompactNode> nodes_;
+    uint32_t root_;
+    Compare comp_;
+};
+
+template <typename Key, typename Value, typename Compare>
+const std::size_t CompactAVLTree<Key, Value, Compare>::MAX_NODES;
+
+template <typename Key, typename Value, typename Compare>
+const uint32_t CompactAVLTree<Key, Value, Compare>::NIL;
+
+template <typename Key, typename Value, typename Compare>
+const uint32_t CompactAVLTree<Key, Value, Compare>::PARENT_MASK;
+
+template <typename Key, typename Value, typename Compare>
+const uint32_t CompactAVLTree<Key, Value, Compare>::CompactNode::BALANCED;
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the CompactAVLTree::iterator class.
+  ---------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator() :
+    tree_(nullptr),
+    index_(NIL)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator(CompactAVLTree* tree, uint32_t index) :
+    tree_(tree),
+    index_(index)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<const Key, Value>& CompactAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return tree_->nodes_[index_].item;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<const Key, Value>* CompactAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &tree_->nodes_[index_].item;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator&
+CompactAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    index_ = Links::successor(*tree_, index_);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator previous(*this);
+    ++(*this);
+    return previous;
+}
+
+/**
+* Moves back one item; from end() that is the largest item.
+*/
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator&
+CompactAVLTree<Key, Value, Compare>::iterator::operator--()
+{
+    index_ = (index_ == NIL) ? Links::last(*tree_) : Links::predecessor(*tree_, index_);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator previous(*this);
+    --(*this);
+    return previous;
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the CompactAVLTree::iterator class.
+  -------------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------
+  Begin implementations for the CompactAVLTree class.
+  -------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree(const Compare& comp) :
+    root_(NIL),
+    comp_(comp)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::left(uint32_t node) const
+{
+    return nodes_[node].left;
+}
+
+template <typename Key, typename Value, typename Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::right(uint32_t node) const
+{
+    return nodes_[node].right;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::setLeft(uint32_t node, uint32_t child)
+{
+    nodes_[node].left = child;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::setRight(uint32_t node, uint32_t child)
+{
+    nodes_[node].right = child;
+}
+
+template <typename Key, typename Value, typename Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::parent(uint32_t node) const
+{
+    uint32_t index = nodes_[node].parentAndBalance & PARENT_MASK;
+    return (index == PARENT_MASK) ? NIL : index;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::setParent(uint32_t node, uint32_t parent)
+{
+    uint32_t& word = nodes_[node].parentAndBalance;
+    word = (word & ~PARENT_MASK) | (parent & PARENT_MASK);
+}
+
+/**
+* Height of the right subtree minus height of the left: -1, 0 or +1.
+*/
+template <typename Key, typename Value, typename Compare>
+int CompactAVLTree<Key, Value, Compare>::balance(uint32_t node) const
+{
+    return static_cast<int>(nodes_[node].parentAndBalance >> 30) - 1;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::setBalance(uint32_t node, int balance)
+{
+    uint32_t& word = nodes_[node].parentAndBalance;
+    word = (word & PARENT_MASK) | (static_cast<uint32_t>(balance + 1) << 30);
+}
+
+template <typename Key, typename Value, typename Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::root() const
+{
+    return root_;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::setRoot(uint32_t node)
+{
+    root_ = node;
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key& CompactAVLTree<Key, Value, Compare>::keyOf(uint32_t node) const
+{
+    return nodes_[node].item.first;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool CompactAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == NIL;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::size() const
+{
+    return nodes_.size();
+}
+
+/**
+* Preallocates room for nodes nodes, so that growing to that size does
+* not reallocate (and transiently double) the node vector.
+*/
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::reserve(std::size_t nodes)
+{
+    nodes_.reserve(nodes);
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::clear()
+{
+    nodes_.clear();
+    root_ = NIL;
+}
+
+/**
+* Inserts, or overwrites the value if the key is present.
+*/
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    insertItem(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Inserts any pair-like argument, moving from it when it is an rvalue.
+*/
+template <typename Key, typename Value, typename Compare>
+template <typename P>
+void CompactAVLTree<Key, Value, Compare>::insert(P&& keyValuePair)
+{
+    std::pair<Key, Value> item(std::forward<P>(keyValuePair));
+    insertItem(std::move(item.first), std::move(item.second));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename V>
+void CompactAVLTree<Key, Value, Compare>::insertItem(K&& key, V&& value)
+{
+    uint32_t parent;
+    bool isLeft;
+    uint32_t found = Links::descend(*this, key, parent, isLeft);
+    if (found != NIL) {
+        nodes_[found].item.second = std::forward<V>(value);
+        return;
+    }
+
+    if (nodes_.size() >= MAX_NODES) {
+        throw std::length_error("CompactAVLTree is full");
+    }
+    uint32_t node = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(CompactNode(std::forward<K>(key), std::forward<V>(value), parent));
+    Links::attach(*this, node, parent, isLeft);
+}
+
+/**
+* Unlinks the node holding key, if any, then closes the gap it leaves
+* in the vector.
+*/
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    uint32_t node = Links::findNode(*this, key);
+    if (node == NIL) {
+        return;
+    }
+    uint32_t last = static_cast<uint32_t>(nodes_.size() - 1);
+    if (node == last) {
+        Links::unlink(*this, node);
+        nodes_.pop_back();
+        return;
+    }
+    // The one copy the move needs, made while a throw changes nothing
+    Key lastKey(nodes_[last].item.first);
+    Links::unlink(*this, node);
+    releaseSlot(node, std::move(lastKey));
+}
+
+/**
+* Frees an unlinked node's slot, which is not the last, by moving the
+* last node into it and pointing that node's neighbours at its new
+* index. The key is const, so the slot is rebuilt rather than assigned,
+* from lastKey, a copy of the last node's key the caller has already
+* made: between destroying the old node and building the new one there
+* are only moves, which cannot throw.
+*/
+template <typename Key, typename Value, typename Compare>
+void CompactAVLTree<Key, Value, Compare>::releaseSlot(uint32_t node, Key&& lastKey)
+{
+    uint32_t last = static_cast<uint32_t>(nodes_.size() - 1);
+    uint32_t up = parent(last);
+    if (up == NIL) {
+        root_ = node;
+    }
+    else if (nodes_[up].left == last) {
+        nodes_[up].left = node;
+    }
+    else {
+        nodes_[up].right = node;
+    }
+    if (nodes_[last].left != NIL) {
+        setParent(nodes_[last].left, node);
+    }
+    if (nodes_[last].right != NIL) {
+        setParent(nodes_[last].right, node);
+    }
+    nodes_[node].~CompactNode();
+    new (&nodes_[node]) CompactNode(std::move(lastKey), nodes_[last]);
+    nodes_.pop_back();
+}
+
+// Iterators hand out mutable values from a const tree, as BinarySearchTree's do
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(const_cast<CompactAVLTree*>(this), Links::first(*this));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(const_cast<CompactAVLTree*>(this), NIL);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    return iterator(const_cast<CompactAVLTree*>(this), Links::findNode(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(const_cast<CompactAVLTree*>(this), Links::lowerBound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(const_cast<CompactAVLTree*>(this), Links::upperBound(*this, key));
+}
+
+/**
+* @precondition The key exists in the map
+* Returns the value associated with the key
+*/
+template <typename Key, typename Value, typename Compare>
+Value& CompactAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    uint32_t node = Links::findNode(*this, key);
+    if (node == NIL) {
+        throw std::out_of_range("Invalid key");
+    }
+    return nodes_[node].item.second;
+}
+
+template <typename Key, typename Value, typename Compare>
+Value const & CompactAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    uint32_t node = Links::findNode(*this, key);
+    if (node == NIL) {
+        throw std::out_of_range("Invalid key");
+    }
+    return nodes_[node].item.second;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool CompactAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return Links::isBalanced(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the CompactAVLTree class.
+  -----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,206 @@
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+#include "key_compare.h"
+#include "test_check.h"
+
+using namespace std;
+
+static long calls = 0;
+
+// A predicate that happens to return int; it must not pass as three-way
+struct IntPredicate
+{
+    int operator()(int a, int b) const { return a < b; }
+};
+
+// A bool predicate other than the standard ones
+struct GreaterPredicate
+{
+    bool operator()(int a, int b) const
+    {
+        ++calls;
+        return a > b;
+    }
+};
+
+// Descending three-way order, with magnitudes other than 1
+struct DescendingThreeWay
+{
+    typedef void is_three_way;
+
+    int operator()(int a, int b) const
+    {
+        ++calls;
+        return 100 * ((a < b) - (a > b));
+    }
+};
+
+// The same order as DescendingThreeWay, for the std::map
+struct Descending
+{
+    bool operator()(int a, int b) const { return a > b; }
+};
+
+/**
+* The kind of each comparator follows its return type and tag: bool is
+* a predicate whatever the tag, a number is three-way only when tagged,
+* and an ordering class is three-way.
+*/
+void testClassification()
+{
+    CHECK((!IsThreeWayCompare<less<int>, int, int>::value));
+    CHECK((!IsThreeWayCompare<GreaterPredicate, int, int>::value));
+    CHECK((IsThreeWayCompare<DescendingThreeWay, int, int>::value));
+    CHECK((IsThreeWayCompare<StringCompare, string, string>::value));
+    CHECK((IsThreeWayCompare<StringCompare, string, const char*>::value));
+    CHECK((IsThreeWayCompare<StringCompare, const char*, string>::value));
+    // IsThreeWayCompare<IntPredicate, int, int> does not compile
+    CHECK((!HasThreeWayTag<IntPredicate>::value && HasThreeWayTag<StringCompare>::value));
+}
+
+/**
+* less, compare and equivalent agree with the order each comparator
+* stands for, for every pair of a few values.
+*/
+template <typename Compare, typename Order>
+bool orderMatches(Order order)
+{
+    Compare comp;
+    for (int a = -3; a <= 3; ++a) {
+        for (int b = -3; b <= 3; ++b) {
+            int want = order(a, b) ? -1 : (order(b, a) ? 1 : 0);
+            if (KeyOrder<Compare>::less(comp, a, b) != (want < 0) ||
+                KeyOrder<Compare>::compare(comp, a, b) != want ||
+                KeyOrder<Compare>::equivalent(comp, a, b) != (want == 0)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void testKeyOrder()
+{
+    CHECK((orderMatches<less<int> >(less<int>())));
+    CHECK((orderMatches<greater<int> >(greater<int>())));
+    CHECK((orderMatches<GreaterPredicate>(greater<int>())));
+    CHECK((orderMatches<DescendingThreeWay>(greater<int>())));
+
+    StringCompare strings;
+    CHECK(KeyOrder<StringCompare>::compare(strings, string("abc"), "abd") == -1);
+    CHECK(KeyOrder<StringCompare>::compare(strings, "abd", string("abc")) == 1);
+    CHECK(KeyOrder<StringCompare>::equivalent(strings, "abc", string("abc")));
+    CHECK(KeyOrder<StringCompare>::less(strings, string("ab"), "abc"));
+}
+
+/**
+* Random updates through each path into the tree, checked against a
+* std::map in the same order with every lookup.
+*/
+template <typename Compare, typename MapCompare>
+bool treeMatches(unsigned seed)
+{
+    AVLTree<int, int, Compare> tree;
+    map<int, int, MapCompare> expected;
+    mt19937 rng(seed);
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 3000);
+        if (rng() % 3 != 0) {
+            tree.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+    }
+    if (!sameItems(tree.begin(), tree.end(), expected) || !tree.shape().balanced) {
+        return false;
+    }
+    for (int key = -1; key <= 3000; ++key) {
+        typename map<int, int, MapCompare>::iterator it = expected.find(key);
+        typename map<int, int, MapCompare>::iterator lower = expected.lower_bound(key);
+        typename map<int, int, MapCompare>::iterator upper = expected.upper_bound(key);
+        typename AVLTree<int, int, Compare>::iterator found = tree.find(key);
+        typename AVLTree<int, int, Compare>::iterator treeLower = tree.lower_bound(key);
+        typename AVLTree<int, int, Compare>::iterator treeUpper = tree.upper_bound(key);
+        if ((found == tree.end()) != (it == expected.end()) ||
+            (it != expected.end() && found->second != it->second) ||
+            (treeLower == tree.end()) != (lower == expected.end()) ||
+            (lower != expected.end() && treeLower->first != lower->first) ||
+            (treeUpper == tree.end()) != (upper == expected.end()) ||
+            (upper != expected.end() && treeUpper->first != upper->first)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testTrees()
+{
+    CHECK((treeMatches<less<int>, less<int> >(1)));
+    CHECK((treeMatches<GreaterPredicate, Descending>(2)));
+    CHECK((treeMatches<DescendingThreeWay, Descending>(3)));
+
+    // A three-way find makes one call per level, and stops on a match
+    AVLTree<int, int, DescendingThreeWay> tree;
+    for (int i = 0; i < 4095; ++i) {
+        tree.insert(make_pair(i, i));
+    }
+    bool withinHeight = true;
+    for (int key = -1; key <= 4095; ++key) {
+        calls = 0;
+        tree.find(key);
+        withinHeight = withinHeight && calls <= tree.height() + 1;
+    }
+    CHECK(withinHeight);
+}
+
+/**
+* StringCompare is transparent: a const char* probe finds, bounds and
+* misses without becoming a std::string.
+*/
+void testTransparent()
+{
+    AVLTree<string, int, StringCompare> tree;
+    map<string, int> expected;
+    for (int i = 0; i < 500; ++i) {
+        string key = "key-" + to_string(i * 37 % 1000);
+        tree.insert(make_pair(key, i));
+        expected[key] = i;
+    }
+    CHECK(sameItems(tree.begin(), tree.end(), expected));
+
+    bool allMatch = true;
+    for (int i = 0; i < 1000; ++i) {
+        string key = "key-" + to_string(i);
+        const char* probe = key.c_str();
+        map<string, int>::iterator it = expected.find(key);
+        map<string, int>::iterator lower = expected.lower_bound(key);
+        map<string, int>::iterator upper = expected.upper_bound(key);
+        AVLTree<string, int, StringCompare>::iterator found = tree.find(probe);
+        AVLTree<string, int, StringCompare>::iterator treeLower = tree.lower_bound(probe);
+        AVLTree<string, int, StringCompare>::iterator treeUpper = tree.upper_bound(probe);
+        allMatch = allMatch && (found == tree.end()) == (it == expected.end()) &&
+                   (it == expected.end() || found->second == it->second) &&
+                   (treeLower == tree.end()) == (lower == expected.end()) &&
+                   (lower == expected.end() || treeLower->first == lower->first) &&
+                   (treeUpper == tree.end()) == (upper == expected.end()) &&
+                   (upper == expected.end() || treeUpper->first == upper->first);
+    }
+    CHECK(allMatch);
+    CHECK(tree.find("absent") == tree.end() && tree.lower_bound("zzz") == tree.end());
+}
+
+int main()
+{
+    testClassification();
+    testKeyOrder();
+    testTrees();
+    testTransparent();
+    return checkResult("compare-test");
+}
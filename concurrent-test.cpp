@@ -0,0 +1,140 @@
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "concurrent_avl.h"
+#include "test_check.h"
+
+using namespace std;
+
+/**
+* Random inserts, overwrites and removes, each mirrored in a std::map;
+* every lookup and the ordered view must agree with it.
+*/
+template <typename Compare>
+void testAgainstMap(size_t shards, unsigned seed)
+{
+    ConcurrentAVLMap<int, int, Compare> m(shards);
+    map<int, int, Compare> expected;
+    mt19937 rng(seed);
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 2000);
+        if (rng() % 3 != 0) {
+            m.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            m.remove(key);
+            expected.erase(key);
+        }
+    }
+    CHECK(m.shardCount() == shards);
+    CHECK(m.size() == expected.size());
+    bool lookupsAgree = true;
+    for (int key = -1; key <= 2000; ++key) {
+        int value = -1;
+        bool found = m.find(key, value);
+        typename map<int, int, Compare>::iterator it = expected.find(key);
+        if (found != (it != expected.end()) || m.contains(key) != found ||
+            (found && value != it->second)) {
+            lookupsAgree = false;
+        }
+    }
+    CHECK(lookupsAgree);
+    {
+        typename ConcurrentAVLMap<int, int, Compare>::ordered_view view = m.ordered();
+        CHECK(sameItems(view.begin(), view.end(), expected));
+    }
+    m.clear();
+    CHECK(m.empty() && m.size() == 0);
+    typename ConcurrentAVLMap<int, int, Compare>::ordered_view empty = m.ordered();
+    CHECK(empty.begin() == empty.end());
+}
+
+/**
+* Writers on disjoint key ranges, each keeping its own std::map, with a
+* reader taking ordered views meanwhile; the views must always be sorted
+* and the final map the union of the writers' maps.
+*/
+void testConcurrentWriters()
+{
+    const int WRITERS = 4;
+    const int RANGE = 5000;
+    ConcurrentAVLMap<int, int> m(8);
+    vector<map<int, int> > expected(WRITERS);
+    vector<thread> threads;
+    for (int w = 0; w < WRITERS; ++w) {
+        threads.push_back(thread([&m, &expected, w] {
+            mt19937 rng(w);
+            for (int i = 0; i < 20000; ++i) {
+                int key = w * RANGE + static_cast<int>(rng() % RANGE);
+                if (rng() % 4 != 0) {
+                    m.insert(make_pair(key, i));
+                    expected[w][key] = i;
+                }
+                else {
+                    m.remove(key);
+                    expected[w].erase(key);
+                }
+            }
+        }));
+    }
+    bool viewsSorted = true;
+    thread reader([&m, &viewsSorted] {
+        for (int r = 0; r < 20; ++r) {
+            ConcurrentAVLMap<int, int>::ordered_view view = m.ordered();
+            int previous = -1;
+            for (ConcurrentAVLMap<int, int>::ordered_view::iterator it = view.begin();
+                 it != view.end(); ++it) {
+                if (it->first <= previous) {
+                    viewsSorted = false;
+                }
+                previous = it->first;
+            }
+        }
+    });
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    reader.join();
+    CHECK(viewsSorted);
+
+    map<int, int> all;
+    for (int w = 0; w < WRITERS; ++w) {
+        all.insert(expected[w].begin(), expected[w].end());
+    }
+    CHECK(m.size() == all.size());
+    ConcurrentAVLMap<int, int>::ordered_view view = m.ordered();
+    CHECK(sameItems(view.begin(), view.end(), all));
+}
+
+void testStrings()
+{
+    ConcurrentAVLMap<string, int> m(3);
+    m.insert(make_pair(string("pear"), 1));
+    m.insert(make_pair(string("apple"), 2));
+    m.insert(make_pair(string("fig"), 3));
+    m.insert(make_pair(string("apple"), 4));
+    int value = 0;
+    CHECK(m.find("apple", value) && value == 4);
+    CHECK(!m.contains("plum"));
+    m.remove("pear");
+    map<string, int> expected;
+    expected["apple"] = 4;
+    expected["fig"] = 3;
+    ConcurrentAVLMap<string, int>::ordered_view view = m.ordered();
+    CHECK(sameItems(view.begin(), view.end(), expected));
+}
+
+int main()
+{
+    testAgainstMap<less<int> >(1, 1);
+    testAgainstMap<less<int> >(7, 2);
+    testAgainstMap<less<int> >(64, 3);
+    testAgainstMap<greater<int> >(5, 4);
+    testConcurrentWriters();
+    testStrings();
+    return checkResult("concurrent-test");
+}
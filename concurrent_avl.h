@@ -0,0 +1,503 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <pthread.h>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* A reader/writer lock: any number of readers, or one writer.
+* (std::shared_mutex needs C++17; this tree builds as C++11.)
+*/
+class RWLock
+{
+public:
+    RWLock();
+    ~RWLock();
+
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+
+private:
+    // Not copyable: the lock is identified by its address.
+    RWLock(const RWLock& other);
+    RWLock& operator=(const RWLock& other);
+
+    pthread_rwlock_t lock_;
+};
+
+/**
+* Holds a lock exclusively (Shared == false) or shared for its lifetime.
+*/
+template <bool Shared>
+class RWLockGuard
+{
+public:
+    explicit RWLockGuard(RWLock& lock) : lock_(lock)
+    {
+        if (Shared) lock_.lock_shared(); else lock_.lock();
+    }
+    ~RWLockGuard()
+    {
+        if (Shared) lock_.unlock_shared(); else lock_.unlock();
+    }
+
+private:
+    RWLockGuard(const RWLockGuard& other);
+    RWLockGuard& operator=(const RWLockGuard& other);
+
+    RWLock& lock_;
+};
+
+typedef RWLockGuard<true> ReadGuard;
+typedef RWLockGuard<false> WriteGuard;
+
+/*
+  -----------------------------------------
+  Begin implementations for the RWLock class.
+  -----------------------------------------
+*/
+
+inline RWLock::RWLock()
+{
+    int error = pthread_rwlock_init(&lock_, nullptr);
+    if (error != 0) {
+        throw std::system_error(error, std::system_category(), "pthread_rwlock_init");
+    }
+}
+
+inline RWLock::~RWLock()
+{
+    pthread_rwlock_destroy(&lock_);
+}
+
+inline void RWLock::lock()
+{
+    pthread_rwlock_wrlock(&lock_);
+}
+
+inline void RWLock::unlock()
+{
+    pthread_rwlock_unlock(&lock_);
+}
+
+inline void RWLock::lock_shared()
+{
+    pthread_rwlock_rdlock(&lock_);
+}
+
+inline void RWLock::unlock_shared()
+{
+    pthread_rwlock_unlock(&lock_);
+}
+
+/*
+  ---------------------------------------
+  End implementations for the RWLock class.
+  ---------------------------------------
+*/
+
+/**
+* A thread-safe ordered map that hash-partitions its keys across a
+* fixed number of AVLTree shards, each behind its own reader/writer
+* lock. Operations on keys in different shards never contend, and
+* lookups in the same shard proceed in parallel.
+*
+* Values are returned by copy: a reference into a shard would outlive
+* the lock that protects it. Ordered traversal goes through an
+* ordered_view, which read-locks every shard for its lifetime and
+* merges the shards' in-order iterators. A thread holding a view must
+* not write to the same map until the view is gone.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+          typename Hash = std::hash<Key> >
+class ConcurrentAVLMap
+{
+public:
+    static const std::size_t DEFAULT_SHARDS = 64;
+
+    class ordered_view;
+
+    explicit ConcurrentAVLMap(std::size_t shards = DEFAULT_SHARDS,
+        const Compare& comp = Compare(), const Hash& hash = Hash());
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+    std::size_t shardCount() const;
+
+    ordered_view ordered() const;
+
+private:
+    typedef AVLTree<Key, Value, Compare> Tree;
+
+    struct Shard
+    {
+        explicit Shard(const Compare& comp) : tree(NodePool::DEFAULT_SLAB_NODES, comp) {}
+        mutable RWLock lock;
+        Tree tree;
+    };
+
+    // Not copyable, like the trees it holds
+    ConcurrentAVLMap(const ConcurrentAVLMap& other);
+    ConcurrentAVLMap& operator=(const ConcurrentAVLMap& other);
+
+    Shard& shardFor(const Key& key) const;
+
+    std::vector<std::unique_ptr<Shard> > shards_;
+    Compare comp_;
+    Hash hash_;
+};
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+const std::size_t ConcurrentAVLMap<Key, Value, Compare, Hash>::DEFAULT_SHARDS;
+
+/**
+* A read-locked, ordered view of the whole map. While it exists no
+* shard can change, so its iterators stay valid.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+class ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view
+{
+public:
+    /**
+    * Visits every item in key order by merging the shards: a min-heap
+    * holds each shard's next item, so a step costs O(log shards).
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    private:
+        friend class ordered_view;
+        typedef typename Tree::iterator TreeIt;
+        typedef std::pair<TreeIt, TreeIt> Cursor;  // (next, end) of one shard
+
+        // Orders cursors so the heap's front holds the smallest key
+        struct Later
+        {
+            Compare comp;
+            bool operator()(const Cursor& a, const Cursor& b) const
+            {
+                return KeyOrder<Compare>::less(comp, b.first->first, a.first->first);
+            }
+        };
+
+        iterator(std::vector<Cursor> cursors, const Compare& comp);
+
+        std::vector<Cursor> heap_;
+        Later later_;
+    };
+
+    ordered_view(ordered_view&& other);
+    ~ordered_view();
+
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    friend class ConcurrentAVLMap<Key, Value, Compare, Hash>;
+    explicit ordered_view(const ConcurrentAVLMap* map);
+
+    ordered_view(const ordered_view& other);
+    ordered_view& operator=(const ordered_view& other);
+
+    const ConcurrentAVLMap* map_;
+};
+
+/*
+---------------------------------------------------------------------
+Begin implementations for the ConcurrentAVLMap::ordered_view classes.
+---------------------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator::iterator() :
+    heap_(),
+    later_()
+{
+
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator::iterator(
+    std::vector<Cursor> cursors, const Compare& comp) :
+    heap_(),
+    later_()
+{
+    later_.comp = comp;
+    for (std::size_t i = 0; i < cursors.size(); ++i) {
+        if (cursors[i].first != cursors[i].second) {
+            heap_.push_back(cursors[i]);
+        }
+    }
+    std::make_heap(heap_.begin(), heap_.end(), later_);
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+const std::pair<const Key, Value>&
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator::operator*() const
+{
+    return *heap_.front().first;
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+const std::pair<const Key, Value>*
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator::operator->() const
+{
+    return &*heap_.front().first;
+}
+
+/**
+* Iterators are equal if they are both at the end or both at the same
+* item; the heap front identifies the item.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+bool ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator::operator==(
+    const iterator& rhs) const
+{
+    if (heap_.empty() || rhs.heap_.empty()) {
+        return heap_.empty() && rhs.heap_.empty();
+    }
+    return heap_.front().first == rhs.heap_.front().first;
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+bool ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator::operator!=(
+    const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+typename ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator&
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator::operator++()
+{
+    std::pop_heap(heap_.begin(), heap_.end(), later_);
+    Cursor& cursor = heap_.back();
+    ++cursor.first;
+    if (cursor.first == cursor.second) {
+        heap_.pop_back();
+    }
+    else {
+        std::push_heap(heap_.begin(), heap_.end(), later_);
+    }
+    return *this;
+}
+
+/**
+* Read-locks every shard, always in shard order. Writers take a single
+* shard lock, so this cannot deadlock against them.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::ordered_view(
+    const ConcurrentAVLMap* map) :
+    map_(map)
+{
+    for (std::size_t i = 0; i < map_->shards_.size(); ++i) {
+        map_->shards_[i]->lock.lock_shared();
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::ordered_view(ordered_view&& other) :
+    map_(other.map_)
+{
+    other.map_ = nullptr;
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::~ordered_view()
+{
+    if (map_ == nullptr) {
+        return;
+    }
+    for (std::size_t i = map_->shards_.size(); i > 0; --i) {
+        map_->shards_[i - 1]->lock.unlock_shared();
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+typename ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::begin() const
+{
+    std::vector<typename iterator::Cursor> cursors;
+    cursors.reserve(map_->shards_.size());
+    for (std::size_t i = 0; i < map_->shards_.size(); ++i) {
+        const Tree& tree = map_->shards_[i]->tree;
+        cursors.push_back(std::make_pair(tree.begin(), tree.end()));
+    }
+    return iterator(cursors, map_->comp_);
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+typename ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::iterator
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view::end() const
+{
+    return iterator();
+}
+
+/*
+-------------------------------------------------------------------
+End implementations for the ConcurrentAVLMap::ordered_view classes.
+-------------------------------------------------------------------
+*/
+
+/*
+----------------------------------------------------
+Begin implementations for the ConcurrentAVLMap class.
+----------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ConcurrentAVLMap(std::size_t shards,
+    const Compare& comp, const Hash& hash) :
+    comp_(comp),
+    hash_(hash)
+{
+    if (shards == 0) {
+        shards = 1;
+    }
+    shards_.reserve(shards);
+    for (std::size_t i = 0; i < shards; ++i) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard(comp)));
+    }
+}
+
+/**
+* The shard owning key. The hash is mixed first so that hashes which
+* are the identity (as std::hash<int> is) still spread runs of keys.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+typename ConcurrentAVLMap<Key, Value, Compare, Hash>::Shard&
+ConcurrentAVLMap<Key, Value, Compare, Hash>::shardFor(const Key& key) const
+{
+    unsigned long long h = static_cast<unsigned long long>(hash_(key));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return *shards_[h % shards_.size()];
+}
+
+/**
+* Inserts or overwrites, as AVLTree::insert does, locking one shard.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+void ConcurrentAVLMap<Key, Value, Compare, Hash>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Shard& shard = shardFor(keyValuePair.first);
+    WriteGuard guard(shard.lock);
+    shard.tree.insert(keyValuePair);
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+void ConcurrentAVLMap<Key, Value, Compare, Hash>::remove(const Key& key)
+{
+    Shard& shard = shardFor(key);
+    WriteGuard guard(shard.lock);
+    shard.tree.remove(key);
+}
+
+/**
+* Copies the value for key into value and returns true, or returns
+* false if key is absent.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+bool ConcurrentAVLMap<Key, Value, Compare, Hash>::find(const Key& key, Value& value) const
+{
+    Shard& shard = shardFor(key);
+    ReadGuard guard(shard.lock);
+    typename Tree::iterator it = shard.tree.find(key);
+    if (it == shard.tree.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+bool ConcurrentAVLMap<Key, Value, Compare, Hash>::contains(const Key& key) const
+{
+    Shard& shard = shardFor(key);
+    ReadGuard guard(shard.lock);
+    return shard.tree.find(key) != shard.tree.end();
+}
+
+/**
+* Empties each shard in turn; other threads may see some shards
+* cleared before others.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+void ConcurrentAVLMap<Key, Value, Compare, Hash>::clear()
+{
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+        WriteGuard guard(shards_[i]->lock);
+        shards_[i]->tree.clear();
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+bool ConcurrentAVLMap<Key, Value, Compare, Hash>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+* Sums the shard sizes, reading each under its lock. Under concurrent
+* writes the total is approximate: the shards are not read at once.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+std::size_t ConcurrentAVLMap<Key, Value, Compare, Hash>::size() const
+{
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+        ReadGuard guard(shards_[i]->lock);
+        total += shards_[i]->tree.size();
+    }
+    return total;
+}
+
+template <typename Key, typename Value, typename Compare, typename Hash>
+std::size_t ConcurrentAVLMap<Key, Value, Compare, Hash>::shardCount() const
+{
+    return shards_.size();
+}
+
+/**
+* Returns a consistent, ordered view of the whole map; see ordered_view.
+*/
+template <typename Key, typename Value, typename Compare, typename Hash>
+typename ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered_view
+ConcurrentAVLMap<Key, Value, Compare, Hash>::ordered() const
+{
+    return ordered_view(this);
+}
+
+/*
+--------------------------------------------------
+End implementations for the ConcurrentAVLMap class.
+--------------------------------------------------
+*/
+
+#endif
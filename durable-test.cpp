@@ -0,0 +1,298 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "durable_avl.h"
+#include "test_check.h"
+
+using namespace std;
+
+typedef DurableAVLTree<string, int> Tree;
+
+struct Change
+{
+    bool insert;
+    string key;
+    int value;
+};
+
+off_t fileSize(const string& path)
+{
+    struct stat info;
+    return (::stat(path.c_str(), &info) == 0) ? info.st_size : -1;
+}
+
+void copyFile(const string& from, const string& to)
+{
+    ifstream in(from.c_str(), ios::binary);
+    ofstream out(to.c_str(), ios::binary | ios::trunc);
+    out << in.rdbuf();
+}
+
+template <typename Key, typename Value, typename Compare>
+bool matches(const DurableAVLTree<Key, Value, Compare>& tree, const map<Key, Value>& expected)
+{
+    return tree.size() == expected.size() && tree.empty() == expected.empty() &&
+           sameItems(tree.tree().begin(), tree.tree().end(), expected);
+}
+
+void apply(const Change& change, map<string, int>& expected)
+{
+    if (change.insert) {
+        expected[change.key] = change.value;
+    }
+    else {
+        expected.erase(change.key);
+    }
+}
+
+/**
+* Inserts and overwrites, and removes of keys then present: every change
+* is logged, since remove() does not log a key that is absent.
+*/
+vector<Change> randomChanges(int count, unsigned seed)
+{
+    vector<Change> changes;
+    map<string, int> present;
+    mt19937 rng(seed);
+    for (int i = 0; i < count; ++i) {
+        Change change = { true, "k" + to_string(rng() % 300), i };
+        if (rng() % 4 == 0 && !present.empty()) {
+            map<string, int>::iterator it = present.lower_bound(change.key);
+            if (it == present.end()) {
+                it = present.begin();
+            }
+            change.insert = false;
+            change.key = it->first;
+        }
+        apply(change, present);
+        changes.push_back(change);
+    }
+    return changes;
+}
+
+/**
+* A reopened tree replays the log onto its checkpoint and must match a
+* std::map given the same changes, across group sizes and checkpoints.
+*/
+void testReplay(const string& snapshot, const string& log)
+{
+    vector<Change> changes = randomChanges(3000, 3);
+    map<string, int> expected;
+    bool allMatch = true;
+    const size_t groups[] = { 1, 16, 1000 };
+    for (size_t round = 0; round < 3; ++round) {
+        Tree tree(snapshot, log, groups[round]);
+        allMatch = allMatch && matches(tree, expected);
+        for (size_t i = round * 1000; i < (round + 1) * 1000; ++i) {
+            if (changes[i].insert) {
+                tree.insert(make_pair(changes[i].key, changes[i].value));
+            }
+            else {
+                tree.remove(changes[i].key);
+            }
+            apply(changes[i], expected);
+        }
+        if (round == 1) {
+            tree.checkpoint();
+            allMatch = allMatch && fileSize(log) == static_cast<off_t>(sizeof(LogHeader));
+        }
+    }
+    CHECK(allMatch);
+
+    Tree tree(snapshot, log);
+    CHECK(matches(tree, expected));
+    CHECK(tree.replayedRecords() == 1000);
+
+    off_t before = fileSize(log);
+    tree.remove("absent");
+    tree.commit();
+    CHECK(fileSize(log) == before && matches(tree, expected));
+}
+
+/**
+* Cutting the log at every byte of its last records, as a crash mid
+* write would, must replay exactly the records wholly before the cut,
+* cut the torn rest off, and leave a log that takes new records.
+*/
+void testTornTail(const string& snapshot, const string& log)
+{
+    const string master = log + ".master";
+    vector<Change> changes = randomChanges(40, 9);
+    vector<off_t> ends;
+    {
+        Tree tree(snapshot, master);
+        for (size_t i = 0; i < changes.size(); ++i) {
+            if (changes[i].insert) {
+                tree.insert(make_pair(changes[i].key, changes[i].value));
+            }
+            else {
+                tree.remove(changes[i].key);
+            }
+            ends.push_back(fileSize(master));
+        }
+    }
+    bool prefixesMatch = true;
+    bool tailsCut = true;
+    bool appendsAfter = true;
+    for (off_t cut = ends[29]; cut <= ends.back(); ++cut) {
+        copyFile(master, log);
+        CHECK(truncate(log.c_str(), cut) == 0);
+        size_t intact = 0;
+        while (intact < ends.size() && ends[intact] <= cut) {
+            ++intact;
+        }
+        map<string, int> expected;
+        for (size_t i = 0; i < intact; ++i) {
+            apply(changes[i], expected);
+        }
+        {
+            Tree tree(snapshot, log);
+            prefixesMatch = prefixesMatch && tree.replayedRecords() == intact &&
+                            matches(tree, expected);
+            tailsCut = tailsCut && fileSize(log) == ends[intact - 1];
+            tree.insert(make_pair(string("after"), static_cast<int>(cut)));
+            expected["after"] = static_cast<int>(cut);
+        }
+        Tree reopened(snapshot, log);
+        appendsAfter = appendsAfter && reopened.replayedRecords() == intact + 1 &&
+                       matches(reopened, expected);
+    }
+    CHECK(prefixesMatch);
+    CHECK(tailsCut);
+    CHECK(appendsAfter);
+
+    // A damaged record ends the replay there, even with intact ones after
+    copyFile(master, log);
+    {
+        FILE* file = fopen(log.c_str(), "r+b");
+        fseek(file, ends[19] + 10, SEEK_SET);
+        fputc('#', file);
+        fclose(file);
+    }
+    map<string, int> expected;
+    for (size_t i = 0; i < 20; ++i) {
+        apply(changes[i], expected);
+    }
+    Tree tree(snapshot, log);
+    CHECK(tree.replayedRecords() == 20 && matches(tree, expected));
+    CHECK(fileSize(log) == ends[19]);
+    unlink(master.c_str());
+}
+
+/**
+* A crash between checkpoint()'s snapshot and its log reset replays the
+* old log onto a snapshot that already holds it; that must change
+* nothing.
+*/
+void testReplayIsIdempotent(const string& snapshot, const string& log)
+{
+    const string saved = log + ".saved";
+    vector<Change> changes = randomChanges(500, 4);
+    map<string, int> expected;
+    {
+        Tree tree(snapshot, log, 8);
+        for (size_t i = 0; i < changes.size(); ++i) {
+            if (changes[i].insert) {
+                tree.insert(make_pair(changes[i].key, changes[i].value));
+            }
+            else {
+                tree.remove(changes[i].key);
+            }
+            apply(changes[i], expected);
+        }
+        tree.commit();
+        copyFile(log, saved);
+        tree.checkpoint();
+    }
+    copyFile(saved, log);
+    Tree tree(snapshot, log);
+    CHECK(tree.replayedRecords() == changes.size());
+    CHECK(matches(tree, expected));
+    unlink(saved.c_str());
+}
+
+/**
+* With a group too large to fill, a change is still committed within
+* maxDelay of being made, by the background flush: a process that goes
+* idle and then dies without closing the tree loses nothing.
+*/
+void testIdleFlush(const string& snapshot, const string& log)
+{
+    pid_t child = fork();
+    if (child == 0) {
+        DurableAVLTree<int, int> tree(snapshot, log, 1000, chrono::microseconds(20000));
+        for (int i = 0; i < 5; ++i) {
+            tree.insert(make_pair(i, i * i));
+        }
+        this_thread::sleep_for(chrono::milliseconds(200));
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    map<int, int> expected;
+    for (int i = 0; i < 5; ++i) {
+        expected[i] = i * i;
+    }
+    DurableAVLTree<int, int> tree(snapshot, log);
+    CHECK(tree.replayedRecords() == 5 && matches(tree, expected));
+}
+
+void testOpenErrors(const string& snapshot, const string& log)
+{
+    {
+        Tree tree(snapshot, log);
+        tree.insert(make_pair(string("a"), 1));
+        tree.checkpoint();
+    }
+    bool threw = false;
+    try {
+        DurableAVLTree<int, int> wrongSnapshot(snapshot, log + ".other");
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    unlink((log + ".other").c_str());
+
+    threw = false;
+    try {
+        DurableAVLTree<int, int> wrongLog(snapshot + ".other", log);
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    threw = false;
+    try {
+        Tree missing(snapshot, "/nonexistent/dir/log");
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main()
+{
+    string snapshot = testPath("durable.snap");
+    string log = testPath("durable.log");
+    void (*tests[])(const string&, const string&) = {
+        testReplay, testTornTail, testReplayIsIdempotent, testIdleFlush, testOpenErrors
+    };
+    for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); ++t) {
+        tests[t](snapshot, log);
+        unlink(snapshot.c_str());
+        unlink(log.c_str());
+    }
+    return checkResult("durable-test");
+}
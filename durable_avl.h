@@ -0,0 +1,222 @@
+#ifndef DURABLE_AVL_H
+#define DURABLE_AVL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <unistd.h>
+#include "avlbst.h"
+#include "operation_log.h"
+
+/**
+* An AVLTree whose changes survive a restart without the whole tree
+* being saved after each one: the tree is rebuilt from its last
+* checkpoint snapshot plus a write-ahead log of the changes since.
+*
+* insert() and remove() append a small record (an operation byte, the
+* key and, for an insert, the value, encoded by SnapshotCodec) to the
+* log and then apply the change to the tree, where it is visible at
+* once. The log commits in groups (see OperationLog): a change is
+* durable within groupRecords changes or maxDelay (plus the sync),
+* whichever comes first, and at once on commit(). The delay is timed
+* in the background, so it holds for a caller that goes idle.
+*
+* checkpoint() saves a snapshot and empties the log. Replaying is
+* idempotent (an insert sets, a remove erases), so a crash between the
+* two only replays the log onto a snapshot that already holds it.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class DurableAVLTree
+{
+public:
+    DurableAVLTree(const std::string& snapshotPath, const std::string& logPath,
+                   std::size_t groupRecords = 1,
+                   std::chrono::microseconds maxDelay = std::chrono::microseconds(1000));
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void commit();
+    void checkpoint();
+
+    const AVLTree<Key, Value, Compare>& tree() const;
+    bool empty() const;
+    std::size_t size() const;
+    uint64_t replayedRecords() const;
+    uint64_t commits() const;
+
+private:
+    // Not copyable: the log owns its file.
+    DurableAVLTree(const DurableAVLTree& other);
+    DurableAVLTree& operator=(const DurableAVLTree& other);
+
+    static const unsigned char OP_INSERT = 1;
+    static const unsigned char OP_REMOVE = 2;
+
+    static LogHeader layout();
+    void applyRecord(LogRecordReader& record);
+
+    std::string snapshotPath_;
+    AVLTree<Key, Value, Compare> tree_;
+    OperationLog log_;
+    LogRecordWriter record_;    // reused for each change
+    uint64_t replayed_;
+};
+
+template <typename Key, typename Value, typename Compare>
+const unsigned char DurableAVLTree<Key, Value, Compare>::OP_INSERT;
+
+template <typename Key, typename Value, typename Compare>
+const unsigned char DurableAVLTree<Key, Value, Compare>::OP_REMOVE;
+
+/*
+  -------------------------------------------------
+  Begin implementations for the DurableAVLTree class.
+  -------------------------------------------------
+*/
+
+/**
+* Loads the snapshot at snapshotPath if there is one, then replays the
+* log at logPath onto it (creating either file as needed). Throws
+* std::runtime_error if either is unreadable or of other types.
+*/
+template <typename Key, typename Value, typename Compare>
+DurableAVLTree<Key, Value, Compare>::DurableAVLTree(const std::string& snapshotPath,
+    const std::string& logPath, std::size_t groupRecords, std::chrono::microseconds maxDelay) :
+    snapshotPath_(snapshotPath),
+    log_(logPath, layout(), groupRecords, maxDelay),
+    replayed_(0)
+{
+    if (::access(snapshotPath.c_str(), F_OK) == 0) {
+        tree_.load(snapshotPath);
+    }
+    replayed_ = log_.replay([this](LogRecordReader& record) { applyRecord(record); });
+}
+
+template <typename Key, typename Value, typename Compare>
+LogHeader DurableAVLTree<Key, Value, Compare>::layout()
+{
+    return LogHeader::describe(SnapshotCodec<Key>::RAW, sizeof(Key),
+                               SnapshotCodec<Value>::RAW, sizeof(Value));
+}
+
+template <typename Key, typename Value, typename Compare>
+void DurableAVLTree<Key, Value, Compare>::applyRecord(LogRecordReader& record)
+{
+    unsigned char op = 0;
+    record.read(&op, sizeof(op));
+    Key key;
+    SnapshotCodec<Key>::read(record, key);
+    if (op == OP_INSERT) {
+        Value value;
+        SnapshotCodec<Value>::read(record, value);
+        tree_.insert(std::make_pair(key, value));
+    }
+    else if (op == OP_REMOVE) {
+        tree_.remove(key);
+    }
+    else {
+        throw std::runtime_error("log: unknown operation in record");
+    }
+    if (record.remaining() != 0) {
+        throw std::runtime_error("log: record is longer than its contents");
+    }
+}
+
+/**
+* Inserts, or overwrites the value if the key is present. If logging it
+* throws, neither the tree nor the log keeps the change.
+*/
+template <typename Key, typename Value, typename Compare>
+void DurableAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    record_.clear();
+    record_.write(&OP_INSERT, sizeof(OP_INSERT));
+    SnapshotCodec<Key>::write(record_, keyValuePair.first);
+    SnapshotCodec<Value>::write(record_, keyValuePair.second);
+    log_.append(record_);
+    tree_.insert(keyValuePair);
+}
+
+/**
+* Removes key if present; a key that is absent is not logged. Like
+* insert, a failure leaves the key in place and out of the log.
+*/
+template <typename Key, typename Value, typename Compare>
+void DurableAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    if (tree_.find(key) == tree_.end()) {
+        return;
+    }
+    record_.clear();
+    record_.write(&OP_REMOVE, sizeof(OP_REMOVE));
+    SnapshotCodec<Key>::write(record_, key);
+    log_.append(record_);
+    tree_.remove(key);
+}
+
+/**
+* Returns once every change so far is durable.
+*/
+template <typename Key, typename Value, typename Compare>
+void DurableAVLTree<Key, Value, Compare>::commit()
+{
+    log_.commit();
+}
+
+/**
+* Saves the whole tree as the new base snapshot and empties the log.
+* save() returns only once the renamed snapshot is durable, so the log
+* is never emptied while a crash could still bring back the old one.
+*/
+template <typename Key, typename Value, typename Compare>
+void DurableAVLTree<Key, Value, Compare>::checkpoint()
+{
+    log_.commit();
+    tree_.save(snapshotPath_);
+    log_.reset();
+}
+
+template <typename Key, typename Value, typename Compare>
+const AVLTree<Key, Value, Compare>& DurableAVLTree<Key, Value, Compare>::tree() const
+{
+    return tree_;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool DurableAVLTree<Key, Value, Compare>::empty() const
+{
+    return tree_.empty();
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t DurableAVLTree<Key, Value, Compare>::size() const
+{
+    return tree_.size();
+}
+
+/**
+* How many log records the constructor replayed onto the snapshot.
+*/
+template <typename Key, typename Value, typename Compare>
+uint64_t DurableAVLTree<Key, Value, Compare>::replayedRecords() const
+{
+    return replayed_;
+}
+
+template <typename Key, typename Value, typename Compare>
+uint64_t DurableAVLTree<Key, Value, Compare>::commits() const
+{
+    return log_.commits();
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the DurableAVLTree class.
+  -----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef FORK_JOIN_H
+#define FORK_JOIN_H
+
+#include <atomic>
+#include <exception>
+#include <thread>
+#include "work_stealing_pool.h"
+
+/**
+* Runs left() and right() and returns when both are done. With a pool,
+* right is submitted to it and left runs on the caller, which then
+* helps with pending tasks until right has finished; with none, they
+* run one after the other. An exception from either is rethrown once
+* both have finished, the left one first.
+*/
+template <typename Left, typename Right>
+void forkJoin(WorkStealingPool* pool, Left left, Right right)
+{
+    std::atomic<bool> done(false);
+    std::exception_ptr rightError;
+    auto runRight = [&right, &rightError, &done]() {
+        try {
+            right();
+        }
+        catch (...) {
+            rightError = std::current_exception();
+        }
+        done.store(true);
+    };
+    if (pool != nullptr) {
+        pool->submit(runRight);
+    }
+
+    std::exception_ptr leftError;
+    try {
+        left();
+    }
+    catch (...) {
+        leftError = std::current_exception();
+    }
+    if (pool == nullptr) {
+        runRight();
+    }
+    while (!done.load()) {
+        if (!pool->runOne()) {
+            std::this_thread::yield();
+        }
+    }
+    if (leftError) {
+        std::rethrow_exception(leftError);
+    }
+    if (rightError) {
+        std::rethrow_exception(rightError);
+    }
+}
+
+/**
+* How many levels of a binary recursion to fork on pool: a few tasks
+* per thread, so that stealing can even out unequal subtrees. 0 when
+* the pool adds no threads.
+*/
+inline int forkDepth(const WorkStealingPool& pool)
+{
+    if (pool.workers() == 0) {
+        return 0;
+    }
+    int depth = 2;
+    while ((1u << (depth - 2)) < pool.parallelism()) {
+        ++depth;
+    }
+    return depth;
+}
+
+#endif
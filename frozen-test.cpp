@@ -0,0 +1,217 @@
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+#include "frozen_map.h"
+#include "test_check.h"
+
+using namespace std;
+
+// A key too wide for two to share a cache line, so BLOCK_KEYS is 1
+struct WideKey
+{
+    int id;
+    char padding[96];
+
+    WideKey() : id(0) {}
+    WideKey(int i) : id(i) {}
+    bool operator<(const WideKey& other) const { return id < other.id; }
+    bool operator==(const WideKey& other) const { return id == other.id; }
+};
+
+/**
+* The snapshot holds expected's items in order, and find, lower_bound
+* and operator[] agree with it for every probe, including probes below
+* and above every key.
+*/
+template <typename Key, typename Value, typename Compare, typename MapCompare>
+bool matches(const FrozenMap<Key, Value, Compare>& frozen,
+             const map<Key, Value, MapCompare>& expected, const vector<Key>& probes)
+{
+    if (frozen.size() != expected.size() || frozen.empty() != expected.empty() ||
+        !sameItems(frozen.begin(), frozen.end(), expected)) {
+        return false;
+    }
+    for (size_t i = 0; i < probes.size(); ++i) {
+        const Key& key = probes[i];
+        typename map<Key, Value, MapCompare>::const_iterator it = expected.find(key);
+        typename map<Key, Value, MapCompare>::const_iterator lower = expected.lower_bound(key);
+        typename FrozenMap<Key, Value, Compare>::iterator found = frozen.find(key);
+        typename FrozenMap<Key, Value, Compare>::iterator frozenLower = frozen.lower_bound(key);
+        if ((found == frozen.end()) != (it == expected.end()) ||
+            (it != expected.end() && !(found->second == it->second && frozen[key] == it->second)) ||
+            (frozenLower == frozen.end()) != (lower == expected.end()) ||
+            (lower != expected.end() && !(frozenLower->first == lower->first))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Every size from empty to a few levels of full blocks, and larger
+* random ones, so the last block is both full and padded. Keys are
+* makeKey(2i) and probes makeKey(j) for every j around them, so each
+* probe falls on, between, below or beyond the keys. MapCompare is
+* Compare as a predicate, for the std::map.
+*/
+template <typename Key, typename Compare, typename MapCompare, typename MakeKey>
+bool testSizes(MakeKey makeKey, size_t blockKeys)
+{
+    mt19937 rng(static_cast<unsigned>(blockKeys));
+    vector<size_t> sizes;
+    for (size_t n = 0; n <= 3 * blockKeys * (blockKeys + 1) + 2 && n <= 600; ++n) {
+        sizes.push_back(n);
+    }
+    for (int i = 0; i < 6; ++i) {
+        sizes.push_back(1000 + rng() % 20000);
+    }
+    bool allMatch = true;
+    for (size_t s = 0; s < sizes.size(); ++s) {
+        map<Key, int, MapCompare> expected;
+        for (size_t i = 0; i < sizes[s]; ++i) {
+            expected[makeKey(2 * static_cast<int>(i))] = static_cast<int>(i);
+        }
+        vector<Key> probes;
+        int top = 2 * static_cast<int>(sizes[s]) + 2;
+        int step = (sizes[s] > 1000) ? 7 : 1;
+        for (int j = -3; j <= top; j += step) {
+            probes.push_back(makeKey(j));
+        }
+        probes.push_back(makeKey(top + 1000));
+        FrozenMap<Key, int, Compare> frozen(expected.begin(), expected.end());
+        allMatch = allMatch && matches(frozen, expected, probes);
+    }
+    return allMatch;
+}
+
+int intKey(int i)
+{
+    return i;
+}
+
+int negatedKey(int i)
+{
+    return -i;
+}
+
+float floatKey(int i)
+{
+    return static_cast<float>(i) * 0.5f - 100.0f;
+}
+
+double doubleKey(int i)
+{
+    return static_cast<double>(i) * 0.25;
+}
+
+string stringKey(int i)
+{
+    char key[16];
+    snprintf(key, sizeof(key), "%08d", i + 10);
+    return key;
+}
+
+WideKey wideKey(int i)
+{
+    return WideKey(i);
+}
+
+void testKeyTypes()
+{
+    // int and float under std::less take the SSE2 search where built
+    CHECK((testSizes<int, less<int>, less<int> >(intKey, FrozenMap<int, int>::BLOCK_KEYS)));
+    CHECK((testSizes<float, less<float>, less<float> >(floatKey,
+        FrozenMap<float, int>::BLOCK_KEYS)));
+    CHECK((testSizes<int, greater<int>, greater<int> >(negatedKey,
+        FrozenMap<int, int, greater<int> >::BLOCK_KEYS)));
+    CHECK((testSizes<double, less<double>, less<double> >(doubleKey,
+        FrozenMap<double, int>::BLOCK_KEYS)));
+    CHECK((testSizes<string, less<string>, less<string> >(stringKey,
+        FrozenMap<string, int>::BLOCK_KEYS)));
+    CHECK((testSizes<string, StringCompare, less<string> >(stringKey,
+        FrozenMap<string, int, StringCompare>::BLOCK_KEYS)));
+    CHECK((FrozenMap<WideKey, int>::BLOCK_KEYS == 1));
+    CHECK((testSizes<WideKey, less<WideKey>, less<WideKey> >(wideKey,
+        FrozenMap<WideKey, int>::BLOCK_KEYS)));
+}
+
+void testErrors()
+{
+    vector<pair<int, int> > decreasing;
+    decreasing.push_back(make_pair(2, 0));
+    decreasing.push_back(make_pair(1, 0));
+    vector<pair<int, int> > repeated;
+    repeated.push_back(make_pair(1, 0));
+    repeated.push_back(make_pair(2, 0));
+    repeated.push_back(make_pair(2, 1));
+
+    bool threw = false;
+    try {
+        FrozenMap<int, int> frozen(decreasing.begin(), decreasing.end());
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    threw = false;
+    try {
+        FrozenMap<int, int> frozen(repeated.begin(), repeated.end());
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // Decreasing is increasing under greater<int>
+    FrozenMap<int, int, greater<int> > reversed(decreasing.begin(), decreasing.end());
+    CHECK(reversed.size() == 2 && reversed.begin()->first == 2);
+
+    FrozenMap<int, int> empty;
+    CHECK(empty.empty() && empty.begin() == empty.end() && empty.find(1) == empty.end() &&
+          empty.lower_bound(1) == empty.end());
+    threw = false;
+    try {
+        empty[1];
+    }
+    catch (const out_of_range&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+/**
+* freeze() copies the tree as it is, and later changes to the tree do
+* not reach the snapshot.
+*/
+void testFreeze()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    mt19937 rng(3);
+    for (int i = 0; i < 5000; ++i) {
+        int key = static_cast<int>(rng() % 20000);
+        tree.insert(make_pair(key, i));
+        expected[key] = i;
+    }
+    FrozenMap<int, int> frozen = tree.freeze();
+    tree.clear();
+    tree.insert(make_pair(-1, -1));
+    vector<int> probes;
+    for (int j = -2; j <= 20001; ++j) {
+        probes.push_back(j);
+    }
+    CHECK(matches(frozen, expected, probes));
+}
+
+int main()
+{
+    testKeyTypes();
+    testErrors();
+    testFreeze();
+    return checkResult("frozen-test");
+}
@@ -0,0 +1,423 @@
+#ifndef FROZEN_MAP_H
+#define FROZEN_MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "key_compare.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+* Counts the keys in one block that are less than key, without
+* branching on the comparisons so the loop can be vectorized.
+*/
+template <typename Key, typename Compare, std::size_t N>
+struct FrozenBlockSearch
+{
+    template <typename K>
+    static std::size_t countLess(const Compare& comp, const Key* block, const K& key)
+    {
+        std::size_t less = 0;
+        for (std::size_t i = 0; i < N; ++i) {
+            less += static_cast<std::size_t>(KeyOrder<Compare>::less(comp, block[i], key));
+        }
+        return less;
+    }
+};
+
+#if defined(__SSE2__)
+// Explicit SSE2 compares for the common 4-byte keys: N / 4 compares
+// build one lane mask, and its popcount is the child index.
+template <std::size_t N>
+struct FrozenBlockSearch<int, std::less<int>, N>
+{
+    static std::size_t countLess(const std::less<int>&, const int* block, int key)
+    {
+        __m128i probe = _mm_set1_epi32(key);
+        unsigned mask = 0;
+        for (std::size_t i = 0; i < N; i += 4) {
+            __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+            mask = (mask << 4) | _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(probe, lanes)));
+        }
+        return __builtin_popcount(mask);
+    }
+};
+
+template <std::size_t N>
+struct FrozenBlockSearch<float, std::less<float>, N>
+{
+    static std::size_t countLess(const std::less<float>&, const float* block, float key)
+    {
+        __m128 probe = _mm_set1_ps(key);
+        unsigned mask = 0;
+        for (std::size_t i = 0; i < N; i += 4) {
+            mask = (mask << 4) | _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(block + i), probe));
+        }
+        return __builtin_popcount(mask);
+    }
+};
+#endif
+
+/**
+* An immutable, read-optimized snapshot of a sorted map, as returned by
+* BinarySearchTree::freeze(). It owns its data and does not refer back
+* to the tree it was made from.
+*
+* Keys are stored in a generalized Eytzinger layout: an implicit search
+* tree of blocks of BLOCK_KEYS sorted keys (one 64-byte cache line of
+* arithmetic keys), where block k's children are blocks
+* k * (BLOCK_KEYS + 1) + 1 ... k * (BLOCK_KEYS + 1) + BLOCK_KEYS + 1.
+* A lookup reads one block per level, counts the keys less than the
+* probe with a branch-free compare (SIMD for int and float keys under
+* std::less), and uses
+* that count as the child index, so it has no data-dependent branches;
+* the children of a block are adjacent, and the first is prefetched
+* while the block is compared.
+* Values live in a parallel array indexed by the same slot.
+*
+* When the key count does not fill the last block, the trailing slots
+* (in sorted order) repeat the largest item, which keeps the compare
+* branch-free without needing a sentinel key.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenMap
+{
+public:
+    static const std::size_t BLOCK_KEYS =
+        sizeof(Key) >= 64 ? 1 : 64 / sizeof(Key);
+
+    typedef std::pair<const Key&, const Value&> reference;
+
+    /**
+    * An in-order iterator over the snapshot.
+    */
+    class iterator
+    {
+    public:
+        struct pointer
+        {
+            reference item;
+            const reference* operator->() const { return &item; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class FrozenMap<Key, Value, Compare>;
+        iterator(const FrozenMap* map, std::size_t slot);
+        const FrozenMap* map_;
+        std::size_t slot_;
+    };
+
+    FrozenMap();
+    template<typename InputIt>
+    FrozenMap(InputIt first, InputIt last, const Compare& comp = Compare());
+
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+private:
+    std::size_t lowerBoundSlot(const Key& key) const;
+    std::size_t firstSlot() const;
+    std::size_t nextSlot(std::size_t slot) const;
+    std::size_t child(std::size_t block, std::size_t i) const;
+    std::size_t countLess(const Key* block, const Key& key) const;
+
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+    std::size_t size_;
+    std::size_t blocks_;
+    std::size_t endSlot_;   // first padding slot, or keys_.size() if none
+    Compare comp_;
+};
+
+template <typename Key, typename Value, typename Compare>
+const std::size_t FrozenMap<Key, Value, Compare>::BLOCK_KEYS;
+
+/*
+-------------------------------------------------------
+Begin implementations for the FrozenMap::iterator class.
+-------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+FrozenMap<Key, Value, Compare>::iterator::iterator() : map_(nullptr), slot_(0)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+FrozenMap<Key, Value, Compare>::iterator::iterator(const FrozenMap* map, std::size_t slot) :
+    map_(map),
+    slot_(slot)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::reference
+FrozenMap<Key, Value, Compare>::iterator::operator*() const
+{
+    return reference(map_->keys_[slot_], map_->values_[slot_]);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator::pointer
+FrozenMap<Key, Value, Compare>::iterator::operator->() const
+{
+    pointer p = { **this };
+    return p;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return map_ == rhs.map_ && slot_ == rhs.slot_;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator&
+FrozenMap<Key, Value, Compare>::iterator::operator++()
+{
+    slot_ = map_->nextSlot(slot_);
+    if (slot_ == map_->keys_.size()) {
+        slot_ = map_->endSlot_;
+    }
+    return *this;
+}
+
+/*
+-----------------------------------------------------
+End implementations for the FrozenMap::iterator class.
+-----------------------------------------------------
+*/
+
+/*
+---------------------------------------------
+Begin implementations for the FrozenMap class.
+---------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+FrozenMap<Key, Value, Compare>::FrozenMap() : size_(0), blocks_(0), endSlot_(0), comp_()
+{
+
+}
+
+/**
+* Builds the snapshot from items in strictly increasing key order,
+* such as a tree's in-order iteration. Slots are filled by walking the
+* implicit layout in order, so construction is linear.
+*/
+template <typename Key, typename Value, typename Compare>
+template <typename InputIt>
+FrozenMap<Key, Value, Compare>::FrozenMap(InputIt first, InputIt last, const Compare& comp) :
+    size_(0),
+    blocks_(0),
+    endSlot_(0),
+    comp_(comp)
+{
+    std::vector<std::pair<Key, Value> > items;
+    for (; first != last; ++first) {
+        items.push_back(std::pair<Key, Value>((*first).first, (*first).second));
+    }
+    for (std::size_t i = 1; i < items.size(); ++i) {
+        if (!KeyOrder<Compare>::less(comp_, items[i - 1].first, items[i].first)) {
+            throw std::invalid_argument("FrozenMap items must be strictly increasing");
+        }
+    }
+
+    size_ = items.size();
+    blocks_ = (size_ + BLOCK_KEYS - 1) / BLOCK_KEYS;
+    keys_.resize(blocks_ * BLOCK_KEYS);
+    values_.resize(blocks_ * BLOCK_KEYS);
+    endSlot_ = keys_.size();
+    if (size_ == 0) {
+        return;
+    }
+
+    std::size_t slot = firstSlot();
+    for (std::size_t rank = 0; rank < keys_.size(); ++rank) {
+        const std::pair<Key, Value>& item = items[std::min(rank, size_ - 1)];
+        if (rank == size_) {
+            endSlot_ = slot;
+        }
+        keys_[slot] = item.first;
+        values_[slot] = item.second;
+        slot = nextSlot(slot);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator
+FrozenMap<Key, Value, Compare>::begin() const
+{
+    return iterator(this, size_ == 0 ? endSlot_ : firstSlot());
+}
+
+template <typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator
+FrozenMap<Key, Value, Compare>::end() const
+{
+    return iterator(this, endSlot_);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator
+FrozenMap<Key, Value, Compare>::find(const Key& key) const
+{
+    std::size_t slot = lowerBoundSlot(key);
+    if (slot == endSlot_ || KeyOrder<Compare>::less(comp_, key, keys_[slot])) {
+        return end();
+    }
+    return iterator(this, slot);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator
+FrozenMap<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(this, lowerBoundSlot(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <typename Key, typename Value, typename Compare>
+Value const & FrozenMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return values_[it.slot_];
+}
+
+/**
+* The branch-free descent. At each block, the number of keys less than
+* key picks the child; if that number is short of a full block, the
+* slot it lands on is the best lower bound seen so far.
+*/
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::lowerBoundSlot(const Key& key) const
+{
+    const Key* keys = keys_.data();
+    std::size_t best = endSlot_;
+    std::size_t block = 0;
+    while (block < blocks_) {
+        std::size_t next = block * (BLOCK_KEYS + 1) + 1;
+        if (next < blocks_) {
+            __builtin_prefetch(keys + next * BLOCK_KEYS);
+        }
+        std::size_t less = countLess(keys + block * BLOCK_KEYS, key);
+        best = (less < BLOCK_KEYS) ? block * BLOCK_KEYS + less : best;
+        block = next + less;
+    }
+    // Padding repeats the largest key, so it never beats a real slot
+    return best;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::countLess(const Key* block, const Key& key) const
+{
+    return FrozenBlockSearch<Key, Compare, BLOCK_KEYS>::countLess(comp_, block, key);
+}
+
+/**
+* Index of block's i-th child block (which may not exist).
+*/
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::child(std::size_t block, std::size_t i) const
+{
+    return block * (BLOCK_KEYS + 1) + i + 1;
+}
+
+/**
+* The leftmost slot of the layout: the smallest key.
+*/
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::firstSlot() const
+{
+    std::size_t block = 0;
+    while (child(block, 0) < blocks_) {
+        block = child(block, 0);
+    }
+    return block * BLOCK_KEYS;
+}
+
+/**
+* The in-order successor of slot, or keys_.size() after the last one.
+* Either descend to the leftmost slot of the next child subtree, step
+* to the next key in the block, or climb to the first ancestor key
+* that follows this subtree.
+*/
+template <typename Key, typename Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::nextSlot(std::size_t slot) const
+{
+    std::size_t block = slot / BLOCK_KEYS;
+    std::size_t i = slot % BLOCK_KEYS;
+    std::size_t right = child(block, i + 1);
+    if (right < blocks_) {
+        while (child(right, 0) < blocks_) {
+            right = child(right, 0);
+        }
+        return right * BLOCK_KEYS;
+    }
+    if (i + 1 < BLOCK_KEYS) {
+        return slot + 1;
+    }
+    while (block != 0) {
+        std::size_t parent = (block - 1) / (BLOCK_KEYS + 1);
+        std::size_t index = (block - 1) % (BLOCK_KEYS + 1);
+        if (index < BLOCK_KEYS) {
+            return parent * BLOCK_KEYS + index;
+        }
+        block = parent;
+    }
+    return keys_.size();
+}
+
+/*
+-------------------------------------------
+End implementations for the FrozenMap class.
+-------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,199 @@
+#include <map>
+#include <random>
+#include <vector>
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+static long comparisons = 0;
+
+// std::less<int> that counts its calls
+struct CountingLess
+{
+    bool operator()(int a, int b) const
+    {
+        ++comparisons;
+        return a < b;
+    }
+};
+
+typedef AVLTree<int, int, CountingLess> Tree;
+
+bool matches(const Tree& tree, const map<int, int>& expected)
+{
+    TreeShape shape = tree.shape();
+    return tree.size() == expected.size() && shape.balanced && shape.height == tree.height() &&
+           sameItems(tree.begin(), tree.end(), expected);
+}
+
+/**
+* Ascending keys hinted with end(), or with the iterator the previous
+* insert returned, take a fixed number of comparisons each whatever the
+* size of the tree: no descent, and no walk to the largest node.
+*/
+void testHintedAscending()
+{
+    const int sizes[] = { 1000, 100000 };
+    for (int s = 0; s < 2; ++s) {
+        Tree endHinted;
+        Tree lastHinted;
+        map<int, int> expected;
+        comparisons = 0;
+        for (int key = 0; key < sizes[s]; ++key) {
+            endHinted.insert(endHinted.end(), make_pair(key, -key));
+            expected[key] = -key;
+        }
+        CHECK(comparisons <= sizes[s]);
+        comparisons = 0;
+        Tree::iterator hint = lastHinted.end();
+        for (int key = 0; key < sizes[s]; ++key) {
+            hint = lastHinted.insert(hint, make_pair(key, -key));
+        }
+        CHECK(comparisons <= 2 * sizes[s]);
+        CHECK(matches(endHinted, expected) && matches(lastHinted, expected));
+    }
+
+    // Descending keys hinted with the previous insert
+    Tree descending;
+    map<int, int> expected;
+    comparisons = 0;
+    Tree::iterator hint = descending.end();
+    for (int key = 10000; key > 0; --key) {
+        hint = descending.insert(hint, make_pair(key, key));
+        expected[key] = key;
+    }
+    CHECK(comparisons <= 3 * 10000);
+    CHECK(matches(descending, expected));
+}
+
+/**
+* The largest node the hinted path remembers must be forgotten by
+* everything else that changes the tree: removing it, clearing, loading,
+* joining, splitting and the batch operations. Each step is followed by
+* hinted appends and checked against std::map.
+*/
+void testLargestNodeFollowsChanges()
+{
+    Tree tree;
+    map<int, int> expected;
+    int next = 0;
+    bool allMatch = true;
+    for (int step = 0; step < 12; ++step) {
+        for (int i = 0; i < 50; ++i, ++next) {
+            if (i % 2 == 0) {
+                tree.insert(tree.end(), make_pair(next, step));
+            }
+            else {
+                tree.insert(--tree.end(), make_pair(next, step));
+            }
+            expected[next] = step;
+        }
+        allMatch = allMatch && matches(tree, expected);
+
+        switch (step % 6) {
+        case 0:
+            // The largest node goes, and the tree's new largest is smaller
+            tree.remove(next - 1);
+            expected.erase(next - 1);
+            tree.remove(next - 2);
+            expected.erase(next - 2);
+            next -= 10;
+            break;
+        case 1: {
+            vector<int> keys;
+            keys.push_back(next - 1);
+            keys.push_back(next - 3);
+            tree.erase_batch(keys.begin(), keys.end());
+            expected.erase(next - 1);
+            expected.erase(next - 3);
+            next -= 20;
+            break;
+        }
+        case 2: {
+            Tree upper;
+            tree.split(next - 30, upper);
+            expected.erase(expected.lower_bound(next - 30), expected.end());
+            next -= 40;
+            break;
+        }
+        case 3: {
+            Tree right;
+            for (int i = 0; i < 30; ++i) {
+                right.insert(make_pair(next + 5 + i, -i));
+                expected[next + 5 + i] = -i;
+            }
+            tree.join(right);
+            next += 35;
+            break;
+        }
+        case 4: {
+            vector<pair<int, int> > items(expected.begin(), expected.end());
+            items.pop_back();
+            expected.erase(--expected.end());
+            tree.bulk_load(items.begin(), items.end());
+            next -= 5;
+            break;
+        }
+        default:
+            tree.clear();
+            expected.clear();
+            next = -100;
+            break;
+        }
+        allMatch = allMatch && matches(tree, expected);
+        tree.insert(tree.end(), make_pair(next + 1000, 1));
+        expected[next + 1000] = 1;
+        tree.remove(next + 1000);
+        expected.erase(next + 1000);
+        allMatch = allMatch && matches(tree, expected);
+    }
+    CHECK(allMatch);
+}
+
+/**
+* Hints that are wrong, or that name an existing key, still insert in
+* the right place or overwrite the value.
+*/
+void testWrongHints()
+{
+    Tree tree;
+    map<int, int> expected;
+    mt19937 rng(4);
+    bool allMatch = true;
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 5000);
+        Tree::iterator hint = tree.end();
+        if (!tree.empty() && rng() % 3 != 0) {
+            hint = tree.lower_bound(static_cast<int>(rng() % 5000));
+        }
+        Tree::iterator placed = tree.insert(hint, make_pair(key, i));
+        expected[key] = i;
+        allMatch = allMatch && placed != tree.end() && placed->first == key && placed->second == i;
+        if (rng() % 4 == 0) {
+            int gone = static_cast<int>(rng() % 5000);
+            tree.remove(gone);
+            expected.erase(gone);
+        }
+    }
+    CHECK(allMatch);
+    CHECK(matches(tree, expected));
+
+    vector<pair<int, int> > tail;
+    for (int key = 4990; key < 6000; key += 3) {
+        tail.push_back(make_pair(key, 7));
+        expected[key] = 7;
+    }
+    tree.append_sorted(tail.begin(), tail.end());
+    tree.insert(tree.end(), make_pair(6000, 8));
+    expected[6000] = 8;
+    CHECK(matches(tree, expected));
+}
+
+int main()
+{
+    testHintedAscending();
+    testLargestNodeFollowsChanges();
+    testWrongHints();
+    return checkResult("ingest-test");
+}
@@ -0,0 +1,172 @@
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+/**
+* Every way of walking tree visits expected's items in the same order:
+* forward, scan(), backwards with -- from end(), and through the
+* reverse and const iterators.
+*/
+template <typename Tree>
+bool walksMatch(const Tree& tree, const map<int, int>& expected)
+{
+    if (!sameItems(tree.begin(), tree.end(), expected) ||
+        !sameItems(tree.cbegin(), tree.cend(), expected)) {
+        return false;
+    }
+
+    vector<pair<int, int> > scanned;
+    for (const pair<const int, int>& item : tree.scan()) {
+        scanned.push_back(item);
+    }
+    if (!sameItems(scanned.begin(), scanned.end(), expected)) {
+        return false;
+    }
+
+    map<int, int>::const_reverse_iterator want = expected.rbegin();
+    typename Tree::iterator back = tree.end();
+    while (back != tree.begin()) {
+        --back;
+        if (want == expected.rend() || back->first != want->first ||
+            back->second != want->second) {
+            return false;
+        }
+        ++want;
+    }
+    if (want != expected.rend()) {
+        return false;
+    }
+
+    vector<pair<int, int> > reversed(tree.rbegin(), tree.rend());
+    vector<pair<int, int> > constReversed(tree.crbegin(), tree.crend());
+    vector<pair<int, int> > wanted(expected.rbegin(), expected.rend());
+    return reversed == wanted && constReversed == wanted;
+}
+
+/**
+* Empty and single-item trees, where begin(), end() and the largest item
+* are the edge cases of every step.
+*/
+void testSmallTrees()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    CHECK(walksMatch(tree, expected));
+    CHECK(tree.begin() == tree.end() && tree.rbegin() == tree.rend() &&
+          tree.scan().begin() == tree.scan().end());
+
+    tree.insert(make_pair(7, 70));
+    expected[7] = 70;
+    CHECK(walksMatch(tree, expected));
+    AVLTree<int, int>::iterator last = --tree.end();
+    CHECK(last == tree.begin() && last->first == 7);
+    CHECK(--tree.begin() == tree.end());
+    CHECK(tree.rbegin()->second == 70 && ++tree.rbegin() == tree.rend());
+
+    tree.remove(7);
+    expected.erase(7);
+    CHECK(walksMatch(tree, expected));
+}
+
+/**
+* --end() reaches the largest item from any end(): the tree's own, and
+* the ones find, lower_bound and upper_bound return on a miss. Stepping
+* forward and back again returns to the same item, and the postfix
+* forms return the old position.
+*/
+void testEndAndSteps()
+{
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(make_pair(2 * i, i));
+    }
+    CHECK((--tree.end())->first == 198);
+    CHECK((--tree.find(1))->first == 198);
+    CHECK((--tree.lower_bound(500))->first == 198);
+    CHECK((--tree.upper_bound(198))->first == 198);
+    CHECK((--tree.cend())->first == 198);
+
+    AVLTree<int, int>::const_iterator fromEnd = tree.end();
+    CHECK((--fromEnd)->first == 198);
+
+    bool allReturn = true;
+    for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        AVLTree<int, int>::iterator step = it;
+        ++step;
+        --step;
+        allReturn = allReturn && step == it;
+        AVLTree<int, int>::iterator post = step--;
+        allReturn = allReturn && post == it && (it == tree.begin() || ++step == it);
+    }
+    CHECK(allReturn);
+
+    AVLTree<int, int>::iterator it = tree.find(100);
+    AVLTree<int, int>::iterator before = it++;
+    CHECK(before->first == 100 && it->first == 102);
+    before = it--;
+    CHECK(before->first == 102 && it->first == 100);
+
+    // Values are writable through iterator, the reverse iterators and scan()
+    tree.rbegin()->second = -1;
+    (--tree.end())->second -= 1;
+    for (pair<const int, int>& item : tree.scan()) {
+        item.second += 1000;
+    }
+    CHECK(tree.find(198)->second == 998 && tree.find(0)->second == 1000);
+}
+
+/**
+* Random updates on an AVL tree, and an unbalanced tree built from
+* sorted keys, whose one long path is deeper than the scan stack's
+* first reservation.
+*/
+void testAgainstMap()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    mt19937 rng(17);
+    bool allMatch = true;
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 5000);
+        if (rng() % 3 != 0) {
+            tree.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        if (i % 2500 == 0) {
+            allMatch = allMatch && walksMatch(tree, expected);
+        }
+    }
+    CHECK(allMatch);
+    CHECK(walksMatch(tree, expected));
+
+    BinarySearchTree<int, int> chain;
+    map<int, int> chainExpected;
+    for (int i = 0; i < 2000; ++i) {
+        chain.insert(make_pair(i, -i));
+        chainExpected[i] = -i;
+    }
+    CHECK(walksMatch(chain, chainExpected));
+    for (int i = 0; i < 2000; i += 3) {
+        chain.remove(i);
+        chainExpected.erase(i);
+    }
+    CHECK(walksMatch(chain, chainExpected));
+}
+
+int main()
+{
+    testSmallTrees();
+    testEndAndSteps();
+    testAgainstMap();
+    return checkResult("iterator-test");
+}
@@ -0,0 +1,182 @@
+#ifndef KEY_COMPARE_H
+#define KEY_COMPARE_H
+
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+/**
+* The trees accept two kinds of comparator:
+*  - a strict weak ordering, comp(a, b) returning bool (std::less), or
+*  - a three-way comparator, comp(a, b) returning a negative, zero or
+*    positive value: a C++20 ordering from <=>, or any other type if
+*    the comparator says so with a nested is_three_way type.
+* A comparator returning int or another arithmetic type without that
+* tag is rejected at compile time: it could be either kind, and taking
+* it for the wrong one breaks the tree silently.
+* KeyOrder answers "less?", "equal?" and "which way?" for either kind,
+* so a descent with a three-way comparator makes exactly one call per
+* level.
+* A comparator with a nested is_transparent type may also be called
+* with arguments that are not Key, such as a string_view probe for
+* std::string keys.
+*/
+template <typename Compare, typename = void>
+struct HasThreeWayTag : std::false_type
+{
+};
+
+template <typename Compare>
+struct HasThreeWayTag<Compare, typename std::conditional<true, void,
+    typename Compare::is_three_way>::type> : std::true_type
+{
+};
+
+template <typename Compare, typename A, typename B>
+struct IsThreeWayCompare : std::integral_constant<bool, HasThreeWayTag<Compare>::value ||
+    std::is_class<typename std::decay<decltype(std::declval<const Compare&>()(
+        std::declval<const A&>(), std::declval<const B&>()))>::type>::value>
+{
+    typedef typename std::decay<decltype(std::declval<const Compare&>()(
+        std::declval<const A&>(), std::declval<const B&>()))>::type Result;
+
+    static_assert(HasThreeWayTag<Compare>::value || std::is_same<Result, bool>::value ||
+                  std::is_class<Result>::value,
+                  "a comparator returning a number must declare a nested is_three_way "
+                  "type to be used as three-way, or return bool to be used as a predicate");
+    static_assert(!HasThreeWayTag<Compare>::value || !std::is_same<Result, bool>::value,
+                  "a comparator returning bool is a predicate, not three-way");
+};
+
+/**
+* The standard orderings on a scalar type agree with ==, which costs one
+* compare and lets a descent stay branch-free.
+*/
+template <typename Compare, typename A, typename B>
+struct HasNativeEquality : std::false_type
+{
+};
+
+template <typename T>
+struct HasNativeEquality<std::less<T>, T, T> : std::is_scalar<T>
+{
+};
+
+template <typename T>
+struct HasNativeEquality<std::greater<T>, T, T> : std::is_scalar<T>
+{
+};
+
+template <typename Compare>
+struct KeyOrder
+{
+    template <typename A, typename B>
+    static bool less(const Compare& comp, const A& a, const B& b)
+    {
+        return less(comp, a, b, IsThreeWayCompare<Compare, A, B>());
+    }
+
+    template <typename A, typename B>
+    static int compare(const Compare& comp, const A& a, const B& b)
+    {
+        return compare(comp, a, b, IsThreeWayCompare<Compare, A, B>());
+    }
+
+    template <typename A, typename B>
+    static bool equivalent(const Compare& comp, const A& a, const B& b)
+    {
+        return equivalent(comp, a, b, HasNativeEquality<Compare, A, B>());
+    }
+
+private:
+    template <typename A, typename B>
+    static bool equivalent(const Compare&, const A& a, const B& b, std::true_type)
+    {
+        return a == b;
+    }
+
+    template <typename A, typename B>
+    static bool equivalent(const Compare& comp, const A& a, const B& b, std::false_type)
+    {
+        return compare(comp, a, b) == 0;
+    }
+
+    template <typename A, typename B>
+    static bool less(const Compare& comp, const A& a, const B& b, std::false_type)
+    {
+        return comp(a, b);
+    }
+
+    template <typename A, typename B>
+    static bool less(const Compare& comp, const A& a, const B& b, std::true_type)
+    {
+        return comp(a, b) < 0;
+    }
+
+    template <typename A, typename B>
+    static int compare(const Compare& comp, const A& a, const B& b, std::false_type)
+    {
+        return static_cast<int>(comp(b, a)) - static_cast<int>(comp(a, b));
+    }
+
+    template <typename A, typename B>
+    static int compare(const Compare& comp, const A& a, const B& b, std::true_type)
+    {
+        auto order = comp(a, b);
+        return (order < 0) ? -1 : ((order > 0) ? 1 : 0);
+    }
+};
+
+/**
+* A transparent three-way comparator for std::string keys: one
+* character scan per comparison, and lookups by const char* (or by
+* std::string_view in C++17) without building a temporary string.
+*/
+struct StringCompare
+{
+    typedef void is_transparent;
+    typedef void is_three_way;
+
+#if __cplusplus >= 201703L
+    int operator()(std::string_view a, std::string_view b) const
+    {
+        return a.compare(b);
+    }
+#else
+    int operator()(const std::string& a, const std::string& b) const
+    {
+        return a.compare(b);
+    }
+    int operator()(const std::string& a, const char* b) const
+    {
+        return a.compare(b);
+    }
+    int operator()(const char* a, const std::string& b) const
+    {
+        int order = b.compare(a);
+        return (order < 0) - (order > 0);
+    }
+#endif
+};
+
+#if defined(__cpp_impl_three_way_comparison) && __cpp_impl_three_way_comparison >= 201907L
+/**
+* A transparent three-way comparator built on operator<=>.
+*/
+struct ThreeWayCompare
+{
+    typedef void is_transparent;
+
+    template <typename A, typename B>
+    auto operator()(const A& a, const B& b) const -> decltype(a <=> b)
+    {
+        return a <=> b;
+    }
+};
+#endif
+
+#endif
@@ -0,0 +1,279 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped_avl.h"
+#include "test_check.h"
+
+using namespace std;
+
+typedef MappedAVLTree<int, long> Tree;
+
+/**
+* Lookups, bounds and iteration both ways agree with expected, and the
+* tree is balanced.
+*/
+template <typename Compare>
+bool matches(const MappedAVLTree<int, long, Compare>& tree, const map<int, long, Compare>& expected)
+{
+    if (tree.size() != expected.size() || tree.empty() != expected.empty() ||
+        !tree.isBalanced() || !sameItems(tree.begin(), tree.end(), expected)) {
+        return false;
+    }
+    typename MappedAVLTree<int, long, Compare>::iterator back = tree.end();
+    for (typename map<int, long, Compare>::const_reverse_iterator it = expected.rbegin();
+         it != expected.rend(); ++it) {
+        --back;
+        if (back->first != it->first) {
+            return false;
+        }
+    }
+    for (int key = -1; key <= 1000; key += 7) {
+        typename map<int, long, Compare>::const_iterator lower = expected.lower_bound(key);
+        typename map<int, long, Compare>::const_iterator upper = expected.upper_bound(key);
+        typename MappedAVLTree<int, long, Compare>::iterator treeLower = tree.lower_bound(key);
+        typename MappedAVLTree<int, long, Compare>::iterator treeUpper = tree.upper_bound(key);
+        if ((tree.find(key) != tree.end()) != (expected.count(key) != 0) ||
+            (treeLower == tree.end()) != (lower == expected.end()) ||
+            (lower != expected.end() && treeLower->first != lower->first) ||
+            (treeUpper == tree.end()) != (upper == expected.end()) ||
+            (upper != expected.end() && treeUpper->first != upper->first)) {
+            return false;
+        }
+    }
+    return back == tree.begin();
+}
+
+off_t fileSize(const string& path)
+{
+    struct stat info;
+    return (::stat(path.c_str(), &info) == 0) ? info.st_size : -1;
+}
+
+void copyFile(const string& from, const string& to)
+{
+    ifstream in(from.c_str(), ios::binary);
+    ofstream out(to.c_str(), ios::binary);
+    out << in.rdbuf();
+}
+
+/**
+* Random updates across several open/close cycles: each reopen must
+* find exactly what the last close left.
+*/
+void testReopen(const string& path)
+{
+    map<int, long> expected;
+    mt19937 rng(1);
+    bool allMatch = true;
+    for (int cycle = 0; cycle < 4; ++cycle) {
+        Tree tree(path);
+        allMatch = allMatch && matches(tree, expected);
+        for (int i = 0; i < 30000; ++i) {
+            int key = static_cast<int>(rng() % 20000);
+            if (rng() % 3 != 0) {
+                tree.insert(make_pair(key, static_cast<long>(i)));
+                expected[key] = i;
+            }
+            else {
+                tree.remove(key);
+                expected.erase(key);
+            }
+        }
+        if (!expected.empty()) {
+            tree[expected.begin()->first] = -5;
+            expected.begin()->second = -5;
+        }
+        allMatch = allMatch && matches(tree, expected);
+        if (cycle % 2 == 0) {
+            tree.close();
+            allMatch = allMatch && !tree.isOpen() && tree.empty() && tree.begin() == tree.end();
+        }
+    }
+    CHECK(allMatch);
+
+    Tree tree(path);
+    CHECK(matches(tree, expected));
+    tree.clear();
+    tree.close();
+    tree.open(path);
+    CHECK(tree.empty() && tree.size() == 0);
+}
+
+/**
+* Where key's node sits relative to other's. Both move together when
+* the file is remapped, so this is the difference of their offsets.
+*/
+long slotDistance(const Tree& tree, int key, int other)
+{
+    return reinterpret_cast<const char*>(&*tree.find(key)) -
+           reinterpret_cast<const char*>(&*tree.find(other));
+}
+
+/**
+* Removed nodes are reused before the file grows, including after the
+* free list has been through a close and reopen. Keys are inserted in
+* order into a fresh file, so their slots are in key order too.
+*/
+void testFreeList(const string& path)
+{
+    const int NODES = 100000;
+    off_t full;
+    {
+        Tree tree(path);
+        for (int key = 0; key < NODES; ++key) {
+            tree.insert(make_pair(key, static_cast<long>(key)));
+        }
+        full = fileSize(path);
+
+        // LIFO: the next insert lands in the slot just freed
+        const pair<const int, long>* slot = &*tree.find(500);
+        tree.remove(500);
+        tree.insert(make_pair(NODES + 500, 1L));
+        CHECK(&*tree.find(NODES + 500) == slot);
+
+        for (int key = 0; key < 1000; ++key) {
+            tree.remove(key);
+        }
+    }
+    map<int, long> expected;
+    for (int key = 1000; key < NODES; ++key) {
+        expected[key] = key;
+    }
+    expected[NODES + 500] = 1;
+    Tree tree(path);
+    bool reused = true;
+    for (int key = 0; key < 1000; ++key) {
+        if (key != 500) {
+            tree.insert(make_pair(-key - 1, static_cast<long>(key)));
+            expected[-key - 1] = key;
+            reused = reused && slotDistance(tree, -key - 1, 1000) < 0;
+        }
+    }
+    CHECK(reused);
+    CHECK(fileSize(path) == full);
+    CHECK(matches(tree, expected));
+
+    // With the free list empty, the file's unused tail comes next
+    tree.insert(make_pair(-5000, 0L));
+    CHECK(slotDistance(tree, -5000, NODES - 1) > 0);
+}
+
+void testOpenErrors(const string& path)
+{
+    string copy = path + ".copy";
+    string other = path + ".other";
+    {
+        Tree tree(path);
+        tree.insert(make_pair(1, 1L));
+        tree.sync();
+
+        bool threw = false;
+        try {
+            Tree second(path);
+        }
+        catch (const runtime_error& error) {
+            threw = strstr(error.what(), "already open") != nullptr;
+        }
+        CHECK(threw);
+
+        // A copy taken between a change and its sync is dirty
+        tree.insert(make_pair(2, 2L));
+        copyFile(path, copy);
+    }
+    bool threw = false;
+    try {
+        Tree dirty(copy);
+    }
+    catch (const runtime_error& error) {
+        threw = strstr(error.what(), "not synced") != nullptr;
+    }
+    CHECK(threw);
+
+    threw = false;
+    try {
+        MappedAVLTree<int, int> wrongTypes(path);
+    }
+    catch (const runtime_error& error) {
+        threw = strstr(error.what(), "other key or value types") != nullptr;
+    }
+    CHECK(threw);
+
+    {
+        ofstream garbage(other.c_str());
+        for (int i = 0; i < 20; ++i) {
+            garbage << "not a tree ";
+        }
+    }
+    threw = false;
+    try {
+        Tree notATree(other);
+    }
+    catch (const runtime_error& error) {
+        threw = strstr(error.what(), "is not a mapped tree") != nullptr;
+    }
+    CHECK(threw);
+
+    threw = false;
+    try {
+        Tree missing("/nonexistent/dir/tree");
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    Tree closed;
+    threw = false;
+    try {
+        closed.insert(make_pair(1, 1L));
+    }
+    catch (const logic_error&) {
+        threw = true;
+    }
+    CHECK(threw && closed.empty());
+
+    // The lock goes with the tree
+    Tree reopened(path);
+    CHECK(reopened.size() == 2);
+    unlink(copy.c_str());
+    unlink(other.c_str());
+}
+
+void testComparator(const string& path)
+{
+    map<int, long, greater<int> > expected;
+    {
+        MappedAVLTree<int, long, greater<int> > tree(path);
+        for (int i = 0; i < 1000; ++i) {
+            tree.insert(make_pair(i * 7 % 1001, static_cast<long>(i)));
+            expected[i * 7 % 1001] = i;
+        }
+        for (int i = 0; i < 1000; i += 3) {
+            tree.remove(i);
+            expected.erase(i);
+        }
+    }
+    MappedAVLTree<int, long, greater<int> > tree(path);
+    CHECK(matches(tree, expected));
+}
+
+int main()
+{
+    string path = testPath("mapped");
+    testReopen(path);
+    unlink(path.c_str());
+    testFreeList(path);
+    unlink(path.c_str());
+    testOpenErrors(path);
+    unlink(path.c_str());
+    testComparator(path);
+    unlink(path.c_str());
+    return checkResult("mapped-test");
+}
@@ -0,0 +1,854 @@
+#ifndef MAPPED_AVL_H
+#define MAPPED_AVL_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "avl_links.h"
+#include "key_compare.h"
+
+/**
+* An AVL tree map whose nodes live in a memory-mapped file, with the
+* same insert/remove/find/operator[] and iterator interface as AVLTree.
+*
+* Nodes link to each other by their byte offset in the file rather than
+* by pointer, so the file can be mapped at any address: open() maps it
+* and checks its fixed-size header, and nothing else, so a multi-GB tree
+* serves find() and iteration at once, paging nodes in as they are
+* touched. The parent offset shares its word with the node's balance
+* factor (-1, 0 or +1) in the two low bits, which node alignment leaves
+* clear. Removed nodes go on a free list kept in the file, and insert()
+* takes from it before growing the file. The balancing itself is
+* AVLLinks, shared with CompactAVLTree; this class is its storage.
+*
+* Keys and values are stored as their bytes, so both must be trivially
+* copyable, and the file must be opened with the comparator it was
+* built with. Only one tree at a time may have a file open: open() takes
+* an exclusive flock() on it, held until close().
+*
+* Crash consistency is limited to sync(): it makes every change durable
+* and marks the file clean. The first change after that marks it dirty
+* on disk before touching any node, and open() refuses a dirty file,
+* since a crash may have left it with half a rotation applied. close()
+* and the destructor sync.
+*
+* Iterators hold offsets, so only removing their own item invalidates
+* them; references to items are invalidated by an insert that grows the
+* file, which remaps it. A value changed through an iterator is not seen
+* as a change; use insert() or operator[] for that.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class MappedAVLTree
+{
+    static_assert(std::is_trivially_copyable<Key>::value &&
+                  std::is_trivially_copyable<Value>::value,
+                  "MappedAVLTree stores keys and values as raw bytes");
+
+public:
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class MappedAVLTree<Key, Value, Compare>;
+        iterator(MappedAVLTree* tree, uint64_t offset);
+        MappedAVLTree* tree_;
+        uint64_t offset_;
+    };
+
+    explicit MappedAVLTree(const Compare& comp = Compare());
+    explicit MappedAVLTree(const std::string& path, const Compare& comp = Compare());
+    ~MappedAVLTree();
+
+    void open(const std::string& path);
+    void sync();
+    void close();
+    bool isOpen() const;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reserve(std::size_t nodes);
+    bool empty() const;
+    std::size_t size() const;
+    bool isBalanced() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    // Not copyable: the tree owns its mapping and file descriptor.
+    MappedAVLTree(const MappedAVLTree& other);
+    MappedAVLTree& operator=(const MappedAVLTree& other);
+
+    static const uint64_t NIL = 0;                  // the header is at offset 0
+    static const uint64_t BALANCE_MASK = 3;
+    static const uint32_t VERSION = 1;
+    static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static const uint32_t CLEAN = 1;
+    static const uint32_t DIRTY = 2;
+    static const std::size_t MIN_FILE_BYTES = std::size_t(1) << 20;
+    static const std::size_t MAX_GROWTH_BYTES = std::size_t(1) << 30;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t nodeSize;
+        uint32_t state;         // CLEAN or DIRTY
+        uint64_t root;
+        uint64_t count;
+        uint64_t freeList;      // free nodes chain through their left field
+        uint64_t end;           // offset of the first node never handed out
+    };
+
+    struct MappedNode
+    {
+        MappedNode(const Key& key, const Value& value, uint64_t parent) :
+            item(key, value), left(NIL), right(NIL), parentAndBalance(parent | BALANCED)
+        {
+        }
+
+        static const uint64_t BALANCED = 1;    // balance factor + 1, in bits 0-1
+
+        std::pair<const Key, Value> item;
+        uint64_t left;
+        uint64_t right;
+        uint64_t parentAndBalance;
+    };
+
+    static_assert(alignof(MappedNode) > BALANCE_MASK, "node offsets need two clear low bits");
+
+    static const char* expectedMagic();
+    static uint64_t firstNode();
+
+    FileHeader& header() const;
+    MappedNode& node(uint64_t offset) const;
+    uint64_t root() const;
+    bool isNodeOffset(uint64_t offset) const;
+    void checkHeader() const;
+    void markDirty();
+    void grow(std::size_t minBytes);
+    void unmap();
+
+    typedef AVLLinks<MappedAVLTree, uint64_t, Key, Compare> Links;
+    friend class AVLLinks<MappedAVLTree, uint64_t, Key, Compare>;
+
+    uint64_t left(uint64_t node) const;
+    uint64_t right(uint64_t node) const;
+    void setLeft(uint64_t node, uint64_t child);
+    void setRight(uint64_t node, uint64_t child);
+    uint64_t parent(uint64_t node) const;
+    void setParent(uint64_t node, uint64_t parent);
+    int balance(uint64_t node) const;
+    void setBalance(uint64_t node, int balance);
+    void setRoot(uint64_t node);
+    const Key& keyOf(uint64_t node) const;
+
+    uint64_t allocate();
+    void release(uint64_t node);
+
+    std::string path_;
+    int fd_;
+    char* base_;
+    std::size_t mapped_;    // bytes mapped: the whole file
+    bool dirty_;            // changed since the last sync
+    Compare comp_;
+};
+
+template <typename Key, typename Value, typename Compare>
+const uint64_t MappedAVLTree<Key, Value, Compare>::NIL;
+
+template <typename Key, typename Value, typename Compare>
+const uint64_t MappedAVLTree<Key, Value, Compare>::BALANCE_MASK;
+
+template <typename Key, typename Value, typename Compare>
+const uint32_t MappedAVLTree<Key, Value, Compare>::VERSION;
+
+template <typename Key, typename Value, typename Compare>
+const uint32_t MappedAVLTree<Key, Value, Compare>::BYTE_ORDER_MARK;
+
+template <typename Key, typename Value, typename Compare>
+const uint32_t MappedAVLTree<Key, Value, Compare>::CLEAN;
+
+template <typename Key, typename Value, typename Compare>
+const uint32_t MappedAVLTree<Key, Value, Compare>::DIRTY;
+
+template <typename Key, typename Value, typename Compare>
+const std::size_t MappedAVLTree<Key, Value, Compare>::MIN_FILE_BYTES;
+
+template <typename Key, typename Value, typename Compare>
+const std::size_t MappedAVLTree<Key, Value, Compare>::MAX_GROWTH_BYTES;
+
+template <typename Key, typename Value, typename Compare>
+const uint64_t MappedAVLTree<Key, Value, Compare>::MappedNode::BALANCED;
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the MappedAVLTree::iterator class.
+  --------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+MappedAVLTree<Key, Value, Compare>::iterator::iterator() :
+    tree_(nullptr),
+    offset_(NIL)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+MappedAVLTree<Key, Value, Compare>::iterator::iterator(MappedAVLTree* tree, uint64_t offset) :
+    tree_(tree),
+    offset_(offset)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<const Key, Value>& MappedAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return tree_->node(offset_).item;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<const Key, Value>* MappedAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &tree_->node(offset_).item;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return offset_ == rhs.offset_;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return offset_ != rhs.offset_;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator&
+MappedAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    offset_ = Links::successor(*tree_, offset_);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator previous(*this);
+    ++(*this);
+    return previous;
+}
+
+/**
+* Moves back one item; from end() that is the largest item.
+*/
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator&
+MappedAVLTree<Key, Value, Compare>::iterator::operator--()
+{
+    offset_ = (offset_ == NIL) ? Links::last(*tree_) : Links::predecessor(*tree_, offset_);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator previous(*this);
+    --(*this);
+    return previous;
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the MappedAVLTree::iterator class.
+  ------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------
+  Begin implementations for the MappedAVLTree class.
+  ------------------------------------------------
+*/
+
+/**
+* A tree with no file; it reads as empty until open().
+*/
+template <typename Key, typename Value, typename Compare>
+MappedAVLTree<Key, Value, Compare>::MappedAVLTree(const Compare& comp) :
+    fd_(-1),
+    base_(nullptr),
+    mapped_(0),
+    dirty_(false),
+    comp_(comp)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+MappedAVLTree<Key, Value, Compare>::MappedAVLTree(const std::string& path, const Compare& comp) :
+    fd_(-1),
+    base_(nullptr),
+    mapped_(0),
+    dirty_(false),
+    comp_(comp)
+{
+    open(path);
+}
+
+/**
+* Syncs and closes the file. A failed sync is not reported here (call
+* sync() or close() first to see it); the file is then left dirty.
+*/
+template <typename Key, typename Value, typename Compare>
+MappedAVLTree<Key, Value, Compare>::~MappedAVLTree()
+{
+    try {
+        close();
+    }
+    catch (...) {
+        unmap();
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+const char* MappedAVLTree<Key, Value, Compare>::expectedMagic()
+{
+    return "BSTMMAP";   // and the terminating NUL: 8 bytes
+}
+
+/**
+* Offset of the first node slot: just past the header, aligned for a node.
+*/
+template <typename Key, typename Value, typename Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::firstNode()
+{
+    const uint64_t align = alignof(MappedNode);
+    return (sizeof(FileHeader) + align - 1) / align * align;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::FileHeader&
+MappedAVLTree<Key, Value, Compare>::header() const
+{
+    return *reinterpret_cast<FileHeader*>(base_);
+}
+
+// The nodes were constructed in the file, possibly by another process
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::MappedNode&
+MappedAVLTree<Key, Value, Compare>::node(uint64_t offset) const
+{
+    return *reinterpret_cast<MappedNode*>(base_ + offset);
+}
+
+template <typename Key, typename Value, typename Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::root() const
+{
+    return (base_ == nullptr) ? NIL : header().root;
+}
+
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::setRoot(uint64_t node)
+{
+    header().root = node;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedAVLTree<Key, Value, Compare>::isOpen() const
+{
+    return base_ != nullptr;
+}
+
+/**
+* Opens the tree at path, creating an empty one if the file does not
+* exist or is empty. Only the header is read, so this takes the same
+* time whatever the size of the tree. Throws std::runtime_error if the
+* file is open in another tree (in this process or another), cannot be
+* mapped, was written for other key or value types, or was left dirty
+* by a crash.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::open(const std::string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("mapped tree: cannot open " + path);
+    }
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        bool held = (errno == EWOULDBLOCK);
+        ::close(fd);
+        throw std::runtime_error(held ? "mapped tree: " + path + " is already open"
+                                      : "mapped tree: cannot lock " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("mapped tree: cannot stat " + path);
+    }
+    bool fresh = (info.st_size == 0);
+    std::size_t bytes = fresh ? MIN_FILE_BYTES : static_cast<std::size_t>(info.st_size);
+    if (fresh && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        ::close(fd);
+        throw std::runtime_error("mapped tree: cannot size " + path);
+    }
+    if (bytes < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("mapped tree: " + path + " is too small");
+    }
+    void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("mapped tree: cannot map " + path);
+    }
+    path_ = path;
+    fd_ = fd;
+    base_ = static_cast<char*>(base);
+    mapped_ = bytes;
+    dirty_ = false;
+
+    if (fresh) {
+        FileHeader& head = header();
+        std::memcpy(head.magic, expectedMagic(), sizeof(head.magic));
+        head.version = VERSION;
+        head.byteOrder = BYTE_ORDER_MARK;
+        head.keySize = sizeof(Key);
+        head.valueSize = sizeof(Value);
+        head.nodeSize = sizeof(MappedNode);
+        head.state = DIRTY;
+        head.root = NIL;
+        head.count = 0;
+        head.freeList = NIL;
+        head.end = firstNode();
+        dirty_ = true;
+        sync();
+        return;
+    }
+    try {
+        checkHeader();
+    }
+    catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+/**
+* Checks that the header describes this tree type and a clean file whose
+* offsets lie within it.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::checkHeader() const
+{
+    const FileHeader& head = header();
+    if (std::memcmp(head.magic, expectedMagic(), sizeof(head.magic)) != 0) {
+        throw std::runtime_error("mapped tree: " + path_ + " is not a mapped tree");
+    }
+    if (head.version != VERSION || head.byteOrder != BYTE_ORDER_MARK) {
+        throw std::runtime_error("mapped tree: " + path_ + " has an unsupported version or byte order");
+    }
+    if (head.keySize != sizeof(Key) || head.valueSize != sizeof(Value) ||
+        head.nodeSize != sizeof(MappedNode)) {
+        throw std::runtime_error("mapped tree: " + path_ + " holds other key or value types");
+    }
+    if (head.state != CLEAN) {
+        throw std::runtime_error("mapped tree: " + path_ + " was not synced after its last change");
+    }
+    if (head.end < firstNode() || head.end > mapped_ ||
+        (head.end - firstNode()) % sizeof(MappedNode) != 0 ||
+        head.count > (head.end - firstNode()) / sizeof(MappedNode) ||
+        (head.root != NIL && !isNodeOffset(head.root)) ||
+        (head.freeList != NIL && !isNodeOffset(head.freeList))) {
+        throw std::runtime_error("mapped tree: " + path_ + " is corrupt");
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedAVLTree<Key, Value, Compare>::isNodeOffset(uint64_t offset) const
+{
+    return offset >= firstNode() && offset < header().end &&
+           (offset - firstNode()) % sizeof(MappedNode) == 0;
+}
+
+/**
+* Makes every change durable, then marks the file clean. The nodes are
+* flushed before the header, so a crash in between leaves it dirty.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::sync()
+{
+    if (base_ == nullptr || !dirty_) {
+        return;
+    }
+    if (::msync(base_, mapped_, MS_SYNC) != 0 || ::fsync(fd_) != 0) {
+        throw std::runtime_error("mapped tree: cannot sync " + path_);
+    }
+    header().state = CLEAN;
+    if (::msync(base_, sizeof(FileHeader), MS_SYNC) != 0) {
+        throw std::runtime_error("mapped tree: cannot sync " + path_);
+    }
+    dirty_ = false;
+}
+
+/**
+* Syncs and unmaps the file; the tree then reads as empty.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::close()
+{
+    sync();
+    unmap();
+}
+
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::unmap()
+{
+    if (base_ == nullptr) {
+        return;
+    }
+    ::munmap(base_, mapped_);
+    ::close(fd_);
+    base_ = nullptr;
+    fd_ = -1;
+    mapped_ = 0;
+    dirty_ = false;
+}
+
+/**
+* Called before any change: the first one after a sync marks the file
+* dirty on disk, so that open() can tell it may be inconsistent.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::markDirty()
+{
+    if (base_ == nullptr) {
+        throw std::logic_error("mapped tree: not open");
+    }
+    if (dirty_) {
+        return;
+    }
+    header().state = DIRTY;
+    if (::msync(base_, sizeof(FileHeader), MS_SYNC) != 0) {
+        throw std::runtime_error("mapped tree: cannot sync " + path_);
+    }
+    dirty_ = true;
+}
+
+/**
+* Extends the file to at least minBytes, doubling it up to a step of
+* MAX_GROWTH_BYTES, and maps it afresh. Node offsets are unchanged, but
+* every reference into the old mapping is invalid afterwards.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::grow(std::size_t minBytes)
+{
+    std::size_t bytes = mapped_;
+    while (bytes < minBytes) {
+        bytes += (bytes < MAX_GROWTH_BYTES) ? bytes : MAX_GROWTH_BYTES;
+    }
+    if (::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+        throw std::runtime_error("mapped tree: cannot grow " + path_);
+    }
+    void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error("mapped tree: cannot map " + path_);
+    }
+    ::munmap(base_, mapped_);
+    base_ = static_cast<char*>(base);
+    mapped_ = bytes;
+}
+
+template <typename Key, typename Value, typename Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::left(uint64_t node) const
+{
+    return this->node(node).left;
+}
+
+template <typename Key, typename Value, typename Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::right(uint64_t node) const
+{
+    return this->node(node).right;
+}
+
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::setLeft(uint64_t node, uint64_t child)
+{
+    this->node(node).left = child;
+}
+
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::setRight(uint64_t node, uint64_t child)
+{
+    this->node(node).right = child;
+}
+
+template <typename Key, typename Value, typename Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::parent(uint64_t node) const
+{
+    return this->node(node).parentAndBalance & ~BALANCE_MASK;
+}
+
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::setParent(uint64_t node, uint64_t parent)
+{
+    uint64_t& word = this->node(node).parentAndBalance;
+    word = (word & BALANCE_MASK) | parent;
+}
+
+/**
+* Height of the right subtree minus height of the left: -1, 0 or +1.
+*/
+template <typename Key, typename Value, typename Compare>
+int MappedAVLTree<Key, Value, Compare>::balance(uint64_t node) const
+{
+    return static_cast<int>(this->node(node).parentAndBalance & BALANCE_MASK) - 1;
+}
+
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::setBalance(uint64_t node, int balance)
+{
+    uint64_t& word = this->node(node).parentAndBalance;
+    word = (word & ~BALANCE_MASK) | static_cast<uint64_t>(balance + 1);
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key& MappedAVLTree<Key, Value, Compare>::keyOf(uint64_t node) const
+{
+    return this->node(node).item.first;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedAVLTree<Key, Value, Compare>::empty() const
+{
+    return root() == NIL;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t MappedAVLTree<Key, Value, Compare>::size() const
+{
+    return (base_ == nullptr) ? 0 : static_cast<std::size_t>(header().count);
+}
+
+/**
+* Grows the file to hold nodes nodes, so that inserting up to that many
+* does not remap it.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::reserve(std::size_t nodes)
+{
+    if (base_ == nullptr) {
+        throw std::logic_error("mapped tree: not open");
+    }
+    std::size_t bytes = static_cast<std::size_t>(firstNode()) + nodes * sizeof(MappedNode);
+    if (bytes > mapped_) {
+        grow(bytes);
+    }
+}
+
+/**
+* Empties the tree. The file keeps its size, for the nodes to come.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::clear()
+{
+    markDirty();
+    FileHeader& head = header();
+    head.root = NIL;
+    head.count = 0;
+    head.freeList = NIL;
+    head.end = firstNode();
+}
+
+/**
+* A slot for a new node: the most recently freed one, or else the next
+* never used, growing the file if it is full.
+*/
+template <typename Key, typename Value, typename Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::allocate()
+{
+    uint64_t offset = header().freeList;
+    if (offset != NIL) {
+        header().freeList = node(offset).left;
+        return offset;
+    }
+    offset = header().end;
+    if (offset + sizeof(MappedNode) > mapped_) {
+        grow(static_cast<std::size_t>(offset + sizeof(MappedNode)));
+    }
+    header().end = offset + sizeof(MappedNode);
+    return offset;
+}
+
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::release(uint64_t node)
+{
+    MappedNode& slot = this->node(node);
+    slot.left = header().freeList;
+    slot.right = NIL;
+    slot.parentAndBalance = NIL;
+    header().freeList = node;
+}
+
+/**
+* Inserts, or overwrites the value if the key is present.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    markDirty();
+    uint64_t parent;
+    bool isLeft;
+    uint64_t found = Links::descend(*this, keyValuePair.first, parent, isLeft);
+    if (found != NIL) {
+        node(found).item.second = keyValuePair.second;
+        return;
+    }
+
+    // allocate() may remap the file, so no node reference is held across it
+    uint64_t fresh = allocate();
+    new (&node(fresh)) MappedNode(keyValuePair.first, keyValuePair.second, parent);
+    ++header().count;
+    Links::attach(*this, fresh, parent, isLeft);
+}
+
+/**
+* Unlinks the node holding key, if any, and puts it on the free list. A
+* node with two children is replaced in the tree by its successor, so no
+* other node moves and iterators to other items stay valid.
+*/
+template <typename Key, typename Value, typename Compare>
+void MappedAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    uint64_t target = Links::findNode(*this, key);
+    if (target == NIL) {
+        return;
+    }
+    markDirty();
+    Links::unlink(*this, target);
+    release(target);
+    --header().count;
+}
+
+// Iterators hand out mutable values from a const tree, as BinarySearchTree's do
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(const_cast<MappedAVLTree*>(this), Links::first(*this));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(const_cast<MappedAVLTree*>(this), NIL);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    return iterator(const_cast<MappedAVLTree*>(this), Links::findNode(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(const_cast<MappedAVLTree*>(this), Links::lowerBound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(const_cast<MappedAVLTree*>(this), Links::upperBound(*this, key));
+}
+
+/**
+* @precondition The key exists in the map
+* Returns the value associated with the key. Writing through the
+* reference is a change that sync() does not know about, so the file is
+* marked dirty here, before it is handed out.
+*/
+template <typename Key, typename Value, typename Compare>
+Value& MappedAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    uint64_t found = Links::findNode(*this, key);
+    if (found == NIL) {
+        throw std::out_of_range("Invalid key");
+    }
+    markDirty();
+    return node(found).item.second;
+}
+
+template <typename Key, typename Value, typename Compare>
+Value const & MappedAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    uint64_t found = Links::findNode(*this, key);
+    if (found == NIL) {
+        throw std::out_of_range("Invalid key");
+    }
+    return node(found).item.second;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return Links::isBalanced(*this);
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the MappedAVLTree class.
+  ----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+struct SlabGroup;
+
+/**
+* A slab allocator for fixed-size tree nodes.
+* Nodes are carved out of slabs of slabNodes blocks each, and freed
+* blocks are kept on an intrusive free list for reuse by the next
+* allocation. release() returns every slab at once, so a tree whose
+* nodes need no destructor can be torn down in O(slabs).
+*
+* A pool constructed with slabNodes == 0 is not pooled: every block
+* goes straight to operator new/delete, as in the original trees.
+*
+* Slabs are held in groups that several pools may share: share() lets
+* a pool take over live blocks that sit in another pool's slabs, and a
+* group is freed once no pool holds it. Only the group a pool is
+* filling takes new slabs, and that group is never shared.
+*/
+class NodePool
+{
+public:
+    static const std::size_t DEFAULT_SLAB_NODES = 256;
+
+    NodePool(std::size_t nodeSize, std::size_t slabNodes);
+    ~NodePool();
+
+    void* allocate();
+    void deallocate(void* block);
+    void release();
+    void discard(void* block);
+    void adopt(NodePool& other);
+    void share(NodePool& other, std::size_t blocks);
+
+    bool pooled() const;
+    bool compatible(const NodePool& other) const;
+    std::size_t slabCount() const;
+    std::size_t liveCount() const;
+    std::uint64_t generation() const;
+
+private:
+    // Not copyable: the free blocks and live count belong to one pool.
+    NodePool(const NodePool& other);
+    NodePool& operator=(const NodePool& other);
+
+    void addSlab();
+    void reserveSlabs(std::size_t count);
+    void retireSlabs();
+    void holdSlabs(const std::vector<std::shared_ptr<SlabGroup> >& groups);
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    std::size_t blockSize_;
+    std::size_t slabNodes_;
+    std::shared_ptr<SlabGroup> slabs_;  // the group new slabs go to, held here only
+    std::vector<std::shared_ptr<SlabGroup> > retired_;  // full groups, maybe shared
+    char* cursor_;      // next unused block in the newest slab
+    char* slabEnd_;     // one past the end of the newest slab
+    FreeBlock* freeList_;
+    std::size_t live_;  // blocks handed out and not yet returned
+    std::uint64_t generation_;  // bumped whenever the blocks handed out change
+};
+
+/**
+* Slabs that are freed together, when the last pool holding them lets go.
+*/
+struct SlabGroup
+{
+    SlabGroup() {}
+    ~SlabGroup()
+    {
+        for (std::size_t i = 0; i < slabs.size(); ++i) {
+            ::operator delete(slabs[i]);
+        }
+    }
+
+    std::vector<char*> slabs;
+
+private:
+    SlabGroup(const SlabGroup& other);
+    SlabGroup& operator=(const SlabGroup& other);
+};
+
+/*
+  -----------------------------------------
+  Begin implementations for the NodePool class.
+  -----------------------------------------
+*/
+
+/**
+* Rounds the node size up so that every block in a slab stays
+* suitably aligned for any node type.
+*/
+inline NodePool::NodePool(std::size_t nodeSize, std::size_t slabNodes) :
+    blockSize_(nodeSize),
+    slabNodes_(slabNodes),
+    cursor_(nullptr),
+    slabEnd_(nullptr),
+    freeList_(nullptr),
+    live_(0),
+    generation_(0)
+{
+    const std::size_t align = alignof(std::max_align_t);
+    if (blockSize_ < sizeof(FreeBlock)) {
+        blockSize_ = sizeof(FreeBlock);
+    }
+    blockSize_ = (blockSize_ + align - 1) / align * align;
+}
+
+inline NodePool::~NodePool()
+{
+    release();
+}
+
+/**
+* Hands out one node-sized block, preferring recycled blocks, then the
+* unused tail of the newest slab, and only then a fresh slab.
+*/
+inline void* NodePool::allocate()
+{
+    ++generation_;
+    if (!pooled()) {
+        void* block = ::operator new(blockSize_);
+        ++live_;
+        return block;
+    }
+    if (freeList_ != nullptr) {
+        FreeBlock* block = freeList_;
+        freeList_ = block->next;
+        ++live_;
+        return block;
+    }
+    if (cursor_ == slabEnd_) {
+        addSlab();
+    }
+    void* block = cursor_;
+    cursor_ += blockSize_;
+    ++live_;
+    return block;
+}
+
+/**
+* Starts a fresh slab for allocate(), in the group being filled. Kept
+* out of allocate() so that its common path stays small enough to
+* inline.
+*/
+inline void NodePool::addSlab()
+{
+    if (!slabs_) {
+        slabs_ = std::make_shared<SlabGroup>();
+    }
+    reserveSlabs(slabs_->slabs.size() + 1);  // so push_back cannot throw
+    char* slab = static_cast<char*>(::operator new(blockSize_ * slabNodes_));
+    slabs_->slabs.push_back(slab);
+    cursor_ = slab;
+    slabEnd_ = slab + blockSize_ * slabNodes_;
+}
+
+/**
+* Returns a block (whose node has already been destroyed) to the pool.
+*/
+inline void NodePool::deallocate(void* block)
+{
+    if (block == nullptr) {
+        return;
+    }
+    --live_;
+    ++generation_;
+    if (!pooled()) {
+        ::operator delete(block);
+        return;
+    }
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = freeList_;
+    freeList_ = freed;
+}
+
+/**
+* Frees every slab without visiting individual blocks, or lets go of it
+* if another pool still holds it. Any nodes still living in the pool
+* must have been destroyed (or need no destructor).
+*/
+inline void NodePool::release()
+{
+    slabs_.reset();
+    retired_.clear();
+    cursor_ = nullptr;
+    slabEnd_ = nullptr;
+    freeList_ = nullptr;
+    live_ = 0;
+    ++generation_;
+}
+
+/**
+* Gives up a block ahead of a release(), which must follow. Unlike
+* deallocate it changes no pool state, so several threads may discard
+* at once: an unpooled block is freed here, a slab block with its slab.
+*/
+inline void NodePool::discard(void* block)
+{
+    if (!pooled()) {
+        ::operator delete(block);
+    }
+}
+
+/**
+* Takes over every block of other, live or free, and leaves other
+* empty, so nodes can move from one tree to another without being
+* copied. Throws std::invalid_argument, changing nothing, unless the
+* pools are compatible.
+*/
+inline void NodePool::adopt(NodePool& other)
+{
+    if (&other == this) {
+        return;
+    }
+    if (!compatible(other)) {
+        throw std::invalid_argument("NodePool::adopt: block sizes or policies differ");
+    }
+    other.retireSlabs();
+    holdSlabs(other.retired_);
+
+    // The unused tail of other's newest slab joins the free blocks
+    for (char* block = other.cursor_; block != other.slabEnd_; block += blockSize_) {
+        FreeBlock* freed = reinterpret_cast<FreeBlock*>(block);
+        freed->next = freeList_;
+        freeList_ = freed;
+    }
+    while (other.freeList_ != nullptr) {
+        FreeBlock* freed = other.freeList_;
+        other.freeList_ = freed->next;
+        freed->next = freeList_;
+        freeList_ = freed;
+    }
+    live_ += other.live_;
+    ++generation_;
+    ++other.generation_;
+
+    other.retired_.clear();
+    other.cursor_ = nullptr;
+    other.slabEnd_ = nullptr;
+    other.live_ = 0;
+}
+
+/**
+* Takes over blocks of other's live blocks, which stay where they are:
+* from now on this pool holds every slab of other's too, so those blocks
+* (and other's) outlive whichever pool lets go first. Both pools keep
+* their own free blocks. O(slab groups), not O(blocks). Throws
+* std::invalid_argument, changing nothing, unless the pools are
+* compatible.
+*/
+inline void NodePool::share(NodePool& other, std::size_t blocks)
+{
+    if (&other == this) {
+        return;
+    }
+    if (!compatible(other)) {
+        throw std::invalid_argument("NodePool::share: block sizes or policies differ");
+    }
+    other.retireSlabs();
+    holdSlabs(other.retired_);
+    live_ += blocks;
+    other.live_ -= blocks;
+    ++generation_;
+    ++other.generation_;
+}
+
+/**
+* Makes room for count slab pointers in the group being filled, growing
+* the capacity at least geometrically: reserving exactly one more each
+* time would copy the whole vector per slab and make filling a large
+* tree quadratic.
+*/
+inline void NodePool::reserveSlabs(std::size_t count)
+{
+    std::vector<char*>& slabs = slabs_->slabs;
+    if (count > slabs.capacity()) {
+        slabs.reserve((count > 2 * slabs.capacity()) ? count : 2 * slabs.capacity());
+    }
+}
+
+/**
+* Moves the group being filled to the full ones, so that it can be
+* shared; the next slab starts a new group. The newest slab's unused
+* tail is still handed out from here.
+*/
+inline void NodePool::retireSlabs()
+{
+    if (slabs_) {
+        retired_.reserve(retired_.size() + 1);
+        retired_.push_back(std::move(slabs_));
+        slabs_.reset();
+    }
+}
+
+/**
+* Adds groups to the full ones held here, each once however many times
+* it has been shared back and forth.
+*/
+inline void NodePool::holdSlabs(const std::vector<std::shared_ptr<SlabGroup> >& groups)
+{
+    retired_.insert(retired_.end(), groups.begin(), groups.end());
+    std::sort(retired_.begin(), retired_.end(),
+        [](const std::shared_ptr<SlabGroup>& a, const std::shared_ptr<SlabGroup>& b) {
+            return std::less<SlabGroup*>()(a.get(), b.get());
+        });
+    retired_.erase(std::unique(retired_.begin(), retired_.end()), retired_.end());
+}
+
+/**
+* Returns true if blocks come from slabs rather than operator new.
+*/
+inline bool NodePool::pooled() const
+{
+    return slabNodes_ != 0;
+}
+
+/**
+* Returns true if one pool's blocks can be freed through the other.
+*/
+inline bool NodePool::compatible(const NodePool& other) const
+{
+    return blockSize_ == other.blockSize_ && pooled() == other.pooled();
+}
+
+inline std::size_t NodePool::slabCount() const
+{
+    std::size_t count = slabs_ ? slabs_->slabs.size() : 0;
+    for (std::size_t i = 0; i < retired_.size(); ++i) {
+        count += retired_[i]->slabs.size();
+    }
+    return count;
+}
+
+inline std::size_t NodePool::liveCount() const
+{
+    return live_;
+}
+
+/**
+* Changes with every allocate, deallocate, release, adopt and share, so a
+* caller can tell that no block has come or gone since it last looked.
+*/
+inline std::uint64_t NodePool::generation() const
+{
+    return generation_;
+}
+
+/*
+  ---------------------------------------
+  End implementations for the NodePool class.
+  ---------------------------------------
+*/
+
+#endif
@@ -0,0 +1,547 @@
+#ifndef OPERATION_LOG_H
+#define OPERATION_LOG_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tree_snapshot.h"
+
+/*
+ * The write-ahead log format used by DurableAVLTree. A file is a fixed
+ * header followed by records; each record is its body length and a
+ * checksum of it (a uint32_t each), then the body. Records are only
+ * ever appended, so a crash can at worst leave a torn last group, which
+ * replay detects by a length running past the end of the file or a
+ * checksum mismatch, and cuts off.
+ */
+
+struct LogHeader
+{
+    static const uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;     // SnapshotHeader::BYTE_ORDER_MARK
+    uint32_t flags;         // and the sizes, as in SnapshotHeader
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t reserved;
+
+    static LogHeader describe(bool rawKeys, std::size_t keySize, bool rawValues,
+                              std::size_t valueSize);
+    static const char* expectedMagic();
+};
+
+/**
+* Gathers the body of one record; SnapshotCodec writes into it.
+*/
+class LogRecordWriter
+{
+public:
+    void clear();
+    void write(const void* data, std::size_t bytes);
+    const char* data() const;
+    std::size_t size() const;
+
+private:
+    std::vector<char> bytes_;
+};
+
+/**
+* Hands out the body of one record in order, for SnapshotCodec to read.
+*/
+class LogRecordReader
+{
+public:
+    LogRecordReader(const char* data, std::size_t bytes);
+
+    void read(void* data, std::size_t bytes);
+    uint64_t remaining() const;
+
+private:
+    const char* next_;
+    std::size_t left_;
+};
+
+/**
+* An append-only file of records with group commit: append() buffers a
+* record, and the buffer is written and fdatasync'd as one once it holds
+* groupRecords records or its oldest record has waited maxDelay. The
+* wait is timed by a flusher thread, so it holds even if no further
+* record comes. commit() forces a write at once. A record is durable
+* once the commit that wrote it returns.
+*
+* The methods may be called from any thread; a mutex orders them and
+* the flusher. A failed background commit leaves its records buffered
+* and is retried after another maxDelay, or by the next append() or
+* commit(), which then report the error.
+*
+* Opening an existing log only checks its header; replay() must then be
+* called before append(), to read back the records and cut off a torn
+* tail, so that new records follow the last intact one.
+*/
+class OperationLog
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    OperationLog(const std::string& path, const LogHeader& layout, std::size_t groupRecords,
+                 std::chrono::microseconds maxDelay);
+    ~OperationLog();
+
+    template <typename Apply>
+    uint64_t replay(Apply apply);
+    void append(const LogRecordWriter& record);
+    void commit();
+    void reset();
+
+    uint64_t pendingRecords() const;
+    uint64_t commits() const;
+
+private:
+    // Not copyable: the log owns its file descriptor.
+    OperationLog(const OperationLog& other);
+    OperationLog& operator=(const OperationLog& other);
+
+    static const std::size_t READ_BYTES = 1 << 20;
+
+    static uint32_t recordChecksum(const char* body, uint32_t bytes);
+    void commitLocked();
+    void flushOverdue();
+    bool fetch(std::vector<char>& window, uint64_t& windowStart, uint64_t offset,
+               std::size_t bytes) const;
+    void writeAt(const char* data, std::size_t bytes, uint64_t offset);
+    void syncFile();
+
+    std::string path_;
+    int fd_;
+    uint64_t end_;              // where the next commit writes
+    bool tailDirty_;            // a failed commit may have left bytes past end_
+    std::vector<char> buffer_;  // framed records not yet written
+    uint64_t pending_;
+    std::size_t groupRecords_;
+    std::chrono::microseconds maxDelay_;
+    Clock::time_point firstPending_;
+    uint64_t commits_;
+
+    mutable std::mutex mutex_;      // guards the file position, buffer and counts
+    std::condition_variable wake_;  // a first record is buffered, or stopping
+    bool stopping_;
+    std::thread flusher_;           // runs flushOverdue; none if every append commits
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the LogHeader class.
+  -------------------------------------------
+*/
+
+inline const char* LogHeader::expectedMagic()
+{
+    return "BSTWLOG";   // and the terminating NUL: 8 bytes
+}
+
+inline LogHeader LogHeader::describe(bool rawKeys, std::size_t keySize, bool rawValues,
+    std::size_t valueSize)
+{
+    SnapshotHeader layout = SnapshotHeader::describe(0, rawKeys, keySize, rawValues, valueSize);
+    LogHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, expectedMagic(), sizeof(header.magic));
+    header.version = VERSION;
+    header.byteOrder = SnapshotHeader::BYTE_ORDER_MARK;
+    header.flags = layout.flags;
+    header.keySize = layout.keySize;
+    header.valueSize = layout.valueSize;
+    return header;
+}
+
+/*
+  -----------------------------------------
+  End implementations for the LogHeader class.
+  -----------------------------------------
+*/
+
+/*
+  ------------------------------------------------------------
+  Begin implementations for the LogRecordWriter and Reader classes.
+  ------------------------------------------------------------
+*/
+
+inline void LogRecordWriter::clear()
+{
+    bytes_.clear();
+}
+
+inline void LogRecordWriter::write(const void* data, std::size_t bytes)
+{
+    const char* first = static_cast<const char*>(data);
+    bytes_.insert(bytes_.end(), first, first + bytes);
+}
+
+inline const char* LogRecordWriter::data() const
+{
+    return bytes_.data();
+}
+
+inline std::size_t LogRecordWriter::size() const
+{
+    return bytes_.size();
+}
+
+inline LogRecordReader::LogRecordReader(const char* data, std::size_t bytes) :
+    next_(data),
+    left_(bytes)
+{
+
+}
+
+inline void LogRecordReader::read(void* data, std::size_t bytes)
+{
+    if (bytes > left_) {
+        throw std::runtime_error("log: record is shorter than its contents");
+    }
+    std::memcpy(data, next_, bytes);
+    next_ += bytes;
+    left_ -= bytes;
+}
+
+inline uint64_t LogRecordReader::remaining() const
+{
+    return left_;
+}
+
+/*
+  ----------------------------------------------------------
+  End implementations for the LogRecordWriter and Reader classes.
+  ----------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------
+  Begin implementations for the OperationLog class.
+  ----------------------------------------------
+*/
+
+/**
+* Opens the log at path, creating it with layout's header if it does not
+* exist or is empty. Throws std::runtime_error if the file cannot be
+* opened or is a log of other key or value types.
+*/
+inline OperationLog::OperationLog(const std::string& path, const LogHeader& layout,
+    std::size_t groupRecords, std::chrono::microseconds maxDelay) :
+    path_(path),
+    fd_(-1),
+    end_(0),
+    tailDirty_(false),
+    pending_(0),
+    groupRecords_(std::max<std::size_t>(groupRecords, 1)),
+    maxDelay_(maxDelay),
+    commits_(0),
+    stopping_(false)
+{
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("log: cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(fd_, &info) != 0) {
+        ::close(fd_);
+        throw std::runtime_error("log: cannot stat " + path);
+    }
+    if (info.st_size == 0) {
+        try {
+            writeAt(reinterpret_cast<const char*>(&layout), sizeof(layout), 0);
+            syncFile();
+        }
+        catch (...) {
+            ::close(fd_);
+            throw;
+        }
+        end_ = sizeof(layout);
+    }
+    else {
+        LogHeader header;
+        if (static_cast<std::size_t>(info.st_size) < sizeof(header)
+            || ::pread(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))
+            || std::memcmp(header.magic, LogHeader::expectedMagic(), sizeof(header.magic)) != 0) {
+            ::close(fd_);
+            throw std::runtime_error("log: " + path + " is not an operation log");
+        }
+        if (header.version != LogHeader::VERSION || header.byteOrder != layout.byteOrder) {
+            ::close(fd_);
+            throw std::runtime_error("log: " + path + " has an unsupported version or byte order");
+        }
+        if (header.flags != layout.flags || header.keySize != layout.keySize
+            || header.valueSize != layout.valueSize) {
+            ::close(fd_);
+            throw std::runtime_error("log: " + path + " holds other key or value types");
+        }
+        end_ = static_cast<uint64_t>(info.st_size);
+    }
+    if (groupRecords_ > 1 && maxDelay_.count() > 0) {
+        flusher_ = std::thread(&OperationLog::flushOverdue, this);
+    }
+}
+
+/**
+* Commits what is buffered. A failure is not reported here (call
+* commit() first to see it); those records are then lost.
+*/
+inline OperationLog::~OperationLog()
+{
+    if (flusher_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        flusher_.join();
+    }
+    try {
+        commit();
+    }
+    catch (...) {
+    }
+    ::close(fd_);
+}
+
+inline uint64_t OperationLog::pendingRecords() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+inline uint64_t OperationLog::commits() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return commits_;
+}
+
+inline uint32_t OperationLog::recordChecksum(const char* body, uint32_t bytes)
+{
+    SnapshotChecksum checksum;
+    checksum.update(&bytes, sizeof(bytes));
+    checksum.update(body, bytes);
+    return static_cast<uint32_t>(checksum.value());
+}
+
+inline void OperationLog::writeAt(const char* data, std::size_t bytes, uint64_t offset)
+{
+    while (bytes != 0) {
+        ssize_t written = ::pwrite(fd_, data, bytes, static_cast<off_t>(offset));
+        if (written < 0) {
+            throw std::runtime_error("log: write failed for " + path_);
+        }
+        data += written;
+        bytes -= static_cast<std::size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+}
+
+inline void OperationLog::syncFile()
+{
+    if (::fdatasync(fd_) != 0) {
+        throw std::runtime_error("log: cannot sync " + path_);
+    }
+}
+
+/**
+* Frames record and buffers it, committing if that completes a group or
+* the oldest buffered record has waited long enough.
+*/
+inline void OperationLog::append(const LogRecordWriter& record)
+{
+    if (record.size() > UINT32_MAX) {
+        throw std::length_error("log: record too large");
+    }
+    uint32_t prefix[2];
+    prefix[0] = static_cast<uint32_t>(record.size());
+    prefix[1] = recordChecksum(record.data(), prefix[0]);
+    const char* framing = reinterpret_cast<const char*>(prefix);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t bufferedBytes = buffer_.size();
+    buffer_.insert(buffer_.end(), framing, framing + sizeof(prefix));
+    buffer_.insert(buffer_.end(), record.data(), record.data() + record.size());
+    if (pending_++ == 0) {
+        firstPending_ = Clock::now();
+        wake_.notify_one();
+    }
+    if (pending_ >= groupRecords_ || Clock::now() - firstPending_ >= maxDelay_) {
+        try {
+            commitLocked();
+        }
+        catch (...) {
+            // The caller sees this append fail, so the record must not
+            // be written by a later commit; the ones before it stay.
+            buffer_.resize(bufferedBytes);
+            --pending_;
+            throw;
+        }
+    }
+}
+
+/**
+* Writes the buffered records and waits until they are on disk. If that
+* fails, they stay buffered and the next commit writes them again at the
+* same place, first cutting off whatever the failed one left past it
+* (append may have taken a record back out of the buffer since).
+*/
+inline void OperationLog::commit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    commitLocked();
+}
+
+inline void OperationLog::commitLocked()
+{
+    if (buffer_.empty()) {
+        return;
+    }
+    if (tailDirty_ && ::ftruncate(fd_, static_cast<off_t>(end_)) != 0) {
+        throw std::runtime_error("log: cannot truncate " + path_);
+    }
+    tailDirty_ = true;
+    writeAt(buffer_.data(), buffer_.size(), end_);
+    syncFile();
+    tailDirty_ = false;
+    end_ += buffer_.size();
+    buffer_.clear();
+    pending_ = 0;
+    ++commits_;
+}
+
+/**
+* Empties the log, once a snapshot holds everything in it. Buffered
+* records are dropped too.
+*/
+inline void OperationLog::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer_.clear();
+    pending_ = 0;
+    if (::ftruncate(fd_, sizeof(LogHeader)) != 0) {
+        throw std::runtime_error("log: cannot truncate " + path_);
+    }
+    syncFile();
+    end_ = sizeof(LogHeader);
+    tailDirty_ = false;
+}
+
+/**
+* The flusher: sleeps until the oldest buffered record has waited
+* maxDelay, then commits. A failure pushes the next try back by
+* maxDelay rather than retrying at once.
+*/
+inline void OperationLog::flushOverdue()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (pending_ == 0) {
+            wake_.wait(lock);
+            continue;
+        }
+        Clock::time_point due = firstPending_ + maxDelay_;
+        if (Clock::now() < due) {
+            wake_.wait_until(lock, due);
+            continue;
+        }
+        try {
+            commitLocked();
+        }
+        catch (...) {
+            firstPending_ = Clock::now();
+        }
+    }
+}
+
+/**
+* Makes window hold the file's bytes [offset, offset + bytes), reading a
+* block from offset if it does not already; false if they run past the
+* end of the log.
+*/
+inline bool OperationLog::fetch(std::vector<char>& window, uint64_t& windowStart,
+    uint64_t offset, std::size_t bytes) const
+{
+    if (offset >= windowStart && offset + bytes <= windowStart + window.size()) {
+        return true;
+    }
+    if (offset + bytes > end_) {
+        return false;
+    }
+    std::size_t wanted = (bytes > READ_BYTES) ? bytes : READ_BYTES;
+    std::size_t block = static_cast<std::size_t>(std::min<uint64_t>(wanted, end_ - offset));
+    window.resize(block);
+    std::size_t got = 0;
+    while (got < block) {
+        ssize_t read = ::pread(fd_, window.data() + got, block - got,
+                               static_cast<off_t>(offset + got));
+        if (read <= 0) {
+            throw std::runtime_error("log: read failed for " + path_);
+        }
+        got += static_cast<std::size_t>(read);
+    }
+    windowStart = offset;
+    return true;
+}
+
+/**
+* Calls apply(LogRecordReader&) on every intact record, oldest first,
+* then truncates the file after the last of them and returns how many
+* there were.
+*/
+template <typename Apply>
+uint64_t OperationLog::replay(Apply apply)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<char> window;
+    uint64_t windowStart = sizeof(LogHeader);
+    uint64_t intactEnd = sizeof(LogHeader);
+    uint64_t records = 0;
+    while (true) {
+        uint32_t prefix[2];
+        if (!fetch(window, windowStart, intactEnd, sizeof(prefix))) {
+            break;
+        }
+        std::memcpy(prefix, window.data() + (intactEnd - windowStart), sizeof(prefix));
+        uint64_t bodyStart = intactEnd + sizeof(prefix);
+        if (!fetch(window, windowStart, bodyStart, prefix[0])) {
+            break;
+        }
+        const char* body = window.data() + (bodyStart - windowStart);
+        if (recordChecksum(body, prefix[0]) != prefix[1]) {
+            break;
+        }
+        LogRecordReader reader(body, prefix[0]);
+        apply(reader);
+        intactEnd = bodyStart + prefix[0];
+        ++records;
+    }
+    if (intactEnd != end_) {
+        if (::ftruncate(fd_, static_cast<off_t>(intactEnd)) != 0) {
+            throw std::runtime_error("log: cannot truncate " + path_);
+        }
+        syncFile();
+        end_ = intactEnd;
+    }
+    return records;
+}
+
+/*
+  --------------------------------------------
+  End implementations for the OperationLog class.
+  --------------------------------------------
+*/
+
+#endif
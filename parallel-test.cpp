@@ -0,0 +1,245 @@
+#include <atomic>
+#include <list>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+#include "fork_join.h"
+#include "test_check.h"
+
+using namespace std;
+
+/**
+* Reaches the root, so that two trees can be compared node by node:
+* the same key at every position, the same stored AVL height, and
+* parent links that point back up.
+*/
+template <typename Key, typename Value>
+struct ShapedTree : AVLTree<Key, Value>
+{
+    bool sameShape(const ShapedTree& other) const
+    {
+        return sameNodes(static_cast<AVLNode<Key, Value>*>(this->root_),
+                         static_cast<AVLNode<Key, Value>*>(other.root_), nullptr, nullptr);
+    }
+
+    static bool sameNodes(AVLNode<Key, Value>* a, AVLNode<Key, Value>* b,
+                          AVLNode<Key, Value>* aParent, AVLNode<Key, Value>* bParent)
+    {
+        if (a == nullptr || b == nullptr) {
+            return a == b;
+        }
+        return a->getKey() == b->getKey() && a->getValue() == b->getValue() &&
+               a->getBalance() == b->getBalance() && a->getParent() == aParent &&
+               b->getParent() == bParent && sameNodes(a->getLeft(), b->getLeft(), a, b) &&
+               sameNodes(a->getRight(), b->getRight(), a, b);
+    }
+};
+
+/**
+* parallel_bulk_load on pools of 0 to 7 workers builds exactly the tree
+* bulk_load builds, for sorted random-access input (built in place),
+* unsorted input and input that is only bidirectional (both gathered
+* and sorted first), and for string items, which load serially.
+*/
+void testBulkLoad()
+{
+    WorkStealingPool none(0);
+    WorkStealingPool one(1);
+    WorkStealingPool several(7);
+    WorkStealingPool* pools[] = { &none, &one, &several };
+    const size_t sizes[] = { 0, 1, 2, 4095, 4096, 100000 };
+    mt19937 rng(9);
+
+    bool allSame = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        vector<pair<int, int> > sorted;
+        for (size_t i = 0; i < sizes[s]; ++i) {
+            sorted.push_back(make_pair(static_cast<int>(i) * 3, static_cast<int>(rng())));
+        }
+        vector<pair<int, int> > shuffled(sorted);
+        shuffle(shuffled.begin(), shuffled.end(), rng);
+        if (!shuffled.empty()) {
+            shuffled.push_back(make_pair(shuffled[0].first, -1));
+        }
+        list<pair<int, int> > linked(shuffled.begin(), shuffled.end());
+        map<int, int> expected(sorted.begin(), sorted.end());
+        if (!shuffled.empty()) {
+            expected[shuffled[0].first] = -1;
+        }
+
+        ShapedTree<int, int> serial;
+        serial.bulk_load(sorted.begin(), sorted.end());
+        ShapedTree<int, int> serialShuffled;
+        serialShuffled.bulk_load(shuffled.begin(), shuffled.end());
+        for (size_t p = 0; p < 3; ++p) {
+            ShapedTree<int, int> tree;
+            tree.insert(make_pair(-5, -5));
+            tree.parallel_bulk_load(sorted.begin(), sorted.end(), *pools[p]);
+            allSame = allSame && tree.sameShape(serial) && tree.size() == sorted.size();
+
+            tree.parallel_bulk_load(shuffled.begin(), shuffled.end(), *pools[p]);
+            allSame = allSame && tree.sameShape(serialShuffled) &&
+                      sameItems(tree.begin(), tree.end(), expected);
+            tree.parallel_bulk_load(linked.begin(), linked.end(), *pools[p]);
+            allSame = allSame && tree.sameShape(serialShuffled);
+
+            // The loaded tree takes ordinary updates
+            tree.insert(make_pair(-1, 0));
+            tree.remove(-1);
+            allSame = allSame && tree.shape().balanced &&
+                      sameItems(tree.begin(), tree.end(), expected);
+        }
+    }
+    CHECK(allSame);
+
+    vector<pair<string, string> > words;
+    for (int i = 0; i < 20000; ++i) {
+        words.push_back(make_pair(to_string(100000 + i), string(i % 50, 'w')));
+    }
+    ShapedTree<string, string> serialWords;
+    serialWords.bulk_load(words.begin(), words.end());
+    ShapedTree<string, string> parallelWords;
+    parallelWords.parallel_bulk_load(words.begin(), words.end(), several);
+    CHECK(parallelWords.sameShape(serialWords));
+}
+
+/**
+* parallel_clear empties a tree, through the pool's release alone for
+* trivially destructible items and through every node otherwise, and
+* leaves it ready for reuse.
+*/
+void testClear()
+{
+    WorkStealingPool pool(3);
+    AVLTree<int, int> ints;
+    AVLTree<string, string> words;
+    for (int i = 0; i < 50000; ++i) {
+        ints.insert(make_pair(i, i));
+        words.insert(make_pair(to_string(i), string(40, 'x')));
+    }
+    ints.parallel_clear(pool);
+    words.parallel_clear(pool);
+    CHECK(ints.empty() && ints.size() == 0 && ints.begin() == ints.end());
+    CHECK(words.empty() && words.size() == 0 && words.begin() == words.end());
+
+    ints.insert(make_pair(1, 1));
+    words.insert(make_pair(string("a"), string("b")));
+    CHECK(ints.size() == 1 && words.size() == 1 && words.find("a") != words.end());
+
+    AVLTree<int, int> empty;
+    empty.parallel_clear(pool);
+    CHECK(empty.empty());
+}
+
+/**
+* parallel_for_each visits every item exactly once on any pool, and an
+* exception thrown from the callback reaches the caller, after which
+* the pool still runs work.
+*/
+void testForEach()
+{
+    WorkStealingPool none(0);
+    WorkStealingPool several(5);
+    AVLTree<int, int> tree;
+    long expectedSum = 0;
+    for (int i = 0; i < 100000; ++i) {
+        tree.insert(make_pair(i, 2 * i));
+        expectedSum += 2 * i;
+    }
+    bool allVisited = true;
+    for (int round = 0; round < 2; ++round) {
+        WorkStealingPool& pool = (round == 0) ? none : several;
+        atomic<long> sum(0);
+        atomic<long> count(0);
+        tree.parallel_for_each([&](const pair<const int, int>& item) {
+            sum += item.second;
+            ++count;
+        }, pool);
+        allVisited = allVisited && sum == expectedSum && count == 100000;
+    }
+    CHECK(allVisited);
+
+    bool caught = false;
+    try {
+        tree.parallel_for_each([](const pair<const int, int>& item) {
+            if (item.first % 25000 == 12345) {
+                throw runtime_error("from the callback");
+            }
+        }, several);
+    }
+    catch (const runtime_error& error) {
+        caught = string(error.what()) == "from the callback";
+    }
+    CHECK(caught);
+
+    atomic<long> count(0);
+    tree.parallel_for_each([&](const pair<const int, int>&) { ++count; }, several);
+    CHECK(count == 100000);
+    AVLTree<int, int> copy;
+    vector<pair<int, int> > items(tree.begin(), tree.end());
+    copy.parallel_bulk_load(items.begin(), items.end(), several);
+    CHECK(copy.size() == 100000 && copy.shape().balanced);
+}
+
+/**
+* forkJoin runs both sides, on a pool or without one, and rethrows
+* once both are done, the left side's exception first.
+*/
+void testForkJoin()
+{
+    WorkStealingPool pool(2);
+    WorkStealingPool* pools[] = { nullptr, &pool };
+    bool allRan = true;
+    for (int p = 0; p < 2; ++p) {
+        bool left = false;
+        bool right = false;
+        forkJoin(pools[p], [&]() { left = true; }, [&]() { right = true; });
+        allRan = allRan && left && right;
+
+        atomic<bool> rightDone(false);
+        string caught;
+        try {
+            forkJoin(pools[p],
+                [&]() { throw runtime_error("left"); },
+                [&]() { rightDone = true; throw logic_error("right"); });
+        }
+        catch (const exception& error) {
+            caught = error.what();
+        }
+        allRan = allRan && rightDone && caught == "left";
+
+        caught.clear();
+        try {
+            forkJoin(pools[p], [&]() {}, [&]() { throw logic_error("right"); });
+        }
+        catch (const logic_error& error) {
+            caught = error.what();
+        }
+        allRan = allRan && caught == "right";
+    }
+    CHECK(allRan);
+
+    // Nested forks deeper than the pool has threads cannot deadlock
+    atomic<int> leaves(0);
+    function<void(int)> fork = [&](int depth) {
+        if (depth == 0) {
+            ++leaves;
+            return;
+        }
+        forkJoin(&pool, [&]() { fork(depth - 1); }, [&]() { fork(depth - 1); });
+    };
+    fork(10);
+    CHECK(leaves == 1024);
+}
+
+int main()
+{
+    testBulkLoad();
+    testClear();
+    testForEach();
+    testForkJoin();
+    return checkResult("parallel-test");
+}
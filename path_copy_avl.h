@@ -0,0 +1,409 @@
+#ifndef PATH_COPY_AVL_H
+#define PATH_COPY_AVL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "key_compare.h"
+
+/**
+* An immutable AVL node. Nodes are shared between tree versions, so
+* they have no parent pointer and are never changed once built; refs
+* counts the parents and version roots that point at the node.
+*/
+template <typename Key, typename Value>
+struct PathNode
+{
+    PathNode(const std::pair<const Key, Value>& item, PathNode* left, PathNode* right) :
+        item(item),
+        left(left),
+        right(right),
+        refs(1),
+        height(1 + std::max(left ? left->height : 0, right ? right->height : 0))
+    {
+    }
+
+    const std::pair<const Key, Value> item;
+    PathNode* const left;
+    PathNode* const right;
+    std::size_t refs;
+    const int height;
+};
+
+/**
+* AVL insert/remove by path copying: an update builds new nodes for the
+* root-to-key path (and for the nodes a rotation rearranges) and shares
+* every other subtree with the version it started from, which stays
+* intact. Each update is O(log n) time and space.
+*
+* Functions returning a node hand the caller one reference to it; node
+* arguments are borrowed. A node whose last reference is released goes
+* to Disposer::dispose(node), which may free it at once or defer it
+* until no reader can still see it.
+*/
+template <typename Key, typename Value, typename Compare, typename Disposer>
+class PathCopyAVL
+{
+public:
+    typedef PathNode<Key, Value> Node;
+    typedef std::pair<const Key, Value> Item;
+
+    PathCopyAVL(const Compare& comp, Disposer& disposer);
+
+    Node* insert(Node* root, const Item& item, bool& added);
+    Node* remove(Node* root, const Key& key, bool& removed);
+
+    template <typename K>
+    static const Node* find(const Node* root, const K& key, const Compare& comp);
+
+    static Node* acquire(Node* node);
+    void release(Node* node);
+
+private:
+    Node* make(const Item& item, Node* left, Node* right);
+    Node* balance(const Item& item, Node* left, Node* right);
+    Node* removeMin(Node* node);
+    static int height(const Node* node);
+
+    const Compare& comp_;
+    Disposer& disposer_;
+};
+
+/**
+* An in-order iterator over one version. With no parent pointers to
+* climb it keeps the path to the current node on a stack, so a step is
+* amortized O(1).
+*/
+template <typename Key, typename Value>
+class PathIterator
+{
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<const Key, Value> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef const value_type& reference;
+
+    PathIterator();
+    explicit PathIterator(const PathNode<Key, Value>* root);
+
+    template <typename K, typename Compare>
+    static PathIterator lowerBound(const PathNode<Key, Value>* root, const K& key,
+                                   const Compare& comp);
+
+    reference operator*() const;
+    pointer operator->() const;
+
+    bool operator==(const PathIterator& rhs) const;
+    bool operator!=(const PathIterator& rhs) const;
+
+    PathIterator& operator++();
+
+private:
+    void pushLeft(const PathNode<Key, Value>* node);
+
+    std::vector<const PathNode<Key, Value>*> path_;
+};
+
+/*
+  ----------------------------------------------
+  Begin implementations for the PathCopyAVL class.
+  ----------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare, typename Disposer>
+PathCopyAVL<Key, Value, Compare, Disposer>::PathCopyAVL(const Compare& comp, Disposer& disposer) :
+    comp_(comp),
+    disposer_(disposer)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare, typename Disposer>
+int PathCopyAVL<Key, Value, Compare, Disposer>::height(const Node* node)
+{
+    return node ? node->height : 0;
+}
+
+template <typename Key, typename Value, typename Compare, typename Disposer>
+typename PathCopyAVL<Key, Value, Compare, Disposer>::Node*
+PathCopyAVL<Key, Value, Compare, Disposer>::acquire(Node* node)
+{
+    if (node) {
+        ++node->refs;
+    }
+    return node;
+}
+
+/**
+* Drops one reference; a node that loses its last one releases its
+* children in turn. Recursion is bounded by the tree height.
+*/
+template <typename Key, typename Value, typename Compare, typename Disposer>
+void PathCopyAVL<Key, Value, Compare, Disposer>::release(Node* node)
+{
+    if (node == nullptr || --node->refs != 0) {
+        return;
+    }
+    Node* left = node->left;
+    Node* right = node->right;
+    disposer_.dispose(node);
+    release(left);
+    release(right);
+}
+
+template <typename Key, typename Value, typename Compare, typename Disposer>
+typename PathCopyAVL<Key, Value, Compare, Disposer>::Node*
+PathCopyAVL<Key, Value, Compare, Disposer>::make(const Item& item, Node* left, Node* right)
+{
+    return new Node(item, acquire(left), acquire(right));
+}
+
+/**
+* Builds a node for item over left and right, rotating once or twice if
+* their heights differ by two. Rotations only ever build new nodes.
+*/
+template <typename Key, typename Value, typename Compare, typename Disposer>
+typename PathCopyAVL<Key, Value, Compare, Disposer>::Node*
+PathCopyAVL<Key, Value, Compare, Disposer>::balance(const Item& item, Node* left, Node* right)
+{
+    Node* result;
+    if (height(left) > height(right) + 1) {
+        if (height(left->left) >= height(left->right)) {
+            Node* lower = make(item, left->right, right);
+            result = make(left->item, left->left, lower);
+            release(lower);
+        }
+        else {
+            Node* pivot = left->right;
+            Node* lower = make(left->item, left->left, pivot->left);
+            Node* upper = make(item, pivot->right, right);
+            result = make(pivot->item, lower, upper);
+            release(lower);
+            release(upper);
+        }
+    }
+    else if (height(right) > height(left) + 1) {
+        if (height(right->right) >= height(right->left)) {
+            Node* lower = make(item, left, right->left);
+            result = make(right->item, lower, right->right);
+            release(lower);
+        }
+        else {
+            Node* pivot = right->left;
+            Node* lower = make(item, left, pivot->left);
+            Node* upper = make(right->item, pivot->right, right->right);
+            result = make(pivot->item, lower, upper);
+            release(lower);
+            release(upper);
+        }
+    }
+    else {
+        result = make(item, left, right);
+    }
+    return result;
+}
+
+/**
+* Returns the root of a version with item inserted, or with its value
+* overwritten if the key is present (as BinarySearchTree::insert does).
+*/
+template <typename Key, typename Value, typename Compare, typename Disposer>
+typename PathCopyAVL<Key, Value, Compare, Disposer>::Node*
+PathCopyAVL<Key, Value, Compare, Disposer>::insert(Node* root, const Item& item, bool& added)
+{
+    if (root == nullptr) {
+        added = true;
+        return make(item, nullptr, nullptr);
+    }
+    int order = KeyOrder<Compare>::compare(comp_, item.first, root->item.first);
+    if (order == 0) {
+        added = false;
+        return make(item, root->left, root->right);
+    }
+    Node* result;
+    if (order < 0) {
+        Node* left = insert(root->left, item, added);
+        result = balance(root->item, left, root->right);
+        release(left);
+    }
+    else {
+        Node* right = insert(root->right, item, added);
+        result = balance(root->item, root->left, right);
+        release(right);
+    }
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, typename Disposer>
+typename PathCopyAVL<Key, Value, Compare, Disposer>::Node*
+PathCopyAVL<Key, Value, Compare, Disposer>::removeMin(Node* node)
+{
+    if (node->left == nullptr) {
+        return acquire(node->right);
+    }
+    Node* left = removeMin(node->left);
+    Node* result = balance(node->item, left, node->right);
+    release(left);
+    return result;
+}
+
+/**
+* Returns the root of a version without key. If key is absent nothing is
+* copied: the result is root itself.
+*/
+template <typename Key, typename Value, typename Compare, typename Disposer>
+typename PathCopyAVL<Key, Value, Compare, Disposer>::Node*
+PathCopyAVL<Key, Value, Compare, Disposer>::remove(Node* root, const Key& key, bool& removed)
+{
+    if (root == nullptr) {
+        removed = false;
+        return nullptr;
+    }
+    int order = KeyOrder<Compare>::compare(comp_, key, root->item.first);
+    if (order == 0) {
+        removed = true;
+        if (root->left == nullptr) {
+            return acquire(root->right);
+        }
+        if (root->right == nullptr) {
+            return acquire(root->left);
+        }
+        // Replace root's item by its successor, the leftmost on the right
+        const Node* successor = root->right;
+        while (successor->left) {
+            successor = successor->left;
+        }
+        Node* right = removeMin(root->right);
+        Node* result = balance(successor->item, root->left, right);
+        release(right);
+        return result;
+    }
+    Node* child = (order < 0) ? root->left : root->right;
+    Node* updated = remove(child, key, removed);
+    if (!removed) {
+        release(updated);
+        return acquire(root);
+    }
+    Node* result = (order < 0) ? balance(root->item, updated, root->right)
+                               : balance(root->item, root->left, updated);
+    release(updated);
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, typename Disposer>
+template <typename K>
+const typename PathCopyAVL<Key, Value, Compare, Disposer>::Node*
+PathCopyAVL<Key, Value, Compare, Disposer>::find(const Node* root, const K& key, const Compare& comp)
+{
+    while (root) {
+        int order = KeyOrder<Compare>::compare(comp, key, root->item.first);
+        if (order == 0) {
+            return root;
+        }
+        root = (order < 0) ? root->left : root->right;
+    }
+    return nullptr;
+}
+
+/*
+  --------------------------------------------
+  End implementations for the PathCopyAVL class.
+  --------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the PathIterator class.
+  -----------------------------------------------
+*/
+
+template <typename Key, typename Value>
+PathIterator<Key, Value>::PathIterator()
+{
+
+}
+
+template <typename Key, typename Value>
+PathIterator<Key, Value>::PathIterator(const PathNode<Key, Value>* root)
+{
+    pushLeft(root);
+}
+
+/**
+* An iterator at the first item whose key is not less than key. The
+* path keeps just the nodes whose left subtree the descent entered:
+* those are the items still to come.
+*/
+template <typename Key, typename Value>
+template <typename K, typename Compare>
+PathIterator<Key, Value> PathIterator<Key, Value>::lowerBound(const PathNode<Key, Value>* root,
+    const K& key, const Compare& comp)
+{
+    PathIterator it;
+    while (root) {
+        if (KeyOrder<Compare>::less(comp, root->item.first, key)) {
+            root = root->right;
+        }
+        else {
+            it.path_.push_back(root);
+            root = root->left;
+        }
+    }
+    return it;
+}
+
+template <typename Key, typename Value>
+void PathIterator<Key, Value>::pushLeft(const PathNode<Key, Value>* node)
+{
+    while (node) {
+        path_.push_back(node);
+        node = node->left;
+    }
+}
+
+template <typename Key, typename Value>
+typename PathIterator<Key, Value>::reference PathIterator<Key, Value>::operator*() const
+{
+    return path_.back()->item;
+}
+
+template <typename Key, typename Value>
+typename PathIterator<Key, Value>::pointer PathIterator<Key, Value>::operator->() const
+{
+    return &path_.back()->item;
+}
+
+template <typename Key, typename Value>
+bool PathIterator<Key, Value>::operator==(const PathIterator& rhs) const
+{
+    if (path_.empty() || rhs.path_.empty()) {
+        return path_.empty() && rhs.path_.empty();
+    }
+    return path_.back() == rhs.path_.back();
+}
+
+template <typename Key, typename Value>
+bool PathIterator<Key, Value>::operator!=(const PathIterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template <typename Key, typename Value>
+PathIterator<Key, Value>& PathIterator<Key, Value>::operator++()
+{
+    const PathNode<Key, Value>* node = path_.back();
+    path_.pop_back();
+    pushLeft(node->right);
+    return *this;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the PathIterator class.
+  ---------------------------------------------
+*/
+
+#endif
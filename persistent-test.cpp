@@ -0,0 +1,144 @@
+#include <cmath>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "persistent_avl.h"
+#include "test_check.h"
+
+using namespace std;
+
+typedef PersistentAVLTree<int, int> Tree;
+
+bool matches(const Tree& tree, const map<int, int>& expected)
+{
+    return tree.size() == expected.size() && tree.empty() == expected.empty() &&
+           sameItems(tree.begin(), tree.end(), expected);
+}
+
+/**
+* Versions taken along a run of random updates must each keep matching
+* the std::map they had, however the later versions change, and also
+* once other versions sharing their nodes are destroyed.
+*/
+void testVersionIsolation()
+{
+    vector<Tree> versions;
+    vector<map<int, int> > versionItems;
+    Tree current;
+    map<int, int> expected;
+    mt19937 rng(5);
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 3000);
+        if (rng() % 3 != 0) {
+            current = current.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            current = current.remove(key);
+            expected.erase(key);
+        }
+        if (i % 1000 == 0) {
+            versions.push_back(i % 2000 == 0 ? current.snapshot() : current);
+            versionItems.push_back(expected);
+        }
+    }
+    CHECK(matches(current, expected));
+    CHECK(current.height() <= 1.45 * log2(expected.size() + 2));
+
+    bool lookupsAgree = true;
+    for (int key = -1; key <= 3000; ++key) {
+        Tree::iterator found = current.find(key);
+        map<int, int>::iterator it = expected.find(key);
+        if ((found != current.end()) != (it != expected.end()) ||
+            (it != expected.end() && found->second != it->second)) {
+            lookupsAgree = false;
+        }
+        Tree::iterator bound = current.lower_bound(key);
+        map<int, int>::iterator expectedBound = expected.lower_bound(key);
+        if ((bound == current.end()) != (expectedBound == expected.end()) ||
+            (expectedBound != expected.end() && bound->first != expectedBound->first)) {
+            lookupsAgree = false;
+        }
+    }
+    CHECK(lookupsAgree);
+
+    bool isolated = true;
+    for (size_t v = 0; v < versions.size(); ++v) {
+        isolated = isolated && matches(versions[v], versionItems[v]);
+    }
+    CHECK(isolated);
+
+    // Dropping every other version, and the newest, frees shared nodes
+    for (size_t v = versions.size(); v-- > 0; ) {
+        if (v % 2 == 0) {
+            versions.erase(versions.begin() + v);
+            versionItems.erase(versionItems.begin() + v);
+        }
+    }
+    current = Tree();
+    bool survivorsIntact = true;
+    for (size_t v = 0; v < versions.size(); ++v) {
+        survivorsIntact = survivorsIntact && matches(versions[v], versionItems[v]);
+    }
+    CHECK(survivorsIntact);
+}
+
+/**
+* An update returns a new version and leaves the one it was called on,
+* and every copy of it, as it was.
+*/
+void testUpdatesLeaveOriginal()
+{
+    Tree base;
+    base = base.insert(make_pair(1, 10)).insert(make_pair(2, 20)).insert(make_pair(3, 30));
+    Tree copy(base);
+    Tree overwritten = base.insert(make_pair(2, 99));
+    Tree removed = base.remove(1);
+    Tree unchanged = base.remove(42);
+
+    map<int, int> expected;
+    expected[1] = 10;
+    expected[2] = 20;
+    expected[3] = 30;
+    CHECK(matches(base, expected));
+    CHECK(matches(copy, expected));
+    CHECK(matches(unchanged, expected));
+    CHECK(overwritten.size() == 3 && overwritten.find(2)->second == 99);
+    CHECK(base.find(2)->second == 20);
+    CHECK(removed.size() == 2 && removed.find(1) == removed.end());
+    CHECK(base.find(1) != base.end());
+
+    Tree moved(std::move(copy));
+    CHECK(matches(moved, expected));
+    CHECK(copy.empty() && copy.size() == 0 && copy.begin() == copy.end());
+    Tree assigned;
+    assigned = moved;
+    assigned = assigned;
+    CHECK(matches(assigned, expected));
+    assigned = assigned.remove(3);
+    CHECK(matches(moved, expected));
+}
+
+void testComparators()
+{
+    PersistentAVLTree<int, int, greater<int> > reversed;
+    for (int i = 0; i < 10; ++i) {
+        reversed = reversed.insert(make_pair(i, i));
+    }
+    CHECK(reversed.begin()->first == 9);
+
+    PersistentAVLTree<string, int> words;
+    PersistentAVLTree<string, int> withFig = words.insert(make_pair(string("fig"), 1));
+    CHECK(words.empty() && withFig.size() == 1);
+    CHECK(withFig.find("fig") != withFig.end());
+}
+
+int main()
+{
+    testVersionIsolation();
+    testUpdatesLeaveOriginal();
+    testComparators();
+    return checkResult("persistent-test");
+}
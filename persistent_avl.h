@@ -0,0 +1,250 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include "path_copy_avl.h"
+
+/**
+* A persistent (immutable) AVL map. insert and remove leave the tree
+* they are called on untouched and return a new version that shares
+* every subtree off the updated path with it, so an update costs
+* O(log n) time and memory and any number of versions can coexist.
+*
+* Copying a version, or taking a snapshot(), is O(1): it shares the
+* root. Nodes are reference counted and freed with the last version
+* that uses them. As with BinarySearchTree, no synchronization is done:
+* versions that share nodes must be created and destroyed from one
+* thread at a time.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class PersistentAVLTree
+{
+public:
+    typedef PathIterator<Key, Value> iterator;
+
+    explicit PersistentAVLTree(const Compare& comp = Compare());
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree(PersistentAVLTree&& other);
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(PersistentAVLTree&& other);
+    ~PersistentAVLTree();
+
+    PersistentAVLTree insert(const std::pair<const Key, Value>& keyValuePair) const;
+    PersistentAVLTree remove(const Key& key) const;
+    PersistentAVLTree snapshot() const;
+
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator begin() const;
+    iterator end() const;
+    bool empty() const;
+    std::size_t size() const;
+    int height() const;
+
+private:
+    typedef PathNode<Key, Value> Node;
+
+    // Frees a node as soon as no version uses it
+    struct Deleter
+    {
+        void dispose(Node* node) { delete node; }
+    };
+
+    typedef PathCopyAVL<Key, Value, Compare, Deleter> Ops;
+
+    PersistentAVLTree(Node* root, std::size_t size, const Compare& comp);
+    void release();
+
+    Node* root_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ----------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+/**
+* Adopts root: the caller's reference passes to the new version.
+*/
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(Node* root, std::size_t size,
+    const Compare& comp) :
+    root_(root),
+    size_(size),
+    comp_(comp)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(Ops::acquire(other.root_)),
+    size_(other.size_),
+    comp_(other.comp_)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(PersistentAVLTree&& other) :
+    root_(other.root_),
+    size_(other.size_),
+    comp_(other.comp_)
+{
+    other.root_ = nullptr;
+    other.size_ = 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree& other)
+{
+    // Acquire first so that self-assignment keeps the root alive
+    Node* root = Ops::acquire(other.root_);
+    release();
+    root_ = root;
+    size_ = other.size_;
+    comp_ = other.comp_;
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(PersistentAVLTree&& other)
+{
+    if (this != &other) {
+        release();
+        root_ = other.root_;
+        size_ = other.size_;
+        comp_ = other.comp_;
+        other.root_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release();
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::release()
+{
+    Deleter deleter;
+    Ops ops(comp_, deleter);
+    ops.release(root_);
+    root_ = nullptr;
+}
+
+/**
+* Returns a version with keyValuePair inserted, or with the value
+* overwritten if the key is present.
+*/
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>
+PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair) const
+{
+    Deleter deleter;
+    Ops ops(comp_, deleter);
+    bool added = false;
+    Node* root = ops.insert(root_, keyValuePair, added);
+    return PersistentAVLTree(root, size_ + (added ? 1 : 0), comp_);
+}
+
+/**
+* Returns a version without key; if key is absent that is this version.
+*/
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>
+PersistentAVLTree<Key, Value, Compare>::remove(const Key& key) const
+{
+    Deleter deleter;
+    Ops ops(comp_, deleter);
+    bool removed = false;
+    Node* root = ops.remove(root_, key, removed);
+    return PersistentAVLTree(root, size_ - (removed ? 1 : 0), comp_);
+}
+
+/**
+* A handle to this version that stays valid and iterable however the
+* tree it came from is updated or destroyed. O(1).
+*/
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare> PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it = lower_bound(key);
+    if (it != end() && !KeyOrder<Compare>::less(comp_, key, it->first)) {
+        return it;
+    }
+    return end();
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator::lowerBound(root_, key, comp_);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(root_);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template <typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::height() const
+{
+    return root_ ? root_->height : 0;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,209 @@
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+/*
+* Built with AVL_SUBTREE_SIZES=1 (see the Makefile): every way the tree
+* changes shape must keep the subtree sizes that rank, select and
+* count_range read.
+*/
+
+typedef AVLTree<int, int> Tree;
+
+/**
+* rank of every key in [lo, hi], select of every position and
+* count_range over random intervals agree with expected, and the tree
+* holds expected's items in a balanced shape.
+*/
+bool ranksMatch(const Tree& tree, const map<int, int>& expected, int lo, int hi, mt19937& rng)
+{
+    if (tree.size() != expected.size() || !tree.shape().balanced ||
+        !sameItems(tree.begin(), tree.end(), expected)) {
+        return false;
+    }
+    for (int key = lo; key <= hi; ++key) {
+        size_t less = distance(expected.begin(), expected.lower_bound(key));
+        if (tree.rank(key) != less) {
+            return false;
+        }
+    }
+    size_t i = 0;
+    for (map<int, int>::const_iterator it = expected.begin(); it != expected.end(); ++it, ++i) {
+        Tree::iterator selected = tree.select(i);
+        if (selected == tree.end() || selected->first != it->first) {
+            return false;
+        }
+    }
+    if (tree.select(expected.size()) != tree.end()) {
+        return false;
+    }
+    for (int round = 0; round < 200; ++round) {
+        int from = lo + static_cast<int>(rng() % (hi - lo + 1));
+        int to = lo + static_cast<int>(rng() % (hi - lo + 1));
+        size_t count = (from < to) ?
+            distance(expected.lower_bound(from), expected.lower_bound(to)) : 0;
+        if (tree.count_range(from, to) != count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testUpdates()
+{
+    mt19937 rng(5);
+    Tree tree;
+    map<int, int> expected;
+    bool allMatch = ranksMatch(tree, expected, -1, 1, rng);
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 2000);
+        if (rng() % 3 != 0) {
+            tree.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        if (i % 2500 == 0) {
+            allMatch = allMatch && ranksMatch(tree, expected, -1, 2000, rng);
+        }
+    }
+    CHECK(allMatch);
+    CHECK(ranksMatch(tree, expected, -1, 2000, rng));
+
+    // Hinted inserts and append_sorted link nodes their own way
+    Tree::iterator hint = tree.end();
+    for (int key = 2000; key < 2500; ++key) {
+        hint = tree.insert(hint, make_pair(key, key));
+        expected[key] = key;
+    }
+    vector<pair<int, int> > tail;
+    for (int key = 2500; key < 3000; ++key) {
+        tail.push_back(make_pair(key, key));
+        expected[key] = key;
+    }
+    tree.append_sorted(tail.begin(), tail.end());
+    CHECK(ranksMatch(tree, expected, -1, 3001, rng));
+
+    vector<pair<int, int> > items(expected.begin(), expected.end());
+    Tree loaded;
+    loaded.bulk_load(items.begin(), items.end());
+    CHECK(ranksMatch(loaded, expected, -1, 3001, rng));
+    Tree parallelLoaded;
+    parallelLoaded.parallel_bulk_load(items.begin(), items.end());
+    CHECK(ranksMatch(parallelLoaded, expected, -1, 3001, rng));
+}
+
+/**
+* Random batches, some with repeated keys, over a tree of even keys.
+*/
+void testBatches()
+{
+    mt19937 rng(8);
+    Tree tree;
+    map<int, int> expected;
+    for (int key = 0; key < 4000; key += 2) {
+        tree.insert(make_pair(key, key));
+        expected[key] = key;
+    }
+    bool allMatch = true;
+    for (int round = 0; round < 60; ++round) {
+        size_t count = rng() % 600;
+        vector<pair<int, int> > batch;
+        vector<int> keys;
+        for (size_t i = 0; i < count; ++i) {
+            int key = static_cast<int>(rng() % 4200) - 100;
+            batch.push_back(make_pair(key, round));
+            keys.push_back(key);
+        }
+        if (round % 2 == 0) {
+            tree.insert_batch(batch.begin(), batch.end());
+            for (size_t i = 0; i < batch.size(); ++i) {
+                expected[batch[i].first] = batch[i].second;
+            }
+        }
+        else {
+            tree.erase_batch(keys.begin(), keys.end());
+            for (size_t i = 0; i < keys.size(); ++i) {
+                expected.erase(keys[i]);
+            }
+        }
+        allMatch = allMatch && ranksMatch(tree, expected, -101, 4100, rng);
+    }
+    CHECK(allMatch);
+}
+
+void testSplitJoinAndSetOperations()
+{
+    mt19937 rng(13);
+    bool allMatch = true;
+    for (int round = 0; round < 40; ++round) {
+        Tree tree;
+        map<int, int> expected;
+        for (int i = static_cast<int>(rng() % 1500); i > 0; --i) {
+            int key = static_cast<int>(rng() % 3000);
+            tree.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        int key = static_cast<int>(rng() % 3000);
+        Tree upper;
+        tree.split(key, upper);
+        map<int, int> below(expected.begin(), expected.lower_bound(key));
+        map<int, int> above(expected.lower_bound(key), expected.end());
+        allMatch = allMatch && ranksMatch(tree, below, -1, 3000, rng) &&
+                   ranksMatch(upper, above, -1, 3000, rng);
+        if (!upper.empty() && round % 2 == 0) {
+            pair<int, int> first = *upper.begin();
+            upper.remove(first.first);
+            tree.join(first, upper);
+        }
+        else {
+            tree.join(upper);
+        }
+        allMatch = allMatch && ranksMatch(tree, expected, -1, 3000, rng);
+
+        Tree other;
+        map<int, int> inOther;
+        for (int i = static_cast<int>(rng() % 1500); i > 0; --i) {
+            int otherKey = static_cast<int>(rng() % 3000);
+            other.insert(make_pair(otherKey, -i));
+            inOther[otherKey] = -i;
+        }
+        switch (round % 3) {
+        case 0:
+            tree.union_with(other);
+            for (map<int, int>::iterator it = inOther.begin(); it != inOther.end(); ++it) {
+                expected[it->first] = it->second;
+            }
+            break;
+        case 1:
+            tree.intersect_with(other);
+            for (map<int, int>::iterator it = expected.begin(); it != expected.end();) {
+                it = (inOther.count(it->first) == 0) ? expected.erase(it) : ++it;
+            }
+            break;
+        default:
+            tree.difference(other);
+            for (map<int, int>::iterator it = inOther.begin(); it != inOther.end(); ++it) {
+                expected.erase(it->first);
+            }
+            break;
+        }
+        allMatch = allMatch && ranksMatch(tree, expected, -1, 3000, rng);
+    }
+    CHECK(allMatch);
+}
+
+int main()
+{
+    testUpdates();
+    testBatches();
+    testSplitJoinAndSetOperations();
+    return checkResult("rank-test");
+}
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "path_copy_avl.h"
+#include "rcu_avl.h"
+#include "test_check.h"
+
+using namespace std;
+
+typedef PathNode<int, int> Node;
+
+/**
+* Holds disposed nodes instead of freeing them, so the test can tell
+* which were disposed and free them (once each) at the end.
+*/
+struct KeepingDisposer
+{
+    void dispose(Node* node) { disposed.push_back(node); }
+    vector<Node*> disposed;
+};
+
+typedef PathCopyAVL<int, int, less<int>, KeepingDisposer> Ops;
+
+/**
+* Returns the subtree height, clearing ok if a stored height is wrong or
+* two sibling heights differ by more than one.
+*/
+int checkShape(const Node* node, bool& ok)
+{
+    if (node == nullptr) {
+        return 0;
+    }
+    int left = checkShape(node->left, ok);
+    int right = checkShape(node->right, ok);
+    if (left - right > 1 || right - left > 1 || node->height != 1 + max(left, right)) {
+        ok = false;
+    }
+    return node->height;
+}
+
+void collect(const Node* node, set<const Node*>& nodes)
+{
+    if (node != nullptr && nodes.insert(node).second) {
+        collect(node->left, nodes);
+        collect(node->right, nodes);
+    }
+}
+
+/**
+* Every update leaves the version it started from intact: versions kept
+* along the way must still match the std::map they had, and no node of
+* a kept version may be disposed until that version is released.
+*/
+void testPathCopy()
+{
+    less<int> comp;
+    KeepingDisposer disposer;
+    Ops ops(comp, disposer);
+    map<int, int> expected;
+    vector<Node*> versions;
+    vector<map<int, int> > versionItems;
+    Node* root = nullptr;
+    mt19937 rng(5);
+    bool reportsAgree = true;
+    for (int i = 0; i < 6000; ++i) {
+        int key = static_cast<int>(rng() % 800);
+        // A kept version takes over the reference the update leaves behind
+        bool keep = (i % 500 == 0);
+        if (keep) {
+            versions.push_back(root);
+            versionItems.push_back(expected);
+        }
+        bool changed = false;
+        Node* next;
+        if (rng() % 3 != 0) {
+            next = ops.insert(root, make_pair(key, i), changed);
+            reportsAgree = reportsAgree && (changed == (expected.count(key) == 0));
+            expected[key] = i;
+        }
+        else {
+            next = ops.remove(root, key, changed);
+            reportsAgree = reportsAgree && (changed == (expected.erase(key) == 1));
+        }
+        if (!keep) {
+            ops.release(root);
+        }
+        root = next;
+    }
+    CHECK(reportsAgree);
+    versions.push_back(root);
+    versionItems.push_back(expected);
+
+    bool versionsIntact = true;
+    bool balanced = true;
+    set<const Node*> live;
+    for (size_t v = 0; v < versions.size(); ++v) {
+        versionsIntact = versionsIntact &&
+            sameItems(PathIterator<int, int>(versions[v]), PathIterator<int, int>(),
+                      versionItems[v]);
+        checkShape(versions[v], balanced);
+        collect(versions[v], live);
+    }
+    CHECK(versionsIntact);
+    CHECK(balanced);
+
+    bool lookupsAgree = true;
+    for (int key = -1; key <= 800; ++key) {
+        const Node* found = Ops::find(root, key, comp);
+        map<int, int>::iterator it = expected.find(key);
+        if ((found != nullptr) != (it != expected.end()) ||
+            (found != nullptr && found->item.second != it->second)) {
+            lookupsAgree = false;
+        }
+        PathIterator<int, int> bound = PathIterator<int, int>::lowerBound(root, key, comp);
+        map<int, int>::iterator expectedBound = expected.lower_bound(key);
+        if ((bound == PathIterator<int, int>()) != (expectedBound == expected.end()) ||
+            (expectedBound != expected.end() && bound->first != expectedBound->first)) {
+            lookupsAgree = false;
+        }
+    }
+    CHECK(lookupsAgree);
+
+    bool liveKept = true;
+    for (size_t d = 0; d < disposer.disposed.size(); ++d) {
+        liveKept = liveKept && live.count(disposer.disposed[d]) == 0;
+    }
+    CHECK(liveKept);
+
+    for (size_t v = 0; v < versions.size(); ++v) {
+        ops.release(versions[v]);
+    }
+    set<Node*> disposed(disposer.disposed.begin(), disposer.disposed.end());
+    CHECK(disposed.size() == disposer.disposed.size());
+    bool allFreed = true;
+    for (set<const Node*>::iterator it = live.begin(); it != live.end(); ++it) {
+        allFreed = allFreed && disposed.count(const_cast<Node*>(*it)) == 1;
+    }
+    CHECK(allFreed);
+    for (set<Node*>::iterator it = disposed.begin(); it != disposed.end(); ++it) {
+        delete *it;
+    }
+}
+
+void testRcuAgainstMap()
+{
+    RcuAVLMap<int, int> m;
+    map<int, int> expected;
+    mt19937 rng(1);
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 2000);
+        if (rng() % 3 != 0) {
+            m.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            m.remove(key);
+            expected.erase(key);
+        }
+    }
+    CHECK(m.size() == expected.size());
+    bool lookupsAgree = true;
+    {
+        RcuAVLMap<int, int>::read_view view = m.view();
+        for (int key = -1; key <= 2000; ++key) {
+            int value = -1;
+            bool found = m.find(key, value);
+            const pair<const int, int>* item = view.find(key);
+            map<int, int>::iterator it = expected.find(key);
+            if (found != (it != expected.end()) || m.contains(key) != found ||
+                (found && value != it->second) || (item != nullptr) != found ||
+                (item != nullptr && item->second != it->second)) {
+                lookupsAgree = false;
+            }
+        }
+        CHECK(sameItems(view.begin(), view.end(), expected));
+    }
+    CHECK(lookupsAgree);
+
+    // A view keeps the version it was taken on, whatever the writer does
+    map<int, int> before = expected;
+    {
+        RcuAVLMap<int, int>::read_view old = m.view();
+        for (int key = 0; key < 2000; key += 3) {
+            m.remove(key);
+            expected.erase(key);
+        }
+        m.insert(make_pair(5000, 1));
+        expected[5000] = 1;
+        CHECK(sameItems(old.begin(), old.end(), before));
+        CHECK(old.find(5000) == nullptr);
+        RcuAVLMap<int, int>::read_view current = m.view();
+        CHECK(sameItems(current.begin(), current.end(), expected));
+    }
+    m.reclaim();
+    m.clear();
+    CHECK(m.empty() && m.size() == 0);
+    RcuAVLMap<int, int>::read_view empty = m.view();
+    CHECK(empty.begin() == empty.end());
+}
+
+/**
+* Readers look up keys no writer touches, and scan, while two writers
+* churn other keys; every read must see the stable keys and a sorted
+* scan, and the end state must match the writers' maps.
+*/
+void testRcuConcurrent()
+{
+    RcuAVLMap<int, int> m;
+    for (int key = 0; key < 4000; key += 2) {
+        m.insert(make_pair(key, key));
+    }
+    atomic<bool> stop(false);
+    atomic<int> badReads(0);
+    vector<thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.push_back(thread([&m, &stop, &badReads] {
+            while (!stop.load()) {
+                int value;
+                for (int key = 0; key < 4000; key += 2) {
+                    if (!m.find(key, value) || value != key) {
+                        ++badReads;
+                    }
+                }
+                RcuAVLMap<int, int>::read_view view = m.view();
+                int previous = -1;
+                for (RcuAVLMap<int, int>::iterator it = view.begin(); it != view.end(); ++it) {
+                    if (it->first <= previous) {
+                        ++badReads;
+                    }
+                    previous = it->first;
+                }
+            }
+        }));
+    }
+    // Writers are serialized by the map; each churns its own odd keys
+    vector<map<int, int> > written(2);
+    vector<thread> writers;
+    for (int w = 0; w < 2; ++w) {
+        writers.push_back(thread([&m, &written, w] {
+            mt19937 rng(w);
+            for (int i = 0; i < 10000; ++i) {
+                int key = 4 * static_cast<int>(rng() % 1000) + 2 * w + 1;
+                if (i % 2 != 0) {
+                    m.insert(make_pair(key, i));
+                    written[w][key] = i;
+                }
+                else {
+                    m.remove(key);
+                    written[w].erase(key);
+                }
+            }
+        }));
+    }
+    for (size_t w = 0; w < writers.size(); ++w) {
+        writers[w].join();
+    }
+    stop = true;
+    for (size_t r = 0; r < readers.size(); ++r) {
+        readers[r].join();
+    }
+    CHECK(badReads.load() == 0);
+    map<int, int> expected = written[0];
+    expected.insert(written[1].begin(), written[1].end());
+    for (int key = 0; key < 4000; key += 2) {
+        expected[key] = key;
+    }
+    RcuAVLMap<int, int>::read_view view = m.view();
+    CHECK(sameItems(view.begin(), view.end(), expected));
+}
+
+void testRcuStrings()
+{
+    RcuAVLMap<string, int, StringCompare> m;
+    m.insert(make_pair(string("b"), 1));
+    m.insert(make_pair(string("a"), 2));
+    int value = 0;
+    CHECK(m.find("a", value) && value == 2);
+    CHECK(!m.contains("c"));
+}
+
+int main()
+{
+    testPathCopy();
+    testRcuAgainstMap();
+    testRcuConcurrent();
+    testRcuStrings();
+    return checkResult("rcu-test");
+}
@@ -0,0 +1,406 @@
+#ifndef RCU_AVL_H
+#define RCU_AVL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "path_copy_avl.h"
+
+/**
+* An ordered map for read-mostly workloads: readers never lock and
+* never wait for writers.
+*
+* Writers are serialized by a mutex. Each update builds a new version
+* by path copying (see PathCopyAVL) and publishes its root with one
+* atomic store, so a reader sees either the old version or the new one,
+* never a tree in the middle of a rotation.
+*
+* Nodes that drop out of the current version are freed by epoch-based
+* reclamation. A reader announces the epoch it started in; nodes
+* retired in epoch e are freed once the epoch has moved to e + 2, which
+* the writer only does when no reader is left in an older epoch.
+* Readers count themselves in one of several padded counters per epoch,
+* picked by thread, so that they do not all write one cache line.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class RcuAVLMap
+{
+public:
+    class read_view;
+    typedef PathIterator<Key, Value> iterator;
+
+    explicit RcuAVLMap(const Compare& comp = Compare());
+    ~RcuAVLMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    bool empty() const;
+    std::size_t size() const;
+
+    read_view view() const;
+    void reclaim();
+
+private:
+    typedef PathNode<Key, Value> Node;
+
+    static const std::size_t EPOCHS = 3;
+    static const std::size_t STRIPES = 16;
+
+    struct ReaderCount
+    {
+        std::atomic<long> count;
+        char pad[64 - sizeof(std::atomic<long>)];
+    };
+
+    // Hands nodes that lost their last reference to the current epoch
+    struct Retirer
+    {
+        void dispose(Node* node) { retired[epoch % EPOCHS].push_back(node); }
+
+        std::size_t epoch;
+        std::vector<Node*> retired[EPOCHS];
+    };
+
+    typedef PathCopyAVL<Key, Value, Compare, Retirer> Ops;
+
+    // Not copyable
+    RcuAVLMap(const RcuAVLMap& other);
+    RcuAVLMap& operator=(const RcuAVLMap& other);
+
+    std::atomic<long>* enter() const;
+    static std::size_t stripe();
+
+    void publish(Node* root);
+    bool tryAdvance();
+    void freeRetired(std::size_t bucket);
+
+    std::atomic<Node*> root_;
+    std::atomic<std::size_t> size_;
+    std::atomic<std::size_t> epoch_;
+    mutable ReaderCount readers_[EPOCHS][STRIPES];
+    std::mutex writeLock_;
+    Retirer retirer_;
+    Compare comp_;
+};
+
+/**
+* A consistent version of the map for a series of lookups or a scan.
+* The view holds its epoch open, which keeps its version's nodes alive
+* and delays reclamation, so it should not be held longer than needed.
+*/
+template <typename Key, typename Value, typename Compare>
+class RcuAVLMap<Key, Value, Compare>::read_view
+{
+public:
+    read_view(read_view&& other);
+    ~read_view();
+
+    const std::pair<const Key, Value>* find(const Key& key) const;
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    friend class RcuAVLMap<Key, Value, Compare>;
+    explicit read_view(const RcuAVLMap* map);
+
+    read_view(const read_view& other);
+    read_view& operator=(const read_view& other);
+
+    const RcuAVLMap* map_;
+    std::atomic<long>* readerCount_;    // where this view counted itself
+    const Node* root_;
+};
+
+template <typename Key, typename Value, typename Compare>
+const std::size_t RcuAVLMap<Key, Value, Compare>::EPOCHS;
+
+template <typename Key, typename Value, typename Compare>
+const std::size_t RcuAVLMap<Key, Value, Compare>::STRIPES;
+
+/*
+  -------------------------------------------------------
+  Begin implementations for the RcuAVLMap::read_view class.
+  -------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+RcuAVLMap<Key, Value, Compare>::read_view::read_view(const RcuAVLMap* map) :
+    map_(map),
+    readerCount_(map->enter()),
+    root_(map->root_.load())
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+RcuAVLMap<Key, Value, Compare>::read_view::read_view(read_view&& other) :
+    map_(other.map_),
+    readerCount_(other.readerCount_),
+    root_(other.root_)
+{
+    other.map_ = nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+RcuAVLMap<Key, Value, Compare>::read_view::~read_view()
+{
+    if (map_ != nullptr) {
+        readerCount_->fetch_sub(1);
+    }
+}
+
+/**
+* Returns the item for key in this view's version, or nullptr.
+*/
+template <typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>*
+RcuAVLMap<Key, Value, Compare>::read_view::find(const Key& key) const
+{
+    const Node* node = Ops::find(root_, key, map_->comp_);
+    return node ? &node->item : nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename RcuAVLMap<Key, Value, Compare>::iterator
+RcuAVLMap<Key, Value, Compare>::read_view::begin() const
+{
+    return iterator(root_);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename RcuAVLMap<Key, Value, Compare>::iterator
+RcuAVLMap<Key, Value, Compare>::read_view::end() const
+{
+    return iterator();
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the RcuAVLMap::read_view class.
+  -----------------------------------------------------
+*/
+
+/*
+  --------------------------------------------
+  Begin implementations for the RcuAVLMap class.
+  --------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+RcuAVLMap<Key, Value, Compare>::RcuAVLMap(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    epoch_(0),
+    comp_(comp)
+{
+    for (std::size_t e = 0; e < EPOCHS; ++e) {
+        for (std::size_t s = 0; s < STRIPES; ++s) {
+            readers_[e][s].count.store(0);
+        }
+    }
+    retirer_.epoch = 0;
+}
+
+/**
+* No reader may be active once the map is being destroyed, so every
+* retired node can be freed at once.
+*/
+template <typename Key, typename Value, typename Compare>
+RcuAVLMap<Key, Value, Compare>::~RcuAVLMap()
+{
+    Ops ops(comp_, retirer_);
+    ops.release(root_.load());
+    for (std::size_t bucket = 0; bucket < EPOCHS; ++bucket) {
+        freeRetired(bucket);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t RcuAVLMap<Key, Value, Compare>::stripe()
+{
+    static thread_local std::size_t index =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) % STRIPES;
+    return index;
+}
+
+/**
+* Counts the calling thread into the current epoch. If the epoch moves
+* between reading it and being counted, the writer may not have seen
+* the count, so the reader retries in the new epoch. Returns the
+* counter to decrement on leaving.
+*/
+template <typename Key, typename Value, typename Compare>
+std::atomic<long>* RcuAVLMap<Key, Value, Compare>::enter() const
+{
+    std::size_t s = stripe();
+    while (true) {
+        std::size_t epoch = epoch_.load();
+        std::atomic<long>& count = readers_[epoch % EPOCHS][s].count;
+        count.fetch_add(1);
+        if (epoch_.load() == epoch) {
+            return &count;
+        }
+        count.fetch_sub(1);
+    }
+}
+
+/**
+* Moves from epoch e to e + 1 if no reader remains in e - 1, then frees
+* what was retired in e - 1: a reader that could still reach those nodes
+* entered in e - 1 or earlier, and all of those have left. Never waits.
+*/
+template <typename Key, typename Value, typename Compare>
+bool RcuAVLMap<Key, Value, Compare>::tryAdvance()
+{
+    std::size_t epoch = epoch_.load();
+    std::size_t previous = (epoch + EPOCHS - 1) % EPOCHS;
+    for (std::size_t s = 0; s < STRIPES; ++s) {
+        if (readers_[previous][s].count.load() != 0) {
+            return false;
+        }
+    }
+    epoch_.store(epoch + 1);
+    retirer_.epoch = epoch + 1;
+    freeRetired(previous);
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+void RcuAVLMap<Key, Value, Compare>::freeRetired(std::size_t bucket)
+{
+    std::vector<Node*>& retired = retirer_.retired[bucket];
+    for (std::size_t i = 0; i < retired.size(); ++i) {
+        delete retired[i];
+    }
+    retired.clear();
+}
+
+/**
+* Makes root the current version and retires what only the old version
+* used. Call with writeLock_ held.
+*/
+template <typename Key, typename Value, typename Compare>
+void RcuAVLMap<Key, Value, Compare>::publish(Node* root)
+{
+    Node* old = root_.exchange(root);
+    Ops ops(comp_, retirer_);
+    ops.release(old);
+    tryAdvance();
+}
+
+/**
+* Inserts or overwrites, as AVLTree::insert does.
+*/
+template <typename Key, typename Value, typename Compare>
+void RcuAVLMap<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    Ops ops(comp_, retirer_);
+    bool added = false;
+    Node* root = ops.insert(root_.load(), keyValuePair, added);
+    publish(root);
+    if (added) {
+        size_.fetch_add(1);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void RcuAVLMap<Key, Value, Compare>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    Ops ops(comp_, retirer_);
+    bool removed = false;
+    Node* root = ops.remove(root_.load(), key, removed);
+    if (!removed) {
+        ops.release(root);
+        return;
+    }
+    publish(root);
+    size_.fetch_sub(1);
+}
+
+template <typename Key, typename Value, typename Compare>
+void RcuAVLMap<Key, Value, Compare>::clear()
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    publish(nullptr);
+    size_.store(0);
+}
+
+/**
+* Copies the value for key into value and returns true, or returns
+* false if key is absent. Never blocks.
+*/
+template <typename Key, typename Value, typename Compare>
+bool RcuAVLMap<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    read_view current(this);
+    const std::pair<const Key, Value>* item = current.find(key);
+    if (item == nullptr) {
+        return false;
+    }
+    value = item->second;
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool RcuAVLMap<Key, Value, Compare>::contains(const Key& key) const
+{
+    read_view current(this);
+    return current.find(key) != nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool RcuAVLMap<Key, Value, Compare>::empty() const
+{
+    return size_.load() == 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t RcuAVLMap<Key, Value, Compare>::size() const
+{
+    return size_.load();
+}
+
+/**
+* Returns a view of the current version; see read_view.
+*/
+template <typename Key, typename Value, typename Compare>
+typename RcuAVLMap<Key, Value, Compare>::read_view RcuAVLMap<Key, Value, Compare>::view() const
+{
+    return read_view(this);
+}
+
+/**
+* Waits for the readers of older versions to finish and frees everything
+* retired so far. Writers are held off meanwhile; readers are not.
+*/
+template <typename Key, typename Value, typename Compare>
+void RcuAVLMap<Key, Value, Compare>::reclaim()
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    for (std::size_t advanced = 0; advanced < EPOCHS; ) {
+        if (tryAdvance()) {
+            ++advanced;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/*
+  ------------------------------------------
+  End implementations for the RcuAVLMap class.
+  ------------------------------------------
+*/
+
+#endif
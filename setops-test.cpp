@@ -0,0 +1,320 @@
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+typedef AVLTree<int, int> Tree;
+
+/**
+* The tree holds expected's items, and its shape, recomputed from every
+* node, is balanced with the height its root has stored.
+*/
+bool matches(const Tree& tree, const map<int, int>& expected)
+{
+    TreeShape shape = tree.shape();
+    return tree.size() == expected.size() && shape.nodes == expected.size() &&
+           shape.balanced && shape.height == tree.height() &&
+           sameItems(tree.begin(), tree.end(), expected);
+}
+
+void fill(Tree& tree, map<int, int>& expected, int count, int range, int value, mt19937& rng)
+{
+    for (int i = 0; i < count; ++i) {
+        int key = static_cast<int>(rng() % range);
+        tree.insert(make_pair(key, value + i));
+        expected[key] = value + i;
+    }
+}
+
+/**
+* Union, intersection and difference of random trees of very different
+* sizes and overlaps, each checked against the same on std::maps, and
+* the result must still take ordinary updates.
+*/
+void testSetOperations()
+{
+    mt19937 rng(3);
+    bool allMatch = true;
+    for (int round = 0; round < 150; ++round) {
+        int range = static_cast<int>(rng() % 5000) + 1;
+        int sizes[] = { 0, 1, 20, 2000 };
+        Tree a;
+        Tree b;
+        map<int, int> inA;
+        map<int, int> inB;
+        fill(a, inA, sizes[rng() % 4], range, 0, rng);
+        fill(b, inB, sizes[rng() % 4], range, -100000, rng);
+
+        switch (round % 3) {
+        case 0:
+            a.union_with(b);
+            for (map<int, int>::iterator it = inB.begin(); it != inB.end(); ++it) {
+                inA[it->first] = it->second;
+            }
+            break;
+        case 1: {
+            a.intersect_with(b);
+            map<int, int> both;
+            for (map<int, int>::iterator it = inA.begin(); it != inA.end(); ++it) {
+                if (inB.count(it->first) != 0) {
+                    both.insert(*it);
+                }
+            }
+            inA = both;
+            break;
+        }
+        default:
+            a.difference(b);
+            for (map<int, int>::iterator it = inB.begin(); it != inB.end(); ++it) {
+                inA.erase(it->first);
+            }
+            break;
+        }
+        allMatch = allMatch && matches(a, inA) && matches(b, inB);
+        a.insert(make_pair(-7, 0));
+        inA[-7] = 0;
+        a.remove(range / 2);
+        inA.erase(range / 2);
+        allMatch = allMatch && matches(a, inA);
+    }
+    CHECK(allMatch);
+
+    Tree self;
+    self.insert(make_pair(1, 1));
+    self.union_with(self);
+    CHECK(self.size() == 1);
+    self.intersect_with(self);
+    CHECK(self.size() == 1);
+    self.difference(self);
+    CHECK(self.empty());
+}
+
+/**
+* Splitting at every kind of key (absent, present, below and above
+* everything) and joining the parts back, with and without a pivot item.
+*/
+void testSplitJoin()
+{
+    mt19937 rng(7);
+    bool allMatch = true;
+    for (int round = 0; round < 150; ++round) {
+        int range = static_cast<int>(rng() % 3000) + 1;
+        Tree tree;
+        map<int, int> expected;
+        fill(tree, expected, static_cast<int>(rng() % 2000), range, 0, rng);
+        int key = static_cast<int>(rng() % (range + 20)) - 10;
+
+        Tree upper;
+        tree.split(key, upper);
+        map<int, int> below(expected.begin(), expected.lower_bound(key));
+        map<int, int> above(expected.lower_bound(key), expected.end());
+        allMatch = allMatch && matches(tree, below) && matches(upper, above);
+
+        if (!upper.empty() && round % 2 == 0) {
+            pair<int, int> first = *upper.begin();
+            upper.remove(first.first);
+            tree.join(first, upper);
+        }
+        else {
+            tree.join(upper);
+        }
+        allMatch = allMatch && matches(tree, expected) && upper.empty();
+        tree.insert(make_pair(range + 5, 1));
+        expected[range + 5] = 1;
+        allMatch = allMatch && matches(tree, expected);
+    }
+    CHECK(allMatch);
+
+    // Heights far apart, in both directions
+    Tree tall;
+    Tree shortRight;
+    map<int, int> expected;
+    for (int i = 0; i < 5000; ++i) {
+        tall.insert(make_pair(i, i));
+        expected[i] = i;
+    }
+    shortRight.insert(make_pair(10001, 1));
+    expected[10001] = 1;
+    tall.join(make_pair(10000, 0), shortRight);
+    expected[10000] = 0;
+    CHECK(matches(tall, expected));
+
+    Tree shortLeft;
+    shortLeft.insert(make_pair(-1, -1));
+    expected[-1] = -1;
+    shortLeft.join(tall);
+    CHECK(matches(shortLeft, expected) && tall.empty());
+}
+
+// A value that counts its copies
+struct Counted
+{
+    static long copies;
+
+    explicit Counted(int v) : value(v), text(40, 'c') {}
+    Counted(const Counted& other) : value(other.value), text(other.text) { ++copies; }
+
+    int value;
+    string text;
+};
+
+long Counted::copies = 0;
+
+ostream& operator<<(ostream& out, const Counted& counted)
+{
+    return out << counted.value;
+}
+
+/**
+* split hands the upper nodes over where they are, copying nothing, and
+* each part outlives the other: the storage they share stays until both
+* have let go of it, whichever goes first and however it is cleared.
+*/
+void testSplitSharesNodes()
+{
+    AVLTree<int, Counted> upper;
+    map<int, int> above;
+    {
+        AVLTree<int, Counted> tree;
+        for (int i = 0; i < 5000; ++i) {
+            tree.insert(make_pair(i, Counted(i)));
+        }
+        const Counted* before = &tree.find(4000)->second;
+        Counted::copies = 0;
+        tree.split(1234, upper);
+        CHECK(Counted::copies == 0 && &upper.find(4000)->second == before);
+        CHECK(tree.size() == 1234 && upper.size() == 5000 - 1234 &&
+              tree.shape().balanced && upper.shape().balanced);
+        for (int i = 1234; i < 5000; ++i) {
+            above[i] = i;
+        }
+    }
+    // The lower part is gone; the upper one still reads and updates
+    for (int i = 1234; i < 5000; i += 3) {
+        upper.remove(i);
+        above.erase(i);
+    }
+    for (int i = 6000; i < 7000; ++i) {
+        upper.insert(make_pair(i, Counted(i)));
+        above[i] = i;
+    }
+    bool allSame = upper.size() == above.size();
+    map<int, int>::iterator want = above.begin();
+    for (AVLTree<int, Counted>::iterator it = upper.begin(); allSame && it != upper.end();
+         ++it, ++want) {
+        allSame = it->first == want->first && it->second.value == want->second;
+    }
+    CHECK(allSame && upper.shape().balanced);
+
+    // Trivially destructible items, cleared a slab at a time
+    Tree ints;
+    map<int, int> expected;
+    for (int i = 0; i < 3000; ++i) {
+        ints.insert(make_pair(i, -i));
+        expected[i] = -i;
+    }
+    Tree intsUpper;
+    ints.split(1000, intsUpper);
+    ints.clear();
+    expected.erase(expected.begin(), expected.lower_bound(1000));
+    CHECK(matches(intsUpper, expected));
+    WorkStealingPool pool(2);
+    intsUpper.parallel_clear(pool);
+    CHECK(intsUpper.empty());
+
+    // Splitting and joining back over and over, pooled and not
+    for (size_t slabNodes = 0; slabNodes <= NodePool::DEFAULT_SLAB_NODES;
+         slabNodes += NodePool::DEFAULT_SLAB_NODES) {
+        Tree whole(slabNodes);
+        Tree part(slabNodes);
+        map<int, int> items;
+        for (int i = 0; i < 2000; ++i) {
+            whole.insert(make_pair(i, i));
+            items[i] = i;
+        }
+        mt19937 rng(11);
+        bool allMatch = true;
+        for (int round = 0; round < 300; ++round) {
+            whole.split(static_cast<int>(rng() % 2100), part);
+            part.insert(make_pair(5000 + round, round));
+            whole.insert(make_pair(-1 - round, round));
+            items[5000 + round] = round;
+            items[-1 - round] = round;
+            whole.join(part);
+            allMatch = allMatch && part.empty();
+        }
+        CHECK(allMatch && matches(whole, items));
+    }
+}
+
+void testJoinErrors()
+{
+    Tree low;
+    Tree high;
+    low.insert(make_pair(1, 1));
+    high.insert(make_pair(5, 5));
+    map<int, int> lowItems;
+    lowItems[1] = 1;
+    map<int, int> highItems;
+    highItems[5] = 5;
+
+    bool threw = false;
+    try {
+        high.join(low);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw && matches(high, highItems) && matches(low, lowItems));
+
+    threw = false;
+    try {
+        low.join(make_pair(7, 7), high);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw && matches(high, highItems) && matches(low, lowItems));
+
+    threw = false;
+    try {
+        low.join(low);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    threw = false;
+    try {
+        low.split(0, high);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw && matches(high, highItems) && matches(low, lowItems));
+
+    // Pooled and unpooled nodes cannot be shared
+    Tree unpooled(0);
+    threw = false;
+    try {
+        low.split(0, unpooled);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw && unpooled.empty() && matches(low, lowItems));
+}
+
+int main()
+{
+    testSetOperations();
+    testSplitJoin();
+    testSplitSharesNodes();
+    testJoinErrors();
+    return checkResult("setops-test");
+}
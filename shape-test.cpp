@@ -0,0 +1,145 @@
+#include <random>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+/**
+* AVLTree answers height() and isBalanced() from its stored heights;
+* both must agree with shape(), which measures every node.
+*/
+bool agrees(const AVLTree<int, int>& tree)
+{
+    TreeShape shape = tree.shape();
+    return shape.nodes == tree.size() && shape.height == tree.height() &&
+           shape.balanced && tree.isBalanced();
+}
+
+// Empty trees have no nodes, height -1, and count as balanced
+void testEmpty()
+{
+    BinarySearchTree<int, int> plain;
+    AVLTree<int, int> avl;
+    TreeShape shape = plain.shape();
+    CHECK(shape.nodes == 0 && shape.leaves == 0 && shape.height == -1 &&
+          shape.averageDepth == 0 && shape.balanced);
+    CHECK(plain.height() == -1 && plain.isBalanced());
+    CHECK(avl.height() == -1 && avl.isBalanced() && agrees(avl));
+}
+
+/**
+* Random inserts and removes, then bulk loads, batches, splits and
+* joins: after each, the O(1) answers match a full walk.
+*/
+void testAvlUpdates()
+{
+    AVLTree<int, int> tree;
+    mt19937 rng(25);
+    bool allAgree = true;
+    for (int i = 0; i < 50000; ++i) {
+        int key = static_cast<int>(rng() % 10000);
+        if (rng() % 3 != 0) {
+            tree.insert(make_pair(key, i));
+        }
+        else {
+            tree.remove(key);
+        }
+        if (i % 97 == 0) {
+            allAgree = allAgree && agrees(tree);
+        }
+    }
+    CHECK(allAgree && agrees(tree));
+
+    vector<pair<int, int> > items;
+    for (int key = 0; key < 5000; ++key) {
+        items.push_back(make_pair(2 * key, key));
+    }
+    AVLTree<int, int> loaded;
+    loaded.bulk_load(items.begin(), items.end());
+    CHECK(agrees(loaded));
+    vector<pair<int, int> > odd;
+    for (int key = 0; key < 3000; ++key) {
+        odd.push_back(make_pair(2 * key + 1, key));
+    }
+    loaded.insert_batch(odd.begin(), odd.end());
+    CHECK(agrees(loaded));
+
+    AVLTree<int, int> right;
+    loaded.split(7001, right);
+    CHECK(agrees(loaded) && agrees(right));
+    loaded.join(right);
+    CHECK(agrees(loaded) && agrees(right) && loaded.size() == 8000);
+
+    for (int key = 0; key < 10000; ++key) {
+        tree.remove(key);
+    }
+    CHECK(agrees(tree) && tree.height() == -1);
+}
+
+/**
+* Small plain trees, balanced and not; the last is balanced at the root
+* but not at 2, whose left subtree is two deeper than its right.
+*/
+bool shapeOf(const vector<int>& keys, int height, size_t leaves, bool balanced)
+{
+    BinarySearchTree<int, int> tree;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], 0));
+    }
+    TreeShape shape = tree.shape();
+    return shape.nodes == keys.size() && shape.height == height && shape.leaves == leaves &&
+           shape.balanced == balanced && tree.height() == height &&
+           tree.isBalanced() == balanced;
+}
+
+void testSmallShapes()
+{
+    CHECK(shapeOf(vector<int>{ 1 }, 0, 1, true));
+    CHECK(shapeOf(vector<int>{ 2, 1, 3, 4 }, 2, 2, true));
+    CHECK(shapeOf(vector<int>{ 2, 1, 3, 4, 5 }, 3, 2, false));
+    CHECK(shapeOf(vector<int>{ 5, 2, 8, 1, 0, 7, 9, 10 }, 3, 3, false));
+}
+
+/**
+* Sorted keys, added with a hint so each insert costs O(1), make a plain
+* tree one path a million nodes deep: shape(), height() and isBalanced()
+* walk it without recursing. So does a zig-zag of alternating small and
+* large keys, which turns at every node.
+*/
+void testDegenerate()
+{
+    const int n = 1000000;
+    BinarySearchTree<int, int> chain;
+    for (int key = 0; key < n; ++key) {
+        chain.insert(chain.end(), make_pair(key, key));
+    }
+    TreeShape shape = chain.shape();
+    CHECK(shape.nodes == static_cast<size_t>(n) && shape.height == n - 1 &&
+          shape.leaves == 1 && !shape.balanced);
+    CHECK(shape.averageDepth == (n - 1) / 2.0);
+    CHECK(chain.height() == n - 1 && !chain.isBalanced());
+
+    BinarySearchTree<int, int> zigzag;
+    BinarySearchTree<int, int>::iterator last = zigzag.end();
+    for (int low = 0, high = n - 1; low <= high; ++low, --high) {
+        last = zigzag.insert(last, make_pair(low, 0));
+        if (low != high) {
+            last = zigzag.insert(last, make_pair(high, 0));
+        }
+    }
+    shape = zigzag.shape();
+    CHECK(shape.nodes == static_cast<size_t>(n) && shape.height == n - 1 &&
+          shape.leaves == 1 && !shape.balanced);
+    CHECK(zigzag.height() == n - 1 && !zigzag.isBalanced());
+}
+
+int main()
+{
+    testEmpty();
+    testAvlUpdates();
+    testSmallShapes();
+    testDegenerate();
+    return checkResult("shape-test");
+}
@@ -0,0 +1,220 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+/**
+* Every node's parent link is right and no subtree heights differ by
+* more than one; returns the height, or -2 once anything is wrong.
+*/
+template <typename Key, typename Value>
+int checkLinks(Node<Key, Value>* node, Node<Key, Value>* parent)
+{
+    if (node == nullptr) {
+        return -1;
+    }
+    int left = checkLinks(node->getLeft(), node);
+    int right = checkLinks(node->getRight(), node);
+    if (node->getParent() != parent || left == -2 || right == -2 ||
+        left - right > 1 || right - left > 1) {
+        return -2;
+    }
+    return 1 + ((left > right) ? left : right);
+}
+
+// Reaches the root, which the tests need to check the links of a load
+template <typename Key, typename Value>
+struct LinkedTree : AVLTree<Key, Value>
+{
+    bool wellLinked() const { return checkLinks<Key, Value>(this->root_, nullptr) != -2; }
+};
+
+void overwrite(const string& path, long offset, const void* data, size_t bytes)
+{
+    FILE* file = fopen(path.c_str(), "r+b");
+    fseek(file, offset, SEEK_SET);
+    fwrite(data, 1, bytes, file);
+    fclose(file);
+}
+
+void append(const string& path, const char* data)
+{
+    FILE* file = fopen(path.c_str(), "ab");
+    fputs(data, file);
+    fclose(file);
+}
+
+/**
+* load() must throw a runtime_error whose message contains reason and
+* leave the tree as it was.
+*/
+template <typename Tree, typename Key, typename Value>
+bool loadFails(Tree& tree, const string& path, const char* reason,
+               const map<Key, Value>& before)
+{
+    bool threw = false;
+    try {
+        tree.load(path);
+    }
+    catch (const runtime_error& error) {
+        threw = strstr(error.what(), reason) != nullptr;
+        if (!threw) {
+            printf("unexpected error: %s\n", error.what());
+        }
+    }
+    return threw && sameItems(tree.begin(), tree.end(), before);
+}
+
+void testRoundTrips(const string& path)
+{
+    mt19937 rng(1);
+    const int sizes[] = { 0, 1, 2, 100, 50000 };
+    bool allMatch = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        AVLTree<int, int> saved;
+        map<int, int> expected;
+        for (int i = 0; i < sizes[s]; ++i) {
+            int key = static_cast<int>(rng());
+            saved.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        saved.save(path);
+
+        LinkedTree<int, int> loaded;
+        loaded.insert(make_pair(5, 5));
+        loaded.load(path);
+        allMatch = allMatch && loaded.size() == expected.size() && loaded.wellLinked() &&
+                   sameItems(loaded.begin(), loaded.end(), expected);
+        BinarySearchTree<int, int> plain;
+        plain.load(path);
+        allMatch = allMatch && plain.isBalanced() &&
+                   sameItems(plain.begin(), plain.end(), expected);
+
+        // The loaded tree takes ordinary updates
+        loaded.insert(make_pair(-3, 3));
+        expected[-3] = 3;
+        loaded.remove(expected.rbegin()->first);
+        expected.erase(expected.rbegin()->first);
+        allMatch = allMatch && loaded.wellLinked() &&
+                   sameItems(loaded.begin(), loaded.end(), expected);
+    }
+    CHECK(allMatch);
+
+    AVLTree<string, string> words;
+    map<string, string> expectedWords;
+    for (int i = 0; i < 3000; ++i) {
+        string key = to_string(rng());
+        string value(rng() % 300, 'a' + i % 26);
+        words.insert(make_pair(key, value));
+        expectedWords[key] = value;
+    }
+    words.save(path);
+    AVLTree<string, string> loadedWords;
+    loadedWords.load(path);
+    CHECK(sameItems(loadedWords.begin(), loadedWords.end(), expectedWords));
+
+    // A second save replaces the first
+    words.clear();
+    words.insert(make_pair(string("only"), string("one")));
+    words.save(path);
+    loadedWords.load(path);
+    CHECK(loadedWords.size() == 1 && loadedWords.find("only") != loadedWords.end());
+    CHECK(access((path + ".tmp").c_str(), F_OK) != 0);
+}
+
+/**
+* Each way a file can be wrong is reported as such, and leaves the tree
+* loading it untouched.
+*/
+void testCorruption(const string& path)
+{
+    AVLTree<int, int> saved;
+    for (int i = 0; i < 1000; ++i) {
+        saved.insert(make_pair(i, i));
+    }
+    AVLTree<int, int> tree;
+    tree.insert(make_pair(-1, -1));
+    map<int, int> before;
+    before[-1] = -1;
+    const long payload = sizeof(SnapshotHeader);
+
+    CHECK(loadFails(tree, path + ".missing", "cannot open", before));
+
+    saved.save(path);
+    overwrite(path, 0, "NOTASNAP", 8);
+    CHECK(loadFails(tree, path, "is not a snapshot", before));
+
+    saved.save(path);
+    uint32_t version = SnapshotHeader::VERSION + 1;
+    overwrite(path, offsetof(SnapshotHeader, version), &version, sizeof(version));
+    CHECK(loadFails(tree, path, "unsupported version", before));
+
+    saved.save(path);
+    CHECK(truncate(path.c_str(), payload + 500) == 0);
+    CHECK(loadFails(tree, path, "is truncated", before));
+
+    saved.save(path);
+    append(path, "extra");
+    CHECK(loadFails(tree, path, "is truncated", before));
+
+    saved.save(path);
+    uint64_t count = uint64_t(1) << 60;
+    overwrite(path, offsetof(SnapshotHeader, count), &count, sizeof(count));
+    CHECK(loadFails(tree, path, "corrupt item count", before));
+
+    saved.save(path);
+    overwrite(path, payload + 100, "x", 1);
+    CHECK(loadFails(tree, path, "fails its checksum", before));
+
+    saved.save(path);
+    AVLTree<string, int> wrongTypes;
+    CHECK(loadFails(wrongTypes, path, "holds other key or value types", map<string, int>()));
+
+    AVLTree<int, int, greater<int> > reversed;
+    reversed.insert(make_pair(-1, -1));
+    bool threw = false;
+    try {
+        reversed.load(path);
+    }
+    catch (const runtime_error& error) {
+        threw = strstr(error.what(), "out of order") != nullptr;
+    }
+    CHECK(threw && reversed.size() == 1);
+
+    AVLTree<string, string> words;
+    words.insert(make_pair(string("key"), string("value")));
+    map<string, string> word;
+    word["key"] = "value";
+    words.save(path);
+    uint64_t length = uint64_t(1) << 40;
+    overwrite(path, payload, &length, sizeof(length));
+    CHECK(loadFails(words, path, "corrupt string length", word));
+
+    threw = false;
+    try {
+        saved.save("/nonexistent/dir/tree.snap");
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main()
+{
+    string path = testPath("snapshot");
+    testRoundTrips(path);
+    testCorruption(path);
+    unlink(path.c_str());
+    return checkResult("snapshot-test");
+}
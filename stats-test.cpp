@@ -0,0 +1,150 @@
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "test_check.h"
+
+using namespace std;
+
+#if !BST_STATS
+#error "stats-test counts operations; build it with -DBST_STATS=1"
+#endif
+
+typedef AVLTree<int, int> Tree;
+
+TreeStats insertAll(Tree& tree, const vector<int>& keys)
+{
+    tree.resetStats();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], 0));
+    }
+    return tree.stats();
+}
+
+vector<int> keysOf(int a, int b, int c)
+{
+    vector<int> keys;
+    keys.push_back(a);
+    keys.push_back(b);
+    keys.push_back(c);
+    return keys;
+}
+
+/**
+* Three keys in each order. Every insert retraces from the new node's
+* parent (the first has none, so its retrace is empty); a retrace steps
+* through nodes until one keeps its height.
+*/
+void testRotationsAndRetraces()
+{
+    // 2, 1, 3: 1 raises 2's height, 3 does not; no rotation
+    Tree noRotation;
+    TreeStats stats = insertAll(noRotation, keysOf(2, 1, 3));
+    CHECK(stats.singleRotations == 0 && stats.doubleRotations == 0);
+    CHECK(stats.retraces == 3 && stats.retraceSteps == 2 && stats.longestRetrace == 1);
+
+    // 1, 2, 3: 3 raises 2, then 1 is right-right heavy and rotates once,
+    // leaving a subtree as tall as 1 was, which ends the retrace
+    Tree single;
+    stats = insertAll(single, keysOf(1, 2, 3));
+    CHECK(stats.singleRotations == 1 && stats.doubleRotations == 0);
+    CHECK(stats.retraces == 3 && stats.retraceSteps == 3 && stats.longestRetrace == 2);
+
+    // 3, 1, 2 and 1, 3, 2 are left-right and right-left: one double each
+    Tree leftRight;
+    stats = insertAll(leftRight, keysOf(3, 1, 2));
+    CHECK(stats.singleRotations == 0 && stats.doubleRotations == 1);
+    CHECK(stats.retraces == 3 && stats.retraceSteps == 3 && stats.longestRetrace == 2);
+    Tree rightLeft;
+    stats = insertAll(rightLeft, keysOf(1, 3, 2));
+    CHECK(stats.singleRotations == 0 && stats.doubleRotations == 1);
+    CHECK(rightLeft.begin()->first == 1 && rightLeft.height() == 1);
+
+    // Removing 1 from 2(1, 3(-, 4)) leaves 2 right-right heavy: one
+    // rotation, and the subtree comes out shorter, so the retrace goes on
+    // to the (absent) parent
+    Tree removal;
+    vector<int> keys = keysOf(2, 1, 3);
+    keys.push_back(4);
+    insertAll(removal, keys);
+    removal.resetStats();
+    removal.remove(1);
+    stats = removal.stats();
+    CHECK(stats.singleRotations == 1 && stats.doubleRotations == 0);
+    CHECK(stats.retraces == 1 && stats.retraceSteps == 1);
+
+    // Ascending 1..2^k - 1 ends perfect, after n - k single rotations
+    Tree ascending;
+    vector<int> run;
+    for (int key = 1; key <= 1023; ++key) {
+        run.push_back(key);
+    }
+    stats = insertAll(ascending, run);
+    CHECK(stats.singleRotations == 1023 - 10 && stats.doubleRotations == 0);
+    CHECK(stats.retraces == 1023 && ascending.shape().leaves == 512);
+}
+
+/**
+* Lookups on the perfect tree of 1..7, rooted at 4: each visits one node
+* per level down to its key, or to the leaf below which it would be.
+*/
+void testLookupDepths()
+{
+    Tree tree;
+    int order[] = { 4, 2, 6, 1, 3, 5, 7 };
+    for (int i = 0; i < 7; ++i) {
+        tree.insert(make_pair(order[i], i));
+    }
+    TreeStats stats = tree.stats();
+    CHECK(stats.allocations == 7 && stats.singleRotations == 0 && stats.doubleRotations == 0);
+    // 0 + 1 + 1 + 2 * 4 nodes passed on the way down to each new leaf
+    CHECK(stats.nodesVisited == 10 && stats.lookups == 0);
+
+    tree.resetStats();
+    for (int key = 1; key <= 7; ++key) {
+        tree.find(key);
+    }
+    tree.find(0);
+    tree.find(8);
+    stats = tree.stats();
+    CHECK(stats.lookups == 9 && stats.nodesVisited == 1 + 2 * 2 + 3 * 4 + 3 * 2);
+    CHECK(stats.lookupDepths[1] == 1 && stats.lookupDepths[2] == 2 && stats.lookupDepths[3] == 6);
+    CHECK(stats.averageLookupDepth() == 23.0 / 9);
+    CHECK(stats.comparisons > 0 && stats.allocations == 0);
+
+    tree.resetStats();
+    stats = tree.stats();
+    CHECK(stats.lookups == 0 && stats.nodesVisited == 0 && stats.comparisons == 0 &&
+          stats.lookupDepths[3] == 0 && stats.longestRetrace == 0);
+}
+
+/**
+* A plain BinarySearchTree counts its descents and allocations, and
+* never rotates or retraces; bulk_load allocates all its nodes at once.
+*/
+void testPlainTreeAndLoads()
+{
+    BinarySearchTree<int, int> chain;
+    for (int key = 1; key <= 7; ++key) {
+        chain.insert(make_pair(key, key));
+    }
+    TreeStats stats = chain.stats();
+    CHECK(stats.nodesVisited == 21 && stats.allocations == 7);
+    CHECK(stats.singleRotations == 0 && stats.doubleRotations == 0 && stats.retraces == 0);
+
+    vector<pair<int, int> > items;
+    for (int key = 0; key < 100; ++key) {
+        items.push_back(make_pair(key, key));
+    }
+    Tree loaded;
+    loaded.bulk_load(items.begin(), items.end());
+    stats = loaded.stats();
+    CHECK(stats.allocations == 100 && stats.singleRotations == 0 && stats.retraces == 0);
+}
+
+int main()
+{
+    testRotationsAndRetraces();
+    testLookupDepths();
+    testPlainTreeAndLoads();
+    return checkResult("stats-test");
+}
@@ -0,0 +1,60 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unistd.h>
+
+/**
+* What the behaviour tests (the *-test.cpp mains) share. CHECK reports a
+* failed condition with its line and carries on, sameItems compares an
+* in-order range with the std::map the test kept alongside, and
+* checkResult prints the tally and gives main its exit status, so that
+* make check stops at the first failing test. Tests that write files
+* put them at testPath(name), which is unique to the process.
+*/
+
+static int checksRun = 0;
+static int checksFailed = 0;
+
+#define CHECK(condition) checkThat((condition), #condition, __FILE__, __LINE__)
+
+inline bool checkThat(bool ok, const char* condition, const char* file, int line)
+{
+    ++checksRun;
+    if (!ok) {
+        ++checksFailed;
+        std::printf("%s:%d: CHECK(%s) failed\n", file, line, condition);
+    }
+    return ok;
+}
+
+/**
+* True if [first, last) holds exactly expected's items, in its order.
+*/
+template <typename Iterator, typename Key, typename Value, typename Compare>
+bool sameItems(Iterator first, Iterator last, const std::map<Key, Value, Compare>& expected)
+{
+    typename std::map<Key, Value, Compare>::const_iterator it = expected.begin();
+    for (; first != last; ++first, ++it) {
+        if (it == expected.end() || !(first->first == it->first) ||
+            !(first->second == it->second)) {
+            return false;
+        }
+    }
+    return it == expected.end();
+}
+
+inline std::string testPath(const char* name)
+{
+    return "/tmp/bst-" + std::to_string(::getpid()) + "-" + name;
+}
+
+inline int checkResult(const char* name)
+{
+    std::printf("%s: %d checks, %d failed\n", name, checksRun, checksFailed);
+    return (checksFailed == 0) ? 0 : 1;
+}
+
+#endif
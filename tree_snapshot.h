@@ -0,0 +1,597 @@
+#ifndef TREE_SNAPSHOT_H
+#define TREE_SNAPSHOT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * The binary snapshot format written by BinarySearchTree::save and read
+ * by load. A file is a fixed header followed by the payload: the keys
+ * of every item in sorted order, then the values in the same order.
+ * Trivially copyable types are stored raw, so each column is one
+ * memcpy-able array; other types go through a SnapshotCodec
+ * specialization (std::string is provided). Numbers are in host byte
+ * order, which the header records so that a foreign file is rejected
+ * rather than misread.
+ */
+
+/**
+* A streaming 64-bit checksum over the payload, eight bytes per step.
+* Feeding the same bytes in any split gives the same value.
+*/
+class SnapshotChecksum
+{
+public:
+    SnapshotChecksum();
+
+    void update(const void* data, std::size_t bytes);
+    uint64_t value() const;
+
+private:
+    static uint64_t mix(uint64_t state, uint64_t word);
+
+    uint64_t state_;
+    uint64_t length_;
+    unsigned char pending_[8];  // bytes of an incomplete word
+    std::size_t pendingBytes_;
+};
+
+struct SnapshotHeader
+{
+    static const uint32_t VERSION = 1;
+    static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static const uint32_t RAW_KEYS = 1;
+    static const uint32_t RAW_VALUES = 2;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t flags;
+    uint32_t keySize;       // sizeof(Key) if keys are raw, else 0
+    uint32_t valueSize;     // likewise for values
+    uint32_t reserved;
+    uint64_t count;         // number of items
+    uint64_t payloadBytes;
+    uint64_t checksum;      // of the payload
+
+    static SnapshotHeader describe(uint64_t count, bool rawKeys, std::size_t keySize,
+                                   bool rawValues, std::size_t valueSize);
+    static const char* expectedMagic();
+};
+
+/**
+* Writes a snapshot to path + ".tmp" and renames it over path on
+* commit(), once the data is on disk, so that a crash or an exception
+* mid-save leaves any previous snapshot at path intact.
+*/
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(const std::string& path);
+    ~SnapshotWriter();
+
+    void write(const void* data, std::size_t bytes);
+    void commit(SnapshotHeader header);
+
+private:
+    SnapshotWriter(const SnapshotWriter& other);
+    SnapshotWriter& operator=(const SnapshotWriter& other);
+
+    void flush();
+    void put(const void* data, std::size_t bytes);
+    void syncDirectory() const;
+
+    static const std::size_t BUFFER_BYTES = 1 << 20;
+
+    std::string path_;
+    std::string tmpPath_;
+    std::FILE* file_;
+    std::vector<char> buffer_;
+    std::size_t used_;
+    uint64_t payloadBytes_;
+    SnapshotChecksum checksum_;
+};
+
+/**
+* Opens a snapshot and checks its header against the file; read() then
+* hands out the payload in order, and finish() checks the checksum once
+* all of it has been read.
+*/
+class SnapshotReader
+{
+public:
+    explicit SnapshotReader(const std::string& path);
+    ~SnapshotReader();
+
+    const SnapshotHeader& header() const;
+    void expect(bool rawKeys, std::size_t keySize, bool rawValues, std::size_t valueSize,
+                std::size_t minItemBytes) const;
+    void read(void* data, std::size_t bytes);
+    uint64_t remaining() const;
+    void finish();
+
+private:
+    SnapshotReader(const SnapshotReader& other);
+    SnapshotReader& operator=(const SnapshotReader& other);
+
+    void take(void* data, std::size_t bytes);
+
+    static const std::size_t BUFFER_BYTES = 1 << 20;
+
+    std::string path_;
+    std::FILE* file_;
+    SnapshotHeader header_;
+    std::vector<char> buffer_;
+    std::size_t begin_;     // unread bytes of buffer_ are [begin_, end_)
+    std::size_t end_;
+    uint64_t consumed_;
+    SnapshotChecksum checksum_;
+};
+
+/**
+* How a key or value type is stored. The primary template covers
+* trivially copyable types, stored as their raw bytes; any other type
+* needs a specialization with RAW = false, MIN_BYTES (the smallest
+* encoding, used to sanity-check a header) and write/read. These take
+* any sink with write(data, bytes) and any source with read(data, bytes)
+* and remaining(), so the same encoding serves snapshots and log records.
+*/
+template <typename T, typename Enable = void>
+struct SnapshotCodec
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SnapshotCodec must be specialized for types that are not trivially copyable");
+
+    static const bool RAW = true;
+    static const std::size_t MIN_BYTES = sizeof(T);
+
+    template <typename Writer>
+    static void write(Writer& writer, const T& item)
+    {
+        writer.write(&item, sizeof(T));
+    }
+
+    template <typename Reader>
+    static void read(Reader& reader, T& item)
+    {
+        reader.read(&item, sizeof(T));
+    }
+};
+
+/**
+* A string is its length as a uint64_t, then its bytes.
+*/
+template <>
+struct SnapshotCodec<std::string>
+{
+    static const bool RAW = false;
+    static const std::size_t MIN_BYTES = sizeof(uint64_t);
+
+    template <typename Writer>
+    static void write(Writer& writer, const std::string& item)
+    {
+        uint64_t length = item.size();
+        writer.write(&length, sizeof(length));
+        writer.write(item.data(), item.size());
+    }
+
+    template <typename Reader>
+    static void read(Reader& reader, std::string& item)
+    {
+        uint64_t length = 0;
+        reader.read(&length, sizeof(length));
+        if (length > reader.remaining()) {
+            throw std::runtime_error("snapshot: corrupt string length");
+        }
+        item.resize(static_cast<std::size_t>(length));
+        if (length != 0) {
+            reader.read(&item[0], static_cast<std::size_t>(length));
+        }
+    }
+};
+
+/**
+* Walks a raw key column and a raw value column in step, presenting
+* each position as a (key, value) pair of references, so that a tree
+* can be built straight from the loaded arrays.
+*/
+template <typename Key, typename Value>
+class SnapshotColumns
+{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef std::pair<const Key&, const Value&> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef void pointer;
+    typedef value_type reference;
+
+    SnapshotColumns(const Key* keys, const Value* values) : keys_(keys), values_(values) {}
+
+    reference operator*() const { return reference(*keys_, *values_); }
+    SnapshotColumns& operator++() { ++keys_; ++values_; return *this; }
+    SnapshotColumns operator+(std::size_t n) const { return SnapshotColumns(keys_ + n, values_ + n); }
+    bool operator==(const SnapshotColumns& rhs) const { return keys_ == rhs.keys_; }
+    bool operator!=(const SnapshotColumns& rhs) const { return keys_ != rhs.keys_; }
+
+private:
+    const Key* keys_;
+    const Value* values_;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the SnapshotChecksum class.
+  --------------------------------------------------
+*/
+
+inline SnapshotChecksum::SnapshotChecksum() :
+    state_(0x9E3779B97F4A7C15ull),
+    length_(0),
+    pendingBytes_(0)
+{
+
+}
+
+inline uint64_t SnapshotChecksum::mix(uint64_t state, uint64_t word)
+{
+    state ^= word * 0x87C37B91114253D5ull;
+    state = (state << 31) | (state >> 33);
+    return state * 0x4CF5AD432745937Full;
+}
+
+inline void SnapshotChecksum::update(const void* data, std::size_t bytes)
+{
+    const unsigned char* next = static_cast<const unsigned char*>(data);
+    length_ += bytes;
+    if (pendingBytes_ != 0) {
+        std::size_t fill = std::min(bytes, sizeof(pending_) - pendingBytes_);
+        std::memcpy(pending_ + pendingBytes_, next, fill);
+        pendingBytes_ += fill;
+        next += fill;
+        bytes -= fill;
+        if (pendingBytes_ < sizeof(pending_)) {
+            return;
+        }
+        uint64_t word;
+        std::memcpy(&word, pending_, sizeof(word));
+        state_ = mix(state_, word);
+        pendingBytes_ = 0;
+    }
+    for (; bytes >= sizeof(uint64_t); next += sizeof(uint64_t), bytes -= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, next, sizeof(word));
+        state_ = mix(state_, word);
+    }
+    std::memcpy(pending_, next, bytes);
+    pendingBytes_ = bytes;
+}
+
+/**
+* Folds in the incomplete last word and the length, then scrambles the
+* state so that every input bit affects every output bit.
+*/
+inline uint64_t SnapshotChecksum::value() const
+{
+    uint64_t state = state_;
+    if (pendingBytes_ != 0) {
+        uint64_t word = 0;
+        std::memcpy(&word, pending_, pendingBytes_);
+        state = mix(state, word);
+    }
+    state ^= length_;
+    state ^= state >> 33;
+    state *= 0xFF51AFD7ED558CCDull;
+    state ^= state >> 33;
+    state *= 0xC4CEB9FE1A85EC53ull;
+    state ^= state >> 33;
+    return state;
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the SnapshotChecksum class.
+  ------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------
+  Begin implementations for the SnapshotHeader class.
+  ------------------------------------------------
+*/
+
+inline const char* SnapshotHeader::expectedMagic()
+{
+    return "BSTSNAP";   // and the terminating NUL: 8 bytes
+}
+
+inline SnapshotHeader SnapshotHeader::describe(uint64_t count, bool rawKeys, std::size_t keySize,
+    bool rawValues, std::size_t valueSize)
+{
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, expectedMagic(), sizeof(header.magic));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.flags = (rawKeys ? RAW_KEYS : 0) | (rawValues ? RAW_VALUES : 0);
+    header.keySize = rawKeys ? static_cast<uint32_t>(keySize) : 0;
+    header.valueSize = rawValues ? static_cast<uint32_t>(valueSize) : 0;
+    header.count = count;
+    return header;
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the SnapshotHeader class.
+  ----------------------------------------------
+*/
+
+/*
+  ------------------------------------------------
+  Begin implementations for the SnapshotWriter class.
+  ------------------------------------------------
+*/
+
+/**
+* Opens the temporary file and reserves room for the header, which is
+* only known once the payload has been written.
+*/
+inline SnapshotWriter::SnapshotWriter(const std::string& path) :
+    path_(path),
+    tmpPath_(path + ".tmp"),
+    file_(nullptr),
+    buffer_(BUFFER_BYTES),
+    used_(0),
+    payloadBytes_(0)
+{
+    file_ = std::fopen(tmpPath_.c_str(), "wb");
+    if (file_ == nullptr) {
+        throw std::runtime_error("snapshot: cannot create " + tmpPath_);
+    }
+    SnapshotHeader blank;
+    std::memset(&blank, 0, sizeof(blank));
+    put(&blank, sizeof(blank));
+}
+
+/**
+* A writer destroyed without commit() discards its temporary file.
+*/
+inline SnapshotWriter::~SnapshotWriter()
+{
+    if (file_ != nullptr) {
+        std::fclose(file_);
+        std::remove(tmpPath_.c_str());
+    }
+}
+
+inline void SnapshotWriter::put(const void* data, std::size_t bytes)
+{
+    if (std::fwrite(data, 1, bytes, file_) != bytes) {
+        throw std::runtime_error("snapshot: write failed for " + tmpPath_);
+    }
+}
+
+inline void SnapshotWriter::flush()
+{
+    if (used_ != 0) {
+        put(buffer_.data(), used_);
+        used_ = 0;
+    }
+}
+
+/**
+* Appends bytes to the payload. Small writes are gathered in a buffer;
+* one larger than the buffer goes straight to the file.
+*/
+inline void SnapshotWriter::write(const void* data, std::size_t bytes)
+{
+    checksum_.update(data, bytes);
+    payloadBytes_ += bytes;
+    if (used_ + bytes > buffer_.size()) {
+        flush();
+        if (bytes >= buffer_.size()) {
+            put(data, bytes);
+            return;
+        }
+    }
+    std::memcpy(buffer_.data() + used_, data, bytes);
+    used_ += bytes;
+}
+
+/**
+* Makes the rename durable: it is an update of the directory holding
+* path, which needs its own fsync.
+*/
+inline void SnapshotWriter::syncDirectory() const
+{
+    std::string::size_type slash = path_.rfind('/');
+    std::string directory = (slash == std::string::npos) ? std::string(".")
+                          : (slash == 0) ? std::string("/") : path_.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        throw std::runtime_error("snapshot: cannot open directory " + directory);
+    }
+    int synced = ::fsync(fd);
+    ::close(fd);
+    if (synced != 0) {
+        throw std::runtime_error("snapshot: cannot sync directory " + directory);
+    }
+}
+
+/**
+* Fills in the payload size and checksum, writes the header, and makes
+* the file durable before renaming it into place. Once this returns,
+* the new snapshot survives a crash.
+*/
+inline void SnapshotWriter::commit(SnapshotHeader header)
+{
+    flush();
+    header.payloadBytes = payloadBytes_;
+    header.checksum = checksum_.value();
+    if (std::fseek(file_, 0, SEEK_SET) != 0) {
+        throw std::runtime_error("snapshot: seek failed for " + tmpPath_);
+    }
+    put(&header, sizeof(header));
+    if (std::fflush(file_) != 0 || ::fsync(fileno(file_)) != 0) {
+        throw std::runtime_error("snapshot: cannot flush " + tmpPath_);
+    }
+    int closed = std::fclose(file_);
+    file_ = nullptr;
+    if (closed != 0 || std::rename(tmpPath_.c_str(), path_.c_str()) != 0) {
+        std::remove(tmpPath_.c_str());
+        throw std::runtime_error("snapshot: cannot replace " + path_);
+    }
+    syncDirectory();
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the SnapshotWriter class.
+  ----------------------------------------------
+*/
+
+/*
+  ------------------------------------------------
+  Begin implementations for the SnapshotReader class.
+  ------------------------------------------------
+*/
+
+/**
+* Opens path and validates the header: magic, version, byte order, and
+* that the file holds exactly the payload the header announces.
+*/
+inline SnapshotReader::SnapshotReader(const std::string& path) :
+    path_(path),
+    file_(nullptr),
+    buffer_(BUFFER_BYTES),
+    begin_(0),
+    end_(0),
+    consumed_(0)
+{
+    file_ = std::fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+        throw std::runtime_error("snapshot: cannot open " + path);
+    }
+    if (std::fread(&header_, 1, sizeof(header_), file_) != sizeof(header_)
+        || std::memcmp(header_.magic, SnapshotHeader::expectedMagic(), sizeof(header_.magic)) != 0) {
+        std::fclose(file_);
+        throw std::runtime_error("snapshot: " + path + " is not a snapshot");
+    }
+    if (header_.version != SnapshotHeader::VERSION || header_.byteOrder != SnapshotHeader::BYTE_ORDER_MARK) {
+        std::fclose(file_);
+        throw std::runtime_error("snapshot: " + path + " has an unsupported version or byte order");
+    }
+    if (std::fseek(file_, 0, SEEK_END) != 0
+        || static_cast<uint64_t>(ftello(file_)) != sizeof(header_) + header_.payloadBytes
+        || std::fseek(file_, sizeof(header_), SEEK_SET) != 0) {
+        std::fclose(file_);
+        throw std::runtime_error("snapshot: " + path + " is truncated");
+    }
+}
+
+inline SnapshotReader::~SnapshotReader()
+{
+    std::fclose(file_);
+}
+
+inline const SnapshotHeader& SnapshotReader::header() const
+{
+    return header_;
+}
+
+/**
+* Checks that the file was written for the same storage of keys and
+* values, and that count items could fit in the payload at all, before
+* anything is allocated for them.
+*/
+inline void SnapshotReader::expect(bool rawKeys, std::size_t keySize, bool rawValues,
+    std::size_t valueSize, std::size_t minItemBytes) const
+{
+    SnapshotHeader layout = SnapshotHeader::describe(0, rawKeys, keySize, rawValues, valueSize);
+    if (header_.flags != layout.flags || header_.keySize != layout.keySize
+        || header_.valueSize != layout.valueSize) {
+        throw std::runtime_error("snapshot: " + path_ + " holds other key or value types");
+    }
+    if (header_.count > header_.payloadBytes / minItemBytes) {
+        throw std::runtime_error("snapshot: " + path_ + " has a corrupt item count");
+    }
+}
+
+inline void SnapshotReader::take(void* data, std::size_t bytes)
+{
+    if (consumed_ + bytes > header_.payloadBytes
+        || std::fread(data, 1, bytes, file_) != bytes) {
+        throw std::runtime_error("snapshot: " + path_ + " is truncated");
+    }
+}
+
+/**
+* Copies the next bytes of the payload to data. Large reads go straight
+* from the file to data, with no copy through the buffer.
+*/
+inline void SnapshotReader::read(void* data, std::size_t bytes)
+{
+    char* out = static_cast<char*>(data);
+    std::size_t total = bytes;
+    std::size_t buffered = std::min(bytes, end_ - begin_);
+    std::memcpy(out, buffer_.data() + begin_, buffered);
+    begin_ += buffered;
+    out += buffered;
+    bytes -= buffered;
+    if (bytes >= buffer_.size()) {
+        take(out, bytes);
+        consumed_ += bytes;
+    }
+    else if (bytes != 0) {
+        uint64_t left = header_.payloadBytes - consumed_;
+        std::size_t refill = static_cast<std::size_t>(std::min<uint64_t>(buffer_.size(), left));
+        if (refill < bytes) {
+            throw std::runtime_error("snapshot: " + path_ + " is truncated");
+        }
+        take(buffer_.data(), refill);
+        consumed_ += refill;
+        std::memcpy(out, buffer_.data(), bytes);
+        begin_ = bytes;
+        end_ = refill;
+    }
+    checksum_.update(data, total);
+}
+
+/**
+* Payload bytes not yet read.
+*/
+inline uint64_t SnapshotReader::remaining() const
+{
+    return header_.payloadBytes - consumed_ + (end_ - begin_);
+}
+
+/**
+* Throws unless the whole payload was read and matches its checksum.
+*/
+inline void SnapshotReader::finish()
+{
+    if (consumed_ != header_.payloadBytes || begin_ != end_) {
+        throw std::runtime_error("snapshot: " + path_ + " has trailing data");
+    }
+    if (checksum_.value() != header_.checksum) {
+        throw std::runtime_error("snapshot: " + path_ + " fails its checksum");
+    }
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the SnapshotReader class.
+  ----------------------------------------------
+*/
+
+#endif
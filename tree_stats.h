@@ -0,0 +1,215 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Build with -DBST_STATS=1 to count what BinarySearchTree and AVLTree
+// do. Off by default, when every counter call compiles to nothing.
+#ifndef BST_STATS
+#define BST_STATS 0
+#endif
+
+/**
+* What a tree has done since it was created or its stats were last
+* reset. Lookups are the descents of find, lower_bound and upper_bound
+* (and everything built on them); nodesVisited also counts the descents
+* of inserts.
+*/
+struct TreeStats
+{
+    static const std::size_t DEPTH_BUCKETS = 64;
+
+    uint64_t comparisons;       // comparator calls, through KeyOrder
+    uint64_t nodesVisited;
+    uint64_t lookups;
+    uint64_t allocations;       // node blocks taken from the pool
+    uint64_t singleRotations;
+    uint64_t doubleRotations;   // each counted once, not as two singles
+    uint64_t retraces;          // AVL walks up after an insert or remove
+    uint64_t retraceSteps;      // nodes rebalanced over all retraces
+    uint64_t longestRetrace;
+    uint64_t lookupDepths[DEPTH_BUCKETS];  // lookups by nodes visited; the last bucket takes the rest
+
+    TreeStats()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        std::memset(this, 0, sizeof(*this));
+    }
+
+    double averageLookupDepth() const
+    {
+        uint64_t total = 0;
+        for (std::size_t depth = 0; depth < DEPTH_BUCKETS; ++depth) {
+            total += depth * lookupDepths[depth];
+        }
+        return (lookups == 0) ? 0.0 : static_cast<double>(total) / lookups;
+    }
+};
+
+/**
+* The shape of a tree, from one walk over it (BinarySearchTree::shape).
+* Heights and depths count edges: the root is at depth 0, a single
+* node has height 0 and an empty tree height -1.
+*/
+struct TreeShape
+{
+    std::size_t nodes;
+    std::size_t leaves;
+    int height;
+    double averageDepth;
+    bool balanced;      // no node's subtree heights differ by more than one
+
+    TreeShape() : nodes(0), leaves(0), height(-1), averageDepth(0.0), balanced(true) {}
+};
+
+#if BST_STATS
+
+/**
+* The counters a tree keeps. Trees are read by several threads at once
+* (under ConcurrentAVLMap's shared lock, and by the parallel operations),
+* so each counter is atomic; relaxed increments keep them exact without
+* ordering anything else. stats() reads them one by one, so a copy
+* taken while other threads count is not a single instant's.
+*/
+class TreeCounters
+{
+public:
+    static const bool LOOKUP = true;
+    static const bool INSERT = false;
+
+    /**
+    * Counts the nodes of one descent; a lookup also records its depth.
+    */
+    class Descent
+    {
+    public:
+        Descent(TreeCounters& counters, bool lookup) :
+            counters_(counters), depth_(0), lookup_(lookup) {}
+        ~Descent()
+        {
+            bump(counters_.nodesVisited_, depth_);
+            if (lookup_) {
+                bump(counters_.lookups_);
+                bump(counters_.lookupDepths_[(depth_ < TreeStats::DEPTH_BUCKETS) ? depth_
+                                             : TreeStats::DEPTH_BUCKETS - 1]);
+            }
+        }
+        void visit() { ++depth_; }
+
+    private:
+        Descent(const Descent& other);
+        Descent& operator=(const Descent& other);
+
+        TreeCounters& counters_;
+        std::size_t depth_;
+        bool lookup_;
+    };
+
+    TreeCounters() { reset(); }
+
+    void compared() { bump(comparisons_); }
+    void allocated(std::size_t blocks) { bump(allocations_, blocks); }
+    void rotated(bool isDouble) { bump(isDouble ? doubleRotations_ : singleRotations_); }
+    void retraced(uint64_t steps)
+    {
+        bump(retraces_);
+        bump(retraceSteps_, steps);
+        uint64_t longest = longestRetrace_.load(std::memory_order_relaxed);
+        while (steps > longest
+               && !longestRetrace_.compare_exchange_weak(longest, steps, std::memory_order_relaxed)) {
+        }
+    }
+
+    TreeStats stats() const
+    {
+        TreeStats stats;
+        stats.comparisons = read(comparisons_);
+        stats.nodesVisited = read(nodesVisited_);
+        stats.lookups = read(lookups_);
+        stats.allocations = read(allocations_);
+        stats.singleRotations = read(singleRotations_);
+        stats.doubleRotations = read(doubleRotations_);
+        stats.retraces = read(retraces_);
+        stats.retraceSteps = read(retraceSteps_);
+        stats.longestRetrace = read(longestRetrace_);
+        for (std::size_t depth = 0; depth < TreeStats::DEPTH_BUCKETS; ++depth) {
+            stats.lookupDepths[depth] = read(lookupDepths_[depth]);
+        }
+        return stats;
+    }
+
+    void reset()
+    {
+        Counter* all[] = {&comparisons_, &nodesVisited_, &lookups_, &allocations_,
+                          &singleRotations_, &doubleRotations_, &retraces_, &retraceSteps_,
+                          &longestRetrace_};
+        for (std::size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+            all[i]->store(0, std::memory_order_relaxed);
+        }
+        for (std::size_t depth = 0; depth < TreeStats::DEPTH_BUCKETS; ++depth) {
+            lookupDepths_[depth].store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    typedef std::atomic<uint64_t> Counter;
+
+    TreeCounters(const TreeCounters& other);
+    TreeCounters& operator=(const TreeCounters& other);
+
+    static void bump(Counter& counter, uint64_t by = 1)
+    {
+        counter.fetch_add(by, std::memory_order_relaxed);
+    }
+    static uint64_t read(const Counter& counter)
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+    Counter comparisons_;
+    Counter nodesVisited_;
+    Counter lookups_;
+    Counter allocations_;
+    Counter singleRotations_;
+    Counter doubleRotations_;
+    Counter retraces_;
+    Counter retraceSteps_;
+    Counter longestRetrace_;
+    Counter lookupDepths_[TreeStats::DEPTH_BUCKETS];
+};
+
+#else
+
+// The same interface, doing nothing.
+class TreeCounters
+{
+public:
+    static const bool LOOKUP = true;
+    static const bool INSERT = false;
+
+    class Descent
+    {
+    public:
+        Descent(TreeCounters&, bool) {}
+        void visit() {}
+    };
+
+    void compared() {}
+    void allocated(std::size_t) {}
+    void rotated(bool) {}
+    void retraced(uint64_t) {}
+
+    TreeStats stats() const { return TreeStats(); }
+    void reset() {}
+};
+
+#endif
+
+#endif
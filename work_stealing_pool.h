@@ -0,0 +1,227 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* A fixed set of worker threads for fork-join work.
+*
+* Each worker has its own task deque: it pushes and pops at the back,
+* so it keeps working on the most recently forked (smallest, hottest)
+* task, and idle threads steal from the front of other deques, where
+* the oldest and largest tasks are. Threads that are not workers submit
+* to one shared deque.
+*
+* A thread waiting for a forked task should call runOne() in a loop
+* rather than block: it then runs pending tasks, its own first, so
+* nested fork-join cannot deadlock and needs no extra threads. With no
+* workers at all, tasks run only through such waiters, i.e. serially.
+*/
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(unsigned workers);
+    ~WorkStealingPool();
+
+    static WorkStealingPool& instance();
+
+    void submit(std::function<void()> task);
+    bool runOne();
+
+    unsigned workers() const;
+    unsigned parallelism() const;
+
+private:
+    // Not copyable: the workers refer to the pool by address.
+    WorkStealingPool(const WorkStealingPool& other);
+    WorkStealingPool& operator=(const WorkStealingPool& other);
+
+    struct TaskQueue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    void workerLoop(unsigned index);
+    bool take(unsigned index, std::function<void()>& task);
+    unsigned queueIndex() const;
+
+    std::vector<std::unique_ptr<TaskQueue> > queues_;   // one per worker, then the shared one
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> pending_;
+    std::mutex sleepLock_;
+    std::condition_variable wake_;
+    bool stopping_;
+
+    // The pool and queue of the worker running on this thread, if any
+    struct WorkerSlot
+    {
+        const WorkStealingPool* pool;
+        unsigned index;
+    };
+    static WorkerSlot& currentWorker();
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the WorkStealingPool class.
+  ------------------------------------------------
+*/
+
+inline WorkStealingPool::WorkStealingPool(unsigned workers) :
+    pending_(0),
+    stopping_(false)
+{
+    for (unsigned i = 0; i <= workers; ++i) {
+        queues_.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+    }
+    for (unsigned i = 0; i < workers; ++i) {
+        threads_.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+    }
+}
+
+/**
+* Stops the workers once the tasks already submitted have run.
+*/
+inline WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::size_t i = 0; i < threads_.size(); ++i) {
+        threads_[i].join();
+    }
+}
+
+/**
+* The pool shared by the trees' parallel operations, created on first
+* use with one worker per hardware thread beyond the caller's.
+*/
+inline WorkStealingPool& WorkStealingPool::instance()
+{
+    static WorkStealingPool pool(std::thread::hardware_concurrency() > 1 ?
+        std::thread::hardware_concurrency() - 1 : 0);
+    return pool;
+}
+
+inline WorkStealingPool::WorkerSlot& WorkStealingPool::currentWorker()
+{
+    static thread_local WorkerSlot slot = { nullptr, 0 };
+    return slot;
+}
+
+inline unsigned WorkStealingPool::workers() const
+{
+    return static_cast<unsigned>(threads_.size());
+}
+
+/**
+* Threads that can run tasks at once: the workers and one waiter.
+*/
+inline unsigned WorkStealingPool::parallelism() const
+{
+    return workers() + 1;
+}
+
+inline unsigned WorkStealingPool::queueIndex() const
+{
+    const WorkerSlot& slot = currentWorker();
+    return (slot.pool == this) ? slot.index : static_cast<unsigned>(queues_.size() - 1);
+}
+
+inline void WorkStealingPool::submit(std::function<void()> task)
+{
+    TaskQueue& queue = *queues_[queueIndex()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        // Counted under sleepLock_ so that a worker about to sleep sees it
+        std::lock_guard<std::mutex> guard(sleepLock_);
+        ++pending_;
+    }
+    wake_.notify_one();
+}
+
+/**
+* Takes the newest task from queue index, or failing that the oldest
+* task of another queue.
+*/
+inline bool WorkStealingPool::take(unsigned index, std::function<void()>& task)
+{
+    if (pending_.load() == 0) {
+        return false;
+    }
+    {
+        TaskQueue& own = *queues_[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+    for (std::size_t step = 1; step < queues_.size(); ++step) {
+        TaskQueue& victim = *queues_[(index + step) % queues_.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* Runs one pending task on the calling thread, if there is one.
+*/
+inline bool WorkStealingPool::runOne()
+{
+    std::function<void()> task;
+    if (!take(queueIndex(), task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+inline void WorkStealingPool::workerLoop(unsigned index)
+{
+    WorkerSlot& slot = currentWorker();
+    slot.pool = this;
+    slot.index = index;
+    while (true) {
+        std::function<void()> task;
+        if (take(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepLock_);
+        wake_.wait(guard, [this]() { return stopping_ || pending_.load() != 0; });
+        if (stopping_ && pending_.load() == 0) {
+            return;
+        }
+    }
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the WorkStealingPool class.
+  ----------------------------------------------
+*/
+
+#endif